@@ -0,0 +1,80 @@
+#include "generated/exposure.wgsl"
+#include "generated/exposure-constants.wgsl"
+
+// Builds a log luminance histogram of the HDR color, then averages it into the adapted exposure, all on the GPU.
+
+@group(0) @binding(0) var hdrImage: texture_2d<f32>;
+@group(0) @binding(1) var<storage, read_write> histogram: array<atomic<u32>, HISTOGRAM_BINS>;
+@group(0) @binding(2) var<storage, read_write> state: Exposure;
+@group(0) @binding(3) var<uniform> u_params: AutoExposureParams;
+
+const MIDDLE_GREY: f32 = 0.18;
+
+var<workgroup> bins: array<atomic<u32>, HISTOGRAM_BINS>;
+var<workgroup> weightedBins: array<f32, HISTOGRAM_BINS>;
+
+// Bin 0 collects the texels too dark to have a meaningful log, the rest split the range evenly in stops.
+fn binIndex(color: vec3<f32>) -> u32
+{
+    let luminance = dot(color, vec3<f32>(0.2126, 0.7152, 0.0722));
+    if (luminance < 1e-5)
+    {
+        return 0u;
+    }
+
+    let position = saturate((log2(luminance) - u_params.minLogLuminance) * u_params.inverseLogLuminanceRange);
+    return u32(position * f32(HISTOGRAM_BINS - 2u)) + 1u;
+}
+
+// One invocation per bin. Texels are counted in workgroup memory first, so the buffer only gets one atomic per bin and workgroup.
+@compute @workgroup_size(16, 16)
+fn cs_histogram(@builtin(global_invocation_id) id: vec3<u32>, @builtin(local_invocation_index) localIndex: u32)
+{
+    atomicStore(&bins[localIndex], 0u);
+    workgroupBarrier();
+
+    if (all(id.xy < textureDimensions(hdrImage)))
+    {
+        atomicAdd(&bins[binIndex(textureLoad(hdrImage, id.xy, 0).rgb)], 1u);
+    }
+    workgroupBarrier();
+
+    let count = atomicLoad(&bins[localIndex]);
+    if (count > 0u)
+    {
+        atomicAdd(&histogram[localIndex], count);
+    }
+}
+
+// Runs as a single workgroup after the histogram.
+@compute @workgroup_size(HISTOGRAM_BINS)
+fn cs_average(@builtin(local_invocation_index) localIndex: u32)
+{
+    let count = atomicLoad(&histogram[localIndex]);
+    weightedBins[localIndex] = f32(count) * f32(localIndex);
+    // Leaves the histogram empty for the next frame.
+    atomicStore(&histogram[localIndex], 0u);
+    workgroupBarrier();
+
+    for (var stride = HISTOGRAM_BINS / 2u; stride > 0u; stride >>= 1u)
+    {
+        if (localIndex < stride)
+        {
+            weightedBins[localIndex] += weightedBins[localIndex + stride];
+        }
+        workgroupBarrier();
+    }
+
+    if (localIndex == 0u)
+    {
+        // The first invocation's count is bin 0, the dark texels that are left out.
+        let litTexels = max(f32(u_params.pixelCount) - f32(count), 1.0);
+        let averageBin = max(weightedBins[0] / litTexels - 1.0, 0.0);
+        let logLuminance = averageBin / f32(HISTOGRAM_BINS - 2u) / u_params.inverseLogLuminanceRange + u_params.minLogLuminance;
+
+        let luminance = mix(state.luminance, exp2(logLuminance), u_params.adaptation);
+        state.luminance = luminance;
+        // Maps the average to middle grey, where the tonemapping LUT is centered.
+        state.exposure = MIDDLE_GREY / luminance;
+    }
+}
@@ -0,0 +1,124 @@
+// Downsample and upsample steps of the bloom chain, one dispatch per mip.
+
+// The previous level, or the HDR color for the first downsample.
+@group(0) @binding(0) var source: texture_2d<f32>;
+// The downsampled level the upsample adds to.
+@group(0) @binding(1) var base: texture_2d<f32>;
+@group(0) @binding(2) var destination: texture_storage_2d<rgba16float, write>;
+@group(0) @binding(3) var linearSampler: sampler;
+
+const WORKGROUP_SIZE: u32 = 8u;
+// Each destination texel filters the 6x6 source texels around its own 2x2, so a workgroup needs two extra on every side.
+const TILE_SIZE: u32 = 20u;
+
+var<workgroup> tile: array<vec3<f32>, TILE_SIZE * TILE_SIZE>;
+
+fn loadTile(workgroupId: vec2<u32>, localIndex: u32)
+{
+    let sourceSize = vec2<i32>(textureDimensions(source));
+    let origin = vec2<i32>(workgroupId * WORKGROUP_SIZE * 2u) - 2;
+    for (var i = localIndex; i < TILE_SIZE * TILE_SIZE; i += WORKGROUP_SIZE * WORKGROUP_SIZE)
+    {
+        let texel = origin + vec2<i32>(i32(i % TILE_SIZE), i32(i / TILE_SIZE));
+        tile[i] = textureLoad(source, clamp(texel, vec2<i32>(0), sourceSize - 1), 0).rgb;
+    }
+    workgroupBarrier();
+}
+
+// Average of the 2x2 texels from the tile position on, which is what a bilinear sample between them would return.
+fn box(position: vec2<u32>) -> vec3<f32>
+{
+    let i = position.y * TILE_SIZE + position.x;
+    return 0.25 * (tile[i] + tile[i + 1u] + tile[i + TILE_SIZE] + tile[i + TILE_SIZE + 1u]);
+}
+
+fn karisWeight(color: vec3<f32>) -> f32
+{
+    return 1.0 / (1.0 + dot(color, vec3<f32>(0.2126, 0.7152, 0.0722)));
+}
+
+// The 13 taps form five overlapping 2x2 groups: the inner one weighs half, the four corner ones an eighth each.
+fn downsample(local: vec2<u32>, karis: bool) -> vec3<f32>
+{
+    let o = local * 2u;
+    let a = box(o + vec2<u32>(0u, 0u));
+    let b = box(o + vec2<u32>(2u, 0u));
+    let c = box(o + vec2<u32>(4u, 0u));
+    let d = box(o + vec2<u32>(1u, 1u));
+    let e = box(o + vec2<u32>(3u, 1u));
+    let f = box(o + vec2<u32>(0u, 2u));
+    let g = box(o + vec2<u32>(2u, 2u));
+    let h = box(o + vec2<u32>(4u, 2u));
+    let i = box(o + vec2<u32>(1u, 3u));
+    let j = box(o + vec2<u32>(3u, 3u));
+    let k = box(o + vec2<u32>(0u, 4u));
+    let l = box(o + vec2<u32>(2u, 4u));
+    let m = box(o + vec2<u32>(4u, 4u));
+
+    var groups = array<vec3<f32>, 5>(
+        0.25 * (d + e + i + j),
+        0.25 * (a + b + f + g),
+        0.25 * (b + c + g + h),
+        0.25 * (f + g + k + l),
+        0.25 * (g + h + l + m),
+    );
+    var weights = array<f32, 5>(0.5, 0.125, 0.125, 0.125, 0.125);
+
+    var color = vec3<f32>(0.0);
+    var total = 0.0;
+    for (var n = 0; n < 5; n++)
+    {
+        let weight = select(weights[n], weights[n] * karisWeight(groups[n]), karis);
+        color += groups[n] * weight;
+        total += weight;
+    }
+    return color / total;
+}
+
+@compute @workgroup_size(WORKGROUP_SIZE, WORKGROUP_SIZE)
+fn cs_downsample_first(@builtin(global_invocation_id) id: vec3<u32>, @builtin(local_invocation_id) local: vec3<u32>,
+                       @builtin(local_invocation_index) localIndex: u32, @builtin(workgroup_id) workgroupId: vec3<u32>)
+{
+    loadTile(workgroupId.xy, localIndex);
+    if (all(id.xy < textureDimensions(destination)))
+    {
+        textureStore(destination, id.xy, vec4<f32>(downsample(local.xy, true), 1.0));
+    }
+}
+
+@compute @workgroup_size(WORKGROUP_SIZE, WORKGROUP_SIZE)
+fn cs_downsample(@builtin(global_invocation_id) id: vec3<u32>, @builtin(local_invocation_id) local: vec3<u32>,
+                 @builtin(local_invocation_index) localIndex: u32, @builtin(workgroup_id) workgroupId: vec3<u32>)
+{
+    loadTile(workgroupId.xy, localIndex);
+    if (all(id.xy < textureDimensions(destination)))
+    {
+        textureStore(destination, id.xy, vec4<f32>(downsample(local.xy, false), 1.0));
+    }
+}
+
+// 3x3 tent over the smaller level with bilinear taps, added to the downsampled level of this size.
+@compute @workgroup_size(WORKGROUP_SIZE, WORKGROUP_SIZE)
+fn cs_upsample(@builtin(global_invocation_id) id: vec3<u32>)
+{
+    let size = textureDimensions(destination);
+    if (any(id.xy >= size))
+    {
+        return;
+    }
+
+    let uv = (vec2<f32>(id.xy) + 0.5) / vec2<f32>(size);
+    let texel = 1.0 / vec2<f32>(textureDimensions(source));
+
+    var color = 4.0 * textureSampleLevel(source, linearSampler, uv, 0.0).rgb;
+    color += 2.0 * textureSampleLevel(source, linearSampler, uv + vec2<f32>(-texel.x, 0.0), 0.0).rgb;
+    color += 2.0 * textureSampleLevel(source, linearSampler, uv + vec2<f32>(texel.x, 0.0), 0.0).rgb;
+    color += 2.0 * textureSampleLevel(source, linearSampler, uv + vec2<f32>(0.0, -texel.y), 0.0).rgb;
+    color += 2.0 * textureSampleLevel(source, linearSampler, uv + vec2<f32>(0.0, texel.y), 0.0).rgb;
+    color += textureSampleLevel(source, linearSampler, uv - texel, 0.0).rgb;
+    color += textureSampleLevel(source, linearSampler, uv + texel, 0.0).rgb;
+    color += textureSampleLevel(source, linearSampler, uv + vec2<f32>(texel.x, -texel.y), 0.0).rgb;
+    color += textureSampleLevel(source, linearSampler, uv + vec2<f32>(-texel.x, texel.y), 0.0).rgb;
+
+    textureStore(destination, id.xy, vec4<f32>(textureLoad(base, id.xy, 0).rgb + color / 16.0, 1.0));
+}
@@ -0,0 +1,43 @@
+#include "generated/post.wgsl"
+#include "generated/post-constants.wgsl"
+
+// Bakes exposure independent grading and tonemapping into a 3D LUT, indexed by log encoded color like the post pass samples it.
+
+@group(0) @binding(0) var lut: texture_storage_3d<rgba16float, write>;
+@group(0) @binding(1) var<uniform> u_grading: Grading;
+
+const MIDDLE_GREY: f32 = 0.18;
+
+fn acesToneMap(hdr: vec3<f32>) -> vec3<f32>
+{
+    let m1 = mat3x3(
+        0.59719, 0.07600, 0.02840,
+        0.35458, 0.90834, 0.13383,
+        0.04823, 0.01566, 0.83777,
+    );
+    let m2 = mat3x3(
+        1.60475, -0.10208, -0.00327,
+        -0.53108,  1.10813, -0.07276,
+        -0.07367, -0.00605,  1.07602,
+    );
+
+    let v = m1 * hdr;
+    let a = v * (v + 0.0245786) - 0.000090537;
+    let b = v * (0.983729 * v + 0.4329510) + 0.238081;
+    return clamp(m2 * (a / b), vec3(0.0), vec3(1.0));
+}
+
+@compute @workgroup_size(4, 4, 4)
+fn cs_main(@builtin(global_invocation_id) id: vec3<u32>)
+{
+    let encoded = vec3<f32>(id) / f32(LUT_SIZE - 1u);
+    var color = MIDDLE_GREY * exp2(mix(vec3<f32>(LUT_MIN_EV), vec3<f32>(LUT_MAX_EV), encoded));
+
+    color *= u_grading.gain;
+    // Contrast pivots around middle grey in stops, so it doesn't change the exposure.
+    color = MIDDLE_GREY * pow(color / MIDDLE_GREY, vec3<f32>(u_grading.contrast));
+    let luminance = dot(color, vec3<f32>(0.2126, 0.7152, 0.0722));
+    color = max(mix(vec3<f32>(luminance), color, u_grading.saturation), vec3<f32>(0.0));
+
+    textureStore(lut, id, vec4<f32>(acesToneMap(color), 1.0));
+}
@@ -1,64 +1,48 @@
-struct VertexOut 
-{
-    @builtin(position) vPos: vec4<f32>,
-    @location(0) vNormal: vec3<f32>,
-    @location(1) vTangent: vec3<f32>,
-    @location(2) vBitangent: vec3<f32>,
-    @location(3) vUv: vec2<f32>,
-    @location(4) vWorldPos: vec3<f32>,
-}
-
-struct PointLight 
-{
-    color: vec4<f32>,
-    position: vec3<f32>,
-    radius: f32,
-}
-
-struct Common 
-{
-    proj: mat4x4f,
-    view: mat4x4f,
-    vp: mat4x4f,
-
-    lightDirection: vec3<f32>,
-    time: f32,
-
-    lightColor: vec3<f32>,
-    normalMapStrength: f32, // TODO: Remove.
+#include "pbr-varyings.wgsl"
+#include "generated/common.wgsl"
+#include "generated/material.wgsl"
+// Texture pools, bucketed by size and format, from binding 3 on. As many as the device can sample.
+#include "generated/texture-pools.wgsl"
+#include "motion.wgsl"
+
+// Set per pipeline variant by the PBR pass, must match the MATERIAL_FEATURE bits.
+override HAS_NORMAL_MAP: bool = true;
+override HAS_EMISSIVE_MAP: bool = true;
+override HAS_OCCLUSION_MAP: bool = true;
+override HAS_METALLIC_ROUGHNESS_MAP: bool = true;
+// 0 is opaque, 1 is masked and 2 is blended.
+override ALPHA_MODE: u32 = 0u;
+
+@group(0) @binding(0) var<uniform> u_view: View;
+@group(0) @binding(1) var u_irradianceMap: texture_cube<f32>; 
+@group(0) @binding(2) var<uniform> u_lighting: Lighting;
 
-    pointLights: array<PointLight, 4>,
+@group(2) @binding(0) var<storage, read> u_materials: array<Material>;
+@group(2) @binding(1) var u_sampler: sampler;
 
-    cameraPosition: vec3<f32>,
-}
+// Log2 of the texture resolution each material would like to be sampled at, read back by the texture streamer.
+@group(2) @binding(2) var<storage, read_write> u_feedback: array<atomic<u32>>;
 
-struct Material 
+struct UvGradients
 {
-    albedoFactor: vec3<f32>,
-    metallicFactor: f32,
-    roughnessFactor: f32,
-    aoFactor: f32,
-    normalFactor: f32,
-    emmisiveFactor: f32,
+    uv: vec2<f32>,
+    ddx: vec2<f32>,
+    ddy: vec2<f32>,
 }
 
-@group(0) @binding(0) var<uniform> u_common: Common;
-@group(0) @binding(1) var u_irradianceMap: texture_cube<f32>; 
-
-@group(2) @binding(0) var<uniform> u_material: Material;
-@group(2) @binding(1) var u_sampler: sampler;
+// The pool is picked per fragment, so gradients are taken up front and sampling can't rely on implicit derivatives.
+fn SampleMaterialTexture(handle: u32, uv: UvGradients, fallback: vec4<f32>) -> vec4<f32>
+{
+    let layer = i32(handle & 0xFFFFu);
 
-@group(2) @binding(2) var u_albedo: texture_2d<f32>;
-@group(2) @binding(3) var u_normal: texture_2d<f32>;
-@group(2) @binding(4) var u_metallic: texture_2d<f32>;
-@group(2) @binding(5) var u_roughness: texture_2d<f32>;
-@group(2) @binding(6) var u_ao: texture_2d<f32>;
-@group(2) @binding(7) var u_emissive: texture_2d<f32>;
+    return SampleTexturePool(handle >> 16u, u_sampler, uv.uv, layer, uv.ddx, uv.ddy, fallback);
+}
 
-fn GetNormal(in: VertexOut) -> vec3<f32> 
+fn GetNormal(in: VertexOut, material: Material, uv: UvGradients) -> vec3<f32> 
 {
-    let normalSample = textureSample(u_normal, u_sampler, in.vUv).rgb;
-    let localNormal = normalSample * 2.0 - 1.0;
+    // Normal maps only store X and Y, Z is always positive in tangent space.
+    let normalSample = (SampleMaterialTexture(material.normalTexture, uv, vec4<f32>(0.5, 0.5, 1.0, 1.0)).rg * 2.0 - 1.0) * material.normalFactor;
+    let localNormal = vec3<f32>(normalSample, sqrt(max(1.0 - dot(normalSample, normalSample), 0.0)));
     
     let localToWorld = mat3x3f(
         normalize(in.vTangent),
@@ -66,7 +50,7 @@ fn GetNormal(in: VertexOut) -> vec3<f32>
         normalize(in.vNormal)
     );
     let worldNormal = localToWorld * normalize(localNormal);
-    return normalize(mix(normalize(in.vNormal), normalize(worldNormal), u_common.normalMapStrength));
+    return normalize(mix(normalize(in.vNormal), normalize(worldNormal), u_lighting.normalMapStrength));
 }
 
 const PI: f32 = 3.14159265359;
@@ -116,37 +100,71 @@ fn F_SchlickRoughness(cosTheta: f32, f0: vec3<f32>, roughness: f32) -> vec3<f32>
     return f0 + (max(vec3<f32>(1.0 - roughness), f0) - f0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
 }
 
+#ifdef MOTION_VECTORS
+struct FragmentOut
+{
+    @location(0) color: vec4<f32>,
+    @location(1) motion: vec2<f32>,
+}
+
+@fragment
+fn main(in: VertexOut) -> FragmentOut {
+#else
 @fragment
 fn main(in: VertexOut) -> @location(0) vec4<f32> {
-    let albedoSample = pow(textureSample(u_albedo, u_sampler, in.vUv).rgb, vec3<f32>(2.2));
-    let metallicSample = textureSample(u_metallic, u_sampler, in.vUv).bbb;
-    let roughnessSample = textureSample(u_roughness, u_sampler, in.vUv).ggg;
-    let aoSample = textureSample(u_ao, u_sampler, in.vUv);
-    let emissiveSample = pow(textureSample(u_emissive, u_sampler, in.vUv).rgb, vec3<f32>(2.2));
-
-    let albedo = albedoSample;
-    let metallic = 1.0 - metallicSample.r;
-    let roughness = roughnessSample.r;
-    let ao = aoSample.r;
-    let emissive = emissiveSample;
-
-    let N = GetNormal(in);
-    let V = normalize(u_common.cameraPosition - in.vWorldPos);
+#endif
+    let material = u_materials[in.vMaterial];
+    let uv = UvGradients(in.vUv, dpdx(in.vUv), dpdy(in.vUv));
+
+    // Factors scale the samples as in glTF, a missing texture samples as white so the factor is used alone.
+    let albedoSample = SampleMaterialTexture(material.albedoTexture, uv, vec4<f32>(1.0)) * vec4<f32>(material.albedoFactor, material.alphaFactor);
+    let albedo = albedoSample.rgb;
+    let alpha = albedoSample.a;
+
+    var metallic = material.metallicFactor;
+    var roughness = material.roughnessFactor;
+    var ao = 1.0;
+    if (HAS_METALLIC_ROUGHNESS_MAP || HAS_OCCLUSION_MAP)
+    {
+        let ormSample = SampleMaterialTexture(material.ormTexture, uv, vec4<f32>(1.0)).rgb; // Occlusion, roughness, metallic.
+        if (HAS_METALLIC_ROUGHNESS_MAP)
+        {
+            metallic *= ormSample.b;
+            roughness *= ormSample.g;
+        }
+        if (HAS_OCCLUSION_MAP)
+        {
+            ao = mix(1.0, ormSample.r, material.aoFactor);
+        }
+    }
+
+    var emissive = material.emissiveFactor;
+    if (HAS_EMISSIVE_MAP)
+    {
+        emissive *= SampleMaterialTexture(material.emissiveTexture, uv, vec4<f32>(1.0)).rgb;
+    }
+
+    var N = normalize(in.vNormal);
+    if (HAS_NORMAL_MAP)
+    {
+        N = GetNormal(in, material, uv);
+    }
+    let V = normalize(u_view.cameraPosition - in.vWorldPos);
     let f0 = mix(vec3<f32>(0.04), albedo, metallic);
 
     var Lo = vec3<f32>(0.0);
     for(var i: i32 = 0; i < 0; i++) 
     {
-        let L = normalize(u_common.pointLights[i].position - in.vWorldPos);
+        let L = normalize(u_lighting.pointLights[i].position - in.vWorldPos);
         let H = normalize(V + L);
 
         let HoV = max(dot(H, V), 0.0);
         let NoH = max(dot(N, H), 0.0);
         let NoL = max(dot(N, L), 0.0);
 
-        let distance = length(u_common.pointLights[i].position - in.vWorldPos);
+        let distance = length(u_lighting.pointLights[i].position - in.vWorldPos);
         let attenuation = 1.0 / (distance * distance);
-        let radiance = u_common.pointLights[i].color.rgb * attenuation * u_common.pointLights[i].color.a;
+        let radiance = u_lighting.pointLights[i].color.rgb * attenuation * u_lighting.pointLights[i].color.a;
 
         let D = D_GGX(N, H, roughness);
         let G = G_Smith(N, V, L, roughness);
@@ -175,12 +193,31 @@ fn main(in: VertexOut) -> @location(0) vec4<f32> {
     
     var color = ambient + Lo + emissive;
 
+    // Tested after the irradiance lookup, which needs implicit derivatives.
+    if (ALPHA_MODE == 1u && alpha < material.alphaCutoff)
+    {
+        discard;
+    }
+
+    // One in 64 pixels is plenty to find the finest resolution a material needs.
+    // A footprint of one texel per pixel across the whole UV range asks for 1 / footprint texels.
+    if (all(vec2<u32>(in.vPos.xy) % 8u == vec2<u32>(0u)))
+    {
+        let footprint = max(length(uv.ddx), length(uv.ddy));
+        let resolution = u32(clamp(ceil(-log2(max(footprint, 1.0e-6))), 0.0, 15.0));
+        atomicMax(&u_feedback[in.vMaterial], resolution);
+    }
+
     // Gamma correct.
     //color = color / (color + vec3<f32>(1.0));
     //color = pow(color, vec3<f32>(1.0 / 2.2));
 
     //color = pow(color, vec3<f32>(2.2));
 
-    return vec4<f32>(color, 1.0);
+#ifdef MOTION_VECTORS
+    return FragmentOut(vec4<f32>(color, select(1.0, alpha, ALPHA_MODE == 2u)), MotionVector(in.vCurrentClip, in.vPreviousClip));
+#else
+    return vec4<f32>(color, select(1.0, alpha, ALPHA_MODE == 2u));
+#endif
 }
 
@@ -1,21 +1,6 @@
-fn acesToneMap(hdr: vec3<f32>) -> vec3<f32>
-{
-    let m1 = mat3x3(
-        0.59719, 0.07600, 0.02840,
-        0.35458, 0.90834, 0.13383,
-        0.04823, 0.01566, 0.83777,
-    );
-    let m2 = mat3x3(
-        1.60475, -0.10208, -0.00327,
-        -0.53108,  1.10813, -0.07276,
-        -0.07367, -0.00605,  1.07602,
-    );
-
-    let v = m1 * hdr;
-    let a = v * (v + 0.0245786) - 0.000090537;
-    let b = v * (0.983729 * v + 0.4329510) + 0.238081;
-    return clamp(m2 * (a / b), vec3(0.0), vec3(1.0));
-}
+#include "generated/post.wgsl"
+#include "generated/post-constants.wgsl"
+#include "generated/exposure.wgsl"
 
 struct VertexOutput
 {
@@ -40,11 +25,25 @@ fn vs_main(@builtin(vertex_index) vi: u32) -> VertexOutput
 
 @group(0) @binding(0) var hdrImage: texture_2d<f32>;
 @group(0) @binding(1) var hdrSampler: sampler;
+@group(0) @binding(2) var bloomImage: texture_2d<f32>;
+@group(0) @binding(3) var gradingLut: texture_3d<f32>;
+@group(0) @binding(4) var<uniform> u_params: PostParams;
+// Adapted on the GPU by the auto exposure, the manual exposure compensates on top of it.
+@group(0) @binding(5) var<storage, read> u_exposure: Exposure;
+
+const MIDDLE_GREY: f32 = 0.18;
 
 @fragment
 fn fs_main(vs: VertexOutput) -> @location(0) vec4<f32>
 {
     let hdr = textureSample(hdrImage, hdrSampler, vs.uv);
-    let sdr = acesToneMap(hdr.rgb);
+    let bloom = textureSample(bloomImage, hdrSampler, vs.uv).rgb;
+    let color = (hdr.rgb + bloom * u_params.bloomIntensity) * u_params.exposure * u_exposure.exposure;
+
+    // Tonemapping and grading are baked into the LUT, which is indexed in stops from middle grey.
+    let encoded = saturate((log2(max(color, vec3<f32>(1e-10)) / MIDDLE_GREY) - LUT_MIN_EV) / (LUT_MAX_EV - LUT_MIN_EV));
+    let lutUv = encoded * (f32(LUT_SIZE - 1u) / f32(LUT_SIZE)) + 0.5 / f32(LUT_SIZE);
+    let sdr = textureSample(gradingLut, hdrSampler, lutUv).rgb;
+
     return vec4(sdr, hdr.a);
 }
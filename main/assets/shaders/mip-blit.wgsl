@@ -0,0 +1,29 @@
+// Render pass fallback for formats that can't be bound as storage textures, such as r8unorm and rg8unorm.
+// Draws one fullscreen triangle per destination mip and layer, using the same 2x2 box filter as mip-comp.wgsl.
+// sRGB formats are bound through their sRGB views, so decoding and encoding happens in hardware.
+
+@group(0) @binding(0) var sourceMip: texture_2d<f32>;
+
+@vertex
+fn vs_main(@builtin(vertex_index) vi: u32) -> @builtin(position) vec4<f32>
+{
+    let uv = vec2<f32>(
+        f32((vi << 1u) & 2u),
+        f32(vi & 2u),
+    );
+    return vec4<f32>(uv * 2.0 - 1.0, 0.0, 1.0);
+}
+
+@fragment
+fn fs_main(@builtin(position) position: vec4<f32>) -> @location(0) vec4<f32>
+{
+    let size = textureDimensions(sourceMip, 0);
+    let coord = vec2<u32>(position.xy) * 2u;
+
+    return (
+        textureLoad(sourceMip, min(coord, size - 1u), 0) +
+        textureLoad(sourceMip, min(coord + vec2<u32>(1u, 0u), size - 1u), 0) +
+        textureLoad(sourceMip, min(coord + vec2<u32>(0u, 1u), size - 1u), 0) +
+        textureLoad(sourceMip, min(coord + vec2<u32>(1u, 1u), size - 1u), 0)
+    ) * 0.25;
+}
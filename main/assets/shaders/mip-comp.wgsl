@@ -1,16 +1,153 @@
-@group(0) @binding(0) var previousMipLevel: texture_2d<f32>;
-@group(0) @binding(1) var nextMipLevel: texture_storage_2d<rgba8unorm, write>;
+// Single pass downsampler, in the spirit of AMD FidelityFX SPD.
+// Every workgroup reduces a 64x64 block of the source mip into up to six mips.
+// Longer chains take one dispatch per six mips, so each dispatch reads what the previous one
+// finished writing, instead of the workgroups of one dispatch handing data to each other.
+//
+// The texture loader prepends MIP_COUNT, SRGB, the destination bindings and storeMip(),
+// because the storage format and the amount of storage textures per stage vary.
+// sRGB textures are bound through their linear rgba8unorm views, so the values are
+// decoded on load, filtered in linear space, and encoded again before every store.
+//
+// Only the first mip of a dispatch may come from an odd sized source, the loader ends a dispatch
+// before any later one would. Odd sources are filtered with three weighted taps per axis,
+// so their last row and column still contribute.
 
-@compute @workgroup_size(8, 8)
-fn main(@builtin(global_invocation_id) id: vec3<u32>) 
+@group(0) @binding(0) var sourceMip: texture_2d_array<f32>;
+
+const BLOCK_SIZE: u32 = 64u;
+
+var<workgroup> tile: array<array<vec4<f32>, 16>, 16>;
+
+fn srgbToLinear(value: vec4<f32>) -> vec4<f32>
+{
+    let low = value.rgb / 12.92;
+    let high = pow((value.rgb + 0.055) / 1.055, vec3<f32>(2.4));
+    return vec4<f32>(select(high, low, value.rgb <= vec3<f32>(0.04045)), value.a);
+}
+
+fn linearToSrgb(value: vec4<f32>) -> vec4<f32>
+{
+    let low = value.rgb * 12.92;
+    let high = 1.055 * pow(value.rgb, vec3<f32>(1.0 / 2.4)) - 0.055;
+    return vec4<f32>(select(high, low, value.rgb <= vec3<f32>(0.0031308)), value.a);
+}
+
+// Called by the generated storeMip().
+fn encodeOutput(value: vec4<f32>) -> vec4<f32>
+{
+    if (SRGB)
+    {
+        return linearToSrgb(value);
+    }
+    return value;
+}
+
+fn loadSource(coord: vec2<u32>, slice: u32) -> vec4<f32>
+{
+    // Clamping keeps the texels past the edge of a block from reading outside of the image.
+    let size = textureDimensions(sourceMip, 0);
+    let value = textureLoad(sourceMip, min(coord, size - 1u), slice, 0);
+    if (SRGB)
+    {
+        return srgbToLinear(value);
+    }
+    return value;
+}
+
+// Weights of the source texels 2x, 2x + 1 and 2x + 2 for the destination texel x.
+// An odd source of 2n + 1 texels is spread evenly over the n destination texels.
+fn axisWeights(destination: u32, sourceSize: u32) -> vec3<f32>
 {
-    let offset = vec2<u32>(0, 1);
-    let color = (
-        textureLoad(previousMipLevel, 2 * id.xy + offset.xx, 0) +
-        textureLoad(previousMipLevel, 2 * id.xy + offset.xy, 0) +
-        textureLoad(previousMipLevel, 2 * id.xy + offset.yx, 0) +
-        textureLoad(previousMipLevel, 2 * id.xy + offset.yy, 0)
-    ) * 0.25;
-
-    textureStore(nextMipLevel, id.xy, color);
+    if ((sourceSize & 1u) == 0u || sourceSize == 1u)
+    {
+        return vec3<f32>(0.5, 0.5, 0.0);
+    }
+
+    let n = f32(sourceSize / 2u);
+    let x = f32(destination);
+    return vec3<f32>(n - x, n, x + 1.0) / (2.0 * n + 1.0);
+}
+
+fn loadReduced(destination: vec2<u32>, slice: u32) -> vec4<f32>
+{
+    let size = textureDimensions(sourceMip, 0);
+    let origin = destination * 2u;
+    if (all((size & vec2<u32>(1u)) == vec2<u32>(0u)))
+    {
+        return (
+            loadSource(origin, slice) +
+            loadSource(origin + vec2<u32>(1u, 0u), slice) +
+            loadSource(origin + vec2<u32>(0u, 1u), slice) +
+            loadSource(origin + vec2<u32>(1u, 1u), slice)
+        ) * 0.25;
+    }
+
+    let weightsX = axisWeights(destination.x, size.x);
+    let weightsY = axisWeights(destination.y, size.y);
+    var value = vec4<f32>(0.0);
+    for (var y = 0u; y < 3u; y++)
+    {
+        for (var x = 0u; x < 3u; x++)
+        {
+            let weight = weightsX[x] * weightsY[y];
+            if (weight > 0.0)
+            {
+                value += loadSource(origin + vec2<u32>(x, y), slice) * weight;
+            }
+        }
+    }
+    return value;
+}
+
+@compute @workgroup_size(16, 16)
+fn main(@builtin(local_invocation_id) localId: vec3<u32>, @builtin(workgroup_id) workgroupId: vec3<u32>)
+{
+    let local = localId.xy;
+    let block = workgroupId.xy;
+    let slice = workgroupId.z;
+
+    // Each thread reduces a 4x4 footprint into a 2x2 quad of the first mip and one texel of the second,
+    // so the first two mips don't need any shared memory.
+    var value = vec4<f32>(0.0);
+    for (var i = 0u; i < 4u; i++)
+    {
+        let offset = vec2<u32>(i & 1u, i >> 1u);
+        let quad = loadReduced(block * 32u + local * 2u + offset, slice);
+        storeMip(1u, block * 32u + local * 2u + offset, slice, quad);
+        value += quad * 0.25;
+    }
+
+    if (MIP_COUNT < 2u)
+    {
+        return;
+    }
+
+    storeMip(2u, block * 16u + local, slice, value);
+    tile[local.y][local.x] = value;
+
+    for (var mip = 3u; mip <= MIP_COUNT; mip++)
+    {
+        workgroupBarrier();
+
+        let size = BLOCK_SIZE >> mip;
+        let active = all(local < vec2<u32>(size));
+        if (active)
+        {
+            let source = local * 2u;
+            value = (
+                tile[source.y][source.x] +
+                tile[source.y][source.x + 1u] +
+                tile[source.y + 1u][source.x] +
+                tile[source.y + 1u][source.x + 1u]
+            ) * 0.25;
+        }
+
+        workgroupBarrier();
+
+        if (active)
+        {
+            tile[local.y][local.x] = value;
+            storeMip(mip, block * size + local, slice, value);
+        }
+    }
 }
@@ -0,0 +1,6 @@
+// Screen space motion since the previous frame in UV units, from unjittered clip positions. Sampling the history at
+// uv - motion finds where the surface was.
+fn MotionVector(current: vec4<f32>, previous: vec4<f32>) -> vec2<f32>
+{
+    return (current.xy / current.w - previous.xy / previous.w) * vec2<f32>(0.5, -0.5);
+}
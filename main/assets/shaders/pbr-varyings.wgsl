@@ -0,0 +1,15 @@
+// Passed from vertex.wgsl to frag.wgsl.
+struct VertexOut 
+{
+    @builtin(position) vPos: vec4<f32>,
+    @location(0) vNormal: vec3<f32>,
+    @location(1) vTangent: vec3<f32>,
+    @location(2) vBitangent: vec3<f32>,
+    @location(3) vUv: vec2<f32>,
+    @location(4) vWorldPos: vec3<f32>,
+    @location(5) @interpolate(flat) vMaterial: u32,
+#ifdef MOTION_VECTORS
+    @location(6) vCurrentClip: vec4<f32>,
+    @location(7) vPreviousClip: vec4<f32>,
+#endif
+}
@@ -0,0 +1,320 @@
+#include "generated/post-aa.wgsl"
+
+// The second input is the edges or blend weights for SMAA's later passes, otherwise the first input again.
+@group(0) @binding(0) var inputImage: texture_2d<f32>;
+@group(0) @binding(1) var secondImage: texture_2d<f32>;
+@group(0) @binding(2) var linearSampler: sampler;
+@group(0) @binding(3) var<uniform> u_params: PostAAParams;
+
+@vertex
+fn vs_main(@builtin(vertex_index) vi: u32) -> @builtin(position) vec4<f32>
+{
+    let uv = vec2<f32>(f32((vi << 1u) & 2u), f32(vi & 2u));
+    return vec4<f32>(uv * 2.0 - 1.0, 0.0, 1.0);
+}
+
+// Edges are found on perceived brightness, the square root stands in for the display's gamma.
+fn luma(color: vec3<f32>) -> f32
+{
+    return sqrt(dot(color, vec3<f32>(0.299, 0.587, 0.114)));
+}
+
+fn inside(position: vec2<i32>) -> bool
+{
+    return all(position >= vec2<i32>(0)) && all(position < vec2<i32>(u_params.size));
+}
+
+fn loadColor(position: vec2<i32>) -> vec4<f32>
+{
+    return textureLoad(inputImage, clamp(position, vec2<i32>(0), vec2<i32>(u_params.size) - 1), 0);
+}
+
+// FXAA 3.11, quality version. Finds the direction of the strongest local gradient, walks along the edge perpendicular
+// to it until the contrast ends on both sides, and shifts the sample towards the edge by how close the pixel is to its end.
+
+const FXAA_EDGE_THRESHOLD: f32 = 0.166;
+const FXAA_EDGE_THRESHOLD_MIN: f32 = 0.0833;
+const FXAA_SUBPIXEL: f32 = 0.75;
+const FXAA_STEPS: i32 = 12;
+
+fn lumaAt(uv: vec2<f32>) -> f32
+{
+    return luma(textureSampleLevel(inputImage, linearSampler, uv, 0.0).rgb);
+}
+
+@fragment
+fn fs_fxaa(@builtin(position) position: vec4<f32>) -> @location(0) vec4<f32>
+{
+    let texel = u_params.texelSize;
+    let uv = position.xy * texel;
+    let center = textureSampleLevel(inputImage, linearSampler, uv, 0.0);
+
+    let lumaM = luma(center.rgb);
+    let lumaN = lumaAt(uv + vec2<f32>(0.0, -texel.y));
+    let lumaS = lumaAt(uv + vec2<f32>(0.0, texel.y));
+    let lumaW = lumaAt(uv + vec2<f32>(-texel.x, 0.0));
+    let lumaE = lumaAt(uv + vec2<f32>(texel.x, 0.0));
+
+    let lumaMax = max(lumaM, max(max(lumaN, lumaS), max(lumaW, lumaE)));
+    let lumaMin = min(lumaM, min(min(lumaN, lumaS), min(lumaW, lumaE)));
+    let range = lumaMax - lumaMin;
+    if (range < max(FXAA_EDGE_THRESHOLD_MIN, lumaMax * FXAA_EDGE_THRESHOLD))
+    {
+        return center;
+    }
+
+    let lumaNW = lumaAt(uv - texel);
+    let lumaSE = lumaAt(uv + texel);
+    let lumaNE = lumaAt(uv + vec2<f32>(texel.x, -texel.y));
+    let lumaSW = lumaAt(uv + vec2<f32>(-texel.x, texel.y));
+
+    // Second derivatives across rows and columns tell whether the edge runs horizontally or vertically.
+    let edgeHorizontal = abs(lumaNW + lumaSW - 2.0 * lumaW) + 2.0 * abs(lumaN + lumaS - 2.0 * lumaM) + abs(lumaNE + lumaSE - 2.0 * lumaE);
+    let edgeVertical = abs(lumaNW + lumaNE - 2.0 * lumaN) + 2.0 * abs(lumaW + lumaE - 2.0 * lumaM) + abs(lumaSW + lumaSE - 2.0 * lumaS);
+    let horizontal = edgeHorizontal >= edgeVertical;
+
+    // Single pixel details are softened by how much they stand out from their neighbours.
+    let lumaAverage = (2.0 * (lumaN + lumaS + lumaW + lumaE) + lumaNW + lumaNE + lumaSW + lumaSE) / 12.0;
+    let subpixelA = saturate(abs(lumaAverage - lumaM) / range);
+    let subpixelB = (-2.0 * subpixelA + 3.0) * subpixelA * subpixelA;
+    let subpixel = subpixelB * subpixelB * FXAA_SUBPIXEL;
+
+    let luma1 = select(lumaW, lumaN, horizontal);
+    let luma2 = select(lumaE, lumaS, horizontal);
+    let gradient1 = luma1 - lumaM;
+    let gradient2 = luma2 - lumaM;
+    let steepest1 = abs(gradient1) >= abs(gradient2);
+    let gradientScaled = 0.25 * max(abs(gradient1), abs(gradient2));
+
+    var stepLength = select(texel.x, texel.y, horizontal);
+    var lumaLocalAverage = 0.5 * (luma2 + lumaM);
+    if (steepest1)
+    {
+        stepLength = -stepLength;
+        lumaLocalAverage = 0.5 * (luma1 + lumaM);
+    }
+
+    // Walks along the edge, half a pixel towards the neighbour it's between.
+    var edgeUv = uv;
+    if (horizontal)
+    {
+        edgeUv.y += 0.5 * stepLength;
+    }
+    else
+    {
+        edgeUv.x += 0.5 * stepLength;
+    }
+
+    let offset = select(vec2<f32>(0.0, texel.y), vec2<f32>(texel.x, 0.0), horizontal);
+    var uv1 = edgeUv - offset;
+    var uv2 = edgeUv + offset;
+    var lumaEnd1 = lumaAt(uv1) - lumaLocalAverage;
+    var lumaEnd2 = lumaAt(uv2) - lumaLocalAverage;
+    var reached1 = abs(lumaEnd1) >= gradientScaled;
+    var reached2 = abs(lumaEnd2) >= gradientScaled;
+
+    var stepScales = array<f32, 12>(1.0, 1.0, 1.0, 1.0, 1.0, 1.5, 2.0, 2.0, 2.0, 2.0, 4.0, 8.0);
+    for (var i = 0; i < FXAA_STEPS && !(reached1 && reached2); i++)
+    {
+        if (!reached1)
+        {
+            uv1 -= offset * stepScales[i];
+            lumaEnd1 = lumaAt(uv1) - lumaLocalAverage;
+            reached1 = abs(lumaEnd1) >= gradientScaled;
+        }
+        if (!reached2)
+        {
+            uv2 += offset * stepScales[i];
+            lumaEnd2 = lumaAt(uv2) - lumaLocalAverage;
+            reached2 = abs(lumaEnd2) >= gradientScaled;
+        }
+    }
+
+    let distance1 = select(uv.y - uv1.y, uv.x - uv1.x, horizontal);
+    let distance2 = select(uv2.y - uv.y, uv2.x - uv.x, horizontal);
+    let nearer1 = distance1 < distance2;
+    let edgeLength = distance1 + distance2;
+
+    // Only pixels on the side of the edge that the nearer end goes towards are shifted.
+    let lumaEnd = select(lumaEnd2, lumaEnd1, nearer1);
+    let correctVariation = (lumaEnd < 0.0) != (lumaM < lumaLocalAverage);
+    let edgeOffset = select(0.0, 0.5 - min(distance1, distance2) / edgeLength, correctVariation);
+    let finalOffset = max(edgeOffset, subpixel) * stepLength;
+
+    var finalUv = uv;
+    if (horizontal)
+    {
+        finalUv.y += finalOffset;
+    }
+    else
+    {
+        finalUv.x += finalOffset;
+    }
+
+    return vec4<f32>(textureSampleLevel(inputImage, linearSampler, finalUv, 0.0).rgb, center.a);
+}
+
+// SMAA 1x. The reference implementation looks the coverage of each edge shape up in precomputed area and search textures,
+// here the lines are searched texel by texel and their coverage is integrated directly, like MLAA does.
+
+const SMAA_THRESHOLD: f32 = 0.1;
+const SMAA_LOCAL_CONTRAST_FACTOR: f32 = 2.0;
+const SMAA_MAX_SEARCH: i32 = 16;
+
+fn lumaLoad(position: vec2<i32>) -> f32
+{
+    return luma(loadColor(position).rgb);
+}
+
+// Red marks an edge on the pixel's left side, green one on its top side.
+@fragment
+fn fs_edges(@builtin(position) position: vec4<f32>) -> @location(0) vec2<f32>
+{
+    let p = vec2<i32>(position.xy);
+    let lumaM = lumaLoad(p);
+    let lumaLeft = lumaLoad(p + vec2<i32>(-1, 0));
+    let lumaTop = lumaLoad(p + vec2<i32>(0, -1));
+
+    let delta = abs(lumaM - vec2<f32>(lumaLeft, lumaTop));
+    var edges = step(vec2<f32>(SMAA_THRESHOLD), delta);
+    if (dot(edges, vec2<f32>(1.0)) == 0.0)
+    {
+        return vec2<f32>(0.0);
+    }
+
+    // An edge is dropped when a much stronger one is next to it, so the stronger one isn't doubled up.
+    let deltaNext = abs(lumaM - vec2<f32>(lumaLoad(p + vec2<i32>(1, 0)), lumaLoad(p + vec2<i32>(0, 1))));
+    let deltaBefore = abs(vec2<f32>(lumaLeft, lumaTop) - vec2<f32>(lumaLoad(p + vec2<i32>(-2, 0)), lumaLoad(p + vec2<i32>(0, -2))));
+    let maxDelta = max(max(delta, deltaNext), deltaBefore);
+    edges *= step(vec2<f32>(max(maxDelta.x, maxDelta.y)), SMAA_LOCAL_CONTRAST_FACTOR * delta);
+
+    return edges;
+}
+
+fn edgesAt(position: vec2<i32>) -> vec2<f32>
+{
+    if (!inside(position))
+    {
+        return vec2<f32>(0.0);
+    }
+    return textureLoad(inputImage, position, 0).rg;
+}
+
+// Number of neighbours in the direction that continue the edge, the channel picks top or left edges.
+fn searchEdge(p: vec2<i32>, direction: vec2<i32>, channel: i32) -> i32
+{
+    var found = 0;
+    for (var i = 1; i <= SMAA_MAX_SEARCH; i++)
+    {
+        if (edgesAt(p + direction * i)[channel] < 0.5)
+        {
+            break;
+        }
+        found = i;
+    }
+    return found;
+}
+
+// 1 when the line turns into the pixel's row or column at its end, -1 when it turns into the neighbour's, 0 for neither or both.
+fn crossing(intoPixel: f32, intoNeighbour: f32) -> f32
+{
+    return step(0.5, intoPixel) - step(0.5, intoNeighbour);
+}
+
+// Signed distance of the reconstructed line from the edge, towards the pixel. The line starts and ends half a pixel off
+// the edge where it turns, and U shapes come back to the edge in the middle.
+fn lineHeight(x: f32, start: f32, end: f32, startHeight: f32, endHeight: f32) -> f32
+{
+    if (startHeight == endHeight)
+    {
+        let middle = 0.5 * (start + end);
+        return startHeight * abs(x - middle) / (middle - start);
+    }
+    return mix(startHeight, endHeight, (x - start) / (end - start));
+}
+
+// Area between the edge and the line over one pixel, on the pixel's side and on the neighbour's.
+fn coverage(height0: f32, height1: f32) -> vec2<f32>
+{
+    if (height0 * height1 >= 0.0)
+    {
+        let area = 0.5 * (height0 + height1);
+        return vec2<f32>(max(area, 0.0), max(-area, 0.0));
+    }
+
+    // The line crosses the edge within the pixel, which leaves a triangle on each side.
+    let crossingPoint = height0 / (height0 - height1);
+    let first = 0.5 * height0 * crossingPoint;
+    let second = 0.5 * height1 * (1.0 - crossingPoint);
+    return vec2<f32>(max(first, 0.0) + max(second, 0.0), max(-first, 0.0) + max(-second, 0.0));
+}
+
+// Per pixel: how much it takes from the pixel above, how much the pixel above takes from it, and the same for the left side.
+@fragment
+fn fs_blend_weights(@builtin(position) position: vec4<f32>) -> @location(0) vec4<f32>
+{
+    let p = vec2<i32>(position.xy);
+    let edges = edgesAt(p);
+    var weights = vec4<f32>(0.0);
+
+    if (edges.g > 0.5)
+    {
+        let left = searchEdge(p, vec2<i32>(-1, 0), 1);
+        let right = searchEdge(p, vec2<i32>(1, 0), 1);
+        let startHeight = 0.5 * crossing(edgesAt(p + vec2<i32>(-left, 0)).r, edgesAt(p + vec2<i32>(-left, -1)).r);
+        let endHeight = 0.5 * crossing(edgesAt(p + vec2<i32>(right + 1, 0)).r, edgesAt(p + vec2<i32>(right + 1, -1)).r);
+        let start = f32(-left);
+        let end = f32(right + 1);
+        weights = vec4<f32>(coverage(lineHeight(0.0, start, end, startHeight, endHeight), lineHeight(1.0, start, end, startHeight, endHeight)), weights.zw);
+    }
+
+    if (edges.r > 0.5)
+    {
+        let up = searchEdge(p, vec2<i32>(0, -1), 0);
+        let down = searchEdge(p, vec2<i32>(0, 1), 0);
+        let startHeight = 0.5 * crossing(edgesAt(p + vec2<i32>(0, -up)).g, edgesAt(p + vec2<i32>(-1, -up)).g);
+        let endHeight = 0.5 * crossing(edgesAt(p + vec2<i32>(0, down + 1)).g, edgesAt(p + vec2<i32>(-1, down + 1)).g);
+        let start = f32(-up);
+        let end = f32(down + 1);
+        weights = vec4<f32>(weights.xy, coverage(lineHeight(0.0, start, end, startHeight, endHeight), lineHeight(1.0, start, end, startHeight, endHeight)));
+    }
+
+    return weights;
+}
+
+fn weightsAt(position: vec2<i32>) -> vec4<f32>
+{
+    if (!inside(position))
+    {
+        return vec4<f32>(0.0);
+    }
+    return textureLoad(secondImage, position, 0);
+}
+
+// Blends each pixel with its neighbours across the edges, by the weights of its own edges and its right and bottom neighbours'.
+// Only the stronger of the horizontal and vertical blends is applied, so corners aren't blended twice.
+@fragment
+fn fs_blend(@builtin(position) position: vec4<f32>) -> @location(0) vec4<f32>
+{
+    let p = vec2<i32>(position.xy);
+    let color = loadColor(p);
+    let own = weightsAt(p);
+
+    let top = own.x;
+    let bottom = weightsAt(p + vec2<i32>(0, 1)).y;
+    let left = own.z;
+    let right = weightsAt(p + vec2<i32>(1, 0)).w;
+
+    let horizontal = top + bottom;
+    let vertical = left + right;
+    if (max(horizontal, vertical) == 0.0)
+    {
+        return color;
+    }
+
+    if (horizontal >= vertical)
+    {
+        return color * (1.0 - horizontal) + loadColor(p + vec2<i32>(0, -1)) * top + loadColor(p + vec2<i32>(0, 1)) * bottom;
+    }
+    return color * (1.0 - vertical) + loadColor(p + vec2<i32>(-1, 0)) * left + loadColor(p + vec2<i32>(1, 0)) * right;
+}
@@ -1,57 +1,57 @@
-struct VertexIn 
-{
-    @location(0) aPos: vec3<f32>,
-}
-
 struct VertexOut 
 {
     @builtin(position) vPos: vec4<f32>,
     @location(0) vUv: vec3<f32>,
 }
 
-struct Common 
-{
-    proj: mat4x4f,
-    view: mat4x4f,
-    vp: mat4x4f,
-
-    lightDirection: vec3<f32>,
-    time: f32,
+#include "generated/common.wgsl"
+#include "generated/skybox-instance.wgsl"
+#include "motion.wgsl"
 
-    lightColor: vec3<f32>,
-    normalMapStrength: f32,
-
-    cameraPosition: vec3<f32>,
-}
-
-struct Instance 
-{
-    model: mat4x4f,
-    exposure: f32
-}
-
-@group(0) @binding(0) var<uniform> u_common: Common;
+@group(0) @binding(0) var<uniform> u_view: View;
 @group(1) @binding(0) var<uniform> u_instance: Instance;
 @group(1) @binding(1) var cubemapSampler: sampler;
 @group(1) @binding(2) var skyboxMap: texture_cube<f32>;
 
 
 @vertex
-fn vs_main(input: VertexIn) -> VertexOut
+fn vs_main(@builtin(vertex_index) vi: u32) -> VertexOut
 {
     var out: VertexOut;
-    let mvp = u_common.vp * u_instance.model;
-    out.vPos = (mvp * vec4<f32>(input.aPos, 1.0)).xyzw;
-    out.vUv = input.aPos;
+
+    // One triangle covering the screen at the far plane, which is depth 0 with reversed Z.
+    let ndc = vec2<f32>(f32((vi << 1u) & 2u), f32(vi & 2u)) * 2.0 - 1.0;
+    out.vPos = vec4<f32>(ndc, 0.0, 1.0);
+
+    // Directions are taken through the near plane, where the infinite projection still inverts cleanly.
+    let near = u_view.invVp * vec4<f32>(ndc, 1.0, 1.0);
+    out.vUv = near.xyz / near.w - u_view.cameraPosition;
 
     return out;
 }
 
+#ifdef MOTION_VECTORS
+struct FragmentOut
+{
+    @location(0) color: vec4<f32>,
+    @location(1) motion: vec2<f32>,
+}
+
+@fragment
+fn fs_main(in: VertexOut) -> FragmentOut
+#else
 @fragment
 fn fs_main(in: VertexOut) -> @location(0) vec4<f32>
+#endif
 {
     var color = pow(textureSample(skyboxMap, cubemapSampler, in.vUv).rgb, vec3<f32>(2.2));
-    color = vec3<f32>(1.0) - exp(-color * u_instance.exposure);
+    color *= u_instance.intensity;
 
+#ifdef MOTION_VECTORS
+    // The sky is at infinity, so only the camera's rotation moves it.
+    let motion = MotionVector(u_view.unjitteredVp * vec4<f32>(in.vUv, 0.0), u_view.previousVp * vec4<f32>(in.vUv, 0.0));
+    return FragmentOut(vec4<f32>(color, 1.0), motion);
+#else
     return vec4<f32>(color, 1.0);
+#endif
 }
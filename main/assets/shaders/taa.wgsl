@@ -0,0 +1,124 @@
+#include "generated/taa.wgsl"
+
+@group(0) @binding(0) var currentColor: texture_2d<f32>;
+@group(0) @binding(1) var motionVectors: texture_2d<f32>;
+@group(0) @binding(2) var history: texture_2d<f32>;
+@group(0) @binding(3) var historySampler: sampler;
+@group(0) @binding(4) var<uniform> u_params: TAAParams;
+
+@vertex
+fn vs_main(@builtin(vertex_index) vi: u32) -> @builtin(position) vec4<f32>
+{
+    let uv = vec2<f32>(f32((vi << 1u) & 2u), f32(vi & 2u));
+    return vec4<f32>(uv * 2.0 - 1.0, 0.0, 1.0);
+}
+
+fn luma(color: vec3<f32>) -> f32
+{
+    return dot(color, vec3<f32>(0.299, 0.587, 0.114));
+}
+
+// Samples are blended after weighting them down by their brightness, so single bright pixels don't flicker through.
+fn compress(color: vec3<f32>) -> vec3<f32>
+{
+    return color / (1.0 + luma(color));
+}
+
+fn expand(color: vec3<f32>) -> vec3<f32>
+{
+    return color / max(1.0 - luma(color), 1.0 / 1024.0);
+}
+
+// The neighbourhood's colors are much closer to a box in YCoCg than in RGB.
+fn toYCoCg(color: vec3<f32>) -> vec3<f32>
+{
+    return vec3<f32>(dot(color, vec3<f32>(0.25, 0.5, 0.25)), dot(color, vec3<f32>(0.5, 0.0, -0.5)), dot(color, vec3<f32>(-0.25, 0.5, -0.25)));
+}
+
+fn toRgb(color: vec3<f32>) -> vec3<f32>
+{
+    let t = color.x - color.z;
+    return vec3<f32>(t + color.y, color.x + color.z, t - color.y);
+}
+
+fn load(position: vec2<i32>) -> vec3<f32>
+{
+    let clamped = clamp(position, vec2<i32>(0), vec2<i32>(u_params.inputSize) - 1);
+    return toYCoCg(compress(textureLoad(currentColor, clamped, 0).rgb));
+}
+
+// Moves the history towards the box's centre until it's inside, which keeps its hue unlike clamping each channel.
+fn clipToBox(color: vec3<f32>, boxMin: vec3<f32>, boxMax: vec3<f32>) -> vec3<f32>
+{
+    let centre = 0.5 * (boxMax + boxMin);
+    let extents = 0.5 * (boxMax - boxMin) + 1.0 / 65536.0;
+    let offset = color - centre;
+    let units = abs(offset / extents);
+    let furthest = max(units.x, max(units.y, units.z));
+    return select(color, centre + offset / furthest, furthest > 1.0);
+}
+
+@fragment
+fn fs_main(@builtin(position) position: vec4<f32>) -> @location(0) vec4<f32>
+{
+    let uv = position.xy / u_params.outputSize;
+    // The scene was rendered with its projection shifted by the jitter, the surface at uv landed at uv + jitter.
+    let source = (uv + u_params.jitter) * u_params.inputSize - 0.5;
+    let nearest = vec2<i32>(round(source));
+
+    // Reconstructs the current color at the pixel's centre from the 3x3 samples around it, and gathers their statistics.
+    var current = vec3<f32>(0.0);
+    var weightSum = 0.0;
+    var boxMin = vec3<f32>(1e9);
+    var boxMax = vec3<f32>(-1e9);
+    var m1 = vec3<f32>(0.0);
+    var m2 = vec3<f32>(0.0);
+    for (var y = -1; y <= 1; y++)
+    {
+        for (var x = -1; x <= 1; x++)
+        {
+            let texel = nearest + vec2<i32>(x, y);
+            let color = load(texel);
+            let delta = vec2<f32>(texel) - source;
+            // Gaussian fit of the Blackman-Harris window.
+            let weight = exp(-2.29 * dot(delta, delta));
+
+            current += color * weight;
+            weightSum += weight;
+            boxMin = min(boxMin, color);
+            boxMax = max(boxMax, color);
+            m1 += color;
+            m2 += color * color;
+        }
+    }
+    current /= weightSum;
+
+    if (u_params.historyValid == 0u)
+    {
+        return vec4<f32>(expand(toRgb(current)), 1.0);
+    }
+
+    // Reprojects with the motion of the nearest sample. Off-screen history is replaced by the current frame.
+    let motion = textureLoad(motionVectors, clamp(nearest, vec2<i32>(0), vec2<i32>(u_params.inputSize) - 1), 0).xy;
+    let historyUv = uv - motion;
+    if (any(historyUv < vec2<f32>(0.0)) || any(historyUv > vec2<f32>(1.0)))
+    {
+        return vec4<f32>(expand(toRgb(current)), 1.0);
+    }
+
+    // Variance clipping, bounded by the neighbourhood's extremes.
+    let mean = m1 / 9.0;
+    let deviation = sqrt(max(m2 / 9.0 - mean * mean, vec3<f32>(0.0)));
+    let clipMin = max(boxMin, mean - 1.25 * deviation);
+    let clipMax = min(boxMax, mean + 1.25 * deviation);
+
+    let previous = toYCoCg(compress(textureSampleLevel(history, historySampler, historyUv, 0.0).rgb));
+    let clipped = clipToBox(previous, clipMin, clipMax);
+
+    // When upscaling, output pixels far from this frame's nearest sample keep more of the history, which has seen closer ones.
+    let nearestOffset = (vec2<f32>(nearest) - source) * u_params.outputSize / u_params.inputSize;
+    let confidence = exp(-2.29 * dot(nearestOffset, nearestOffset));
+    let blend = clamp(u_params.blend * (0.5 + confidence), 0.0, 1.0);
+
+    return vec4<f32>(expand(toRgb(mix(clipped, current, blend))), 1.0);
+}
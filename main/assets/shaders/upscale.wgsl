@@ -0,0 +1,147 @@
+#include "generated/upscale.wgsl"
+
+@group(0) @binding(0) var inputImage: texture_2d<f32>;
+@group(0) @binding(1) var<uniform> u_params: UpscaleParams;
+
+@vertex
+fn vs_main(@builtin(vertex_index) vi: u32) -> @builtin(position) vec4<f32>
+{
+    let uv = vec2<f32>(f32((vi << 1u) & 2u), f32(vi & 2u));
+    return vec4<f32>(uv * 2.0 - 1.0, 0.0, 1.0);
+}
+
+// The filters expect color in [0, 1]. HDR is compressed reversibly around them.
+fn compress(color: vec3<f32>) -> vec3<f32>
+{
+    return color / (1.0 + max(color.r, max(color.g, color.b)));
+}
+
+fn expand(color: vec3<f32>) -> vec3<f32>
+{
+    return color / max(1.0 - max(color.r, max(color.g, color.b)), 1.0 / 1024.0);
+}
+
+fn load(position: vec2<i32>) -> vec3<f32>
+{
+    let clamped = clamp(position, vec2<i32>(0), vec2<i32>(u_params.inputSize) - 1);
+    return compress(textureLoad(inputImage, clamped, 0).rgb);
+}
+
+fn luma(color: vec3<f32>) -> f32
+{
+    return dot(color, vec3<f32>(0.299, 0.587, 0.114));
+}
+
+// Edge adaptive upscale. A Lanczos-2 like kernel over the 12 nearest texels is rotated along the local edge
+// and stretched with its strength, then clamped to the nearest 2x2 texels to avoid ringing.
+@fragment
+fn fs_easu(@builtin(position) position: vec4<f32>) -> @location(0) vec4<f32>
+{
+    let source = position.xy * u_params.inputSize / u_params.outputSize - 0.5;
+    let base = vec2<i32>(floor(source));
+    let f = source - floor(source);
+
+    var colors: array<vec3<f32>, 16>;
+    var lumas: array<f32, 16>;
+    for (var y = 0; y < 4; y++)
+    {
+        for (var x = 0; x < 4; x++)
+        {
+            let color = load(base + vec2<i32>(x - 1, y - 1));
+            colors[y * 4 + x] = color;
+            lumas[y * 4 + x] = luma(color);
+        }
+    }
+
+    // Gradient direction and edge strength of the 2x2 centre texels, bilinearly weighted.
+    var direction = vec2<f32>(0.0);
+    var edge = 0.0;
+    for (var y = 1; y < 3; y++)
+    {
+        for (var x = 1; x < 3; x++)
+        {
+            let weight = select(f.x, 1.0 - f.x, x == 1) * select(f.y, 1.0 - f.y, y == 1);
+            let centre = lumas[y * 4 + x];
+            let left = lumas[y * 4 + x - 1];
+            let right = lumas[y * 4 + x + 1];
+            let top = lumas[(y - 1) * 4 + x];
+            let bottom = lumas[(y + 1) * 4 + x];
+
+            let dx = right - left;
+            let dy = bottom - top;
+            direction += vec2<f32>(dx, dy) * weight;
+
+            let edgeX = saturate(abs(dx) / max(max(abs(right - centre), abs(centre - left)), 1.0 / 32768.0));
+            let edgeY = saturate(abs(dy) / max(max(abs(bottom - centre), abs(centre - top)), 1.0 / 32768.0));
+            edge += (edgeX * edgeX + edgeY * edgeY) * weight;
+        }
+    }
+
+    let directionLength2 = dot(direction, direction);
+    direction = select(direction * inverseSqrt(directionLength2), vec2<f32>(1.0, 0.0), directionLength2 < 1.0 / 32768.0);
+    edge = edge * 0.5;
+    edge *= edge;
+
+    // Diagonal edges stretch the kernel up to sqrt(2), strong edges also narrow it across the edge.
+    let stretch = 1.0 / max(abs(direction.x), abs(direction.y));
+    let scale = vec2<f32>(1.0 + (stretch - 1.0) * edge, 1.0 - 0.5 * edge);
+    let lobe = 0.5 + ((1.0 / 4.0 - 0.04) - 0.5) * edge;
+    let clip = 1.0 / lobe;
+
+    var sum = vec3<f32>(0.0);
+    var weightSum = 0.0;
+    for (var y = 0; y < 4; y++)
+    {
+        for (var x = 0; x < 4; x++)
+        {
+            // The corners are too far away to contribute.
+            if ((x == 0 || x == 3) && (y == 0 || y == 3))
+            {
+                continue;
+            }
+
+            let offset = vec2<f32>(f32(x - 1), f32(y - 1)) - f;
+            let rotated = vec2<f32>(offset.x * direction.x + offset.y * direction.y, offset.y * direction.x - offset.x * direction.y) * scale;
+            let d2 = min(dot(rotated, rotated), clip);
+
+            var lanczos = 2.0 / 5.0 * d2 - 1.0;
+            var falloff = lobe * d2 - 1.0;
+            lanczos = 25.0 / 16.0 * lanczos * lanczos - (25.0 / 16.0 - 1.0);
+            falloff *= falloff;
+            let weight = lanczos * falloff;
+
+            sum += colors[y * 4 + x] * weight;
+            weightSum += weight;
+        }
+    }
+
+    let minimum = min(min(colors[5], colors[6]), min(colors[9], colors[10]));
+    let maximum = max(max(colors[5], colors[6]), max(colors[9], colors[10]));
+    let color = clamp(sum / weightSum, minimum, maximum);
+
+    return vec4<f32>(expand(color), 1.0);
+}
+
+// Contrast adaptive sharpening. The negative lobe of a 5 tap cross is as strong as it can be
+// without pushing the centre outside the range of its neighbours.
+@fragment
+fn fs_rcas(@builtin(position) position: vec4<f32>) -> @location(0) vec4<f32>
+{
+    let p = vec2<i32>(position.xy);
+    let top = load(p + vec2<i32>(0, -1));
+    let left = load(p + vec2<i32>(-1, 0));
+    let centre = load(p);
+    let right = load(p + vec2<i32>(1, 0));
+    let bottom = load(p + vec2<i32>(0, 1));
+
+    let minimum = min(min(top, left), min(right, bottom));
+    let maximum = max(max(top, left), max(right, bottom));
+
+    let hitMin = min(minimum, centre) / (4.0 * maximum + 1.0 / 32768.0);
+    let hitMax = (1.0 - max(maximum, centre)) / (4.0 * minimum - 4.0);
+    let lobes = max(-hitMin, hitMax);
+    let lobe = max(-(0.25 - 1.0 / 16.0), min(max(lobes.r, max(lobes.g, lobes.b)), 0.0)) * u_params.sharpness;
+
+    let color = (lobe * (top + left + right + bottom) + centre) / (4.0 * lobe + 1.0);
+    return vec4<f32>(expand(color), 1.0);
+}
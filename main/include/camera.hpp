@@ -1,10 +1,27 @@
 #pragma once
+#include <cmath>
+#include <mat4x4.hpp>
+#include <vec2.hpp>
 
 struct Camera
 {
     float fov{ 1.8f };
     float ratio;
     float zNear{ 0.1f };
-    float zFar{ 100.0f };
-};
 
+    // Reversed Z with the far plane at infinity: depth is 1 at zNear and goes to 0 towards infinity,
+    // which spreads float precision evenly over distance. The jitter offsets everything projected, in NDC.
+    glm::mat4 Projection(const glm::vec2& jitter = glm::vec2{ 0.0f }) const
+    {
+        const float focalLength = 1.0f / std::tan(fov * 0.5f);
+
+        glm::mat4 projection{ 0.0f };
+        projection[0][0] = focalLength / ratio;
+        projection[1][1] = focalLength;
+        projection[2][0] = -jitter.x;
+        projection[2][1] = -jitter.y;
+        projection[2][3] = -1.0f;
+        projection[3][2] = zNear;
+        return projection;
+    }
+};
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+
+// Picks the resolution scale of the scene passes so the GPU frame time stays within a budget.
+// The GPU time is smoothed and the scale moves in fixed steps with a cooldown, so render targets aren't reallocated every frame.
+class DynamicResolution
+{
+public:
+    DynamicResolution(float budgetMs = 14.0f, float minScale = 0.5f, float maxScale = 1.0f);
+
+    // Takes the GPU time of the last finished frame, zero while none has finished.
+    void Update(float gpuFrameMs);
+
+    float Scale() const { return _enabled ? _scale : _maxScale; }
+    float SmoothedGpuMs() const { return _smoothedMs; }
+
+    void SetEnabled(bool enabled) { _enabled = enabled; }
+    bool Enabled() const { return _enabled; }
+    void SetBudget(float budgetMs) { _budgetMs = budgetMs; }
+    float Budget() const { return _budgetMs; }
+
+private:
+    float _budgetMs;
+    float _minScale;
+    float _maxScale;
+
+    float _scale;
+    float _smoothedMs{ 0.0f };
+    uint32_t _cooldown{ 0 };
+    bool _enabled{ true };
+};
@@ -0,0 +1,65 @@
+#pragma once
+#include <webgpu/webgpu_cpp.h>
+#include <chrono>
+#include <deque>
+#include <functional>
+
+// How many frames the CPU may record ahead of the GPU.
+constexpr uint32_t MAX_FRAMES_IN_FLIGHT{ 3 };
+
+// Numbers the frames in flight and fences each by the queue reporting its submissions as done.
+// Work that has to wait for the GPU, like destroying resources it may still read, is deferred to the frame being recorded
+// and runs once that frame has finished. Setup work before the first BeginFrame() counts as part of frame 0.
+class FrameScheduler
+{
+public:
+    FrameScheduler(const wgpu::Queue& queue);
+    ~FrameScheduler();
+
+    // Fails while MAX_FRAMES_IN_FLIGHT frames are still running, the frame should be skipped instead of stalling.
+    bool BeginFrame();
+    // Fences everything submitted so far, has to come after the frame's last submit.
+    void EndFrame();
+
+    // Runs the callback once the current frame has finished on the GPU.
+    void Defer(std::function<void()> callback);
+    void DeferDestroy(const wgpu::Buffer& buffer);
+    void DeferDestroy(const wgpu::Texture& texture);
+
+    // The frame being recorded, counting from zero.
+    uint64_t FrameNumber() const { return _frameNumber; }
+    // Index of the current frame's context, for resources kept once per frame in flight.
+    uint32_t FrameIndex() const { return static_cast<uint32_t>(_frameNumber % MAX_FRAMES_IN_FLIGHT); }
+    uint64_t CompletedFrames() const { return _completedFrames; }
+    uint32_t FramesInFlight() const { return static_cast<uint32_t>(_frameNumber - _completedFrames); }
+    // Estimate of how long the GPU was busy with the last finished frame: from its submission, or the end of the frame before
+    // if that was later, until the queue reported it done. Includes the callback latency, so it's an upper bound.
+    float LastFrameGpuMs() const { return _lastFrameGpuMs; }
+
+private:
+    struct Deferred
+    {
+        uint64_t frameNumber;
+        std::function<void()> callback;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Fence
+    {
+        FrameScheduler* scheduler;
+        uint64_t frameNumber;
+        Clock::time_point submitTime;
+    };
+
+    void OnFrameCompleted(const Fence& fence);
+
+    wgpu::Queue _queue;
+    // Ordered by frame, work deferred between frames belongs to the next one.
+    std::deque<Deferred> _deferred;
+
+    uint64_t _frameNumber{ 0 };
+    uint64_t _completedFrames{ 0 };
+    Clock::time_point _lastCompletionTime{};
+    float _lastFrameGpuMs{ 0.0f };
+};
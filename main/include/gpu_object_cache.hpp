@@ -0,0 +1,68 @@
+#pragma once
+#include <webgpu/webgpu_cpp.h>
+#include <array>
+#include <unordered_map>
+#include <vector>
+
+enum class GpuObjectType
+{
+    Sampler,
+    BindGroupLayout,
+    PipelineLayout,
+    BindGroup,
+    Count
+};
+
+// Deduplicates immutable GPU objects by hashing the contents of their descriptors.
+// Labels are ignored, so the first object created for a descriptor keeps its label.
+// Objects are compared by handle, which stays unique because the cache holds a reference to everything it hashed.
+class GpuObjectCache
+{
+public:
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+    };
+
+    GpuObjectCache(const wgpu::Device& device);
+
+    wgpu::Sampler GetSampler(const wgpu::SamplerDescriptor& descriptor);
+    wgpu::BindGroupLayout GetBindGroupLayout(const wgpu::BindGroupLayoutDescriptor& descriptor);
+    wgpu::PipelineLayout GetPipelineLayout(const wgpu::PipelineLayoutDescriptor& descriptor);
+    // Cached bind groups keep the resources they reference alive until they've gone unused for a while,
+    // bind groups over resources that only live for one frame shouldn't be cached.
+    // Dynamic offsets aren't part of the descriptor, so passes that draw once per offset, like cube faces, create the bind group once.
+    wgpu::BindGroup GetBindGroup(const wgpu::BindGroupDescriptor& descriptor);
+
+    // Drops the bind groups that haven't been asked for in a while.
+    void EndFrame();
+
+    const Stats& GetStats(GpuObjectType type) const { return _stats[static_cast<size_t>(type)]; }
+
+private:
+    using Key = std::vector<uint64_t>;
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct CachedBindGroup
+    {
+        wgpu::BindGroup bindGroup;
+        uint64_t lastUsedFrame;
+    };
+
+    void Count(GpuObjectType type, bool hit);
+
+    wgpu::Device _device;
+
+    std::unordered_map<Key, wgpu::Sampler, KeyHash> _samplers;
+    std::unordered_map<Key, wgpu::BindGroupLayout, KeyHash> _bindGroupLayouts;
+    std::unordered_map<Key, wgpu::PipelineLayout, KeyHash> _pipelineLayouts;
+    std::unordered_map<Key, CachedBindGroup, KeyHash> _bindGroups;
+
+    std::array<Stats, static_cast<size_t>(GpuObjectType::Count)> _stats{};
+    uint64_t _frame{ 0 };
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "render_pass.hpp"
+#include <webgpu/webgpu_cpp.h>
+#include <glm.hpp>
+#include <stopwatch.hpp>
+
+// Exposes the HDR color for its average luminance without the CPU seeing it. A compute pass bins every texel's
+// log luminance into a histogram with workgroup atomics, then a single workgroup averages the histogram, adapts
+// towards it over time, and writes the exposure into a buffer the post process reads.
+class AutoExposurePass : public RenderPass
+{
+public:
+    static constexpr uint32_t HISTOGRAM_BINS{ 256 };
+    // Luminance range the histogram covers, in stops. Bin 0 holds everything darker, which is left out of the average.
+    static constexpr float HISTOGRAM_MIN_EV{ -10.0f };
+    static constexpr float HISTOGRAM_MAX_EV{ 6.0f };
+
+    // Lives on the GPU, the adapted luminance carries over to the next frame.
+    struct Exposure
+    {
+        float exposure{ 1.0f };
+        float luminance{ 0.18f };
+        float _padding[2];
+    };
+
+    AutoExposurePass(Renderer& renderer);
+    virtual ~AutoExposurePass();
+
+    // Records the histogram and the adaptation into one compute pass, from the HDR color before any exposure.
+    void Render(const wgpu::CommandEncoder& encoder, const wgpu::TextureView& hdr, const glm::uvec2& size);
+
+    // Holds the exposure to multiply the HDR color with, which stays at one while disabled.
+    const wgpu::Buffer& ExposureBuffer() const { return _exposureBuffer; }
+
+    // Disabling resets the exposure, so enabling it again adapts from a neutral one.
+    void SetEnabled(bool enabled);
+    bool Enabled() const { return _enabled; }
+    // How fast the exposure follows the scene, higher adapts faster.
+    void SetAdaptationSpeed(float speed) { _adaptationSpeed = speed; }
+    float GetAdaptationSpeed() const { return _adaptationSpeed; }
+
+private:
+    struct Params
+    {
+        float minLogLuminance;
+        float inverseLogLuminanceRange;
+        // Fraction of the way to the target luminance covered this frame.
+        float adaptation;
+        uint32_t pixelCount;
+    };
+
+    wgpu::BindGroupLayout _bindGroupLayout;
+    uint64_t _histogramKey;
+    uint64_t _averageKey;
+
+    wgpu::Buffer _histogramBuffer;
+    wgpu::Buffer _exposureBuffer;
+    wgpu::TextureView _hdr;
+    wgpu::BindGroup _bindGroup;
+
+    Stopwatch _frameTimer;
+    float _adaptationSpeed{ 1.5f };
+    bool _enabled{ true };
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "render_pass.hpp"
+#include <webgpu/webgpu_cpp.h>
+#include <glm.hpp>
+#include <vector>
+
+// Physically based bloom, as in Jimenez's "Next generation post processing in Call of Duty: Advanced Warfare".
+// The HDR color is downsampled into a mip chain starting at half its size, with a 13 tap filter that works on tiles
+// of the source in workgroup memory. The chain is then upsampled again with a 3x3 tent, adding each level on the way up,
+// so the glow gets wider the brighter a spot is, without any threshold. Everything runs in compute, in RGBA16F.
+class BloomPass : public RenderPass
+{
+public:
+    BloomPass(Renderer& renderer);
+    virtual ~BloomPass();
+
+    // Recreates the chain if the size of the HDR color changed. The output view has to be imported into the frame's graph after this.
+    void BeginFrame(const glm::uvec2& size);
+    const wgpu::TextureView& OutputView() const { return _upViews.empty() ? _downViews.front() : _upViews.front(); }
+
+    // Records the compute passes, the input has to be the size given to BeginFrame().
+    void Render(const wgpu::CommandEncoder& encoder, const wgpu::TextureView& input);
+
+    void SetEnabled(bool enabled) { _enabled = enabled; }
+    bool Enabled() const { return _enabled; }
+    uint32_t MipCount() const { return static_cast<uint32_t>(_downViews.size()); }
+
+private:
+    void CreateChain(const glm::uvec2& size);
+    wgpu::BindGroup CreateBindGroup(const wgpu::TextureView& source, const wgpu::TextureView& base, const wgpu::TextureView& destination) const;
+    void ReleaseChain();
+
+    wgpu::BindGroupLayout _bindGroupLayout;
+    wgpu::Sampler _sampler;
+    uint64_t _downsampleFirstKey;
+    uint64_t _downsampleKey;
+    uint64_t _upsampleKey;
+
+    glm::uvec2 _size{ 0 };
+    wgpu::Texture _downTexture;
+    wgpu::Texture _upTexture;
+    // One view per mip, the up chain has one mip less since its smallest level is the down chain's.
+    std::vector<wgpu::TextureView> _downViews;
+    std::vector<wgpu::TextureView> _upViews;
+    std::vector<glm::uvec2> _mipSizes;
+    // Only the first downsample reads a texture from outside the chain.
+    wgpu::TextureView _input;
+    std::vector<wgpu::BindGroup> _downBindGroups;
+    std::vector<wgpu::BindGroup> _upBindGroups;
+
+    bool _enabled{ true };
+};
@@ -1,17 +1,75 @@
 #pragma once
 #include "graphics/render_pass.hpp"
+#include "uniform_block.hpp"
+#include <glm.hpp>
+#include <cmath>
 
+// The whole post stack after the scene in one fullscreen pass: reads the HDR color once, applies exposure,
+// adds bloom, and tonemaps and grades through a 3D LUT. The LUT is baked by a compute shader whenever the grading changes,
+// so the per pixel cost stays one lookup however much grading is done.
 class HDRPass : public RenderPass
 {
 public:
+    // The LUT covers this range of stops around middle grey, in log2 steps. Brighter colors clip to white.
+    static constexpr float LUT_MIN_EV{ -10.0f };
+    static constexpr float LUT_MAX_EV{ 8.0f };
+    static constexpr uint32_t LUT_SIZE{ 32 };
+
+    struct Grading
+    {
+        glm::vec3 gain{ 1.0f };
+        float contrast{ 1.0f };
+        float saturation{ 1.0f };
+        float _padding[3];
+    };
+
     HDRPass(Renderer& renderer);
-    virtual void Render(const wgpu::CommandEncoder& encoder, const wgpu::TextureView& renderTarget, std::shared_ptr<const wgpu::TextureView> resolveTarget = nullptr) override;
+    virtual ~HDRPass();
+
+    // Rebakes the LUT into the frame's commands if the grading changed, has to come before Render().
+    void Prepare(const wgpu::CommandEncoder& encoder);
+    // Records into the render pass the graph began for it. The textures may change between frames, without bloom it's left out.
+    // The exposure buffer holds the auto exposure, which the manual exposure is applied on top of.
+    void Render(const wgpu::RenderPassEncoder& pass, const wgpu::TextureView& hdrView, const wgpu::Buffer& exposureBuffer, const wgpu::TextureView& bloomView = nullptr);
+
+    // In stops, as compensation on top of the auto exposure.
+    void SetExposure(float exposure) { _params.Set(_params.Data().exposure, std::exp2(exposure)); _exposure = exposure; }
+    float GetExposure() const { return _exposure; }
+    void SetBloomIntensity(float intensity) { _params.Set(_params.Data().bloomIntensity, intensity); }
+    float GetBloomIntensity() const { return _params.Data().bloomIntensity; }
 
-    void UpdateHDRView(const wgpu::TextureView& hdrView);
+    void SetGrading(const Grading& grading);
+    const Grading& GetGrading() const { return _grading.Data(); }
 
 private:
+    struct Params
+    {
+        float exposure{ 1.0f };
+        float bloomIntensity{ 0.04f };
+        float _padding[2];
+    };
+
+    void UpdateBindGroup(const wgpu::TextureView& hdrView, const wgpu::Buffer& exposureBuffer, const wgpu::TextureView& bloomView);
+
     wgpu::Sampler _hdrSampler;
-    wgpu::RenderPipeline _renderPipeline;
+    uint64_t _pipelineKey;
     wgpu::BindGroupLayout _hdrBindGroupLayout;
     wgpu::BindGroup _hdrBindGroup;
+    wgpu::TextureView _hdrView;
+    wgpu::TextureView _bloomView;
+    wgpu::Buffer _exposureBuffer;
+    // Stands in for the bloom when there is none.
+    wgpu::Texture _blackTexture;
+    wgpu::TextureView _blackView;
+    UniformBlock<Params> _params;
+    float _exposure{ 0.0f };
+
+    wgpu::Texture _lutTexture;
+    wgpu::TextureView _lutView;
+    uint64_t _lutPipelineKey;
+    wgpu::BindGroup _lutBindGroup;
+    UniformBlock<Grading> _grading;
+    bool _lutDirty{ true };
+    // Nothing is drawn before the first bake.
+    bool _lutBaked{ false };
 };
@@ -8,7 +8,7 @@ public:
     HDRIConversionPass(Renderer& renderer);
     virtual ~HDRIConversionPass() override;
 
-    virtual void Render(const wgpu::CommandEncoder& encoder, const wgpu::TextureView& renderTarget, std::shared_ptr<const wgpu::TextureView> resolveTarget = nullptr) override;
+    void Render(const wgpu::CommandEncoder& encoder, const wgpu::TextureView& renderTarget, std::shared_ptr<const wgpu::TextureView> resolveTarget = nullptr);
 
     void SetFace(uint32_t face) { _currentFace = face; }
 
@@ -24,8 +24,6 @@ private:
     wgpu::Texture _hdrTexture;
     wgpu::TextureView _cubemapView;
     wgpu::Sampler _hdrSampler;
-    wgpu::Buffer _faceUniformBuffer;
     wgpu::TextureView _hdrView;
-    uint32_t _uniformStride;
     uint32_t _currentFace{ 0 };
 };
@@ -7,5 +7,6 @@ class ImGuiPass : public RenderPass
 public:
     ImGuiPass(Renderer& renderer);
     virtual ~ImGuiPass();
-    virtual void Render(const wgpu::CommandEncoder& encoder, const wgpu::TextureView& renderTarget, std::shared_ptr<const wgpu::TextureView> resolveTarget = nullptr) override;
+    // Records into the render pass the graph began for it.
+    void Render(const wgpu::RenderPassEncoder& pass);
 };
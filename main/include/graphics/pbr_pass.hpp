@@ -4,9 +4,8 @@
 #include "renderer.hpp"
 #include <webgpu/webgpu_cpp.h>
 #include <glm.hpp>
-#include <queue>
-
-constexpr uint32_t MAX_INSTANCES{ 4096 };
+#include <unordered_map>
+#include <vector>
 
 class PBRPass : public RenderPass
 {
@@ -23,26 +22,44 @@ public:
     PBRPass(Renderer& renderer);
     virtual ~PBRPass();
 
-    virtual void Render(const wgpu::CommandEncoder& encoder, const wgpu::TextureView& renderTarget, std::shared_ptr<const wgpu::TextureView> resolveTarget = nullptr) override;
+    // Both record into the scene pass, with the sky drawn in between so it doesn't cover blended surfaces.
+    // The blended half draws back to front and finishes the frame's drawings.
+    void RenderOpaque(const wgpu::RenderPassEncoder& pass);
+    void RenderBlended(const wgpu::RenderPassEncoder& pass);
 
     void DrawMesh(const Mesh& mesh, const Transform& transform) const;
-    const wgpu::BindGroupLayout& PBRBindGroupLayout() const { return _pbrBindGroupLayout; }
 
 private:
     struct Instance
     {
         glm::mat4 model;
         glm::mat4 transInvModel;
+        uint32_t materialIndex;
+        uint32_t _padding[3];
     };
 
-    wgpu::BindGroupLayout _pbrBindGroupLayout;
+    // Variants hold the MATERIAL_FEATURE bits in the low half, and what the scene pass's targets need above them.
+    static constexpr uint32_t MATERIAL_FEATURE_MASK{ 0xFFFF };
+    static constexpr uint32_t VARIANT_MOTION_VECTORS{ 1 << 16 };
+    static constexpr uint32_t VARIANT_SAMPLE_COUNT_SHIFT{ 24 };
+
+    // Adds the bits of the renderer's current scene targets to the material features.
+    uint32_t SceneVariant(uint32_t features) const;
+    // Compiles the shader variant, unless it's already been requested.
+    uint64_t RequestVariant(uint32_t variant);
+    void RenderDrawings(const wgpu::RenderPassEncoder& pass, size_t begin, size_t end);
+
     wgpu::BindGroupLayout _instanceBindGroupLayout;
     wgpu::BindGroup _instanceBindGroup;
-    uint32_t _uniformStride;
-    wgpu::Buffer _instanceBuffer;
-    wgpu::RenderPipeline _pipeline;
+    wgpu::PipelineLayout _pipelineLayout;
+    // Pipeline cache keys by variant.
+    std::unordered_map<uint32_t, uint64_t> _variants;
     wgpu::ShaderModule _vertModule;
     wgpu::ShaderModule _fragModule;
+    wgpu::ShaderModule _motionVertModule;
+    wgpu::ShaderModule _motionFragModule;
 
-    mutable std::queue<std::tuple<Mesh, Transform>> _drawings;
+    mutable std::vector<std::tuple<Mesh, Transform>> _drawings;
+    // Drawings from here on are blended, once they're sorted.
+    size_t _blendedBegin{ 0 };
 };
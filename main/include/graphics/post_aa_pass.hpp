@@ -0,0 +1,54 @@
+#pragma once
+
+#include "render_pass.hpp"
+#include <webgpu/webgpu_cpp.h>
+#include <glm.hpp>
+
+// Anti-aliasing of the tonemapped image, for when the scene is rendered with one sample.
+// FXAA blurs along the edges it finds in a single pass. SMAA finds the edges first, reconstructs the shape of the lines they
+// belong to, and only blends the pixels the lines cross, which keeps the rest of the image sharp.
+class PostAAPass : public RenderPass
+{
+public:
+    PostAAPass(Renderer& renderer);
+    virtual ~PostAAPass();
+
+    // All record a fullscreen triangle into the render pass the graph began for them, on a target of the given size.
+    void RenderFXAA(const wgpu::RenderPassEncoder& pass, const wgpu::TextureView& input, const glm::uvec2& size);
+    // SMAA's passes, in order. Edges go to an RG8 target, blend weights to an RGBA8 one and the blend to the output format.
+    void RenderEdges(const wgpu::RenderPassEncoder& pass, const wgpu::TextureView& input, const glm::uvec2& size);
+    void RenderBlendWeights(const wgpu::RenderPassEncoder& pass, const wgpu::TextureView& edges, const glm::uvec2& size);
+    void RenderBlend(const wgpu::RenderPassEncoder& pass, const wgpu::TextureView& input, const wgpu::TextureView& weights, const glm::uvec2& size);
+
+    static constexpr wgpu::TextureFormat EDGES_FORMAT{ wgpu::TextureFormat::RG8Unorm };
+    static constexpr wgpu::TextureFormat BLEND_WEIGHTS_FORMAT{ wgpu::TextureFormat::RGBA8Unorm };
+
+private:
+    struct Params
+    {
+        glm::vec2 texelSize;
+        glm::vec2 size;
+    };
+
+    // The inputs usually stay the same textures, the bind group is only rebuilt when they change.
+    struct Stage
+    {
+        uint64_t pipelineKey;
+        wgpu::TextureView input;
+        wgpu::TextureView secondInput;
+        wgpu::BindGroup bindGroup;
+    };
+
+    uint64_t RequestPipeline(const char* entryPoint, wgpu::TextureFormat format, const char* label);
+    // Stages with one input bind it twice.
+    void Render(const wgpu::RenderPassEncoder& pass, Stage& stage, const wgpu::TextureView& input, const wgpu::TextureView& secondInput, const glm::uvec2& size);
+
+    wgpu::ShaderModule _shader;
+    wgpu::BindGroupLayout _bindGroupLayout;
+    wgpu::PipelineLayout _pipelineLayout;
+    wgpu::Sampler _sampler;
+    Stage _fxaa{};
+    Stage _edges{};
+    Stage _blendWeights{};
+    Stage _blend{};
+};
@@ -3,14 +3,14 @@
 #include <webgpu/webgpu_cpp.h>
 class Renderer;
 
+// Common state of the passes. How a pass is recorded depends on whether the render graph begins its render pass,
+// or it renders to a target of its own, like the offline cubemap passes.
 class RenderPass
 {
 public:
     RenderPass(Renderer& renderer, wgpu::TextureFormat renderFormat) : _renderer(renderer), _renderFormat(renderFormat) {}
     virtual ~RenderPass();
 
-    virtual void Render(const wgpu::CommandEncoder& encoder, const wgpu::TextureView& renderTarget, std::shared_ptr<const wgpu::TextureView> resolveTarget = nullptr) = 0;
-
 protected:
     Renderer& _renderer;
     const wgpu::TextureFormat _renderFormat{ wgpu::TextureFormat::Undefined };
@@ -1,26 +1,30 @@
 #pragma once
 
 #include "render_pass.hpp"
+#include "uniform_block.hpp"
 #include <webgpu/webgpu_cpp.h>
 #include <glm.hpp>
+#include <unordered_map>
 
 class SkyboxPass : public RenderPass
 {
 public:
+    // Only changes when the intensity is edited, the view direction is reconstructed from the view uniform.
     struct Instance
     {
-        glm::mat4 model;
-        float exposure{ 3.0f };
-        float padding[3];
+        // Scales the sky's radiance, it's exposed together with the scene by the post process.
+        float intensity{ 1.0f };
+        float _padding[3];
     };
 
     SkyboxPass(Renderer& renderer);
     virtual ~SkyboxPass();
 
-    virtual void Render(const wgpu::CommandEncoder& encoder, const wgpu::TextureView& renderTarget, std::shared_ptr<const wgpu::TextureView> resolveTarget = nullptr) override;
+    // Records a fullscreen triangle into the scene pass after the opaque geometry, the sky is only drawn where the depth is still clear.
+    void Render(const wgpu::RenderPassEncoder& pass);
 
-    void SetExposure(float exposure) { _instance.exposure = exposure; }
-    float GetExposure() const { return _instance.exposure; }
+    void SetIntensity(float intensity) { _instance.Set(_instance.Data().intensity, intensity); }
+    float GetIntensity() const { return _instance.Data().intensity; }
 
     const wgpu::TextureView& SkyboxView() const { return _skyboxView; }
     const wgpu::TextureView SkyboxView(uint32_t face) const 
@@ -37,14 +41,18 @@ public:
     }
 
 private:
+    // The scene pass's sample count and motion vector target decide which pipeline the sky has to use.
+    static uint32_t PipelineVariant(uint32_t sampleCount, bool motionVectors);
+    uint64_t RequestPipeline(uint32_t sampleCount, bool motionVectors);
+
     wgpu::Texture _skyboxTexture;
     wgpu::TextureView _skyboxView;
     wgpu::Sampler _skyboxSampler;
-    wgpu::Buffer _vertexBuffer;
     wgpu::BindGroupLayout _skyboxBGL;
     wgpu::BindGroup _skyboxBindGroup;
     wgpu::ShaderModule _skyboxShader;
-    wgpu::RenderPipeline _skyboxPipeline;
-    wgpu::Buffer _instanceBuffer;
-    Instance _instance;
+    wgpu::ShaderModule _skyboxMotionShader;
+    wgpu::PipelineLayout _pipelineLayout;
+    std::unordered_map<uint32_t, uint64_t> _pipelineKeys;
+    UniformBlock<Instance> _instance;
 };
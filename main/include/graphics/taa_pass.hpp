@@ -0,0 +1,72 @@
+#pragma once
+
+#include "render_pass.hpp"
+#include <webgpu/webgpu_cpp.h>
+#include <glm.hpp>
+#include <array>
+
+// Temporal anti-aliasing. The scene is rendered with one sample and a sub-pixel jitter that changes every frame,
+// and each frame's samples are blended into a history at the output size. The history is reprojected with the scene's
+// motion vectors and clipped to the current neighbourhood's colors, so it can't hold on to what's no longer visible.
+// Since the history is at the output size, rendering the scene smaller upscales it over time.
+class TAAPass : public RenderPass
+{
+public:
+    TAAPass(Renderer& renderer);
+    virtual ~TAAPass();
+
+    // Swaps the histories, and recreates them if the output size changed. Returns the jitter of the coming frame in pixels,
+    // from the sample sequence.
+    glm::vec2 BeginFrame(const glm::uvec2& outputSize);
+
+    // Read and written by the pass, both have to be imported into the frame's graph.
+    const wgpu::TextureView& HistoryView() const { return _histories[1 - _current].view; }
+    const wgpu::TextureView& OutputView() const { return _histories[_current].view; }
+
+    // Records a fullscreen triangle into the render pass on OutputView(). The jitter is the one returned by BeginFrame().
+    void Render(const wgpu::RenderPassEncoder& pass, const wgpu::TextureView& color, const wgpu::TextureView& motion, const glm::uvec2& inputSize, const glm::vec2& jitter);
+
+    // The next frame won't blend with anything rendered before it, like after a camera cut.
+    void ResetHistory() { _historyValid = false; }
+
+    // Weight of the current frame in the history, lower is smoother but reacts slower.
+    void SetBlend(float blend) { _blend = blend; }
+    float GetBlend() const { return _blend; }
+
+private:
+    struct Params
+    {
+        glm::vec2 inputSize;
+        glm::vec2 outputSize;
+        // In UV units of the input.
+        glm::vec2 jitter;
+        float blend;
+        uint32_t historyValid;
+    };
+
+    // The inputs are transient, the bind group is only rebuilt when they're backed by other textures.
+    struct History
+    {
+        wgpu::Texture texture;
+        wgpu::TextureView view;
+        wgpu::TextureView color;
+        wgpu::TextureView motion;
+        // Reads the other history.
+        wgpu::BindGroup bindGroup;
+    };
+
+    void CreateHistories(const glm::uvec2& size);
+
+    wgpu::ShaderModule _shader;
+    wgpu::BindGroupLayout _bindGroupLayout;
+    wgpu::PipelineLayout _pipelineLayout;
+    wgpu::Sampler _sampler;
+    uint64_t _pipelineKey;
+
+    std::array<History, 2> _histories{};
+    uint32_t _current{ 0 };
+    glm::uvec2 _outputSize{ 0 };
+    uint32_t _sampleIndex{ 0 };
+    bool _historyValid{ false };
+    float _blend{ 0.1f };
+};
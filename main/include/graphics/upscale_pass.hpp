@@ -0,0 +1,49 @@
+#pragma once
+
+#include "render_pass.hpp"
+#include <webgpu/webgpu_cpp.h>
+#include <glm.hpp>
+
+// Spatial upscaling in the style of FSR 1: an edge adaptive upscale (EASU) followed by contrast adaptive sharpening (RCAS).
+// Works on the HDR scene color before tonemapping, which it compresses into [0, 1) and expands again around each filter.
+class UpscalePass : public RenderPass
+{
+public:
+    UpscalePass(Renderer& renderer);
+    virtual ~UpscalePass();
+
+    // Both record a fullscreen triangle into the render pass the graph began for them, on a target of outputSize.
+    void RenderUpscale(const wgpu::RenderPassEncoder& pass, const wgpu::TextureView& input, const glm::uvec2& inputSize, const glm::uvec2& outputSize);
+    void RenderSharpen(const wgpu::RenderPassEncoder& pass, const wgpu::TextureView& input, const glm::uvec2& size);
+
+    // 0 disables sharpening, 1 is the strongest.
+    void SetSharpness(float sharpness) { _sharpness = sharpness; }
+    float GetSharpness() const { return _sharpness; }
+
+private:
+    struct Params
+    {
+        glm::vec2 inputSize;
+        glm::vec2 outputSize;
+        float sharpness;
+        float _padding[3];
+    };
+
+    // The input usually stays the same texture, the bind group is only rebuilt when it changes.
+    struct Stage
+    {
+        uint64_t pipelineKey;
+        wgpu::TextureView input;
+        wgpu::BindGroup bindGroup;
+    };
+
+    uint64_t RequestPipeline(const char* entryPoint, const char* label);
+    void Render(const wgpu::RenderPassEncoder& pass, Stage& stage, const wgpu::TextureView& input, const Params& params);
+
+    wgpu::ShaderModule _shader;
+    wgpu::BindGroupLayout _bindGroupLayout;
+    wgpu::PipelineLayout _pipelineLayout;
+    Stage _upscale{};
+    Stage _sharpen{};
+    float _sharpness{ 0.8f };
+};
@@ -0,0 +1,144 @@
+#pragma once
+#include <webgpu/webgpu_cpp.h>
+#include <vec3.hpp>
+#include <vector>
+
+class Renderer;
+
+// Texture handles hold the pool index in the upper and the array layer in the lower 16 bits.
+constexpr uint32_t INVALID_TEXTURE{ 0xFFFFFFFF };
+constexpr uint32_t INVALID_MATERIAL{ 0xFFFFFFFF };
+constexpr uint32_t MAX_MATERIALS{ 1024 };
+
+// Streamed textures move between these resolutions, and every one of them is a pool per format.
+constexpr uint32_t MIN_STREAMED_RESOLUTION_LOG2{ 4 };
+constexpr uint32_t MAX_STREAMED_RESOLUTION_LOG2{ 12 };
+// Albedo and emissive are sRGB RGBA8, normals RG8 and ORM linear RGBA8.
+constexpr uint32_t TEXTURE_POOL_FORMATS{ 3 };
+// Enough for square textures at every streamed resolution. Devices that sample fewer textures per stage get fewer pools.
+constexpr uint32_t MAX_TEXTURE_POOLS{ TEXTURE_POOL_FORMATS * (MAX_STREAMED_RESOLUTION_LOG2 - MIN_STREAMED_RESOLUTION_LOG2 + 1) };
+
+// Feature bits select the PBR shader variant a material is drawn with, each maps to an override constant in frag.wgsl.
+// Materials without a texture skip its fetch and fall back to their factors.
+constexpr uint32_t MATERIAL_FEATURE_NORMAL_MAP{ 1 << 0 };
+constexpr uint32_t MATERIAL_FEATURE_EMISSIVE_MAP{ 1 << 1 };
+constexpr uint32_t MATERIAL_FEATURE_OCCLUSION_MAP{ 1 << 2 };
+constexpr uint32_t MATERIAL_FEATURE_METALLIC_ROUGHNESS_MAP{ 1 << 3 };
+constexpr uint32_t MATERIAL_FEATURE_ALPHA_MASK{ 1 << 4 };
+constexpr uint32_t MATERIAL_FEATURE_ALPHA_BLEND{ 1 << 5 };
+constexpr uint32_t MATERIAL_FEATURE_MAPS{ MATERIAL_FEATURE_NORMAL_MAP | MATERIAL_FEATURE_EMISSIVE_MAP | MATERIAL_FEATURE_OCCLUSION_MAP | MATERIAL_FEATURE_METALLIC_ROUGHNESS_MAP };
+
+enum class MaterialTexture
+{
+    Albedo,
+    Normal,
+    ORM,
+    Emissive
+};
+
+// Shaders include its generated declaration from generated/material.wgsl.
+struct Material
+{
+    // Factors scale their texture as in glTF, and stand in for it when there is none.
+    glm::vec3 albedoFactor{ 1.0f };
+    float metallicFactor{ 1.0f };
+    glm::vec3 emissiveFactor{ 0.0f };
+    float roughnessFactor{ 1.0f };
+    // Occlusion strength and normal scale, only read with their maps.
+    float aoFactor{ 1.0f };
+    float normalFactor{ 1.0f };
+
+    uint32_t albedoTexture{ INVALID_TEXTURE };
+    uint32_t normalTexture{ INVALID_TEXTURE };
+    uint32_t ormTexture{ INVALID_TEXTURE };
+    uint32_t emissiveTexture{ INVALID_TEXTURE };
+
+    float alphaFactor{ 1.0f };
+    // Only read by masked materials.
+    float alphaCutoff{ 0.5f };
+
+    uint32_t& TextureHandle(MaterialTexture texture)
+    {
+        switch (texture)
+        {
+        case MaterialTexture::Albedo:   return albedoTexture;
+        case MaterialTexture::Normal:   return normalTexture;
+        case MaterialTexture::ORM:      return ormTexture;
+        default:                        return emissiveTexture;
+        }
+    }
+};
+
+// Packs material textures into texture_2d_array pools, bucketed by size, format and mip count,
+// and keeps every material in one storage buffer. A single bind group then covers all materials,
+// so draws don't have to rebind textures and can be batched across materials.
+class MaterialSystem
+{
+public:
+    MaterialSystem(const Renderer& renderer);
+
+    // Copies the mips from baseMip on into a free layer of a matching pool, the texture can be released afterwards.
+    // The pool is sampled as viewFormat, which has to be the texture's format or one of its view formats.
+    uint32_t AddTexture(const wgpu::Texture& texture, wgpu::TextureFormat viewFormat, uint32_t baseMip = 0);
+    // Copies all but the largest mip into a pool of half the size, and returns the new handle.
+    // The old handle stays valid until it's removed.
+    uint32_t ShrinkTexture(uint32_t handle);
+    // Frees the layer for reuse, no material may reference it anymore. Later uploads are queued behind the frames that still sample it.
+    // Pools that end up mostly empty are compacted, which updates the handles of the materials in them, and empty pools are released.
+    void RemoveTexture(uint32_t handle);
+
+    // Returns INVALID_MATERIAL once MAX_MATERIALS are in use.
+    uint32_t AddMaterial(const Material& material);
+    void UpdateMaterial(uint32_t index, const Material& material);
+    const Material& GetMaterial(uint32_t index) const { return _materials[index]; }
+    uint32_t MaterialCount() const { return static_cast<uint32_t>(_materials.size()); }
+
+    const wgpu::BindGroupLayout& BindGroupLayout() const { return _bindGroupLayout; }
+    const wgpu::BindGroup& BindGroup() const;
+
+    // One u32 per material, the fragment shader raises it to the log2 texture resolution it would like to sample.
+    const wgpu::Buffer& FeedbackBuffer() const { return _feedbackBuffer; }
+
+private:
+    // Released pools keep their slot, without a texture, until a new pool takes it.
+    struct TexturePool
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t mipLevelCount;
+        wgpu::TextureFormat format;
+        wgpu::TextureFormat viewFormat;
+        uint32_t layerCount;
+        uint32_t layerCapacity;
+        std::vector<uint32_t> freeLayers;
+        wgpu::Texture texture;
+        wgpu::TextureView view;
+    };
+
+    TexturePool* FindOrCreatePool(uint32_t width, uint32_t height, uint32_t mipLevelCount, wgpu::TextureFormat format, wgpu::TextureFormat viewFormat);
+    bool AllocateLayer(TexturePool& pool, uint32_t& layer);
+    bool GrowPool(TexturePool& pool);
+    void CompactPool(uint32_t poolIndex);
+    void ReleasePool(uint32_t poolIndex);
+    // Untracks and destroys a pool texture once the current frame is done with it.
+    void RetirePoolTexture(const wgpu::Texture& texture);
+    void CreatePoolTexture(TexturePool& pool, uint32_t layerCapacity);
+    void CopyLayers(const wgpu::Texture& source, uint32_t sourceMip, uint32_t sourceLayer, const wgpu::Texture& destination, uint32_t destinationLayer, uint32_t layerCount) const;
+
+    const Renderer& _renderer;
+    uint32_t _maxLayers;
+    uint32_t _maxPools;
+
+    std::vector<TexturePool> _pools;
+    std::vector<Material> _materials;
+
+    wgpu::Buffer _materialBuffer;
+    wgpu::Buffer _feedbackBuffer;
+    wgpu::Sampler _sampler;
+    wgpu::Texture _emptyPoolTexture;
+    wgpu::TextureView _emptyPoolView;
+    wgpu::BindGroupLayout _bindGroupLayout;
+
+    mutable wgpu::BindGroup _bindGroup;
+    mutable bool _bindGroupDirty{ true };
+};
@@ -1,51 +1,42 @@
 #pragma once
 #include <webgpu/webgpu_cpp.h>
+#include <memory>
+#include <optional>
+#include <string>
 #include <vec3.hpp>
 
 #include "aliases.hpp"
+#include "material_system.hpp"
+#include "residency_manager.hpp"
 
 class Renderer;
 
-struct Material{
-    glm::vec3 albedoFactor;
-    float metallicFactor;
-    float roughnessFactor;
-    float aoFactor;
-    float normalFactor;
-    float emissiveFactor;
-};
-
 struct Mesh
 {
-    wgpu::Buffer vertBuf;
-    wgpu::Buffer indexBuf;
-    wgpu::IndexFormat indexFormat;
-    uint32_t indexCount;
-
-    wgpu::Buffer materialBuf;
-
-    wgpu::Sampler sampler;
-    wgpu::BindGroup bindGroup;
-
-    wgpu::Texture albedoTexture;
-    wgpu::TextureView albedoTextureView;
-
-    wgpu::Texture normalTexture;
-    wgpu::TextureView normalTextureView;
-
-    wgpu::Texture metallicTexture;
-    wgpu::TextureView metallicTextureView;
-
-    wgpu::Texture roughnessTexture;
-    wgpu::TextureView roughnessTextureView;
-
-    wgpu::Texture aoTexture;
-    wgpu::TextureView aoTextureView;
-
-    wgpu::Texture emissiveTexture;
-    wgpu::TextureView emissiveTextureView;
+    struct Buffers
+    {
+        wgpu::Buffer vertBuf;
+        wgpu::Buffer indexBuf;
+        wgpu::IndexFormat indexFormat;
+        uint32_t indexCount;
+    };
+
+    // Shared by every copy of the mesh, eviction releases them and Reload() creates them again.
+    std::shared_ptr<Buffers> buffers;
+
+    // Index into the material system, its textures live in the shared texture pools.
+    uint32_t materialIndex;
+    // MATERIAL_FEATURE bits, picks the shader variant the mesh is drawn with.
+    uint32_t materialFeatures;
+
+    // Where the geometry is read from again after an eviction.
+    std::string path;
+    uint32_t gltfMesh;
+    ResidencyManager::EvictionId evictionId;
 
     static std::optional<Mesh> CreateMesh(const std::string& path, Renderer& renderer);
+    // Creates the buffers of an evicted mesh again from its glTF.
+    bool Reload(Renderer& renderer) const;
 };
 
 
@@ -0,0 +1,71 @@
+#pragma once
+#include <webgpu/webgpu_cpp.h>
+#include <functional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Renderer;
+
+// Compiles render and compute pipelines asynchronously, keyed by a hash of their descriptor.
+// Callers keep the key and ask for the pipeline every time they need it, getting a fallback until it's ready.
+//
+// Pipeline variants that are built on demand are recorded by family and name in a warm-up manifest,
+// which is kept in the browser's local storage and compiled in the background at the next startup.
+class PipelineCache
+{
+public:
+    using WarmUpCallback = std::function<void(const std::string& variant)>;
+
+    PipelineCache(const Renderer& renderer);
+
+    // Starts compiling, unless the pipeline is already known. Returns the key to fetch it with.
+    uint64_t RequestRenderPipeline(const wgpu::RenderPipelineDescriptor& descriptor);
+    uint64_t RequestComputePipeline(const wgpu::ComputePipelineDescriptor& descriptor);
+
+    // Returns the fallback while the pipeline is still compiling, or if it failed to compile.
+    wgpu::RenderPipeline GetRenderPipeline(uint64_t key, const wgpu::RenderPipeline& fallback = nullptr) const;
+    wgpu::ComputePipeline GetComputePipeline(uint64_t key, const wgpu::ComputePipeline& fallback = nullptr) const;
+
+    // For work that can't be skipped. Returns the cached pipeline when it's ready and compiles it on the spot otherwise.
+    wgpu::RenderPipeline CreateRenderPipelineBlocking(const wgpu::RenderPipelineDescriptor& descriptor);
+    wgpu::ComputePipeline CreateComputePipelineBlocking(const wgpu::ComputePipelineDescriptor& descriptor);
+
+    // The callback builds and requests the variant by name, recorded variants of the family are warmed up through it.
+    void RegisterWarmUp(const std::string& family, WarmUpCallback warmUp);
+    void RecordVariant(const std::string& family, const std::string& variant);
+    // Requests every variant in the manifest, call once all families are registered.
+    void WarmUp();
+
+    uint32_t PendingCount() const { return _pendingCount; }
+
+private:
+    template <typename Pipeline>
+    struct Entry
+    {
+        Pipeline pipeline;
+        // The key holds their handles, so they have to stay alive as long as the entry.
+        wgpu::PipelineLayout layout;
+        std::vector<wgpu::ShaderModule> modules;
+    };
+
+    struct PendingPipeline
+    {
+        PipelineCache* cache;
+        uint64_t key;
+    };
+
+    void OnRenderPipelineCreated(PendingPipeline* pending, WGPUCreatePipelineAsyncStatus status, WGPURenderPipeline pipeline, const char* message);
+    void OnComputePipelineCreated(PendingPipeline* pending, WGPUCreatePipelineAsyncStatus status, WGPUComputePipeline pipeline, const char* message);
+    void SaveManifest() const;
+
+    const Renderer& _renderer;
+
+    std::unordered_map<uint64_t, Entry<wgpu::RenderPipeline>> _renderPipelines;
+    std::unordered_map<uint64_t, Entry<wgpu::ComputePipeline>> _computePipelines;
+    uint32_t _pendingCount{ 0 };
+
+    std::unordered_map<std::string, WarmUpCallback> _warmUps;
+    std::set<std::string> _manifest;
+};
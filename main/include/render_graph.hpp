@@ -0,0 +1,167 @@
+#pragma once
+#include <webgpu/webgpu_cpp.h>
+#include <glm.hpp>
+#include <functional>
+#include <string>
+#include <vector>
+
+class Renderer;
+
+// Handle to a texture declared in the graph, only valid until the graph is executed.
+using RenderGraphResource = uint32_t;
+constexpr RenderGraphResource INVALID_RENDER_GRAPH_RESOURCE{ ~0u };
+
+// Transient textures are sized relative to the extent the graph is executed with.
+struct RenderGraphTextureDesc
+{
+    const char* label{ nullptr };
+    wgpu::TextureFormat format{ wgpu::TextureFormat::Undefined };
+    uint32_t sampleCount{ 1 };
+    float scale{ 1.0f };
+    // Added to rendering to and sampling from the texture, which every transient texture allows.
+    wgpu::TextureUsage usage{ wgpu::TextureUsage::None };
+};
+
+// Rebuilt every frame from passes that declare which textures they read and write.
+// Executing it orders the passes so every texture is written before it's read, culls the passes nothing imported depends on,
+// picks the load and store ops of their attachments, and lets transient textures whose lifetimes don't overlap share one texture.
+// Transient textures are pooled by size, format and sample count across frames, so a steady frame doesn't create any.
+class RenderGraph
+{
+public:
+    // Declares what a pass uses, only while the pass is being added.
+    class Builder
+    {
+    public:
+        RenderGraphResource CreateTexture(const RenderGraphTextureDesc& desc);
+
+        // The first write of a texture in the frame clears it, later ones load it. Resolving counts as writing the resolve target.
+        void WriteColor(RenderGraphResource target, const wgpu::Color& clearValue = { 0.0, 0.0, 0.0, 1.0 }, RenderGraphResource resolveTarget = INVALID_RENDER_GRAPH_RESOURCE);
+        void WriteDepth(RenderGraphResource target, float clearValue = 1.0f);
+        // Written by compute work recorded through Context::Encoder(). Transient textures have to ask for storage usage.
+        void WriteStorage(RenderGraphResource target);
+        // Sampled by the pass through Context::View().
+        void Read(RenderGraphResource resource);
+        // Keeps the pass even when nothing reads what it writes.
+        void SideEffect();
+
+    private:
+        friend class RenderGraph;
+        Builder(RenderGraph& graph, uint32_t pass) : _graph(graph), _pass(pass) {}
+
+        RenderGraph& _graph;
+        uint32_t _pass;
+    };
+
+    class Context;
+
+    using SetupCallback = std::function<void(Builder&)>;
+    using ExecuteCallback = std::function<void(const Context&)>;
+
+    RenderGraph(const Renderer& renderer);
+    ~RenderGraph();
+
+    // Textures owned elsewhere, like the back buffer. They're outputs of the graph, so the passes writing them are never culled.
+    RenderGraphResource ImportTexture(const char* label, const wgpu::TextureView& view);
+    // The setup runs right away, the execution once the graph is executed, if the pass isn't culled.
+    void AddPass(const char* name, const SetupCallback& setup, ExecuteCallback execute);
+
+    // Records the passes that are left into the encoder, and empties the graph for the next frame.
+    void Execute(const wgpu::CommandEncoder& encoder, uint32_t width, uint32_t height);
+
+    uint32_t PassCount() const { return _passCount; }
+    uint32_t CulledPassCount() const { return _culledPassCount; }
+    uint32_t VirtualTextureCount() const { return _virtualTextureCount; }
+    uint32_t TransientTextureCount() const { return static_cast<uint32_t>(_textures.size()); }
+
+private:
+    struct Attachment
+    {
+        RenderGraphResource target;
+        RenderGraphResource resolveTarget;
+        wgpu::Color clearValue;
+        float depthClearValue;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        ExecuteCallback execute;
+        std::vector<RenderGraphResource> reads;
+        std::vector<RenderGraphResource> writes;
+        std::vector<Attachment> colors;
+        Attachment depth{ INVALID_RENDER_GRAPH_RESOURCE, INVALID_RENDER_GRAPH_RESOURCE };
+        bool sideEffect{ false };
+
+        // Filled in while compiling.
+        std::vector<wgpu::RenderPassColorAttachment> colorAttachments;
+        wgpu::RenderPassDepthStencilAttachment depthAttachment;
+    };
+
+    struct Resource
+    {
+        RenderGraphTextureDesc desc;
+        wgpu::TextureView view;
+        bool imported;
+        uint32_t width;
+        uint32_t height;
+        uint32_t firstUse;
+        uint32_t lastUse;
+    };
+
+    struct Texture
+    {
+        wgpu::Texture texture;
+        wgpu::TextureView view;
+        wgpu::TextureFormat format;
+        uint32_t sampleCount;
+        uint32_t width;
+        uint32_t height;
+        wgpu::TextureUsage usage;
+        // Graph extent the texture was sized for.
+        uint32_t extentWidth;
+        uint32_t extentHeight;
+        // Position of the last pass in this frame that uses it, so later textures can take it over.
+        uint32_t busyUntil;
+        uint64_t lastUsedFrame;
+    };
+
+    // Writers of each resource, in the order they were added.
+    std::vector<uint32_t> SortPasses(const std::vector<std::vector<uint32_t>>& writers) const;
+    void AllocateTextures(uint32_t width, uint32_t height);
+    void ResolveAttachments(const std::vector<uint32_t>& order);
+    void ReleaseUnusedTextures();
+
+    const Renderer& _renderer;
+
+    std::vector<Pass> _passes;
+    std::vector<Resource> _resources;
+    std::vector<Texture> _textures;
+
+    uint64_t _frame{ 0 };
+    uint32_t _width{ 0 };
+    uint32_t _height{ 0 };
+    uint32_t _passCount{ 0 };
+    uint32_t _culledPassCount{ 0 };
+    uint32_t _virtualTextureCount{ 0 };
+};
+
+// What a pass gets while it's recorded.
+class RenderGraph::Context
+{
+public:
+    const wgpu::CommandEncoder& Encoder() const { return _encoder; }
+    // Begins a render pass on the attachments the pass declared, with the load and store ops the graph picked.
+    wgpu::RenderPassEncoder BeginRenderPass(const char* label) const;
+    const wgpu::TextureView& View(RenderGraphResource resource) const;
+    // Size of a transient texture, after scaling.
+    glm::uvec2 Size(RenderGraphResource resource) const;
+
+private:
+    friend class RenderGraph;
+    Context(const RenderGraph& graph, const wgpu::CommandEncoder& encoder, const Pass& pass) : _graph(graph), _encoder(encoder), _pass(pass) {}
+
+    const RenderGraph& _graph;
+    const wgpu::CommandEncoder& _encoder;
+    const Pass& _pass;
+};
@@ -9,15 +9,42 @@
 #include "aliases.hpp"
 #include "camera.hpp"
 #include "mesh.hpp"
+#include "residency_manager.hpp"
 #include "transform.hpp"
+#include "uniform_block.hpp"
 
 constexpr uint32_t MAX_POINT_LIGHTS{ 4 };
 
+// From cheapest to most expensive. Everything but MSAA renders the scene with one sample.
+enum class AntiAliasing
+{
+    Off,
+    FXAA,   // Blurs along the edges of the tonemapped image.
+    SMAA,   // Blends across the edges of the tonemapped image by the shape of the lines they form.
+    MSAA4x,
+    TAA     // Renders the scene with one sample and a jittered projection, and accumulates the samples over frames.
+};
+
 class PBRPass;
 class HDRPass;
 class ImGuiPass;
 class SkyboxPass;
+class UpscalePass;
+class TAAPass;
+class PostAAPass;
+class BloomPass;
+class AutoExposurePass;
 class TextureLoader;
+class UploadManager;
+class UniformRing;
+class FrameScheduler;
+class RenderGraph;
+class DynamicResolution;
+class GpuObjectCache;
+class PipelineCache;
+class ShaderLibrary;
+class MaterialSystem;
+class TextureStreamer;
 class HDRIConversionPass;
 
 class Renderer
@@ -35,7 +62,7 @@ public:
     Renderer(DeviceResources deviceResources, GLFWwindow* window, int32_t width, int32_t height);
     ~Renderer();
 
-    void Render() const;
+    void Render();
     void Resize(int32_t width, int32_t height);
 
     void DrawMesh(const Mesh& mesh, const Transform& transform);
@@ -43,14 +70,19 @@ public:
 
     Camera& GetCamera() { return _camera; }
     Transform& GetCameraTransform() { return _cameraTransform; }
-    wgpu::Buffer CreateBuffer(const void* data, unsigned long size, wgpu::BufferUsage usage, const char* label) const;
+    wgpu::Buffer CreateBuffer(const void* data, unsigned long size, wgpu::BufferUsage usage, const char* label, ResidencyCategory category = ResidencyCategory::Buffers) const;
     wgpu::ShaderModule CreateShader(const std::string& path, const char* label = nullptr) const;
+    wgpu::ShaderModule CreateShaderFromSource(const std::string& source, const char* label = nullptr) const;
     const wgpu::Device& Device() const { return _device; }
     const wgpu::Queue& Queue() const { return _queue; }
-    const wgpu::TextureView HDRView() const { return _hdrView; }
-    const wgpu::TextureView MSAAView() const { return _msaaView; }
-    const wgpu::TextureFormat DEPTH_STENCIL_FORMAT{ wgpu::TextureFormat::Depth24Plus };
-    const wgpu::RenderPassDepthStencilAttachment& DepthStencilAttachment() const { return _depthStencilAttachment; }
+    const wgpu::TextureFormat DEPTH_STENCIL_FORMAT{ wgpu::TextureFormat::Depth32Float };
+    const wgpu::TextureFormat MOTION_VECTOR_FORMAT{ wgpu::TextureFormat::RG16Float };
+    // Takes effect with the next frame, the scene pipelines for the mode compile on first use.
+    void SetAntiAliasing(AntiAliasing antiAliasing);
+    AntiAliasing GetAntiAliasing() const { return _antiAliasing; }
+    // Pipelines drawing into the scene pass have to match these.
+    uint32_t SceneSampleCount() const { return _antiAliasing == AntiAliasing::MSAA4x ? 4 : 1; }
+    bool SceneMotionVectors() const { return _antiAliasing == AntiAliasing::TAA; }
     glm::mat4 BuildSRT(const Transform& transform) const; // TODO: Maybe move out of here.
     const wgpu::BindGroup CommonBindGroup() const { return _commonBindGroup; }
     const wgpu::BindGroupLayout CommonBindGroupLayout() const { return _commonBGLayout; }
@@ -59,8 +91,25 @@ public:
     const wgpu::SwapChain& SwapChain() const { return _swapChain; }
     GLFWwindow* Window() const { return _window; }
     const TextureLoader& GetTextureLoader() const { return *_textureLoader; }
+    ResidencyManager& GetResidencyManager() const { return *_residencyManager; }
+    GpuObjectCache& GetObjectCache() const { return *_objectCache; }
+    PipelineCache& GetPipelineCache() const { return *_pipelineCache; }
+    ShaderLibrary& GetShaderLibrary() const { return *_shaderLibrary; }
+    UploadManager& GetUploadManager() const { return *_uploadManager; }
+    UniformRing& GetUniformRing() const { return *_uniformRing; }
+    FrameScheduler& GetFrameScheduler() const { return *_frameScheduler; }
+    RenderGraph& GetRenderGraph() const { return *_renderGraph; }
+    DynamicResolution& GetDynamicResolution() const { return *_dynamicResolution; }
+    MaterialSystem& GetMaterialSystem() const { return *_materialSystem; }
+    TextureStreamer& GetTextureStreamer() const { return *_textureStreamer; }
 
     SkyboxPass& GetSkyboxPass() { return *_skyboxPass; }
+    HDRPass& GetHDRPass() { return *_hdrPass; }
+    UpscalePass& GetUpscalePass() { return *_upscalePass; }
+    TAAPass& GetTAAPass() { return *_taaPass; }
+    PostAAPass& GetPostAAPass() { return *_postAAPass; }
+    BloomPass& GetBloomPass() { return *_bloomPass; }
+    AutoExposurePass& GetAutoExposurePass() { return *_autoExposurePass; }
 
     struct PointLight
     {
@@ -70,68 +119,95 @@ public:
     };
 
 private:
-    void SetupRenderTarget();
+    void CreateSurface();
+    // Reconfigures everything that depends on the canvas size.
+    void ApplySize();
     void CreatePipelineAndBuffers();
 
+    // Destroyed last, everything else may untrack its resources on the way out.
+    std::unique_ptr<ResidencyManager> _residencyManager;
+    std::unique_ptr<GpuObjectCache> _objectCache;
+    std::unique_ptr<PipelineCache> _pipelineCache;
+    std::unique_ptr<ShaderLibrary> _shaderLibrary;
+
     std::unique_ptr<PBRPass> _pbrPass;
     std::unique_ptr<HDRPass> _hdrPass;
     std::unique_ptr<ImGuiPass> _imGuiPass;
     std::unique_ptr<SkyboxPass> _skyboxPass;
+    std::unique_ptr<UpscalePass> _upscalePass;
+    std::unique_ptr<TAAPass> _taaPass;
+    std::unique_ptr<PostAAPass> _postAAPass;
+    std::unique_ptr<BloomPass> _bloomPass;
+    std::unique_ptr<AutoExposurePass> _autoExposurePass;
 
     std::unique_ptr<TextureLoader> _textureLoader;
+    std::unique_ptr<UploadManager> _uploadManager;
+    std::unique_ptr<UniformRing> _uniformRing;
+    std::unique_ptr<MaterialSystem> _materialSystem;
+    std::unique_ptr<TextureStreamer> _textureStreamer;
+    std::unique_ptr<RenderGraph> _renderGraph;
+    std::unique_ptr<DynamicResolution> _dynamicResolution;
+    // Destroyed first, what's still deferred runs while everything it refers to is alive.
+    std::unique_ptr<FrameScheduler> _frameScheduler;
 
     wgpu::Adapter _adapter;
     wgpu::Instance _instance;
     wgpu::Device _device;
     wgpu::Queue _queue;
     GLFWwindow* _window;
+    wgpu::Surface _surface;
     wgpu::SwapChain _swapChain;
-    wgpu::Texture _msaaTarget;
-    wgpu::TextureView _msaaView;
-    wgpu::Texture _hdrTarget;
-    wgpu::TextureView _hdrView;
-    wgpu::Texture _depthTexture;
-    wgpu::TextureView _depthTextureView;
     wgpu::Texture _irradianceTexture;
     wgpu::TextureView _irradianceView;
 
-    wgpu::Buffer _commonBuf;
-    wgpu::RenderPassDepthStencilAttachment _depthStencilAttachment;
-
     wgpu::BindGroupLayout _commonBGLayout;
 
     wgpu::BindGroup _commonBindGroup;
 
     int32_t _width = 1280;
     int32_t _height = 720;
+    // Resize events only record the size, it's applied at the start of the next frame.
+    int32_t _pendingWidth = 1280;
+    int32_t _pendingHeight = 720;
 
     uint32_t _irradianceSize{ 32 };
 
     wgpu::TextureFormat _swapChainFormat{ wgpu::TextureFormat::BGRA8Unorm };  
+    AntiAliasing _antiAliasing{ AntiAliasing::MSAA4x };
 
     Camera _camera;
     Transform _cameraTransform;
 
 
-    struct Common
+    // Uniforms are split by how often they change, each block only uploads what changed since the last frame.
+    // Changes with the camera.
+    struct View
     {
         glm::mat4 proj;
         glm::mat4 view;
         glm::mat4 vp; 
+        glm::mat4 invVp;
+        // Without jitter, for motion vectors.
+        glm::mat4 unjitteredVp;
+        glm::mat4 previousVp;
+
+        glm::vec3 cameraPosition;
+        float _padding;
+    };
 
+    // Changes when lights are edited.
+    struct Lighting
+    {
         glm::vec3 lightDirection;
-        float time;
+        float normalMapStrength;
 
         glm::vec3 lightColor;
-        float normalMapStrength;
+        float _padding;
 
         std::array<PointLight, MAX_POINT_LIGHTS> pointLights;
-        
-        glm::vec3 cameraPosition;
-        float _padding;
     };
 
-
-    mutable Common _commonData;
+    UniformBlock<View> _view;
+    UniformBlock<Lighting> _lighting;
 
 };
@@ -0,0 +1,105 @@
+#pragma once
+#include <webgpu/webgpu_cpp.h>
+#include <array>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+enum class ResidencyCategory
+{
+    Buffers,
+    Meshes,
+    Staging,
+    Textures,
+    TexturePools,
+    RenderTargets,
+    Count
+};
+
+// Evictables are asked to free memory in this order, least recently used first.
+enum class EvictionPriority
+{
+    StreamedMips,
+    Meshes
+};
+
+enum class EvictionResult
+{
+    Shrunk,     // Freed some memory, but can be asked again.
+    Evicted,    // Freed everything, IsEvicted() reports it from now on.
+    Pinned      // Has nothing left to free.
+};
+
+// Keeps count of the GPU memory behind every tracked buffer and texture, and enforces a budget on it.
+// When the tracked total exceeds the budget at the end of a frame, evictables that haven't been touched
+// for a few frames are asked to free memory, so the renderer degrades in quality instead of running out of memory.
+class ResidencyManager
+{
+public:
+    using EvictionId = uint32_t;
+    using EvictCallback = std::function<EvictionResult()>;
+
+    ResidencyManager(uint64_t budget = 512ull * 1024 * 1024);
+
+    // Objects are tracked by handle and have to be untracked before their last reference is dropped.
+    void Track(const wgpu::Buffer& buffer, ResidencyCategory category);
+    void Track(const wgpu::Texture& texture, ResidencyCategory category);
+    void Untrack(const wgpu::Buffer& buffer);
+    void Untrack(const wgpu::Texture& texture);
+
+    // The callback frees memory by untracking or replacing the objects it owns.
+    EvictionId AddEvictable(EvictionPriority priority, EvictCallback evict);
+    void RemoveEvictable(EvictionId id);
+    // Marks the evictable as used this frame.
+    void Touch(EvictionId id);
+    bool IsEvicted(EvictionId id) const;
+    // For evictables that loaded what they freed again, they can be evicted anew.
+    void MarkResident(EvictionId id);
+
+    // Evicts until the budget is met again, or nothing is left to evict.
+    void EndFrame();
+
+    void SetBudget(uint64_t budget) { _budget = budget; }
+    uint64_t Budget() const { return _budget; }
+    bool OverBudget() const { return _totalBytes > _budget; }
+    uint64_t TotalBytes() const { return _totalBytes; }
+    uint64_t CategoryBytes(ResidencyCategory category) const { return _categoryBytes[static_cast<size_t>(category)]; }
+    uint64_t EvictionCount() const { return _evictionCount; }
+
+private:
+    struct Allocation
+    {
+        ResidencyCategory category;
+        uint64_t bytes;
+    };
+
+    enum class EvictableState
+    {
+        Resident,
+        Evicted,
+        Removed
+    };
+
+    struct Evictable
+    {
+        EvictionPriority priority;
+        EvictCallback evict;
+        uint64_t lastUsedFrame;
+        EvictableState state;
+    };
+
+    void Track(const void* handle, ResidencyCategory category, uint64_t bytes);
+    void Untrack(const void* handle);
+
+    uint64_t _budget;
+    uint64_t _totalBytes{ 0 };
+    std::array<uint64_t, static_cast<size_t>(ResidencyCategory::Count)> _categoryBytes{};
+    std::unordered_map<const void*, Allocation> _allocations;
+
+    std::vector<Evictable> _evictables;
+    std::vector<EvictionId> _freeEvictables;
+
+    uint64_t _frame{ 0 };
+    uint64_t _evictionCount{ 0 };
+    bool _reportedOverBudget{ false };
+};
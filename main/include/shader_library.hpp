@@ -0,0 +1,100 @@
+#pragma once
+#include <webgpu/webgpu_cpp.h>
+#include <glm.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// WGSL name, alignment and size of the C++ types that can be shared with shaders.
+template <typename T> struct WgslType;
+template <> struct WgslType<float>     { static constexpr const char* name = "f32";          static constexpr uint32_t align = 4;  static constexpr uint32_t size = 4; };
+template <> struct WgslType<int32_t>   { static constexpr const char* name = "i32";          static constexpr uint32_t align = 4;  static constexpr uint32_t size = 4; };
+template <> struct WgslType<uint32_t>  { static constexpr const char* name = "u32";          static constexpr uint32_t align = 4;  static constexpr uint32_t size = 4; };
+template <> struct WgslType<glm::vec2> { static constexpr const char* name = "vec2<f32>";    static constexpr uint32_t align = 8;  static constexpr uint32_t size = 8; };
+template <> struct WgslType<glm::vec3> { static constexpr const char* name = "vec3<f32>";    static constexpr uint32_t align = 16; static constexpr uint32_t size = 12; };
+template <> struct WgslType<glm::vec4> { static constexpr const char* name = "vec4<f32>";    static constexpr uint32_t align = 16; static constexpr uint32_t size = 16; };
+template <> struct WgslType<glm::mat4> { static constexpr const char* name = "mat4x4f";      static constexpr uint32_t align = 16; static constexpr uint32_t size = 64; };
+
+// Describes a C++ struct that's shared with shaders, and generates its WGSL declaration.
+// Fields are given with their C++ offset, which is checked against the WGSL layout rules. Padding members are left out.
+class ShaderStruct
+{
+public:
+    ShaderStruct(const std::string& name, size_t size);
+
+    template <typename T>
+    ShaderStruct& Field(const std::string& name, size_t offset, uint32_t count = 1)
+    {
+        return AddField(name, WgslType<T>::name, WgslType<T>::align, WgslType<T>::size, offset, count);
+    }
+
+    ShaderStruct& Field(const std::string& name, const ShaderStruct& type, size_t offset, uint32_t count = 1);
+
+    const std::string& Name() const { return _name; }
+    // Logs every field whose offset doesn't match, and the size if the C++ struct can't be used as an array element.
+    std::string Declaration() const;
+
+private:
+    struct Member
+    {
+        std::string name;
+        std::string type;
+        uint32_t count;
+        size_t offset;
+        size_t wgslOffset;
+    };
+
+    ShaderStruct& AddField(const std::string& name, const std::string& type, uint32_t align, uint32_t size, size_t offset, uint32_t count);
+    uint32_t WgslSize() const;
+
+    std::string _name;
+    size_t _size;
+    std::vector<Member> _members;
+    uint32_t _align{ 1 };
+    size_t _end{ 0 };
+};
+
+// Preprocesses WGSL and caches the resulting modules by a hash of their final source.
+// Supports #include "file", which pulls every file in once, #define NAME value with identifier substitution,
+// and #ifdef, #ifndef, #else and #endif. Includes are looked up among the generated files first, then next to the including file.
+class ShaderLibrary
+{
+public:
+    using Defines = std::vector<std::pair<std::string, std::string>>;
+
+    ShaderLibrary(const wgpu::Device& device);
+
+    // Adds a file that shaders can include by name, without it existing on disk.
+    void AddGeneratedFile(const std::string& name, const std::string& source);
+    // Generates the declarations of the structs into one includable file, in the given order.
+    void AddGeneratedStructs(const std::string& name, const std::vector<ShaderStruct>& structs);
+
+    wgpu::ShaderModule GetModule(const std::string& path, const Defines& defines = {}, const char* label = nullptr);
+    // Includes in the source are resolved relative to the shader directory.
+    wgpu::ShaderModule GetModuleFromSource(const std::string& source, const Defines& defines = {}, const char* label = nullptr);
+
+    std::string Preprocess(const std::string& source, const std::string& directory, const Defines& defines) const;
+
+    uint32_t ModuleCount() const { return static_cast<uint32_t>(_modules.size()); }
+    uint64_t CacheHits() const { return _cacheHits; }
+
+private:
+    struct PreprocessState
+    {
+        std::unordered_map<std::string, std::string> defines;
+        std::vector<std::string> included;
+    };
+
+    wgpu::ShaderModule CreateModule(const std::string& code, const char* label);
+    void PreprocessFile(const std::string& source, const std::string& directory, PreprocessState& state, std::string& output) const;
+    std::string LoadFile(const std::string& path) const;
+
+    wgpu::Device _device;
+
+    std::unordered_map<std::string, std::string> _generatedFiles;
+    // Source files are only read from disk once.
+    mutable std::unordered_map<std::string, std::string> _files;
+    // Modules by a hash of their preprocessed source, with the source to tell collisions apart.
+    std::unordered_map<uint64_t, std::pair<std::string, wgpu::ShaderModule>> _modules;
+    uint64_t _cacheHits{ 0 };
+};
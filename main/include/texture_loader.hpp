@@ -1,19 +1,67 @@
 #pragma once
 #include <webgpu/webgpu_cpp.h>
+#include <unordered_map>
 
 class Renderer;
 
+struct BlockInfo
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes;
+};
+
+BlockInfo GetBlockInfo(wgpu::TextureFormat format);
+
 class TextureLoader
 {
 public:
     TextureLoader(const Renderer& renderer);
 
+    // Loaded textures are tracked by the residency manager, whoever releases them has to untrack them.
     wgpu::Texture LoadTexture(const std::string& path, const char* label = nullptr) const;
+    // RGBA8UnormSrgb data is stored in an RGBA8Unorm texture with an sRGB view format,
+    // so views that should decode it have to ask for RGBA8UnormSrgb explicitly.
     wgpu::Texture LoadTexture(const std::vector<uint8_t>& data, uint32_t width, uint32_t height, wgpu::TextureFormat format, uint32_t mipLevels = 1, const char* label = nullptr) const;
 
+    // Fills every mip after the first, for all array layers. A dispatch writes up to six mips, fewer when the device
+    // limits storage textures further, and the chain is split after every odd sized level.
+    // Format is the one the texture is sampled as, and defaults to the texture's own format.
+    // Formats that can't be bound as storage textures fall back to one render pass per mip.
+    void GenerateMips(const wgpu::CommandEncoder& encoder, const wgpu::Texture& texture, wgpu::TextureFormat format = wgpu::TextureFormat::Undefined) const;
+
 private:
+    // The descriptors are kept so warmed up variants hash to the same pipeline once they're used.
+    struct MipPipeline
+    {
+        wgpu::BindGroupLayout bindGroupLayout;
+        wgpu::ComputePipelineDescriptor descriptor;
+        wgpu::ComputePipeline pipeline;
+    };
+
+    struct BlitPipeline
+    {
+        wgpu::BindGroupLayout bindGroupLayout;
+        wgpu::ColorTargetState colorTarget;
+        wgpu::FragmentState fragment;
+        wgpu::RenderPipelineDescriptor descriptor;
+        wgpu::RenderPipeline pipeline;
+    };
+
+    // Warming up only starts compiling in the background, otherwise the pipeline is ready when these return.
+    const MipPipeline& GetMipPipeline(wgpu::TextureFormat format, uint32_t mipCount, bool warmUp = false) const;
+    const BlitPipeline& GetBlitPipeline(wgpu::TextureFormat format, bool warmUp = false) const;
+    void GenerateMipsBlit(const wgpu::CommandEncoder& encoder, const wgpu::Texture& texture, wgpu::TextureFormat format) const;
+    wgpu::Texture LoadKTX2(const std::vector<uint8_t>& fileData, const char* label) const;
+    wgpu::Texture TranscodeBasis(const std::vector<uint8_t>& fileData, const char* label) const;
+    void WriteLevel(const wgpu::Texture& texture, wgpu::TextureFormat format, uint32_t level, uint32_t baseLayer, uint32_t layerCount, const uint8_t* data, size_t size) const;
+
     const Renderer& _renderer;
-    wgpu::BindGroupLayout _bgLayout;
-    wgpu::ComputePipeline _computePipeline;
+    std::string _mipShaderSource;
+    wgpu::ShaderModule _blitShader;
+    uint32_t _maxMipsPerDispatch;
+    // Keyed by format in the upper and mip count in the lower 32 bits.
+    mutable std::unordered_map<uint64_t, MipPipeline> _mipPipelines;
+    mutable std::unordered_map<wgpu::TextureFormat, BlitPipeline> _blitPipelines;
 
 };
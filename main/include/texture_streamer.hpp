@@ -0,0 +1,71 @@
+#pragma once
+#include <webgpu/webgpu_cpp.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "material_system.hpp"
+#include "residency_manager.hpp"
+
+class Renderer;
+
+// Keeps material textures at a low resolution until the GPU reports that a material is seen up close.
+// frag.wgsl writes the texture resolution every material needs into the material system's feedback buffer,
+// which is read back asynchronously, and finer mips are then built from the source image, read again on demand.
+// Textures are registered as evictables and give up their largest mip when GPU memory runs over budget.
+class TextureStreamer
+{
+public:
+    // Reads the full resolution source image again, the streamer doesn't keep it around.
+    using SourceLoader = std::function<std::vector<uint8_t>()>;
+
+    TextureStreamer(const Renderer& renderer);
+
+    // Uploads the texture with only its mips at or below the initial resolution resident,
+    // and assigns the resulting handle to the material. The data isn't retained, finer mips come from the loader.
+    void AddTexture(uint32_t materialIndex, MaterialTexture slot, const std::vector<uint8_t>& data, uint32_t width, uint32_t height, wgpu::TextureFormat format,
+                    const std::string& label, SourceLoader loadSource);
+
+    // Streams in textures requested by the last feedback that came back, as long as memory is within budget.
+    // Call before flushing uploads.
+    void Update();
+
+    // Copies and clears the feedback buffer, as long as the previous readback has been consumed.
+    void RecordFeedbackReadback(const wgpu::CommandEncoder& encoder);
+    // Maps the readback recorded this frame, call after the frame was submitted.
+    void RequestFeedback();
+
+private:
+    struct StreamedTexture
+    {
+        uint32_t materialIndex;
+        MaterialTexture slot;
+        SourceLoader loadSource;
+        uint32_t width;
+        uint32_t height;
+        wgpu::TextureFormat format;
+        std::string label;
+        uint32_t mipLevelCount;
+        uint32_t residentBaseMip;
+        ResidencyManager::EvictionId evictionId;
+    };
+
+    enum class ReadbackState
+    {
+        Idle,
+        Recorded,
+        Mapping,
+        Ready
+    };
+
+    void StreamIn(StreamedTexture& texture, const std::vector<uint8_t>& data, uint32_t baseMip);
+    EvictionResult StreamOut(StreamedTexture& texture);
+    void ReplaceHandle(const StreamedTexture& texture, uint32_t handle);
+
+    const Renderer& _renderer;
+    std::vector<StreamedTexture> _textures;
+
+    wgpu::Buffer _readbackBuffer;
+    ReadbackState _readbackState{ ReadbackState::Idle };
+    std::vector<uint32_t> _feedback;
+};
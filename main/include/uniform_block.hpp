@@ -0,0 +1,57 @@
+#pragma once
+#include <webgpu/webgpu_cpp.h>
+#include <algorithm>
+#include <cstring>
+
+// CPU copy of a uniform buffer that tracks which bytes changed, and uploads only that range when flushed.
+// Writes that don't change anything leave the block clean, so callers can set values every frame.
+template <typename T>
+class UniformBlock
+{
+public:
+    UniformBlock() = default;
+    UniformBlock(const wgpu::Buffer& buffer) : _buffer(buffer) {}
+
+    const wgpu::Buffer& Buffer() const { return _buffer; }
+    const T& Data() const { return _data; }
+    bool Dirty() const { return _dirtyBegin < _dirtyEnd; }
+
+    // The field has to be a member of Data().
+    template <typename Field>
+    void Set(const Field& field, const Field& value)
+    {
+        Write(reinterpret_cast<const uint8_t*>(&field) - reinterpret_cast<const uint8_t*>(&_data), &value, sizeof(Field));
+    }
+
+    void Write(size_t offset, const void* data, size_t size)
+    {
+        uint8_t* destination = reinterpret_cast<uint8_t*>(&_data) + offset;
+        if (memcmp(destination, data, size) == 0)
+            return;
+
+        memcpy(destination, data, size);
+        _dirtyBegin = std::min(_dirtyBegin, offset);
+        _dirtyEnd = std::max(_dirtyEnd, offset + size);
+    }
+
+    void Flush(const wgpu::Queue& queue)
+    {
+        if (!Dirty())
+            return;
+
+        // Queue writes have to start and end on four byte boundaries.
+        const size_t begin = _dirtyBegin & ~size_t{ 3 };
+        const size_t end = std::min((_dirtyEnd + 3) & ~size_t{ 3 }, sizeof(T));
+
+        queue.WriteBuffer(_buffer, begin, reinterpret_cast<const uint8_t*>(&_data) + begin, end - begin);
+        _dirtyBegin = sizeof(T);
+        _dirtyEnd = 0;
+    }
+
+private:
+    T _data{};
+    wgpu::Buffer _buffer;
+    // Starts out dirty, so the first flush uploads everything.
+    size_t _dirtyBegin{ 0 };
+    size_t _dirtyEnd{ sizeof(T) };
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <webgpu/webgpu_cpp.h>
+#include <vector>
+
+class Renderer;
+
+// Hands out suballocations of one uniform buffer for data that only lives for a frame, bound through dynamic offsets.
+// Allocations are written to a CPU copy and uploaded together on Flush(). A frame's range is recycled
+// once the frame scheduler reports the frame as done, so the ring never grows past its initial size.
+class UniformRing
+{
+public:
+    UniformRing(const Renderer& renderer, uint64_t size = 4 * 1024 * 1024);
+
+    // Copies the data into the ring and returns the dynamic offset to bind it at.
+    // Fails when the frames still in flight use up the whole ring, the caller should skip the work that needed it.
+    bool Allocate(const void* data, uint64_t size, uint32_t& offset);
+
+    template <typename T>
+    bool Allocate(const T& value, uint32_t& offset)
+    {
+        return Allocate(&value, sizeof(T), offset);
+    }
+
+    // Bind groups use this with the size of one allocation as their binding size.
+    const wgpu::Buffer& Buffer() const { return _buffer; }
+
+    // Uploads everything allocated since the last flush, has to happen before the work using it is submitted.
+    void Flush();
+    // Marks the end of the frame's allocations, which are freed once the frame has finished.
+    void EndFrame();
+
+    uint64_t Size() const { return _size; }
+    uint64_t UsedBytes() const { return _usedBytes; }
+
+private:
+    const Renderer& _renderer;
+    uint64_t _size;
+    uint32_t _alignment;
+
+    wgpu::Buffer _buffer;
+    std::vector<uint8_t> _data;
+
+    uint64_t _head{ 0 };
+    uint64_t _flushedHead{ 0 };
+    // Counts the bytes skipped when wrapping too, so it only drops back to zero once all frames are done.
+    uint64_t _usedBytes{ 0 };
+    uint64_t _frameBytes{ 0 };
+    bool _reportedFull{ false };
+};
@@ -0,0 +1,72 @@
+#pragma once
+#include <webgpu/webgpu_cpp.h>
+#include <vector>
+
+class Renderer;
+
+// Batches buffer and texture uploads into a single command encoder.
+// Data is copied into a ring of mapped staging buffers, which are unmapped and submitted together on Flush(),
+// and mapped again for reuse once the queue reports the batch as done.
+class UploadManager
+{
+public:
+    UploadManager(const Renderer& renderer, uint64_t stagingBufferSize = 16 * 1024 * 1024);
+
+    void UploadBuffer(const wgpu::Buffer& destination, uint64_t offset, const void* data, uint64_t size);
+
+    // bytesPerRow and rowsPerImage describe the tightly packed source data, in texel blocks for compressed formats.
+    // Rows are realigned to the 256 byte copy alignment while staging.
+    void UploadTexture(const wgpu::ImageCopyTexture& destination, const void* data, uint32_t bytesPerRow, uint32_t rowsPerImage, const wgpu::Extent3D& size);
+
+    // Work recorded here executes after every upload made before it, and before every upload made after it.
+    const wgpu::CommandEncoder& Encoder();
+
+    // Submits everything recorded since the last flush.
+    void Flush();
+
+    uint64_t SubmittedBatches() const { return _submittedBatches; }
+    uint64_t CompletedBatches() const { return _completedBatches; }
+
+private:
+    struct StagingBuffer
+    {
+        wgpu::Buffer buffer;
+        uint8_t* mapping;
+        uint64_t size;
+        uint64_t offset;
+    };
+
+    struct Allocation
+    {
+        wgpu::Buffer buffer;
+        uint8_t* mapping;
+        uint64_t offset;
+    };
+
+    struct Batch
+    {
+        UploadManager* manager;
+        std::vector<StagingBuffer> stagingBuffers;
+    };
+
+    struct PendingMap
+    {
+        UploadManager* manager;
+        StagingBuffer stagingBuffer;
+    };
+
+    Allocation Allocate(uint64_t size, uint64_t alignment);
+    StagingBuffer AcquireStagingBuffer(uint64_t size);
+    void OnBatchCompleted(Batch* batch);
+    void OnStagingBufferMapped(PendingMap* pendingMap, bool success);
+
+    const Renderer& _renderer;
+    uint64_t _stagingBufferSize;
+
+    wgpu::CommandEncoder _encoder;
+    std::vector<StagingBuffer> _recording;
+    std::vector<StagingBuffer> _available;
+
+    uint64_t _submittedBatches{ 0 };
+    uint64_t _completedBatches{ 0 };
+};
@@ -1,5 +1,12 @@
 #pragma once
 
+#include <charconv>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
 #include "aliases.hpp"
 
 inline uint32_t ceilToNextMultiple(uint32_t value, uint32_t step)
@@ -8,7 +15,7 @@ inline uint32_t ceilToNextMultiple(uint32_t value, uint32_t step)
     return step * divide_and_ceil;
 }
 
-inline uint32_t bitWidth(uint32_t value)
+constexpr uint32_t bitWidth(uint32_t value)
 {
     if(value == 0)
         return 0;
@@ -21,6 +28,14 @@ inline uint32_t bitWidth(uint32_t value)
     }
 }
 
+// Parses the whole text as an unsigned number, fails on anything else instead of throwing.
+inline bool parseUint32(std::string_view text, uint32_t& value)
+{
+    const char* end = text.data() + text.size();
+    const auto [last, error] = std::from_chars(text.data(), end, value);
+    return error == std::errc{} && last == end;
+}
+
 inline uint16_t float32ToFloat16(float value)
 {
     uint32_t f32 = *reinterpret_cast<uint32_t*>(&value);
@@ -62,3 +77,15 @@ inline std::vector<uint16_t> convertFloat32ToFloat16(const std::vector<float>& b
     }
     return result;
 }
+
+inline std::string readTextFile(const std::string& path)
+{
+    std::ifstream file{};
+    file.open(path);
+    file.seekg(0, std::ios::end);
+    size_t size = file.tellg();
+    std::string source(size, ' ');
+    file.seekg(0);
+    file.read(source.data(), size);
+    return source;
+}
@@ -0,0 +1,51 @@
+#include "dynamic_resolution.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Weight of the newest frame in the smoothed GPU time.
+constexpr float SMOOTHING{ 0.1f };
+constexpr float SCALE_STEP{ 0.05f };
+// Frames to wait after a change, until the smoothed time reflects the new resolution.
+constexpr uint32_t COOLDOWN_FRAMES{ 30 };
+// Scaling up needs this much headroom, so the scale doesn't oscillate around the budget.
+constexpr float UPSCALE_HEADROOM{ 0.85f };
+
+DynamicResolution::DynamicResolution(float budgetMs, float minScale, float maxScale) :
+    _budgetMs(budgetMs),
+    _minScale(minScale),
+    _maxScale(maxScale),
+    _scale(maxScale)
+{
+}
+
+void DynamicResolution::Update(float gpuFrameMs)
+{
+    if (gpuFrameMs <= 0.0f)
+        return;
+
+    _smoothedMs = _smoothedMs == 0.0f ? gpuFrameMs : _smoothedMs + (gpuFrameMs - _smoothedMs) * SMOOTHING;
+
+    if (!_enabled)
+    {
+        _scale = _maxScale;
+        return;
+    }
+
+    if (_cooldown > 0)
+    {
+        --_cooldown;
+        return;
+    }
+
+    // The scene's cost goes with its pixel count, so the scale goes with the square root of the time ratio.
+    const float target = std::clamp(_scale * std::sqrt(_budgetMs / _smoothedMs), _minScale, _maxScale);
+    const float quantized = std::clamp(std::round(target / SCALE_STEP) * SCALE_STEP, _minScale, _maxScale);
+
+    const bool down = quantized < _scale;
+    const bool up = quantized > _scale && _smoothedMs < _budgetMs * UPSCALE_HEADROOM;
+    if (down || up)
+    {
+        _scale = quantized;
+        _cooldown = COOLDOWN_FRAMES;
+    }
+}
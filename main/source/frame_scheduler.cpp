@@ -0,0 +1,74 @@
+#include "frame_scheduler.hpp"
+#include <algorithm>
+#include <iostream>
+#include "enum_util.hpp"
+
+FrameScheduler::FrameScheduler(const wgpu::Queue& queue) : _queue(queue)
+{
+}
+
+FrameScheduler::~FrameScheduler()
+{
+    // Nothing is rendered anymore, so whatever is left doesn't have to wait.
+    for (Deferred& deferred : _deferred)
+    {
+        deferred.callback();
+    }
+}
+
+bool FrameScheduler::BeginFrame()
+{
+    return FramesInFlight() < MAX_FRAMES_IN_FLIGHT;
+}
+
+void FrameScheduler::EndFrame()
+{
+    _queue.OnSubmittedWorkDone([](WGPUQueueWorkDoneStatus status, void* userdata)
+                               {
+                                   Fence* fence = reinterpret_cast<Fence*>(userdata);
+                                   if (status != WGPUQueueWorkDoneStatus_Success)
+                                       std::cout << "Frame " << fence->frameNumber << " finished with status: " << conv_enum_str<wgpu::QueueWorkDoneStatus>(status) << std::endl;
+
+                                   fence->scheduler->OnFrameCompleted(*fence);
+                                   delete fence;
+                               }, new Fence{ this, _frameNumber, Clock::now() });
+
+    ++_frameNumber;
+}
+
+void FrameScheduler::Defer(std::function<void()> callback)
+{
+    _deferred.push_back({ _frameNumber, std::move(callback) });
+}
+
+void FrameScheduler::DeferDestroy(const wgpu::Buffer& buffer)
+{
+    if (buffer)
+        Defer([buffer]() { buffer.Destroy(); });
+}
+
+void FrameScheduler::DeferDestroy(const wgpu::Texture& texture)
+{
+    if (texture)
+        Defer([texture]() { texture.Destroy(); });
+}
+
+void FrameScheduler::OnFrameCompleted(const Fence& fence)
+{
+    const uint64_t frameNumber = fence.frameNumber;
+
+    // The queue finishes work in submission order, so frames complete in order too.
+    _completedFrames = frameNumber + 1;
+
+    const Clock::time_point now = Clock::now();
+    _lastFrameGpuMs = std::chrono::duration<float, std::milli>(now - std::max(fence.submitTime, _lastCompletionTime)).count();
+    _lastCompletionTime = now;
+
+    // Callbacks may defer more work, which lands behind them with the frame being recorded.
+    while (!_deferred.empty() && _deferred.front().frameNumber <= frameNumber)
+    {
+        std::function<void()> callback = std::move(_deferred.front().callback);
+        _deferred.pop_front();
+        callback();
+    }
+}
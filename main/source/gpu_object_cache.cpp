@@ -0,0 +1,195 @@
+#include "gpu_object_cache.hpp"
+#include <cstring>
+
+// Bind groups that go unused for this many frames are released.
+constexpr uint64_t BIND_GROUP_LIFETIME_FRAMES{ 120 };
+
+uint64_t FloatBits(float value)
+{
+    uint32_t bits{};
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+template <typename T>
+uint64_t HandleBits(const T& object)
+{
+    return reinterpret_cast<uint64_t>(object.Get());
+}
+
+size_t GpuObjectCache::KeyHash::operator()(const Key& key) const
+{
+    // FNV-1a over the words.
+    uint64_t hash{ 14695981039346656037ull };
+    for (uint64_t word : key)
+    {
+        hash ^= word;
+        hash *= 1099511628211ull;
+    }
+
+    return static_cast<size_t>(hash);
+}
+
+GpuObjectCache::GpuObjectCache(const wgpu::Device& device) : _device(device)
+{
+}
+
+wgpu::Sampler GpuObjectCache::GetSampler(const wgpu::SamplerDescriptor& descriptor)
+{
+    // Chained structs can't be hashed without knowing them.
+    if (descriptor.nextInChain)
+    {
+        Count(GpuObjectType::Sampler, false);
+        return _device.CreateSampler(&descriptor);
+    }
+
+    const Key key{
+        static_cast<uint64_t>(descriptor.addressModeU),
+        static_cast<uint64_t>(descriptor.addressModeV),
+        static_cast<uint64_t>(descriptor.addressModeW),
+        static_cast<uint64_t>(descriptor.magFilter),
+        static_cast<uint64_t>(descriptor.minFilter),
+        static_cast<uint64_t>(descriptor.mipmapFilter),
+        FloatBits(descriptor.lodMinClamp),
+        FloatBits(descriptor.lodMaxClamp),
+        static_cast<uint64_t>(descriptor.compare),
+        descriptor.maxAnisotropy
+    };
+
+    auto it = _samplers.find(key);
+    Count(GpuObjectType::Sampler, it != _samplers.end());
+    if (it != _samplers.end())
+        return it->second;
+
+    wgpu::Sampler sampler = _device.CreateSampler(&descriptor);
+    _samplers.emplace(key, sampler);
+    return sampler;
+}
+
+wgpu::BindGroupLayout GpuObjectCache::GetBindGroupLayout(const wgpu::BindGroupLayoutDescriptor& descriptor)
+{
+    Key key{ descriptor.entryCount };
+    bool hashable = descriptor.nextInChain == nullptr;
+
+    for (size_t i = 0; i < descriptor.entryCount; ++i)
+    {
+        const wgpu::BindGroupLayoutEntry& entry = descriptor.entries[i];
+        hashable &= entry.nextInChain == nullptr;
+
+        key.insert(key.end(), {
+            entry.binding,
+            static_cast<uint64_t>(entry.visibility),
+            static_cast<uint64_t>(entry.buffer.type),
+            entry.buffer.hasDynamicOffset,
+            entry.buffer.minBindingSize,
+            static_cast<uint64_t>(entry.sampler.type),
+            static_cast<uint64_t>(entry.texture.sampleType),
+            static_cast<uint64_t>(entry.texture.viewDimension),
+            entry.texture.multisampled,
+            static_cast<uint64_t>(entry.storageTexture.access),
+            static_cast<uint64_t>(entry.storageTexture.format),
+            static_cast<uint64_t>(entry.storageTexture.viewDimension)
+        });
+    }
+
+    if (!hashable)
+    {
+        Count(GpuObjectType::BindGroupLayout, false);
+        return _device.CreateBindGroupLayout(&descriptor);
+    }
+
+    auto it = _bindGroupLayouts.find(key);
+    Count(GpuObjectType::BindGroupLayout, it != _bindGroupLayouts.end());
+    if (it != _bindGroupLayouts.end())
+        return it->second;
+
+    wgpu::BindGroupLayout bindGroupLayout = _device.CreateBindGroupLayout(&descriptor);
+    _bindGroupLayouts.emplace(key, bindGroupLayout);
+    return bindGroupLayout;
+}
+
+wgpu::PipelineLayout GpuObjectCache::GetPipelineLayout(const wgpu::PipelineLayoutDescriptor& descriptor)
+{
+    if (descriptor.nextInChain)
+    {
+        Count(GpuObjectType::PipelineLayout, false);
+        return _device.CreatePipelineLayout(&descriptor);
+    }
+
+    Key key{ descriptor.bindGroupLayoutCount };
+    for (size_t i = 0; i < descriptor.bindGroupLayoutCount; ++i)
+    {
+        key.push_back(HandleBits(descriptor.bindGroupLayouts[i]));
+    }
+
+    auto it = _pipelineLayouts.find(key);
+    Count(GpuObjectType::PipelineLayout, it != _pipelineLayouts.end());
+    if (it != _pipelineLayouts.end())
+        return it->second;
+
+    // Holding the layout keeps the bind group layouts it was hashed with alive.
+    wgpu::PipelineLayout pipelineLayout = _device.CreatePipelineLayout(&descriptor);
+    _pipelineLayouts.emplace(key, pipelineLayout);
+    return pipelineLayout;
+}
+
+wgpu::BindGroup GpuObjectCache::GetBindGroup(const wgpu::BindGroupDescriptor& descriptor)
+{
+    Key key{ HandleBits(descriptor.layout), descriptor.entryCount };
+    bool hashable = descriptor.nextInChain == nullptr;
+
+    for (size_t i = 0; i < descriptor.entryCount; ++i)
+    {
+        const wgpu::BindGroupEntry& entry = descriptor.entries[i];
+        hashable &= entry.nextInChain == nullptr;
+
+        key.insert(key.end(), {
+            entry.binding,
+            HandleBits(entry.buffer),
+            entry.offset,
+            entry.size,
+            HandleBits(entry.sampler),
+            HandleBits(entry.textureView)
+        });
+    }
+
+    if (!hashable)
+    {
+        Count(GpuObjectType::BindGroup, false);
+        return _device.CreateBindGroup(&descriptor);
+    }
+
+    auto it = _bindGroups.find(key);
+    Count(GpuObjectType::BindGroup, it != _bindGroups.end());
+    if (it != _bindGroups.end())
+    {
+        it->second.lastUsedFrame = _frame;
+        return it->second.bindGroup;
+    }
+
+    wgpu::BindGroup bindGroup = _device.CreateBindGroup(&descriptor);
+    _bindGroups.emplace(key, CachedBindGroup{ bindGroup, _frame });
+    return bindGroup;
+}
+
+void GpuObjectCache::EndFrame()
+{
+    ++_frame;
+
+    for (auto it = _bindGroups.begin(); it != _bindGroups.end();)
+    {
+        if (it->second.lastUsedFrame + BIND_GROUP_LIFETIME_FRAMES < _frame)
+            it = _bindGroups.erase(it);
+        else
+            ++it;
+    }
+}
+
+void GpuObjectCache::Count(GpuObjectType type, bool hit)
+{
+    Stats& stats = _stats[static_cast<size_t>(type)];
+    if (hit)
+        ++stats.hits;
+    else
+        ++stats.misses;
+}
@@ -0,0 +1,157 @@
+#include "graphics/auto_exposure_pass.hpp"
+#include "renderer.hpp"
+#include "pipeline_cache.hpp"
+#include "gpu_object_cache.hpp"
+#include "shader_library.hpp"
+#include "uniform_ring.hpp"
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <string>
+
+// Has to match the histogram workgroup in auto-exposure.wgsl, which has one invocation per bin.
+constexpr uint32_t HISTOGRAM_WORKGROUP_SIZE{ 16 };
+static_assert(HISTOGRAM_WORKGROUP_SIZE * HISTOGRAM_WORKGROUP_SIZE == AutoExposurePass::HISTOGRAM_BINS);
+
+AutoExposurePass::AutoExposurePass(Renderer& renderer) : RenderPass(renderer, wgpu::TextureFormat::Undefined)
+{
+    ShaderStruct exposureStruct{ "Exposure", sizeof(Exposure) };
+    exposureStruct.Field<float>("exposure", offsetof(Exposure, exposure))
+                  .Field<float>("luminance", offsetof(Exposure, luminance));
+    ShaderStruct paramsStruct{ "AutoExposureParams", sizeof(Params) };
+    paramsStruct.Field<float>("minLogLuminance", offsetof(Params, minLogLuminance))
+                .Field<float>("inverseLogLuminanceRange", offsetof(Params, inverseLogLuminanceRange))
+                .Field<float>("adaptation", offsetof(Params, adaptation))
+                .Field<uint32_t>("pixelCount", offsetof(Params, pixelCount));
+    _renderer.GetShaderLibrary().AddGeneratedStructs("generated/exposure.wgsl", { exposureStruct, paramsStruct });
+    _renderer.GetShaderLibrary().AddGeneratedFile("generated/exposure-constants.wgsl",
+                                                  "const HISTOGRAM_BINS: u32 = " + std::to_string(HISTOGRAM_BINS) + "u;\n");
+
+    _histogramBuffer = _renderer.CreateBuffer(nullptr, HISTOGRAM_BINS * sizeof(uint32_t), wgpu::BufferUsage::Storage, "Luminance histogram buffer");
+    const Exposure exposure{};
+    _exposureBuffer = _renderer.CreateBuffer(&exposure, sizeof(Exposure), wgpu::BufferUsage::Storage, "Exposure buffer");
+
+    std::array<wgpu::BindGroupLayoutEntry, 4> bgLayoutEntries{};
+    bgLayoutEntries[0].binding = 0;
+    bgLayoutEntries[0].visibility = wgpu::ShaderStage::Compute;
+    bgLayoutEntries[0].texture.sampleType = wgpu::TextureSampleType::Float;
+    bgLayoutEntries[0].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+    bgLayoutEntries[1].binding = 1;
+    bgLayoutEntries[1].visibility = wgpu::ShaderStage::Compute;
+    bgLayoutEntries[1].buffer.type = wgpu::BufferBindingType::Storage;
+    bgLayoutEntries[1].buffer.minBindingSize = HISTOGRAM_BINS * sizeof(uint32_t);
+    bgLayoutEntries[2].binding = 2;
+    bgLayoutEntries[2].visibility = wgpu::ShaderStage::Compute;
+    bgLayoutEntries[2].buffer.type = wgpu::BufferBindingType::Storage;
+    bgLayoutEntries[2].buffer.minBindingSize = sizeof(Exposure);
+    bgLayoutEntries[3].binding = 3;
+    bgLayoutEntries[3].visibility = wgpu::ShaderStage::Compute;
+    bgLayoutEntries[3].buffer.type = wgpu::BufferBindingType::Uniform;
+    bgLayoutEntries[3].buffer.minBindingSize = sizeof(Params);
+    bgLayoutEntries[3].buffer.hasDynamicOffset = true;
+
+    wgpu::BindGroupLayoutDescriptor bgLayoutDesc{};
+    bgLayoutDesc.label = "Auto exposure bind group layout";
+    bgLayoutDesc.entryCount = bgLayoutEntries.size();
+    bgLayoutDesc.entries = bgLayoutEntries.data();
+    _bindGroupLayout = _renderer.GetObjectCache().GetBindGroupLayout(bgLayoutDesc);
+
+    wgpu::PipelineLayoutDescriptor pipelineLayoutDesc{};
+    pipelineLayoutDesc.label = "Auto exposure pipeline layout";
+    pipelineLayoutDesc.bindGroupLayoutCount = 1;
+    pipelineLayoutDesc.bindGroupLayouts = &_bindGroupLayout;
+
+    wgpu::ComputePipelineDescriptor pipelineDesc{};
+    pipelineDesc.layout = _renderer.GetObjectCache().GetPipelineLayout(pipelineLayoutDesc);
+    pipelineDesc.compute.module = _renderer.CreateShader("assets/shaders/auto-exposure.wgsl", "Auto exposure shader");
+
+    pipelineDesc.label = "Luminance histogram pipeline";
+    pipelineDesc.compute.entryPoint = "cs_histogram";
+    _histogramKey = _renderer.GetPipelineCache().RequestComputePipeline(pipelineDesc);
+
+    pipelineDesc.label = "Exposure adaptation pipeline";
+    pipelineDesc.compute.entryPoint = "cs_average";
+    _averageKey = _renderer.GetPipelineCache().RequestComputePipeline(pipelineDesc);
+}
+
+AutoExposurePass::~AutoExposurePass()
+{
+}
+
+void AutoExposurePass::SetEnabled(bool enabled)
+{
+    if (enabled == _enabled)
+        return;
+
+    _enabled = enabled;
+    if (!_enabled)
+    {
+        const Exposure exposure{};
+        _renderer.Queue().WriteBuffer(_exposureBuffer, 0, &exposure, sizeof(Exposure));
+    }
+    else
+    {
+        // Render() wasn't called while disabled, so the time since then would adapt all the way in one frame.
+        _frameTimer.reset();
+        _frameTimer.start();
+    }
+}
+
+void AutoExposurePass::Render(const wgpu::CommandEncoder& encoder, const wgpu::TextureView& hdr, const glm::uvec2& size)
+{
+    // Adapts by the time since the last frame, so the speed doesn't depend on the frame rate. The first frame doesn't adapt.
+    const float deltaTime = static_cast<float>(_frameTimer.elapsedSeconds());
+    _frameTimer.reset();
+    _frameTimer.start();
+
+    wgpu::ComputePipeline histogram = _renderer.GetPipelineCache().GetComputePipeline(_histogramKey);
+    wgpu::ComputePipeline average = _renderer.GetPipelineCache().GetComputePipeline(_averageKey);
+    if (!histogram || !average)
+        return;
+
+    // The graph usually hands out the same texture every frame.
+    if (hdr.Get() != _hdr.Get())
+    {
+        std::array<wgpu::BindGroupEntry, 4> bgEntries{};
+        bgEntries[0].binding = 0;
+        bgEntries[0].textureView = hdr;
+        bgEntries[1].binding = 1;
+        bgEntries[1].buffer = _histogramBuffer;
+        bgEntries[1].size = HISTOGRAM_BINS * sizeof(uint32_t);
+        bgEntries[2].binding = 2;
+        bgEntries[2].buffer = _exposureBuffer;
+        bgEntries[2].size = sizeof(Exposure);
+        bgEntries[3].binding = 3;
+        bgEntries[3].buffer = _renderer.GetUniformRing().Buffer();
+        bgEntries[3].size = sizeof(Params);
+
+        wgpu::BindGroupDescriptor bgDesc{};
+        bgDesc.label = "Auto exposure bind group";
+        bgDesc.layout = _bindGroupLayout;
+        bgDesc.entryCount = bgEntries.size();
+        bgDesc.entries = bgEntries.data();
+
+        _bindGroup = _renderer.Device().CreateBindGroup(&bgDesc);
+        _hdr = hdr;
+    }
+
+    const Params params{ HISTOGRAM_MIN_EV, 1.0f / (HISTOGRAM_MAX_EV - HISTOGRAM_MIN_EV), 1.0f - std::exp(-deltaTime * _adaptationSpeed), size.x * size.y };
+    uint32_t dynamicOffset{};
+    if (!_renderer.GetUniformRing().Allocate(params, dynamicOffset))
+        return;
+
+    wgpu::ComputePassDescriptor computePassDesc{};
+    computePassDesc.label = "Auto exposure compute pass";
+    wgpu::ComputePassEncoder computePass = encoder.BeginComputePass(&computePassDesc);
+    computePass.SetBindGroup(0, _bindGroup, 1, &dynamicOffset);
+
+    computePass.SetPipeline(histogram);
+    const glm::uvec2 workgroups = (size + HISTOGRAM_WORKGROUP_SIZE - 1u) / HISTOGRAM_WORKGROUP_SIZE;
+    computePass.DispatchWorkgroups(workgroups.x, workgroups.y, 1);
+
+    // Also clears the histogram for the next frame.
+    computePass.SetPipeline(average);
+    computePass.DispatchWorkgroups(1, 1, 1);
+
+    computePass.End();
+}
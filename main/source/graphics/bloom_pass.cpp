@@ -0,0 +1,231 @@
+#include "graphics/bloom_pass.hpp"
+#include "renderer.hpp"
+#include "frame_scheduler.hpp"
+#include "pipeline_cache.hpp"
+#include "gpu_object_cache.hpp"
+#include <algorithm>
+
+constexpr uint32_t BLOOM_MAX_MIPS{ 6 };
+// Has to match the workgroup size in bloom.wgsl.
+constexpr uint32_t BLOOM_WORKGROUP_SIZE{ 8 };
+
+BloomPass::BloomPass(Renderer& renderer) : RenderPass(renderer, wgpu::TextureFormat::RGBA16Float)
+{
+    std::array<wgpu::BindGroupLayoutEntry, 4> bgLayoutEntries{};
+    bgLayoutEntries[0].binding = 0;
+    bgLayoutEntries[0].visibility = wgpu::ShaderStage::Compute;
+    bgLayoutEntries[0].texture.sampleType = wgpu::TextureSampleType::Float;
+    bgLayoutEntries[0].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+    bgLayoutEntries[1].binding = 1;
+    bgLayoutEntries[1].visibility = wgpu::ShaderStage::Compute;
+    bgLayoutEntries[1].texture.sampleType = wgpu::TextureSampleType::Float;
+    bgLayoutEntries[1].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+    bgLayoutEntries[2].binding = 2;
+    bgLayoutEntries[2].visibility = wgpu::ShaderStage::Compute;
+    bgLayoutEntries[2].storageTexture.access = wgpu::StorageTextureAccess::WriteOnly;
+    bgLayoutEntries[2].storageTexture.format = _renderFormat;
+    bgLayoutEntries[2].storageTexture.viewDimension = wgpu::TextureViewDimension::e2D;
+    bgLayoutEntries[3].binding = 3;
+    bgLayoutEntries[3].visibility = wgpu::ShaderStage::Compute;
+    bgLayoutEntries[3].sampler.type = wgpu::SamplerBindingType::Filtering;
+
+    wgpu::BindGroupLayoutDescriptor bgLayoutDesc{};
+    bgLayoutDesc.label = "Bloom bind group layout";
+    bgLayoutDesc.entryCount = bgLayoutEntries.size();
+    bgLayoutDesc.entries = bgLayoutEntries.data();
+    _bindGroupLayout = _renderer.GetObjectCache().GetBindGroupLayout(bgLayoutDesc);
+
+    wgpu::PipelineLayoutDescriptor pipelineLayoutDesc{};
+    pipelineLayoutDesc.label = "Bloom pipeline layout";
+    pipelineLayoutDesc.bindGroupLayoutCount = 1;
+    pipelineLayoutDesc.bindGroupLayouts = &_bindGroupLayout;
+    wgpu::PipelineLayout pipelineLayout = _renderer.GetObjectCache().GetPipelineLayout(pipelineLayoutDesc);
+
+    wgpu::SamplerDescriptor samplerDesc{};
+    samplerDesc.label = "Bloom sampler";
+    samplerDesc.addressModeU = wgpu::AddressMode::ClampToEdge;
+    samplerDesc.addressModeV = wgpu::AddressMode::ClampToEdge;
+    samplerDesc.addressModeW = wgpu::AddressMode::ClampToEdge;
+    samplerDesc.minFilter = wgpu::FilterMode::Linear;
+    samplerDesc.magFilter = wgpu::FilterMode::Linear;
+    samplerDesc.mipmapFilter = wgpu::MipmapFilterMode::Nearest;
+    _sampler = _renderer.GetObjectCache().GetSampler(samplerDesc);
+
+    wgpu::ShaderModule shader = _renderer.CreateShader("assets/shaders/bloom.wgsl", "Bloom shader");
+
+    wgpu::ComputePipelineDescriptor pipelineDesc{};
+    pipelineDesc.layout = pipelineLayout;
+    pipelineDesc.compute.module = shader;
+
+    pipelineDesc.label = "Bloom first downsample pipeline";
+    pipelineDesc.compute.entryPoint = "cs_downsample_first";
+    _downsampleFirstKey = _renderer.GetPipelineCache().RequestComputePipeline(pipelineDesc);
+
+    pipelineDesc.label = "Bloom downsample pipeline";
+    pipelineDesc.compute.entryPoint = "cs_downsample";
+    _downsampleKey = _renderer.GetPipelineCache().RequestComputePipeline(pipelineDesc);
+
+    pipelineDesc.label = "Bloom upsample pipeline";
+    pipelineDesc.compute.entryPoint = "cs_upsample";
+    _upsampleKey = _renderer.GetPipelineCache().RequestComputePipeline(pipelineDesc);
+}
+
+BloomPass::~BloomPass()
+{
+    ReleaseChain();
+}
+
+void BloomPass::BeginFrame(const glm::uvec2& size)
+{
+    if (size != _size)
+        CreateChain(size);
+}
+
+void BloomPass::ReleaseChain()
+{
+    // Frames in flight may still read the old chain.
+    for (const wgpu::Texture& texture : { _downTexture, _upTexture })
+    {
+        if (!texture)
+            continue;
+
+        _renderer.GetResidencyManager().Untrack(texture);
+        _renderer.GetFrameScheduler().DeferDestroy(texture);
+    }
+
+    _downTexture = nullptr;
+    _upTexture = nullptr;
+    _downViews.clear();
+    _upViews.clear();
+    _mipSizes.clear();
+    _downBindGroups.clear();
+    _upBindGroups.clear();
+    _input = nullptr;
+}
+
+void BloomPass::CreateChain(const glm::uvec2& size)
+{
+    ReleaseChain();
+    _size = size;
+
+    // Stops before the smallest level gets under a few texels, where it would only add a flat tint.
+    const glm::uvec2 baseSize = glm::max(size / 2u, glm::uvec2{ 1 });
+    uint32_t mipCount{ 1 };
+    while (mipCount < BLOOM_MAX_MIPS && std::min(baseSize.x, baseSize.y) >> mipCount >= 4)
+        ++mipCount;
+
+    wgpu::TextureDescriptor textureDesc{};
+    textureDesc.dimension = wgpu::TextureDimension::e2D;
+    textureDesc.size = { baseSize.x, baseSize.y, 1 };
+    textureDesc.format = _renderFormat;
+    textureDesc.sampleCount = 1;
+    textureDesc.usage = wgpu::TextureUsage::StorageBinding | wgpu::TextureUsage::TextureBinding;
+
+    textureDesc.label = "Bloom downsample chain";
+    textureDesc.mipLevelCount = mipCount;
+    _downTexture = _renderer.Device().CreateTexture(&textureDesc);
+    _renderer.GetResidencyManager().Track(_downTexture, ResidencyCategory::RenderTargets);
+
+    if (mipCount > 1)
+    {
+        textureDesc.label = "Bloom upsample chain";
+        textureDesc.mipLevelCount = mipCount - 1;
+        _upTexture = _renderer.Device().CreateTexture(&textureDesc);
+        _renderer.GetResidencyManager().Track(_upTexture, ResidencyCategory::RenderTargets);
+    }
+
+    for (uint32_t mip = 0; mip < mipCount; ++mip)
+    {
+        wgpu::TextureViewDescriptor viewDesc{};
+        viewDesc.dimension = wgpu::TextureViewDimension::e2D;
+        viewDesc.baseMipLevel = mip;
+        viewDesc.mipLevelCount = 1;
+        viewDesc.baseArrayLayer = 0;
+        viewDesc.arrayLayerCount = 1;
+
+        _downViews.push_back(_downTexture.CreateView(&viewDesc));
+        if (mip + 1 < mipCount)
+            _upViews.push_back(_upTexture.CreateView(&viewDesc));
+        _mipSizes.push_back(glm::max(baseSize >> mip, glm::uvec2{ 1 }));
+    }
+
+    // Everything but the first downsample stays within the chain.
+    _downBindGroups.resize(mipCount);
+    for (uint32_t mip = 1; mip < mipCount; ++mip)
+    {
+        _downBindGroups[mip] = CreateBindGroup(_downViews[mip - 1], _downViews[mip - 1], _downViews[mip]);
+    }
+
+    // The smallest upsampled level reads the smallest downsampled one.
+    _upBindGroups.resize(_upViews.size());
+    for (uint32_t mip = 0; mip < _upViews.size(); ++mip)
+    {
+        const wgpu::TextureView& source = mip + 1 < _upViews.size() ? _upViews[mip + 1] : _downViews[mip + 1];
+        _upBindGroups[mip] = CreateBindGroup(source, _downViews[mip], _upViews[mip]);
+    }
+}
+
+wgpu::BindGroup BloomPass::CreateBindGroup(const wgpu::TextureView& source, const wgpu::TextureView& base, const wgpu::TextureView& destination) const
+{
+    std::array<wgpu::BindGroupEntry, 4> bgEntries{};
+    bgEntries[0].binding = 0;
+    bgEntries[0].textureView = source;
+    bgEntries[1].binding = 1;
+    bgEntries[1].textureView = base;
+    bgEntries[2].binding = 2;
+    bgEntries[2].textureView = destination;
+    bgEntries[3].binding = 3;
+    bgEntries[3].sampler = _sampler;
+
+    wgpu::BindGroupDescriptor bgDesc{};
+    bgDesc.label = "Bloom bind group";
+    bgDesc.layout = _bindGroupLayout;
+    bgDesc.entryCount = bgEntries.size();
+    bgDesc.entries = bgEntries.data();
+
+    return _renderer.Device().CreateBindGroup(&bgDesc);
+}
+
+void BloomPass::Render(const wgpu::CommandEncoder& encoder, const wgpu::TextureView& input)
+{
+    PipelineCache& pipelineCache = _renderer.GetPipelineCache();
+    wgpu::ComputePipeline downsampleFirst = pipelineCache.GetComputePipeline(_downsampleFirstKey);
+    wgpu::ComputePipeline downsample = pipelineCache.GetComputePipeline(_downsampleKey);
+    wgpu::ComputePipeline upsample = pipelineCache.GetComputePipeline(_upsampleKey);
+    if (!downsampleFirst || !downsample || !upsample || _downViews.empty())
+        return;
+
+    // The graph usually hands out the same texture every frame.
+    if (input.Get() != _input.Get())
+    {
+        _downBindGroups[0] = CreateBindGroup(input, input, _downViews[0]);
+        _input = input;
+    }
+
+    auto dispatch = [this](const wgpu::ComputePassEncoder& computePass, uint32_t mip)
+    {
+        const glm::uvec2 workgroups = (_mipSizes[mip] + BLOOM_WORKGROUP_SIZE - 1u) / BLOOM_WORKGROUP_SIZE;
+        computePass.DispatchWorkgroups(workgroups.x, workgroups.y, 1);
+    };
+
+    wgpu::ComputePassDescriptor computePassDesc{};
+    computePassDesc.label = "Bloom compute pass";
+    wgpu::ComputePassEncoder computePass = encoder.BeginComputePass(&computePassDesc);
+
+    // The first downsample weighs its samples down by brightness, so single bright pixels don't flicker through the chain.
+    for (uint32_t mip = 0; mip < _downViews.size(); ++mip)
+    {
+        computePass.SetPipeline(mip == 0 ? downsampleFirst : downsample);
+        computePass.SetBindGroup(0, _downBindGroups[mip], 0, nullptr);
+        dispatch(computePass, mip);
+    }
+
+    computePass.SetPipeline(upsample);
+    for (uint32_t mip = static_cast<uint32_t>(_upViews.size()); mip-- > 0;)
+    {
+        computePass.SetBindGroup(0, _upBindGroups[mip], 0, nullptr);
+        dispatch(computePass, mip);
+    }
+
+    computePass.End();
+}
@@ -1,9 +1,33 @@
 #include "graphics/hdr_pass.hpp"
+#include "graphics/auto_exposure_pass.hpp"
 #include "renderer.hpp"
+#include "pipeline_cache.hpp"
+#include "gpu_object_cache.hpp"
+#include "shader_library.hpp"
+#include <cstddef>
 #include <iostream>
+#include <string>
+
+constexpr uint32_t LUT_WORKGROUP_SIZE{ 4 };
 
 HDRPass::HDRPass(Renderer& renderer) : RenderPass(renderer, renderer.SwapChainFormat())
 {
+    ShaderStruct paramsStruct{ "PostParams", sizeof(Params) };
+    paramsStruct.Field<float>("exposure", offsetof(Params, exposure))
+                .Field<float>("bloomIntensity", offsetof(Params, bloomIntensity));
+    ShaderStruct gradingStruct{ "Grading", sizeof(Grading) };
+    gradingStruct.Field<glm::vec3>("gain", offsetof(Grading, gain))
+                 .Field<float>("contrast", offsetof(Grading, contrast))
+                 .Field<float>("saturation", offsetof(Grading, saturation));
+    _renderer.GetShaderLibrary().AddGeneratedStructs("generated/post.wgsl", { paramsStruct, gradingStruct });
+    _renderer.GetShaderLibrary().AddGeneratedFile("generated/post-constants.wgsl",
+                                                  "const LUT_SIZE: u32 = " + std::to_string(LUT_SIZE) + "u;\n"
+                                                  "const LUT_MIN_EV: f32 = " + std::to_string(LUT_MIN_EV) + ";\n"
+                                                  "const LUT_MAX_EV: f32 = " + std::to_string(LUT_MAX_EV) + ";\n");
+
+    _params = UniformBlock<Params>{ _renderer.CreateBuffer(nullptr, sizeof(Params), wgpu::BufferUsage::Uniform, "Post process params buffer") };
+    _grading = UniformBlock<Grading>{ _renderer.CreateBuffer(nullptr, sizeof(Grading), wgpu::BufferUsage::Uniform, "Color grading buffer") };
+
     wgpu::ColorTargetState colorTargetHDR{};
     colorTargetHDR.format = _renderer.SwapChainFormat();
     colorTargetHDR.blend = nullptr;
@@ -35,7 +59,7 @@ HDRPass::HDRPass(Renderer& renderer) : RenderPass(renderer, renderer.SwapChainFo
 
     rpHDRDesc.depthStencil = nullptr;
 
-    std::array<wgpu::BindGroupLayoutEntry, 2> bgLayoutHDREntries{};
+    std::array<wgpu::BindGroupLayoutEntry, 6> bgLayoutHDREntries{};
     bgLayoutHDREntries[0].binding = 0;
     bgLayoutHDREntries[0].visibility = wgpu::ShaderStage::Fragment;
     bgLayoutHDREntries[0].texture.sampleType = wgpu::TextureSampleType::Float;
@@ -43,19 +67,35 @@ HDRPass::HDRPass(Renderer& renderer) : RenderPass(renderer, renderer.SwapChainFo
     bgLayoutHDREntries[1].binding = 1;
     bgLayoutHDREntries[1].visibility = wgpu::ShaderStage::Fragment;
     bgLayoutHDREntries[1].sampler.type = wgpu::SamplerBindingType::Filtering;
+    bgLayoutHDREntries[2].binding = 2;
+    bgLayoutHDREntries[2].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutHDREntries[2].texture.sampleType = wgpu::TextureSampleType::Float;
+    bgLayoutHDREntries[2].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+    bgLayoutHDREntries[3].binding = 3;
+    bgLayoutHDREntries[3].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutHDREntries[3].texture.sampleType = wgpu::TextureSampleType::Float;
+    bgLayoutHDREntries[3].texture.viewDimension = wgpu::TextureViewDimension::e3D;
+    bgLayoutHDREntries[4].binding = 4;
+    bgLayoutHDREntries[4].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutHDREntries[4].buffer.type = wgpu::BufferBindingType::Uniform;
+    bgLayoutHDREntries[4].buffer.minBindingSize = sizeof(Params);
+    bgLayoutHDREntries[5].binding = 5;
+    bgLayoutHDREntries[5].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutHDREntries[5].buffer.type = wgpu::BufferBindingType::ReadOnlyStorage;
+    bgLayoutHDREntries[5].buffer.minBindingSize = sizeof(AutoExposurePass::Exposure);
 
     wgpu::BindGroupLayoutDescriptor bgLayoutHDRDesc{};
     bgLayoutHDRDesc.entryCount = bgLayoutHDREntries.size();
     bgLayoutHDRDesc.entries = bgLayoutHDREntries.data();
 
-    _hdrBindGroupLayout = _renderer.Device().CreateBindGroupLayout(&bgLayoutHDRDesc);
+    _hdrBindGroupLayout = _renderer.GetObjectCache().GetBindGroupLayout(bgLayoutHDRDesc);
 
     wgpu::PipelineLayoutDescriptor hdrPipelineLayoutDesc{};
     hdrPipelineLayoutDesc.label = "HDR pipeline layout";
     hdrPipelineLayoutDesc.bindGroupLayoutCount = 1;
     hdrPipelineLayoutDesc.bindGroupLayouts = &_hdrBindGroupLayout;
 
-    wgpu::PipelineLayout hdrPipelineLayout = _renderer.Device().CreatePipelineLayout(&hdrPipelineLayoutDesc);
+    wgpu::PipelineLayout hdrPipelineLayout = _renderer.GetObjectCache().GetPipelineLayout(hdrPipelineLayoutDesc);
 
     rpHDRDesc.layout = hdrPipelineLayout;
 
@@ -70,43 +110,165 @@ HDRPass::HDRPass(Renderer& renderer) : RenderPass(renderer, renderer.SwapChainFo
     hdrSamplerDesc.lodMaxClamp = 1000.0f;
     hdrSamplerDesc.compare = wgpu::CompareFunction::Undefined;
 
-    _hdrSampler = _renderer.Device().CreateSampler(&hdrSamplerDesc);
+    _hdrSampler = _renderer.GetObjectCache().GetSampler(hdrSamplerDesc);
+
+    _pipelineKey = _renderer.GetPipelineCache().RequestRenderPipeline(rpHDRDesc);
+
+    wgpu::TextureDescriptor blackDesc{};
+    blackDesc.label = "Black texture";
+    blackDesc.dimension = wgpu::TextureDimension::e2D;
+    blackDesc.size = { 1, 1, 1 };
+    blackDesc.format = wgpu::TextureFormat::RGBA16Float;
+    blackDesc.mipLevelCount = 1;
+    blackDesc.sampleCount = 1;
+    blackDesc.usage = wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::CopyDst;
+    _blackTexture = _renderer.Device().CreateTexture(&blackDesc);
+    _renderer.GetResidencyManager().Track(_blackTexture, ResidencyCategory::Textures);
+    _blackView = _blackTexture.CreateView();
+
+    const std::array<uint16_t, 4> black{ 0, 0, 0, 0 };
+    wgpu::ImageCopyTexture blackCopy{};
+    blackCopy.texture = _blackTexture;
+    wgpu::TextureDataLayout blackLayout{};
+    blackLayout.bytesPerRow = sizeof(black);
+    const wgpu::Extent3D blackExtent{ 1, 1, 1 };
+    _renderer.Queue().WriteTexture(&blackCopy, black.data(), sizeof(black), &blackLayout, &blackExtent);
+
+    // The LUT is indexed by log encoded color, which spreads its texels evenly over the stops.
+    wgpu::TextureDescriptor lutDesc{};
+    lutDesc.label = "Color grading LUT";
+    lutDesc.dimension = wgpu::TextureDimension::e3D;
+    lutDesc.size = { LUT_SIZE, LUT_SIZE, LUT_SIZE };
+    lutDesc.format = wgpu::TextureFormat::RGBA16Float;
+    lutDesc.mipLevelCount = 1;
+    lutDesc.sampleCount = 1;
+    lutDesc.usage = wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::StorageBinding;
+    _lutTexture = _renderer.Device().CreateTexture(&lutDesc);
+    _renderer.GetResidencyManager().Track(_lutTexture, ResidencyCategory::Textures);
+    _lutView = _lutTexture.CreateView();
+
+    std::array<wgpu::BindGroupLayoutEntry, 2> lutLayoutEntries{};
+    lutLayoutEntries[0].binding = 0;
+    lutLayoutEntries[0].visibility = wgpu::ShaderStage::Compute;
+    lutLayoutEntries[0].storageTexture.access = wgpu::StorageTextureAccess::WriteOnly;
+    lutLayoutEntries[0].storageTexture.format = wgpu::TextureFormat::RGBA16Float;
+    lutLayoutEntries[0].storageTexture.viewDimension = wgpu::TextureViewDimension::e3D;
+    lutLayoutEntries[1].binding = 1;
+    lutLayoutEntries[1].visibility = wgpu::ShaderStage::Compute;
+    lutLayoutEntries[1].buffer.type = wgpu::BufferBindingType::Uniform;
+    lutLayoutEntries[1].buffer.minBindingSize = sizeof(Grading);
+
+    wgpu::BindGroupLayoutDescriptor lutLayoutDesc{};
+    lutLayoutDesc.label = "Color grading LUT bind group layout";
+    lutLayoutDesc.entryCount = lutLayoutEntries.size();
+    lutLayoutDesc.entries = lutLayoutEntries.data();
+    wgpu::BindGroupLayout lutBindGroupLayout = _renderer.GetObjectCache().GetBindGroupLayout(lutLayoutDesc);
+
+    wgpu::PipelineLayoutDescriptor lutPipelineLayoutDesc{};
+    lutPipelineLayoutDesc.label = "Color grading LUT pipeline layout";
+    lutPipelineLayoutDesc.bindGroupLayoutCount = 1;
+    lutPipelineLayoutDesc.bindGroupLayouts = &lutBindGroupLayout;
+
+    wgpu::ComputePipelineDescriptor lutPipelineDesc{};
+    lutPipelineDesc.label = "Color grading LUT pipeline";
+    lutPipelineDesc.layout = _renderer.GetObjectCache().GetPipelineLayout(lutPipelineLayoutDesc);
+    lutPipelineDesc.compute.module = _renderer.CreateShader("assets/shaders/color-grading-lut.wgsl", "Color grading LUT shader");
+    lutPipelineDesc.compute.entryPoint = "cs_main";
+    _lutPipelineKey = _renderer.GetPipelineCache().RequestComputePipeline(lutPipelineDesc);
+
+    std::array<wgpu::BindGroupEntry, 2> lutEntries{};
+    lutEntries[0].binding = 0;
+    lutEntries[0].textureView = _lutView;
+    lutEntries[1].binding = 1;
+    lutEntries[1].buffer = _grading.Buffer();
+    lutEntries[1].size = sizeof(Grading);
+
+    wgpu::BindGroupDescriptor lutBindGroupDesc{};
+    lutBindGroupDesc.label = "Color grading LUT bind group";
+    lutBindGroupDesc.layout = lutBindGroupLayout;
+    lutBindGroupDesc.entryCount = lutEntries.size();
+    lutBindGroupDesc.entries = lutEntries.data();
+    _lutBindGroup = _renderer.Device().CreateBindGroup(&lutBindGroupDesc);
+}
+
+HDRPass::~HDRPass()
+{
+    _renderer.GetResidencyManager().Untrack(_blackTexture);
+    _renderer.GetResidencyManager().Untrack(_lutTexture);
+}
+
+void HDRPass::SetGrading(const Grading& grading)
+{
+    _grading.Write(0, &grading, sizeof(Grading));
+    _lutDirty = _lutDirty || _grading.Dirty();
+}
+
+void HDRPass::Prepare(const wgpu::CommandEncoder& encoder)
+{
+    _params.Flush(_renderer.Queue());
+
+    if (!_lutDirty)
+        return;
+
+    // Stays dirty until the pipeline has compiled.
+    wgpu::ComputePipeline pipeline = _renderer.GetPipelineCache().GetComputePipeline(_lutPipelineKey);
+    if (!pipeline)
+        return;
+
+    _grading.Flush(_renderer.Queue());
 
-    _renderPipeline = _renderer.Device().CreateRenderPipeline(&rpHDRDesc);
+    wgpu::ComputePassDescriptor computePassDesc{};
+    computePassDesc.label = "Color grading LUT compute pass";
+    wgpu::ComputePassEncoder computePass = encoder.BeginComputePass(&computePassDesc);
+    computePass.SetPipeline(pipeline);
+    computePass.SetBindGroup(0, _lutBindGroup, 0, nullptr);
+    const uint32_t workgroupCount = LUT_SIZE / LUT_WORKGROUP_SIZE;
+    computePass.DispatchWorkgroups(workgroupCount, workgroupCount, workgroupCount);
+    computePass.End();
 
-    UpdateHDRView(_renderer.HDRView());
+    _lutDirty = false;
+    _lutBaked = true;
 }
 
-void HDRPass::Render(const wgpu::CommandEncoder& encoder, const wgpu::TextureView& renderTarget, std::shared_ptr<const wgpu::TextureView> resolveTarget)
+void HDRPass::Render(const wgpu::RenderPassEncoder& pass, const wgpu::TextureView& hdrView, const wgpu::Buffer& exposureBuffer, const wgpu::TextureView& bloomView)
 {
-    wgpu::RenderPassColorAttachment colorDescTonemap{};
-    colorDescTonemap.view = renderTarget;
-    colorDescTonemap.loadOp = wgpu::LoadOp::Clear;
-    colorDescTonemap.storeOp = wgpu::StoreOp::Store;
-    colorDescTonemap.resolveTarget = nullptr;
-
-
-    wgpu::RenderPassDescriptor hdrPassDesc{};
-    hdrPassDesc.label = "HDR render pass";
-    hdrPassDesc.colorAttachmentCount = 1;
-    hdrPassDesc.colorAttachments = &colorDescTonemap;
-    hdrPassDesc.depthStencilAttachment = nullptr;
-
-    wgpu::RenderPassEncoder hdrPass = encoder.BeginRenderPass(&hdrPassDesc);
-    
-    hdrPass.SetPipeline(_renderPipeline);
-    hdrPass.SetBindGroup(0, _hdrBindGroup, 0, nullptr);
-    hdrPass.Draw(3, 1, 0, 0);
-    hdrPass.End();
+    UpdateBindGroup(hdrView, exposureBuffer, bloomView ? bloomView : _blackView);
+
+    // The back buffer is still cleared while the pipeline compiles, or the LUT is waiting for its first bake.
+    wgpu::RenderPipeline pipeline = _renderer.GetPipelineCache().GetRenderPipeline(_pipelineKey);
+    if (pipeline && _lutBaked)
+    {
+        pass.SetPipeline(pipeline);
+        pass.SetBindGroup(0, _hdrBindGroup, 0, nullptr);
+        pass.Draw(3, 1, 0, 0);
+    }
 }
 
-void HDRPass::UpdateHDRView(const wgpu::TextureView& hdrView)
+void HDRPass::UpdateBindGroup(const wgpu::TextureView& hdrView, const wgpu::Buffer& exposureBuffer, const wgpu::TextureView& bloomView)
 {
-    std::array<wgpu::BindGroupEntry, 2> bgEntriesHDR{};
+    // The graph usually hands out the same textures every frame.
+    if (hdrView.Get() == _hdrView.Get() && bloomView.Get() == _bloomView.Get() && exposureBuffer.Get() == _exposureBuffer.Get())
+        return;
+
+    _hdrView = hdrView;
+    _bloomView = bloomView;
+    _exposureBuffer = exposureBuffer;
+
+    std::array<wgpu::BindGroupEntry, 6> bgEntriesHDR{};
     bgEntriesHDR[0].binding = 0;
     bgEntriesHDR[0].textureView = hdrView;
     bgEntriesHDR[1].binding = 1;
     bgEntriesHDR[1].sampler = _hdrSampler;
+    bgEntriesHDR[2].binding = 2;
+    bgEntriesHDR[2].textureView = bloomView;
+    bgEntriesHDR[3].binding = 3;
+    bgEntriesHDR[3].textureView = _lutView;
+    bgEntriesHDR[4].binding = 4;
+    bgEntriesHDR[4].buffer = _params.Buffer();
+    bgEntriesHDR[4].size = sizeof(Params);
+    bgEntriesHDR[5].binding = 5;
+    bgEntriesHDR[5].buffer = exposureBuffer;
+    bgEntriesHDR[5].size = sizeof(AutoExposurePass::Exposure);
 
     wgpu::BindGroupDescriptor hdrBindgroupDesc{};
     hdrBindgroupDesc.layout = _hdrBindGroupLayout;
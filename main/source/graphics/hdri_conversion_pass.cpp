@@ -1,9 +1,14 @@
 #include "graphics/hdri_conversion_pass.hpp"
 #include "stb_image.h"
 #include "renderer.hpp"
+#include "pipeline_cache.hpp"
+#include "gpu_object_cache.hpp"
+#include "uniform_ring.hpp"
+#include "frame_scheduler.hpp"
 #include <utils.hpp>
+#include "upload_manager.hpp"
 
-HDRIConversionPass::HDRIConversionPass(Renderer& renderer) : RenderPass(renderer, wgpu::TextureFormat::RGBA16Float), _uniformStride(ceilToNextMultiple(sizeof(_currentFace), 256))
+HDRIConversionPass::HDRIConversionPass(Renderer& renderer) : RenderPass(renderer, wgpu::TextureFormat::RGBA16Float)
 {
     std::array<wgpu::BindGroupLayoutEntry, 3> bgLayoutEntries{};
     bgLayoutEntries[0].binding = 0;
@@ -28,13 +33,13 @@ HDRIConversionPass::HDRIConversionPass(Renderer& renderer) : RenderPass(renderer
     bgLayoutDesc.entryCount = bgLayoutEntries.size();
     bgLayoutDesc.entries = bgLayoutEntries.data();
 
-    _bindGroupLayout = _renderer.Device().CreateBindGroupLayout(&bgLayoutDesc);
+    _bindGroupLayout = _renderer.GetObjectCache().GetBindGroupLayout(bgLayoutDesc);
 
     wgpu::PipelineLayoutDescriptor bgPipelineLayoutDesc{};
     bgPipelineLayoutDesc.bindGroupLayoutCount = 1;
     bgPipelineLayoutDesc.bindGroupLayouts = &_bindGroupLayout;
      
-    _pipelineLayout = _renderer.Device().CreatePipelineLayout(&bgPipelineLayoutDesc);
+    _pipelineLayout = _renderer.GetObjectCache().GetPipelineLayout(bgPipelineLayoutDesc);
 
     wgpu::ShaderModule shader = _renderer.CreateShader("assets/shaders/hdri-to-cubemap.wgsl", "HDRI to cubemap shader module");
 
@@ -57,9 +62,8 @@ HDRIConversionPass::HDRIConversionPass(Renderer& renderer) : RenderPass(renderer
     renderPipelineDesc.fragment = &fragmentState;
     renderPipelineDesc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
 
-    _renderPipeline = _renderer.Device().CreateRenderPipeline(&renderPipelineDesc);
-
-    _faceUniformBuffer = _renderer.CreateBuffer(&_faceUniformBuffer, _uniformStride * 6, wgpu::BufferUsage::Uniform, "HDRI to cubemap face uniform buffer");
+    // Runs once while the renderer is being set up, so there's nothing to fall back to.
+    _renderPipeline = _renderer.GetPipelineCache().CreateRenderPipelineBlocking(renderPipelineDesc);
 
     _hdriData = stbi_loadf("assets/textures/wrestling_gym_4k.hdr", &_hdrWidth, &_hdrHeight, &_hdrChannels, STBI_rgb_alpha);
 
@@ -80,6 +84,7 @@ HDRIConversionPass::HDRIConversionPass(Renderer& renderer) : RenderPass(renderer
     hdrTextureDesc.usage = wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::StorageBinding;
 
     _hdrTexture = _renderer.Device().CreateTexture(&hdrTextureDesc);
+    _renderer.GetResidencyManager().Track(_hdrTexture, ResidencyCategory::Textures);
 
     wgpu::ImageCopyTexture hdrTextureCopy{};
     hdrTextureCopy.texture = _hdrTexture;
@@ -87,11 +92,6 @@ HDRIConversionPass::HDRIConversionPass(Renderer& renderer) : RenderPass(renderer
     hdrTextureCopy.mipLevel = 0;
     hdrTextureCopy.origin = { 0, 0, 0 };
 
-    wgpu::TextureDataLayout hdrDataLayout{};
-    hdrDataLayout.offset = 0;
-    hdrDataLayout.bytesPerRow = _hdrWidth * 4 * sizeof(uint16_t);
-    hdrDataLayout.rowsPerImage = _hdrHeight;
-
     wgpu::Extent3D hdrSize{};
     hdrSize.width = _hdrWidth;
     hdrSize.height = _hdrHeight;
@@ -102,7 +102,7 @@ HDRIConversionPass::HDRIConversionPass(Renderer& renderer) : RenderPass(renderer
     hdrData.assign(_hdriData, _hdriData + _hdrWidth * _hdrHeight * 4);
     auto hdrData16 = convertFloat32ToFloat16(hdrData);
 
-    _renderer.Queue().WriteTexture(&hdrTextureCopy, hdrData16.data(), _hdrWidth * _hdrHeight * 4 * sizeof(uint16_t), &hdrDataLayout, &hdrSize);
+    _renderer.GetUploadManager().UploadTexture(hdrTextureCopy, hdrData16.data(), _hdrWidth * 4 * sizeof(uint16_t), _hdrHeight, hdrSize);
 
     wgpu::TextureViewDescriptor hdrViewDesc{};
     hdrViewDesc.label = "HDR texture view";
@@ -124,13 +124,14 @@ HDRIConversionPass::HDRIConversionPass(Renderer& renderer) : RenderPass(renderer
     hdrSamplerDesc.minFilter = wgpu::FilterMode::Linear;
     hdrSamplerDesc.magFilter = wgpu::FilterMode::Linear;
     hdrSamplerDesc.mipmapFilter = wgpu::MipmapFilterMode::Linear;
-    _hdrSampler = _renderer.Device().CreateSampler(&hdrSamplerDesc);
+    _hdrSampler = _renderer.GetObjectCache().GetSampler(hdrSamplerDesc);
 }
 
 HDRIConversionPass::~HDRIConversionPass()
 { 
-    _hdrTexture.Destroy();
-    _faceUniformBuffer.Destroy();
+    _renderer.GetResidencyManager().Untrack(_hdrTexture);
+    // The conversion may still be running.
+    _renderer.GetFrameScheduler().DeferDestroy(_hdrTexture);
     stbi_image_free(_hdriData);
 }
 
@@ -142,7 +143,7 @@ void HDRIConversionPass::Render(const wgpu::CommandEncoder& encoder, const wgpu:
     bgEntriesHDR[1].binding = 1;
     bgEntriesHDR[1].sampler = _hdrSampler;
     bgEntriesHDR[2].binding = 2;
-    bgEntriesHDR[2].buffer = _faceUniformBuffer;
+    bgEntriesHDR[2].buffer = _renderer.GetUniformRing().Buffer();
     bgEntriesHDR[2].size = sizeof(_currentFace);
 
     wgpu::BindGroupDescriptor hdrBindgroupDesc{};
@@ -150,7 +151,7 @@ void HDRIConversionPass::Render(const wgpu::CommandEncoder& encoder, const wgpu:
     hdrBindgroupDesc.entryCount = bgEntriesHDR.size();
     hdrBindgroupDesc.entries = bgEntriesHDR.data();
 
-    _hdrBindGroup = _renderer.Device().CreateBindGroup(&hdrBindgroupDesc);
+    _hdrBindGroup = _renderer.GetObjectCache().GetBindGroup(hdrBindgroupDesc);
 
     wgpu::RenderPassColorAttachment colorDescTonemap{};
     colorDescTonemap.view = renderTarget;
@@ -168,8 +169,12 @@ void HDRIConversionPass::Render(const wgpu::CommandEncoder& encoder, const wgpu:
 
     hdrPass.SetPipeline(_renderPipeline);
 
-    uint32_t dynamicOffset{ _currentFace * _uniformStride };
-    _renderer.Queue().WriteBuffer(_faceUniformBuffer, dynamicOffset, &_currentFace, sizeof(_currentFace));
+    uint32_t dynamicOffset{};
+    if (!_renderer.GetUniformRing().Allocate(_currentFace, dynamicOffset))
+    {
+        hdrPass.End();
+        return;
+    }
 
     hdrPass.SetBindGroup(0, _hdrBindGroup, 1, &dynamicOffset);
     hdrPass.Draw(3, 1, 0, 0);
@@ -4,6 +4,7 @@
 #include <backends/imgui_impl_glfw.h>
 #include <backends/imgui_impl_wgpu.h>
 #include "enum_util.hpp"
+#include "frame_scheduler.hpp"
 #include <iostream>
 
 ImGuiPass::ImGuiPass(Renderer& renderer) : RenderPass(renderer, renderer.SwapChainFormat())
@@ -21,7 +22,7 @@ ImGuiPass::ImGuiPass(Renderer& renderer) : RenderPass(renderer, renderer.SwapCha
     ImGui_ImplWGPU_InitInfo imguiInitInfo{};
     imguiInitInfo.DepthStencilFormat = conv_enum<WGPUTextureFormat>(wgpu::TextureFormat::Undefined);
     imguiInitInfo.Device = _renderer.Device().Get();
-    imguiInitInfo.NumFramesInFlight = 3;
+    imguiInitInfo.NumFramesInFlight = MAX_FRAMES_IN_FLIGHT;
     imguiInitInfo.PipelineMultisampleState = { nullptr, 1,  0xFF'FF'FF'FF, false };
     imguiInitInfo.RenderTargetFormat = conv_enum<WGPUTextureFormat>(_renderFormat);
     ImGui_ImplWGPU_Init(&imguiInitInfo);
@@ -33,20 +34,7 @@ ImGuiPass::ImGuiPass(Renderer& renderer) : RenderPass(renderer, renderer.SwapCha
 
 ImGuiPass::~ImGuiPass() = default;
 
-void ImGuiPass::Render(const wgpu::CommandEncoder& encoder, const wgpu::TextureView& renderTarget, std::shared_ptr<const wgpu::TextureView> resolveTarget)
+void ImGuiPass::Render(const wgpu::RenderPassEncoder& pass)
 {
-    wgpu::RenderPassColorAttachment imguiColorDesc{};
-    imguiColorDesc.view = renderTarget;
-    imguiColorDesc.loadOp = wgpu::LoadOp::Load;
-    imguiColorDesc.storeOp = wgpu::StoreOp::Store;
-
-    wgpu::RenderPassDescriptor imguiPassDesc{};
-    imguiPassDesc.label = "ImGui render pass";
-    imguiPassDesc.colorAttachmentCount = 1;
-    imguiPassDesc.colorAttachments = &imguiColorDesc;
-    imguiPassDesc.depthStencilAttachment = nullptr;
-
-    wgpu::RenderPassEncoder imguiPass = encoder.BeginRenderPass(&imguiPassDesc);
-    ImGui_ImplWGPU_RenderDrawData(ImGui::GetDrawData(), imguiPass.Get());
-    imguiPass.End();
+    ImGui_ImplWGPU_RenderDrawData(ImGui::GetDrawData(), pass.Get());
 }
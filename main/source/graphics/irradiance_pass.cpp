@@ -1,11 +1,13 @@
 #include "graphics/irradiance_pass.hpp"
 #include "stb_image.h"
 #include "renderer.hpp"
+#include "pipeline_cache.hpp"
+#include "gpu_object_cache.hpp"
+#include "uniform_ring.hpp"
 #include <utils.hpp>
 
 IrradiancePass::IrradiancePass(Renderer& renderer, const wgpu::TextureView& skyboxView) : 
     RenderPass(renderer, wgpu::TextureFormat::RGBA16Float), 
-    _uniformStride(ceilToNextMultiple(sizeof(_currentFace), 256)), 
     _skyboxView(skyboxView)
 {
     std::array<wgpu::BindGroupLayoutEntry, 3> bgLayoutEntries{};
@@ -31,13 +33,13 @@ IrradiancePass::IrradiancePass(Renderer& renderer, const wgpu::TextureView& skyb
     bgLayoutDesc.entryCount = bgLayoutEntries.size();
     bgLayoutDesc.entries = bgLayoutEntries.data();
 
-    _bindGroupLayout = _renderer.Device().CreateBindGroupLayout(&bgLayoutDesc);
+    _bindGroupLayout = _renderer.GetObjectCache().GetBindGroupLayout(bgLayoutDesc);
 
     wgpu::PipelineLayoutDescriptor bgPipelineLayoutDesc{};
     bgPipelineLayoutDesc.bindGroupLayoutCount = 1;
     bgPipelineLayoutDesc.bindGroupLayouts = &_bindGroupLayout;
 
-    _pipelineLayout = _renderer.Device().CreatePipelineLayout(&bgPipelineLayoutDesc);
+    _pipelineLayout = _renderer.GetObjectCache().GetPipelineLayout(bgPipelineLayoutDesc);
 
     wgpu::ShaderModule shader = _renderer.CreateShader("assets/shaders/irradiance-convolution.wgsl", "Irradiance convolution shader module");
     
@@ -60,9 +62,8 @@ IrradiancePass::IrradiancePass(Renderer& renderer, const wgpu::TextureView& skyb
     renderPipelineDesc.fragment = &fragmentState;
     renderPipelineDesc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
 
-    _renderPipeline = _renderer.Device().CreateRenderPipeline(&renderPipelineDesc);
-
-    _faceUniformBuffer = _renderer.CreateBuffer(&_faceUniformBuffer, _uniformStride * 6, wgpu::BufferUsage::Uniform, "Irradiance convolution face uniform buffer");
+    // Runs once while the renderer is being set up, so there's nothing to fall back to.
+    _renderPipeline = _renderer.GetPipelineCache().CreateRenderPipelineBlocking(renderPipelineDesc);
 
     wgpu::SamplerDescriptor hdrSamplerDesc{};
     hdrSamplerDesc.label = "HDR sampler";
@@ -72,13 +73,10 @@ IrradiancePass::IrradiancePass(Renderer& renderer, const wgpu::TextureView& skyb
     hdrSamplerDesc.minFilter = wgpu::FilterMode::Linear;
     hdrSamplerDesc.magFilter = wgpu::FilterMode::Linear;
     hdrSamplerDesc.mipmapFilter = wgpu::MipmapFilterMode::Linear;
-    _cubemapSampler = _renderer.Device().CreateSampler(&hdrSamplerDesc);
+    _cubemapSampler = _renderer.GetObjectCache().GetSampler(hdrSamplerDesc);
 }
 
-IrradiancePass::~IrradiancePass()
-{
-    _faceUniformBuffer.Destroy();
-}
+IrradiancePass::~IrradiancePass() = default;
 
 void IrradiancePass::Render(const wgpu::CommandEncoder& encoder, const wgpu::TextureView& renderTarget, std::shared_ptr<const wgpu::TextureView> resolveTarget)
 {
@@ -88,7 +86,7 @@ void IrradiancePass::Render(const wgpu::CommandEncoder& encoder, const wgpu::Tex
     bgEntriesHDR[1].binding = 1;
     bgEntriesHDR[1].sampler = _cubemapSampler;
     bgEntriesHDR[2].binding = 2;
-    bgEntriesHDR[2].buffer = _faceUniformBuffer;
+    bgEntriesHDR[2].buffer = _renderer.GetUniformRing().Buffer();
     bgEntriesHDR[2].size = sizeof(_currentFace);
 
     wgpu::BindGroupDescriptor hdrBindgroupDesc{};
@@ -96,7 +94,7 @@ void IrradiancePass::Render(const wgpu::CommandEncoder& encoder, const wgpu::Tex
     hdrBindgroupDesc.entryCount = bgEntriesHDR.size();
     hdrBindgroupDesc.entries = bgEntriesHDR.data();
 
-    _bindGroup = _renderer.Device().CreateBindGroup(&hdrBindgroupDesc);
+    _bindGroup = _renderer.GetObjectCache().GetBindGroup(hdrBindgroupDesc);
 
     wgpu::RenderPassColorAttachment colorDescTonemap{};
     colorDescTonemap.view = renderTarget;
@@ -114,8 +112,12 @@ void IrradiancePass::Render(const wgpu::CommandEncoder& encoder, const wgpu::Tex
 
     hdrPass.SetPipeline(_renderPipeline);
 
-    uint32_t dynamicOffset{ _currentFace * _uniformStride };
-    _renderer.Queue().WriteBuffer(_faceUniformBuffer, dynamicOffset, &_currentFace, sizeof(_currentFace));
+    uint32_t dynamicOffset{};
+    if (!_renderer.GetUniformRing().Allocate(_currentFace, dynamicOffset))
+    {
+        hdrPass.End();
+        return;
+    }
 
     hdrPass.SetBindGroup(0, _bindGroup, 1, &dynamicOffset);
     hdrPass.Draw(3, 1, 0, 0);
@@ -1,17 +1,30 @@
 #include "graphics/pbr_pass.hpp"
 #include "utils.hpp"
 #include <renderer.hpp>
+#include "pipeline_cache.hpp"
+#include "gpu_object_cache.hpp"
+#include "shader_library.hpp"
+#include "uniform_ring.hpp"
+#include <algorithm>
 #include <cstddef>
 #include "mesh.hpp"
+#include "material_system.hpp"
 #include <iostream>
 
 PBRPass::PBRPass(Renderer& renderer) : 
-    RenderPass(renderer, wgpu::TextureFormat::RGBA16Float),
-    _uniformStride(ceilToNextMultiple(sizeof(Instance), 256)),
-    _vertModule(_renderer.CreateShader("assets/shaders/vertex.wgsl", "Vertex shader")),
-    _fragModule(_renderer.CreateShader("assets/shaders/frag.wgsl", "Fragment shader"))
+    RenderPass(renderer, wgpu::TextureFormat::RGBA16Float)
 {
-    _instanceBuffer = _renderer.CreateBuffer(nullptr, _uniformStride * MAX_INSTANCES, wgpu::BufferUsage::Uniform, "PBR instances buffer");
+    ShaderStruct instanceStruct{ "Instance", sizeof(Instance) };
+    instanceStruct.Field<glm::mat4>("model", offsetof(Instance, model))
+                  .Field<glm::mat4>("transInvModel", offsetof(Instance, transInvModel))
+                  .Field<uint32_t>("materialIndex", offsetof(Instance, materialIndex));
+
+    _renderer.GetShaderLibrary().AddGeneratedStructs("generated/pbr-instance.wgsl", { instanceStruct });
+
+    _vertModule = _renderer.CreateShader("assets/shaders/vertex.wgsl", "Vertex shader");
+    _fragModule = _renderer.CreateShader("assets/shaders/frag.wgsl", "Fragment shader");
+    _motionVertModule = _renderer.GetShaderLibrary().GetModule("assets/shaders/vertex.wgsl", { { "MOTION_VECTORS", "" } }, "Motion vector vertex shader");
+    _motionFragModule = _renderer.GetShaderLibrary().GetModule("assets/shaders/frag.wgsl", { { "MOTION_VECTORS", "" } }, "Motion vector fragment shader");
 
     std::array<wgpu::BindGroupLayoutEntry, 1> instanceBGLayoutEntry{};
     instanceBGLayoutEntry[0].binding = 0;
@@ -24,47 +37,12 @@ PBRPass::PBRPass(Renderer& renderer) :
     bgLayoutDesc.label = "Instance binding group layout";
     bgLayoutDesc.entryCount = instanceBGLayoutEntry.size();
     bgLayoutDesc.entries = instanceBGLayoutEntry.data();
-    _instanceBindGroupLayout = _renderer.Device().CreateBindGroupLayout(&bgLayoutDesc);
-
-    wgpu::BindGroupLayoutEntry textureLayoutEntry{};
-    textureLayoutEntry.visibility = wgpu::ShaderStage::Fragment;
-    textureLayoutEntry.texture.sampleType = wgpu::TextureSampleType::Float;
-    textureLayoutEntry.texture.viewDimension = wgpu::TextureViewDimension::e2D;
-    textureLayoutEntry.texture.multisampled = false;
-
-    std::array<wgpu::BindGroupLayoutEntry, 8> pbrBGLayoutEntries{};
-    pbrBGLayoutEntries[0].binding = 0;
-    pbrBGLayoutEntries[0].visibility = wgpu::ShaderStage::Fragment;
-    pbrBGLayoutEntries[0].buffer.type = wgpu::BufferBindingType::Uniform;
-    pbrBGLayoutEntries[0].buffer.minBindingSize = sizeof(Material);
-
-    pbrBGLayoutEntries[1].binding = 1;
-    pbrBGLayoutEntries[1].visibility = wgpu::ShaderStage::Fragment;
-    pbrBGLayoutEntries[1].sampler.type = wgpu::SamplerBindingType::Filtering;
-
-    pbrBGLayoutEntries[2] = textureLayoutEntry;
-    pbrBGLayoutEntries[2].binding = 2;
-    pbrBGLayoutEntries[3] = textureLayoutEntry;
-    pbrBGLayoutEntries[3].binding = 3;
-    pbrBGLayoutEntries[4] = textureLayoutEntry;
-    pbrBGLayoutEntries[4].binding = 4;
-    pbrBGLayoutEntries[5] = textureLayoutEntry;
-    pbrBGLayoutEntries[5].binding = 5;
-    pbrBGLayoutEntries[6] = textureLayoutEntry;
-    pbrBGLayoutEntries[6].binding = 6;
-    pbrBGLayoutEntries[7] = textureLayoutEntry;
-    pbrBGLayoutEntries[7].binding = 7;
-
-    wgpu::BindGroupLayoutDescriptor pbrBGLayoutDesc{};
-    pbrBGLayoutDesc.label = "PBR bind group layout";
-    pbrBGLayoutDesc.entryCount = pbrBGLayoutEntries.size();
-    pbrBGLayoutDesc.entries = pbrBGLayoutEntries.data();
-    _pbrBindGroupLayout = _renderer.Device().CreateBindGroupLayout(&pbrBGLayoutDesc);
-
+    _instanceBindGroupLayout = _renderer.GetObjectCache().GetBindGroupLayout(bgLayoutDesc);
 
     std::array<wgpu::BindGroupEntry, 1> bgEntry{};
     bgEntry[0].binding = 0;
-    bgEntry[0].buffer = _instanceBuffer;
+    // Instances are allocated from the transient uniform ring every frame.
+    bgEntry[0].buffer = _renderer.GetUniformRing().Buffer();
     bgEntry[0].size = sizeof(Instance);
 
     wgpu::BindGroupDescriptor bgDesc{};
@@ -76,10 +54,38 @@ PBRPass::PBRPass(Renderer& renderer) :
 
     wgpu::PipelineLayoutDescriptor layoutDesc{};
     layoutDesc.label = "Default pipeline layout";
-    std::array<wgpu::BindGroupLayout, 3> bindGroupLayouts{ _renderer.CommonBindGroupLayout(), _instanceBindGroupLayout, _pbrBindGroupLayout};
+    std::array<wgpu::BindGroupLayout, 3> bindGroupLayouts{ _renderer.CommonBindGroupLayout(), _instanceBindGroupLayout, _renderer.GetMaterialSystem().BindGroupLayout() };
     layoutDesc.bindGroupLayoutCount = bindGroupLayouts.size();
     layoutDesc.bindGroupLayouts = bindGroupLayouts.data();
-    wgpu::PipelineLayout pipelineLayout = _renderer.Device().CreatePipelineLayout(&layoutDesc);
+    _pipelineLayout = _renderer.GetObjectCache().GetPipelineLayout(layoutDesc);
+
+    // Variants are only compiled once a material needs them, the full featured ones double as fallbacks while they do.
+    RequestVariant(SceneVariant(MATERIAL_FEATURE_MAPS));
+    _renderer.GetPipelineCache().RegisterWarmUp("pbr", [this](const std::string& variant)
+                                                {
+                                                    // Variants recorded under other scene settings, or that don't parse, aren't worth compiling.
+                                                    uint32_t parsed{};
+                                                    if (parseUint32(variant, parsed) && (parsed & ~MATERIAL_FEATURE_MASK) == SceneVariant(0))
+                                                        RequestVariant(parsed);
+                                                });
+}
+
+PBRPass::~PBRPass() = default;
+
+uint32_t PBRPass::SceneVariant(uint32_t features) const
+{
+    return features | (_renderer.SceneMotionVectors() ? VARIANT_MOTION_VECTORS : 0) | (_renderer.SceneSampleCount() << VARIANT_SAMPLE_COUNT_SHIFT);
+}
+
+uint64_t PBRPass::RequestVariant(uint32_t variant)
+{
+    auto it = _variants.find(variant);
+    if (it != _variants.end())
+        return it->second;
+
+    const uint32_t features = variant & MATERIAL_FEATURE_MASK;
+    const bool motionVectors = variant & VARIANT_MOTION_VECTORS;
+    const uint32_t sampleCount = std::max(variant >> VARIANT_SAMPLE_COUNT_SHIFT, 1u);
 
     std::vector<wgpu::VertexAttribute> vertAttrs = {};
     vertAttrs.emplace_back(wgpu::VertexFormat::Float32x3, offsetof(Vertex, position),  0);
@@ -94,6 +100,8 @@ PBRPass::PBRPass(Renderer& renderer) :
     vertexBufferLayout.attributes = vertAttrs.data();
     vertexBufferLayout.stepMode = wgpu::VertexStepMode::Vertex;
 
+    const bool alphaBlend = features & MATERIAL_FEATURE_ALPHA_BLEND;
+
     wgpu::BlendState blend{};
     blend.color.operation = wgpu::BlendOperation::Add;
     blend.color.srcFactor = wgpu::BlendFactor::SrcAlpha;
@@ -104,19 +112,37 @@ PBRPass::PBRPass(Renderer& renderer) :
 
     wgpu::ColorTargetState colorTarget{};
     colorTarget.format = wgpu::TextureFormat::RGBA16Float; // TODO: Match this with renderer format, instead of hardcoding
-    colorTarget.blend = &blend;
+    colorTarget.blend = alphaBlend ? &blend : nullptr;
     colorTarget.writeMask = wgpu::ColorWriteMask::All;
 
+    // Motion is written without blending, so blended surfaces replace the motion of what's behind them.
+    std::array<wgpu::ColorTargetState, 2> colorTargets{ colorTarget, {} };
+    colorTargets[1].format = _renderer.MOTION_VECTOR_FORMAT;
+    colorTargets[1].writeMask = wgpu::ColorWriteMask::All;
+
+    // Names match the overrides in frag.wgsl.
+    std::array<wgpu::ConstantEntry, 5> constants{};
+    constants[0].key = "HAS_NORMAL_MAP";
+    constants[0].value = (features & MATERIAL_FEATURE_NORMAL_MAP) ? 1.0 : 0.0;
+    constants[1].key = "HAS_EMISSIVE_MAP";
+    constants[1].value = (features & MATERIAL_FEATURE_EMISSIVE_MAP) ? 1.0 : 0.0;
+    constants[2].key = "HAS_OCCLUSION_MAP";
+    constants[2].value = (features & MATERIAL_FEATURE_OCCLUSION_MAP) ? 1.0 : 0.0;
+    constants[3].key = "HAS_METALLIC_ROUGHNESS_MAP";
+    constants[3].value = (features & MATERIAL_FEATURE_METALLIC_ROUGHNESS_MAP) ? 1.0 : 0.0;
+    constants[4].key = "ALPHA_MODE";
+    constants[4].value = alphaBlend ? 2.0 : (features & MATERIAL_FEATURE_ALPHA_MASK) ? 1.0 : 0.0;
+
     wgpu::FragmentState fragment{};
-    fragment.module = _fragModule;
+    fragment.module = motionVectors ? _motionFragModule : _fragModule;
     fragment.entryPoint = "main"; // TODO: Make separate shader class, that has this composed.
-    fragment.targetCount = 1;
-    fragment.targets = &colorTarget;
-    fragment.constantCount = 0; // TODO: research constants.
-    fragment.constants = nullptr;
+    fragment.targetCount = motionVectors ? 2 : 1;
+    fragment.targets = colorTargets.data();
+    fragment.constantCount = constants.size();
+    fragment.constants = constants.data();
 
     wgpu::VertexState vertex{};
-    vertex.module = _vertModule;
+    vertex.module = motionVectors ? _motionVertModule : _vertModule;
     vertex.entryPoint = "main";
     vertex.bufferCount = 1;
     vertex.buffers = &vertexBufferLayout;
@@ -125,10 +151,10 @@ PBRPass::PBRPass(Renderer& renderer) :
     rpDesc.label = "PBR render pipeline";
     rpDesc.fragment = &fragment;
     rpDesc.vertex = vertex;
-    rpDesc.layout = pipelineLayout;
+    rpDesc.layout = _pipelineLayout;
     rpDesc.depthStencil = nullptr;
 
-    rpDesc.multisample.count = 4; // TODO: Match this with renderer target, instead of hardcoding
+    rpDesc.multisample.count = sampleCount;
     rpDesc.multisample.mask = 0xFF'FF'FF'FF;
     rpDesc.multisample.alphaToCoverageEnabled = false;
 
@@ -137,71 +163,114 @@ PBRPass::PBRPass(Renderer& renderer) :
     rpDesc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
     rpDesc.primitive.stripIndexFormat = wgpu::IndexFormat::Undefined;
 
+    // Blended surfaces are tested against the depth buffer but don't occlude each other.
     wgpu::DepthStencilState depthState{};
-    depthState.depthCompare = wgpu::CompareFunction::Less;
-    depthState.depthWriteEnabled = true;
+    depthState.depthCompare = wgpu::CompareFunction::Greater; // Reversed Z.
+    depthState.depthWriteEnabled = !alphaBlend;
     depthState.format = _renderer.DEPTH_STENCIL_FORMAT;
     depthState.stencilReadMask = 0;
     depthState.stencilWriteMask = 0;
 
     rpDesc.depthStencil = &depthState;
 
-    _pipeline = _renderer.Device().CreateRenderPipeline(&rpDesc);
+    const uint64_t key = _renderer.GetPipelineCache().RequestRenderPipeline(rpDesc);
+    _variants.emplace(variant, key);
+    _renderer.GetPipelineCache().RecordVariant("pbr", std::to_string(variant));
+
+    return key;
 }
 
-PBRPass::~PBRPass() = default;
+void PBRPass::RenderOpaque(const wgpu::RenderPassEncoder& pass)
+{
+    // Draws are batched by shader variant. The blend bit is the highest, so blended surfaces go last.
+    std::stable_sort(_drawings.begin(), _drawings.end(), [](const auto& lhs, const auto& rhs)
+                     {
+                         return std::get<0>(lhs).materialFeatures < std::get<0>(rhs).materialFeatures;
+                     });
+
+    _blendedBegin = std::find_if(_drawings.begin(), _drawings.end(), [](const auto& drawing)
+                                 {
+                                     return std::get<0>(drawing).materialFeatures & MATERIAL_FEATURE_ALPHA_BLEND;
+                                 }) - _drawings.begin();
+
+    RenderDrawings(pass, 0, _blendedBegin);
+}
+
+void PBRPass::RenderBlended(const wgpu::RenderPassEncoder& pass)
+{
+    // Blended surfaces go back to front by the view depth of their origin, so nearer ones blend over farther ones.
+    const glm::mat4 view = glm::inverse(_renderer.BuildSRT(_renderer.GetCameraTransform()));
+    auto viewDepth = [&view](const std::tuple<Mesh, Transform>& drawing)
+    {
+        return (view * glm::vec4{ std::get<1>(drawing).translation, 1.0f }).z;
+    };
+    std::sort(_drawings.begin() + _blendedBegin, _drawings.end(), [&viewDepth](const auto& lhs, const auto& rhs)
+              {
+                  return viewDepth(lhs) > viewDepth(rhs);
+              });
+
+    RenderDrawings(pass, _blendedBegin, _drawings.size());
+    _drawings.clear();
+    _blendedBegin = 0;
+}
 
-void PBRPass::Render(const wgpu::CommandEncoder& encoder, const wgpu::TextureView& renderTarget, std::shared_ptr<const wgpu::TextureView> resolveTarget)
+void PBRPass::RenderDrawings(const wgpu::RenderPassEncoder& pass, size_t begin, size_t end)
 {
-    wgpu::RenderPassColorAttachment colorDesc{};
-    colorDesc.view = renderTarget;
-    colorDesc.resolveTarget = resolveTarget ? *resolveTarget : nullptr;
-    colorDesc.loadOp = wgpu::LoadOp::Load;
-    colorDesc.storeOp = wgpu::StoreOp::Discard; // TODO: Review difference with store.
-    colorDesc.clearValue.r = 0.3f;
-    colorDesc.clearValue.g = 0.3f;
-    colorDesc.clearValue.b = 0.3f;
-    colorDesc.clearValue.a = 1.0f;
-
-    wgpu::RenderPassDescriptor renderPass{};
-    renderPass.label = "Main render pass";
-    renderPass.colorAttachmentCount = 1;
-    renderPass.colorAttachments = &colorDesc;
-    renderPass.depthStencilAttachment = &_renderer.DepthStencilAttachment();
-
-    wgpu::RenderPassEncoder pass = encoder.BeginRenderPass(&renderPass);
-
-    pass.SetPipeline(_pipeline);
-
-    uint32_t i{ 0 };
-    while (!_drawings.empty())
+    if (begin == end)
+        return;
+
+    // Every material lives in the same bind group, only the instance changes per draw.
+    pass.SetBindGroup(0, _renderer.CommonBindGroup(), 0, nullptr);
+    pass.SetBindGroup(2, _renderer.GetMaterialSystem().BindGroup(), 0, nullptr);
+
+    PipelineCache& pipelineCache = _renderer.GetPipelineCache();
+
+    uint32_t batchFeatures{ ~0u };
+    wgpu::RenderPipeline pipeline{};
+    for (size_t i = begin; i < end; ++i)
     {
-        auto [mesh, transform] = _drawings.front();
-        _drawings.pop();
+        const auto& [mesh, transform] = _drawings[i];
+        if (mesh.materialFeatures != batchFeatures)
+        {
+            // Until the variant has compiled the batch is drawn with every map enabled, or skipped if that isn't ready either.
+            batchFeatures = mesh.materialFeatures;
+            const uint64_t fallbackKey = RequestVariant(SceneVariant((batchFeatures & ~MATERIAL_FEATURE_MAPS) | MATERIAL_FEATURE_MAPS));
+            pipeline = pipelineCache.GetRenderPipeline(RequestVariant(SceneVariant(batchFeatures)), pipelineCache.GetRenderPipeline(fallbackKey));
+            if (pipeline)
+                pass.SetPipeline(pipeline);
+        }
+
+        if (!pipeline)
+            continue;
 
         Instance instance;
         instance.model = _renderer.BuildSRT(transform);
         instance.transInvModel = glm::mat4{ glm::mat3{ glm::transpose(glm::inverse(instance.model)) } };
+        instance.materialIndex = mesh.materialIndex;
 
-        uint32_t dynamicOffset{ i * _uniformStride };
-        _renderer.Queue().WriteBuffer(_instanceBuffer, dynamicOffset, &instance, sizeof(instance)); // TODO: write entire buffer once.
+        uint32_t dynamicOffset{};
+        if (!_renderer.GetUniformRing().Allocate(instance, dynamicOffset))
+            continue;
 
-        pass.SetVertexBuffer(0, mesh.vertBuf, 0, wgpu::kWholeSize);
-        pass.SetIndexBuffer(mesh.indexBuf, mesh.indexFormat, 0, wgpu::kWholeSize);
+        pass.SetVertexBuffer(0, mesh.buffers->vertBuf, 0, wgpu::kWholeSize);
+        pass.SetIndexBuffer(mesh.buffers->indexBuf, mesh.buffers->indexFormat, 0, wgpu::kWholeSize);
 
-        pass.SetBindGroup(0, _renderer.CommonBindGroup(), 0, nullptr);
         pass.SetBindGroup(1, _instanceBindGroup, 1, &dynamicOffset);
-        pass.SetBindGroup(2, mesh.bindGroup, 0, nullptr);
-
-        pass.DrawIndexed(mesh.indexCount, 1, 0, 0, 0);
 
-        ++i;
+        pass.DrawIndexed(mesh.buffers->indexCount, 1, 0, 0, 0);
     }
-
-    pass.End();
 }
 
 void PBRPass::DrawMesh(const Mesh& mesh, const Transform& transform) const
 {
-    _drawings.emplace(mesh, transform);
+    if (!mesh.buffers)
+        return;
+
+    // Evicted meshes are loaded again when they're drawn, and skipped for as long as that fails.
+    ResidencyManager& residencyManager = _renderer.GetResidencyManager();
+    if (residencyManager.IsEvicted(mesh.evictionId) && !mesh.Reload(_renderer))
+        return;
+
+    residencyManager.Touch(mesh.evictionId);
+    _drawings.emplace_back(mesh, transform);
 }
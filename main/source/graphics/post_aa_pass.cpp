@@ -0,0 +1,152 @@
+#include "graphics/post_aa_pass.hpp"
+#include "renderer.hpp"
+#include "pipeline_cache.hpp"
+#include "gpu_object_cache.hpp"
+#include "shader_library.hpp"
+#include "uniform_ring.hpp"
+#include <cstddef>
+
+PostAAPass::PostAAPass(Renderer& renderer) : RenderPass(renderer, renderer.SwapChainFormat())
+{
+    ShaderStruct paramsStruct{ "PostAAParams", sizeof(Params) };
+    paramsStruct.Field<glm::vec2>("texelSize", offsetof(Params, texelSize))
+                .Field<glm::vec2>("size", offsetof(Params, size));
+    _renderer.GetShaderLibrary().AddGeneratedStructs("generated/post-aa.wgsl", { paramsStruct });
+
+    _shader = _renderer.CreateShader("assets/shaders/post-aa.wgsl", "Post AA shader");
+
+    std::array<wgpu::BindGroupLayoutEntry, 4> bgLayoutEntries{};
+    bgLayoutEntries[0].binding = 0;
+    bgLayoutEntries[0].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutEntries[0].texture.sampleType = wgpu::TextureSampleType::Float;
+    bgLayoutEntries[0].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+    bgLayoutEntries[1].binding = 1;
+    bgLayoutEntries[1].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutEntries[1].texture.sampleType = wgpu::TextureSampleType::Float;
+    bgLayoutEntries[1].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+    bgLayoutEntries[2].binding = 2;
+    bgLayoutEntries[2].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutEntries[2].sampler.type = wgpu::SamplerBindingType::Filtering;
+    bgLayoutEntries[3].binding = 3;
+    bgLayoutEntries[3].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutEntries[3].buffer.type = wgpu::BufferBindingType::Uniform;
+    bgLayoutEntries[3].buffer.minBindingSize = sizeof(Params);
+    bgLayoutEntries[3].buffer.hasDynamicOffset = true;
+
+    wgpu::BindGroupLayoutDescriptor bgLayoutDesc{};
+    bgLayoutDesc.label = "Post AA bind group layout";
+    bgLayoutDesc.entryCount = bgLayoutEntries.size();
+    bgLayoutDesc.entries = bgLayoutEntries.data();
+    _bindGroupLayout = _renderer.GetObjectCache().GetBindGroupLayout(bgLayoutDesc);
+
+    wgpu::PipelineLayoutDescriptor pipelineLayoutDesc{};
+    pipelineLayoutDesc.label = "Post AA pipeline layout";
+    pipelineLayoutDesc.bindGroupLayoutCount = 1;
+    pipelineLayoutDesc.bindGroupLayouts = &_bindGroupLayout;
+    _pipelineLayout = _renderer.GetObjectCache().GetPipelineLayout(pipelineLayoutDesc);
+
+    wgpu::SamplerDescriptor samplerDesc{};
+    samplerDesc.label = "Post AA sampler";
+    samplerDesc.addressModeU = wgpu::AddressMode::ClampToEdge;
+    samplerDesc.addressModeV = wgpu::AddressMode::ClampToEdge;
+    samplerDesc.addressModeW = wgpu::AddressMode::ClampToEdge;
+    samplerDesc.minFilter = wgpu::FilterMode::Linear;
+    samplerDesc.magFilter = wgpu::FilterMode::Linear;
+    samplerDesc.mipmapFilter = wgpu::MipmapFilterMode::Nearest;
+    _sampler = _renderer.GetObjectCache().GetSampler(samplerDesc);
+
+    _fxaa.pipelineKey = RequestPipeline("fs_fxaa", _renderFormat, "FXAA pipeline");
+    _edges.pipelineKey = RequestPipeline("fs_edges", EDGES_FORMAT, "SMAA edge detection pipeline");
+    _blendWeights.pipelineKey = RequestPipeline("fs_blend_weights", BLEND_WEIGHTS_FORMAT, "SMAA blend weight pipeline");
+    _blend.pipelineKey = RequestPipeline("fs_blend", _renderFormat, "SMAA blend pipeline");
+}
+
+PostAAPass::~PostAAPass() = default;
+
+uint64_t PostAAPass::RequestPipeline(const char* entryPoint, wgpu::TextureFormat format, const char* label)
+{
+    wgpu::ColorTargetState colorTarget{};
+    colorTarget.format = format;
+    colorTarget.blend = nullptr;
+    colorTarget.writeMask = wgpu::ColorWriteMask::All;
+
+    wgpu::FragmentState fragment{};
+    fragment.module = _shader;
+    fragment.entryPoint = entryPoint;
+    fragment.targetCount = 1;
+    fragment.targets = &colorTarget;
+
+    wgpu::RenderPipelineDescriptor pipelineDesc{};
+    pipelineDesc.label = label;
+    pipelineDesc.layout = _pipelineLayout;
+    pipelineDesc.vertex.module = _shader;
+    pipelineDesc.vertex.entryPoint = "vs_main";
+    pipelineDesc.vertex.bufferCount = 0;
+    pipelineDesc.vertex.buffers = nullptr;
+    pipelineDesc.fragment = &fragment;
+    pipelineDesc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
+    pipelineDesc.primitive.cullMode = wgpu::CullMode::None;
+    pipelineDesc.multisample.count = 1;
+    pipelineDesc.multisample.mask = 0xFF'FF'FF'FF;
+    pipelineDesc.depthStencil = nullptr;
+
+    return _renderer.GetPipelineCache().RequestRenderPipeline(pipelineDesc);
+}
+
+void PostAAPass::RenderFXAA(const wgpu::RenderPassEncoder& pass, const wgpu::TextureView& input, const glm::uvec2& size)
+{
+    Render(pass, _fxaa, input, input, size);
+}
+
+void PostAAPass::RenderEdges(const wgpu::RenderPassEncoder& pass, const wgpu::TextureView& input, const glm::uvec2& size)
+{
+    Render(pass, _edges, input, input, size);
+}
+
+void PostAAPass::RenderBlendWeights(const wgpu::RenderPassEncoder& pass, const wgpu::TextureView& edges, const glm::uvec2& size)
+{
+    Render(pass, _blendWeights, edges, edges, size);
+}
+
+void PostAAPass::RenderBlend(const wgpu::RenderPassEncoder& pass, const wgpu::TextureView& input, const wgpu::TextureView& weights, const glm::uvec2& size)
+{
+    Render(pass, _blend, input, weights, size);
+}
+
+void PostAAPass::Render(const wgpu::RenderPassEncoder& pass, Stage& stage, const wgpu::TextureView& input, const wgpu::TextureView& secondInput, const glm::uvec2& size)
+{
+    if (input.Get() != stage.input.Get() || secondInput.Get() != stage.secondInput.Get())
+    {
+        std::array<wgpu::BindGroupEntry, 4> bgEntries{};
+        bgEntries[0].binding = 0;
+        bgEntries[0].textureView = input;
+        bgEntries[1].binding = 1;
+        bgEntries[1].textureView = secondInput;
+        bgEntries[2].binding = 2;
+        bgEntries[2].sampler = _sampler;
+        bgEntries[3].binding = 3;
+        bgEntries[3].buffer = _renderer.GetUniformRing().Buffer();
+        bgEntries[3].size = sizeof(Params);
+
+        wgpu::BindGroupDescriptor bgDesc{};
+        bgDesc.label = "Post AA bind group";
+        bgDesc.layout = _bindGroupLayout;
+        bgDesc.entryCount = bgEntries.size();
+        bgDesc.entries = bgEntries.data();
+
+        stage.bindGroup = _renderer.Device().CreateBindGroup(&bgDesc);
+        stage.input = input;
+        stage.secondInput = secondInput;
+    }
+
+    // The target is still cleared while the pipeline compiles.
+    wgpu::RenderPipeline pipeline = _renderer.GetPipelineCache().GetRenderPipeline(stage.pipelineKey);
+    const Params params{ 1.0f / glm::vec2{ size }, glm::vec2{ size } };
+    uint32_t dynamicOffset{};
+    if (!pipeline || !_renderer.GetUniformRing().Allocate(params, dynamicOffset))
+        return;
+
+    pass.SetPipeline(pipeline);
+    pass.SetBindGroup(0, stage.bindGroup, 1, &dynamicOffset);
+    pass.Draw(3, 1, 0, 0);
+}
@@ -1,68 +1,24 @@
 #include "graphics/skybox_pass.hpp"
 #include "renderer.hpp"
+#include <cstddef>
+#include "pipeline_cache.hpp"
+#include "gpu_object_cache.hpp"
+#include "shader_library.hpp"
 
-constexpr glm::vec3 CUBE_VERTICES[] = {
-    // -Z   
-    glm::vec3{ -1.0f,  1.0f, -1.0f },
-    glm::vec3{ -1.0f, -1.0f, -1.0f },
-    glm::vec3{  1.0f, -1.0f, -1.0f },
-    glm::vec3{  1.0f, -1.0f, -1.0f },
-    glm::vec3{  1.0f,  1.0f, -1.0f },
-    glm::vec3{ -1.0f,  1.0f, -1.0f },
-
-    // -X
-    glm::vec3{ -1.0f, -1.0f,  1.0f },
-    glm::vec3{ -1.0f, -1.0f, -1.0f },
-    glm::vec3{ -1.0f,  1.0f, -1.0f },
-    glm::vec3{ -1.0f,  1.0f, -1.0f },
-    glm::vec3{ -1.0f,  1.0f,  1.0f },
-    glm::vec3{ -1.0f, -1.0f,  1.0f },
-
-    // +X
-    glm::vec3{  1.0f, -1.0f, -1.0f },
-    glm::vec3{  1.0f, -1.0f,  1.0f },
-    glm::vec3{  1.0f,  1.0f,  1.0f },
-    glm::vec3{  1.0f,  1.0f,  1.0f },
-    glm::vec3{  1.0f,  1.0f, -1.0f },
-    glm::vec3{  1.0f, -1.0f, -1.0f },
-
-    // +Z
-    glm::vec3{ -1.0f, -1.0f,  1.0f },
-    glm::vec3{ -1.0f,  1.0f,  1.0f },
-    glm::vec3{  1.0f,  1.0f,  1.0f },
-    glm::vec3{  1.0f,  1.0f,  1.0f },
-    glm::vec3{  1.0f, -1.0f,  1.0f },
-    glm::vec3{ -1.0f, -1.0f,  1.0f },
-
-    // +Y
-    glm::vec3{ -1.0f,  1.0f, -1.0f },
-    glm::vec3{  1.0f,  1.0f, -1.0f },
-    glm::vec3{  1.0f,  1.0f,  1.0f },
-    glm::vec3{  1.0f,  1.0f,  1.0f },
-    glm::vec3{ -1.0f,  1.0f,  1.0f },
-    glm::vec3{ -1.0f,  1.0f, -1.0f }, 
-
-    // -Y
-    glm::vec3{ -1.0f, -1.0f, -1.0f },
-    glm::vec3{ -1.0f, -1.0f,  1.0f },
-    glm::vec3{  1.0f, -1.0f, -1.0f },
-    glm::vec3{  1.0f, -1.0f, -1.0f },
-    glm::vec3{ -1.0f, -1.0f,  1.0f },
-    glm::vec3{  1.0f, -1.0f,  1.0f }, 
-};
- 
 SkyboxPass::SkyboxPass(Renderer& renderer) : RenderPass(renderer, wgpu::TextureFormat::RGBA16Float)
 {
-    _instance.model = glm::identity<glm::mat4>(); 
+    ShaderStruct instanceStruct{ "Instance", sizeof(Instance) };
+    instanceStruct.Field<float>("intensity", offsetof(Instance, intensity));
+    _renderer.GetShaderLibrary().AddGeneratedStructs("generated/skybox-instance.wgsl", { instanceStruct });
 
-    _vertexBuffer = _renderer.CreateBuffer(CUBE_VERTICES, sizeof(CUBE_VERTICES), wgpu::BufferUsage::Vertex, "Skybox vertex buffer");
-    _instanceBuffer = _renderer.CreateBuffer(&_instance, sizeof(_instance), wgpu::BufferUsage::Uniform, "Skybox instance buffer");
+    _instance = UniformBlock<Instance>{ _renderer.CreateBuffer(nullptr, sizeof(Instance), wgpu::BufferUsage::Uniform, "Skybox instance buffer") };
     _skyboxShader = _renderer.CreateShader("assets/shaders/skybox.wgsl", "Skybox shader");
+    _skyboxMotionShader = _renderer.GetShaderLibrary().GetModule("assets/shaders/skybox.wgsl", { { "MOTION_VECTORS", "" } }, "Skybox motion vector shader");
 
     std::array<wgpu::BindGroupLayoutEntry, 3> skyboxBGLayoutEntries{};
     skyboxBGLayoutEntries[0].binding = 0;
     skyboxBGLayoutEntries[0].visibility = wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment;
-    skyboxBGLayoutEntries[0].buffer.minBindingSize = sizeof(_instance);
+    skyboxBGLayoutEntries[0].buffer.minBindingSize = sizeof(Instance);
     skyboxBGLayoutEntries[0].buffer.type = wgpu::BufferBindingType::Uniform;
     skyboxBGLayoutEntries[0].buffer.hasDynamicOffset = false;
 
@@ -80,7 +36,7 @@ SkyboxPass::SkyboxPass(Renderer& renderer) : RenderPass(renderer, wgpu::TextureF
     bindGroupLayoutDesc.entryCount = skyboxBGLayoutEntries.size();
     bindGroupLayoutDesc.entries = skyboxBGLayoutEntries.data();
 
-    _skyboxBGL = _renderer.Device().CreateBindGroupLayout(&bindGroupLayoutDesc);
+    _skyboxBGL = _renderer.GetObjectCache().GetBindGroupLayout(bindGroupLayoutDesc);
 
     std::array<wgpu::BindGroupLayout, 2> bindGroupLayouts{ _renderer.CommonBindGroupLayout(), _skyboxBGL };
 
@@ -88,61 +44,9 @@ SkyboxPass::SkyboxPass(Renderer& renderer) : RenderPass(renderer, wgpu::TextureF
     pipelineLayoutDesc.bindGroupLayoutCount = bindGroupLayouts.size();
     pipelineLayoutDesc.bindGroupLayouts = bindGroupLayouts.data();
 
-    wgpu::PipelineLayout skyboxPipelineLayout = _renderer.Device().CreatePipelineLayout(&pipelineLayoutDesc);
-    
-    wgpu::BlendState blend{};
-    blend.color.operation = wgpu::BlendOperation::Add;
-    blend.color.srcFactor = wgpu::BlendFactor::SrcAlpha;
-    blend.color.dstFactor = wgpu::BlendFactor::OneMinusSrcAlpha;
-    blend.alpha.operation = wgpu::BlendOperation::Add;
-    blend.alpha.srcFactor = wgpu::BlendFactor::Zero;
-    blend.alpha.dstFactor = wgpu::BlendFactor::One;
+    _pipelineLayout = _renderer.GetObjectCache().GetPipelineLayout(pipelineLayoutDesc);
+    RequestPipeline(_renderer.SceneSampleCount(), _renderer.SceneMotionVectors());
 
-    wgpu::ColorTargetState colorTarget{};
-    colorTarget.format = wgpu::TextureFormat::RGBA16Float; // TODO: Match this with renderer format, instead of hardcoding
-    colorTarget.blend = &blend;
-    colorTarget.writeMask = wgpu::ColorWriteMask::All;
-
-    wgpu::FragmentState fragmentState{};
-    fragmentState.module = _skyboxShader;
-    fragmentState.entryPoint = "fs_main";
-    fragmentState.targetCount = 1;
-    fragmentState.targets = &colorTarget;
-
-    wgpu::VertexAttribute vertexAttribute{};
-    vertexAttribute.format = wgpu::VertexFormat::Float32x3;
-    vertexAttribute.offset = 0;
-    vertexAttribute.shaderLocation = 0;
-
-    wgpu::VertexBufferLayout vertexBufferLayout{};
-    vertexBufferLayout.arrayStride = sizeof(glm::vec3);
-    vertexBufferLayout.stepMode = wgpu::VertexStepMode::Vertex;
-    vertexBufferLayout.attributeCount = 1;
-    vertexBufferLayout.attributes = &vertexAttribute;
-
-    wgpu::RenderPipelineDescriptor renderPipelineDesc{};
-    renderPipelineDesc.label = "Skybox pipeline";
-    renderPipelineDesc.layout = skyboxPipelineLayout;
-    renderPipelineDesc.vertex.module = _skyboxShader;
-    renderPipelineDesc.vertex.entryPoint = "vs_main";
-    renderPipelineDesc.vertex.bufferCount = 1;
-    renderPipelineDesc.vertex.buffers = &vertexBufferLayout;
-    renderPipelineDesc.fragment = &fragmentState;
-    renderPipelineDesc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
-    renderPipelineDesc.primitive.cullMode = wgpu::CullMode::None; // Review later.
-    
-    wgpu::DepthStencilState depthStencilState{};
-    depthStencilState.format = _renderer.DEPTH_STENCIL_FORMAT;
-    depthStencilState.depthWriteEnabled = false;
-    depthStencilState.depthCompare = wgpu::CompareFunction::Less; // Review later.
-
-    renderPipelineDesc.depthStencil = &depthStencilState;
-    renderPipelineDesc.multisample.count = 4; // TODO: Match this with renderer target, instead of hardcoding
-    renderPipelineDesc.multisample.mask = 0xFF'FF'FF'FF;
-    renderPipelineDesc.multisample.alphaToCoverageEnabled = false;
-
-    _skyboxPipeline = _renderer.Device().CreateRenderPipeline(&renderPipelineDesc);
-    
     wgpu::SamplerDescriptor samplerDesc{};
     samplerDesc.label = "Skybox sampler";
     samplerDesc.addressModeU = wgpu::AddressMode::ClampToEdge;
@@ -152,7 +56,7 @@ SkyboxPass::SkyboxPass(Renderer& renderer) : RenderPass(renderer, wgpu::TextureF
     samplerDesc.magFilter = wgpu::FilterMode::Linear;
     samplerDesc.mipmapFilter = wgpu::MipmapFilterMode::Linear;
 
-    _skyboxSampler = _renderer.Device().CreateSampler(&samplerDesc);
+    _skyboxSampler = _renderer.GetObjectCache().GetSampler(samplerDesc);
      
     wgpu::TextureDescriptor skyboxTextureDesc{};
     skyboxTextureDesc.label = "Skybox texture";
@@ -172,12 +76,13 @@ SkyboxPass::SkyboxPass(Renderer& renderer) : RenderPass(renderer, wgpu::TextureF
     skyboxViewDesc.mipLevelCount = 1;
 
     _skyboxTexture = _renderer.Device().CreateTexture(&skyboxTextureDesc);
+    _renderer.GetResidencyManager().Track(_skyboxTexture, ResidencyCategory::Textures);
     _skyboxView = _skyboxTexture.CreateView(&skyboxViewDesc);
 
 
     std::array<wgpu::BindGroupEntry, 3> bgEntries{};
     bgEntries[0].binding = 0;
-    bgEntries[0].buffer = _instanceBuffer;
+    bgEntries[0].buffer = _instance.Buffer();
     bgEntries[0].offset = 0;
     bgEntries[1].binding = 1;
     bgEntries[1].sampler = _skyboxSampler;
@@ -194,36 +99,83 @@ SkyboxPass::SkyboxPass(Renderer& renderer) : RenderPass(renderer, wgpu::TextureF
 
 SkyboxPass::~SkyboxPass() = default;
 
-void SkyboxPass::Render(const wgpu::CommandEncoder& encoder, const wgpu::TextureView& renderTarget, std::shared_ptr<const wgpu::TextureView> resolveTarget)
+uint32_t SkyboxPass::PipelineVariant(uint32_t sampleCount, bool motionVectors)
+{
+    return sampleCount | (motionVectors ? 1u << 8 : 0u);
+}
+
+uint64_t SkyboxPass::RequestPipeline(uint32_t sampleCount, bool motionVectors)
+{
+    auto it = _pipelineKeys.find(PipelineVariant(sampleCount, motionVectors));
+    if (it != _pipelineKeys.end())
+        return it->second;
+
+    wgpu::BlendState blend{};
+    blend.color.operation = wgpu::BlendOperation::Add;
+    blend.color.srcFactor = wgpu::BlendFactor::SrcAlpha;
+    blend.color.dstFactor = wgpu::BlendFactor::OneMinusSrcAlpha;
+    blend.alpha.operation = wgpu::BlendOperation::Add;
+    blend.alpha.srcFactor = wgpu::BlendFactor::Zero;
+    blend.alpha.dstFactor = wgpu::BlendFactor::One;
+
+    wgpu::ColorTargetState colorTarget{};
+    colorTarget.format = wgpu::TextureFormat::RGBA16Float; // TODO: Match this with renderer format, instead of hardcoding
+    colorTarget.blend = &blend;
+    colorTarget.writeMask = wgpu::ColorWriteMask::All;
+
+    // The sky's motion comes from the camera rotation alone, it's written without blending.
+    std::array<wgpu::ColorTargetState, 2> colorTargets{ colorTarget, {} };
+    colorTargets[1].format = _renderer.MOTION_VECTOR_FORMAT;
+    colorTargets[1].writeMask = wgpu::ColorWriteMask::All;
+
+    const wgpu::ShaderModule& shader = motionVectors ? _skyboxMotionShader : _skyboxShader;
+
+    wgpu::FragmentState fragmentState{};
+    fragmentState.module = shader;
+    fragmentState.entryPoint = "fs_main";
+    fragmentState.targetCount = motionVectors ? 2 : 1;
+    fragmentState.targets = colorTargets.data();
+
+    wgpu::RenderPipelineDescriptor renderPipelineDesc{};
+    renderPipelineDesc.label = "Skybox pipeline";
+    renderPipelineDesc.layout = _pipelineLayout;
+    renderPipelineDesc.vertex.module = shader;
+    renderPipelineDesc.vertex.entryPoint = "vs_main";
+    renderPipelineDesc.vertex.bufferCount = 0;
+    renderPipelineDesc.vertex.buffers = nullptr;
+    renderPipelineDesc.fragment = &fragmentState;
+    renderPipelineDesc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
+    renderPipelineDesc.primitive.cullMode = wgpu::CullMode::None; // Review later.
+    
+    wgpu::DepthStencilState depthStencilState{};
+    depthStencilState.format = _renderer.DEPTH_STENCIL_FORMAT;
+    depthStencilState.depthWriteEnabled = false;
+    // The sky is at the far plane, which is depth 0 with reversed Z. It passes against the cleared depth and
+    // is rejected early behind anything drawn.
+    depthStencilState.depthCompare = wgpu::CompareFunction::GreaterEqual;
+
+    renderPipelineDesc.depthStencil = &depthStencilState;
+    renderPipelineDesc.multisample.count = sampleCount;
+    renderPipelineDesc.multisample.mask = 0xFF'FF'FF'FF;
+    renderPipelineDesc.multisample.alphaToCoverageEnabled = false;
+
+    const uint64_t key = _renderer.GetPipelineCache().RequestRenderPipeline(renderPipelineDesc);
+    _pipelineKeys[PipelineVariant(sampleCount, motionVectors)] = key;
+    return key;
+}
+
+void SkyboxPass::Render(const wgpu::RenderPassEncoder& pass)
 {
-    Transform cameraTransform = _renderer.GetCameraTransform();
-    _instance.model = glm::translate(glm::mat4{ 1.0f }, cameraTransform.translation);
-    _renderer.Queue().WriteBuffer(_instanceBuffer, 0, &_instance, sizeof(_instance));
-
-    wgpu::RenderPassColorAttachment colorDesc{};
-    colorDesc.view = renderTarget;
-    colorDesc.resolveTarget = resolveTarget ? *resolveTarget : nullptr;
-    colorDesc.loadOp = wgpu::LoadOp::Clear;
-    colorDesc.storeOp = wgpu::StoreOp::Store;
-    colorDesc.clearValue.r = 0.3f;
-    colorDesc.clearValue.g = 0.3f;
-    colorDesc.clearValue.b = 0.3f;
-    colorDesc.clearValue.a = 1.0f;
-
-    wgpu::RenderPassDescriptor renderPass{};
-    renderPass.label = "Skybox render pass";
-    renderPass.colorAttachmentCount = 1;
-    renderPass.colorAttachments = &colorDesc;
-    renderPass.depthStencilAttachment = &_renderer.DepthStencilAttachment();
-
-    wgpu::RenderPassEncoder pass = encoder.BeginRenderPass(&renderPass);
-
-    pass.SetPipeline(_skyboxPipeline);
-    pass.SetVertexBuffer(0, _vertexBuffer, 0, wgpu::kWholeSize);
-    pass.SetBindGroup(0, _renderer.CommonBindGroup(), 0, nullptr);
-    pass.SetBindGroup(1, _skyboxBindGroup, 0, nullptr);
-
-    pass.Draw(36, 1, 0, 0);
-
-    pass.End();
+    _instance.Flush(_renderer.Queue());
+
+    const uint64_t key = RequestPipeline(_renderer.SceneSampleCount(), _renderer.SceneMotionVectors());
+    wgpu::RenderPipeline pipeline = _renderer.GetPipelineCache().GetRenderPipeline(key);
+    if (pipeline)
+    {
+        pass.SetPipeline(pipeline);
+        pass.SetBindGroup(0, _renderer.CommonBindGroup(), 0, nullptr);
+        pass.SetBindGroup(1, _skyboxBindGroup, 0, nullptr);
+
+        pass.Draw(3, 1, 0, 0);
+    }
 }
@@ -0,0 +1,211 @@
+#include "graphics/taa_pass.hpp"
+#include "renderer.hpp"
+#include "frame_scheduler.hpp"
+#include "pipeline_cache.hpp"
+#include "gpu_object_cache.hpp"
+#include "shader_library.hpp"
+#include "uniform_ring.hpp"
+#include <cstddef>
+
+// Halton sequence in bases 2 and 3 spreads the samples evenly over a pixel, for any number of frames.
+constexpr uint32_t TAA_SAMPLE_COUNT{ 8 };
+
+float Halton(uint32_t index, uint32_t base)
+{
+    float result{ 0.0f };
+    float fraction{ 1.0f };
+    for (; index > 0; index /= base)
+    {
+        fraction /= static_cast<float>(base);
+        result += fraction * static_cast<float>(index % base);
+    }
+
+    return result;
+}
+
+TAAPass::TAAPass(Renderer& renderer) : RenderPass(renderer, wgpu::TextureFormat::RGBA16Float)
+{
+    ShaderStruct paramsStruct{ "TAAParams", sizeof(Params) };
+    paramsStruct.Field<glm::vec2>("inputSize", offsetof(Params, inputSize))
+                .Field<glm::vec2>("outputSize", offsetof(Params, outputSize))
+                .Field<glm::vec2>("jitter", offsetof(Params, jitter))
+                .Field<float>("blend", offsetof(Params, blend))
+                .Field<uint32_t>("historyValid", offsetof(Params, historyValid));
+    _renderer.GetShaderLibrary().AddGeneratedStructs("generated/taa.wgsl", { paramsStruct });
+
+    _shader = _renderer.CreateShader("assets/shaders/taa.wgsl", "TAA shader");
+
+    std::array<wgpu::BindGroupLayoutEntry, 5> bgLayoutEntries{};
+    bgLayoutEntries[0].binding = 0;
+    bgLayoutEntries[0].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutEntries[0].texture.sampleType = wgpu::TextureSampleType::UnfilterableFloat;
+    bgLayoutEntries[0].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+    bgLayoutEntries[1].binding = 1;
+    bgLayoutEntries[1].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutEntries[1].texture.sampleType = wgpu::TextureSampleType::UnfilterableFloat;
+    bgLayoutEntries[1].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+    bgLayoutEntries[2].binding = 2;
+    bgLayoutEntries[2].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutEntries[2].texture.sampleType = wgpu::TextureSampleType::Float;
+    bgLayoutEntries[2].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+    bgLayoutEntries[3].binding = 3;
+    bgLayoutEntries[3].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutEntries[3].sampler.type = wgpu::SamplerBindingType::Filtering;
+    bgLayoutEntries[4].binding = 4;
+    bgLayoutEntries[4].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutEntries[4].buffer.type = wgpu::BufferBindingType::Uniform;
+    bgLayoutEntries[4].buffer.minBindingSize = sizeof(Params);
+    bgLayoutEntries[4].buffer.hasDynamicOffset = true;
+
+    wgpu::BindGroupLayoutDescriptor bgLayoutDesc{};
+    bgLayoutDesc.label = "TAA bind group layout";
+    bgLayoutDesc.entryCount = bgLayoutEntries.size();
+    bgLayoutDesc.entries = bgLayoutEntries.data();
+    _bindGroupLayout = _renderer.GetObjectCache().GetBindGroupLayout(bgLayoutDesc);
+
+    wgpu::PipelineLayoutDescriptor pipelineLayoutDesc{};
+    pipelineLayoutDesc.label = "TAA pipeline layout";
+    pipelineLayoutDesc.bindGroupLayoutCount = 1;
+    pipelineLayoutDesc.bindGroupLayouts = &_bindGroupLayout;
+    _pipelineLayout = _renderer.GetObjectCache().GetPipelineLayout(pipelineLayoutDesc);
+
+    wgpu::SamplerDescriptor samplerDesc{};
+    samplerDesc.label = "TAA history sampler";
+    samplerDesc.addressModeU = wgpu::AddressMode::ClampToEdge;
+    samplerDesc.addressModeV = wgpu::AddressMode::ClampToEdge;
+    samplerDesc.addressModeW = wgpu::AddressMode::ClampToEdge;
+    samplerDesc.minFilter = wgpu::FilterMode::Linear;
+    samplerDesc.magFilter = wgpu::FilterMode::Linear;
+    samplerDesc.mipmapFilter = wgpu::MipmapFilterMode::Nearest;
+    _sampler = _renderer.GetObjectCache().GetSampler(samplerDesc);
+
+    wgpu::ColorTargetState colorTarget{};
+    colorTarget.format = _renderFormat;
+    colorTarget.blend = nullptr;
+    colorTarget.writeMask = wgpu::ColorWriteMask::All;
+
+    wgpu::FragmentState fragment{};
+    fragment.module = _shader;
+    fragment.entryPoint = "fs_main";
+    fragment.targetCount = 1;
+    fragment.targets = &colorTarget;
+
+    wgpu::RenderPipelineDescriptor pipelineDesc{};
+    pipelineDesc.label = "TAA pipeline";
+    pipelineDesc.layout = _pipelineLayout;
+    pipelineDesc.vertex.module = _shader;
+    pipelineDesc.vertex.entryPoint = "vs_main";
+    pipelineDesc.vertex.bufferCount = 0;
+    pipelineDesc.vertex.buffers = nullptr;
+    pipelineDesc.fragment = &fragment;
+    pipelineDesc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
+    pipelineDesc.primitive.cullMode = wgpu::CullMode::None;
+    pipelineDesc.multisample.count = 1;
+    pipelineDesc.multisample.mask = 0xFF'FF'FF'FF;
+    pipelineDesc.depthStencil = nullptr;
+
+    _pipelineKey = _renderer.GetPipelineCache().RequestRenderPipeline(pipelineDesc);
+}
+
+TAAPass::~TAAPass()
+{
+    for (History& history : _histories)
+    {
+        if (history.texture)
+            _renderer.GetResidencyManager().Untrack(history.texture);
+    }
+}
+
+glm::vec2 TAAPass::BeginFrame(const glm::uvec2& outputSize)
+{
+    if (outputSize != _outputSize)
+        CreateHistories(outputSize);
+
+    _current = 1 - _current;
+    _sampleIndex = (_sampleIndex + 1) % TAA_SAMPLE_COUNT;
+
+    // The sequence starts at 1, index 0 would be the pixel's corner in both bases.
+    return glm::vec2{ Halton(_sampleIndex + 1, 2), Halton(_sampleIndex + 1, 3) } - 0.5f;
+}
+
+void TAAPass::CreateHistories(const glm::uvec2& size)
+{
+    for (History& history : _histories)
+    {
+        // Frames in flight may still read the old history.
+        if (history.texture)
+        {
+            _renderer.GetResidencyManager().Untrack(history.texture);
+            _renderer.GetFrameScheduler().DeferDestroy(history.texture);
+        }
+
+        wgpu::TextureDescriptor textureDesc{};
+        textureDesc.label = "TAA history";
+        textureDesc.dimension = wgpu::TextureDimension::e2D;
+        textureDesc.size = { size.x, size.y, 1 };
+        textureDesc.format = _renderFormat;
+        textureDesc.mipLevelCount = 1;
+        textureDesc.sampleCount = 1;
+        textureDesc.usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding;
+
+        history = {};
+        history.texture = _renderer.Device().CreateTexture(&textureDesc);
+        _renderer.GetResidencyManager().Track(history.texture, ResidencyCategory::RenderTargets);
+        history.view = history.texture.CreateView();
+    }
+
+    _outputSize = size;
+    _historyValid = false;
+}
+
+void TAAPass::Render(const wgpu::RenderPassEncoder& pass, const wgpu::TextureView& color, const wgpu::TextureView& motion, const glm::uvec2& inputSize, const glm::vec2& jitter)
+{
+    History& output = _histories[_current];
+    if (color.Get() != output.color.Get() || motion.Get() != output.motion.Get() || !output.bindGroup)
+    {
+        std::array<wgpu::BindGroupEntry, 5> bgEntries{};
+        bgEntries[0].binding = 0;
+        bgEntries[0].textureView = color;
+        bgEntries[1].binding = 1;
+        bgEntries[1].textureView = motion;
+        bgEntries[2].binding = 2;
+        bgEntries[2].textureView = HistoryView();
+        bgEntries[3].binding = 3;
+        bgEntries[3].sampler = _sampler;
+        bgEntries[4].binding = 4;
+        bgEntries[4].buffer = _renderer.GetUniformRing().Buffer();
+        bgEntries[4].size = sizeof(Params);
+
+        wgpu::BindGroupDescriptor bgDesc{};
+        bgDesc.label = "TAA bind group";
+        bgDesc.layout = _bindGroupLayout;
+        bgDesc.entryCount = bgEntries.size();
+        bgDesc.entries = bgEntries.data();
+
+        output.bindGroup = _renderer.Device().CreateBindGroup(&bgDesc);
+        output.color = color;
+        output.motion = motion;
+    }
+
+    Params params{};
+    params.inputSize = glm::vec2{ inputSize };
+    params.outputSize = glm::vec2{ _outputSize };
+    params.jitter = jitter / params.inputSize;
+    params.blend = _blend;
+    params.historyValid = _historyValid ? 1 : 0;
+
+    // The target is still cleared while the pipeline compiles, and the history starts over.
+    wgpu::RenderPipeline pipeline = _renderer.GetPipelineCache().GetRenderPipeline(_pipelineKey);
+    uint32_t dynamicOffset{};
+    if (!pipeline || !_renderer.GetUniformRing().Allocate(params, dynamicOffset))
+    {
+        _historyValid = false;
+        return;
+    }
+
+    pass.SetPipeline(pipeline);
+    pass.SetBindGroup(0, output.bindGroup, 1, &dynamicOffset);
+    pass.Draw(3, 1, 0, 0);
+
+    _historyValid = true;
+}
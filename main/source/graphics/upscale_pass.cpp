@@ -0,0 +1,118 @@
+#include "graphics/upscale_pass.hpp"
+#include "renderer.hpp"
+#include "pipeline_cache.hpp"
+#include "gpu_object_cache.hpp"
+#include "shader_library.hpp"
+#include "uniform_ring.hpp"
+#include <cstddef>
+
+UpscalePass::UpscalePass(Renderer& renderer) : RenderPass(renderer, wgpu::TextureFormat::RGBA16Float)
+{
+    ShaderStruct paramsStruct{ "UpscaleParams", sizeof(Params) };
+    paramsStruct.Field<glm::vec2>("inputSize", offsetof(Params, inputSize))
+                .Field<glm::vec2>("outputSize", offsetof(Params, outputSize))
+                .Field<float>("sharpness", offsetof(Params, sharpness));
+    _renderer.GetShaderLibrary().AddGeneratedStructs("generated/upscale.wgsl", { paramsStruct });
+
+    _shader = _renderer.CreateShader("assets/shaders/upscale.wgsl", "Upscale shader");
+
+    std::array<wgpu::BindGroupLayoutEntry, 2> bgLayoutEntries{};
+    bgLayoutEntries[0].binding = 0;
+    bgLayoutEntries[0].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutEntries[0].texture.sampleType = wgpu::TextureSampleType::UnfilterableFloat;
+    bgLayoutEntries[0].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+    bgLayoutEntries[1].binding = 1;
+    bgLayoutEntries[1].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutEntries[1].buffer.type = wgpu::BufferBindingType::Uniform;
+    bgLayoutEntries[1].buffer.minBindingSize = sizeof(Params);
+    bgLayoutEntries[1].buffer.hasDynamicOffset = true;
+
+    wgpu::BindGroupLayoutDescriptor bgLayoutDesc{};
+    bgLayoutDesc.label = "Upscale bind group layout";
+    bgLayoutDesc.entryCount = bgLayoutEntries.size();
+    bgLayoutDesc.entries = bgLayoutEntries.data();
+    _bindGroupLayout = _renderer.GetObjectCache().GetBindGroupLayout(bgLayoutDesc);
+
+    wgpu::PipelineLayoutDescriptor pipelineLayoutDesc{};
+    pipelineLayoutDesc.label = "Upscale pipeline layout";
+    pipelineLayoutDesc.bindGroupLayoutCount = 1;
+    pipelineLayoutDesc.bindGroupLayouts = &_bindGroupLayout;
+    _pipelineLayout = _renderer.GetObjectCache().GetPipelineLayout(pipelineLayoutDesc);
+
+    _upscale.pipelineKey = RequestPipeline("fs_easu", "Upscale pipeline");
+    _sharpen.pipelineKey = RequestPipeline("fs_rcas", "Sharpen pipeline");
+}
+
+UpscalePass::~UpscalePass() = default;
+
+uint64_t UpscalePass::RequestPipeline(const char* entryPoint, const char* label)
+{
+    wgpu::ColorTargetState colorTarget{};
+    colorTarget.format = _renderFormat;
+    colorTarget.blend = nullptr;
+    colorTarget.writeMask = wgpu::ColorWriteMask::All;
+
+    wgpu::FragmentState fragment{};
+    fragment.module = _shader;
+    fragment.entryPoint = entryPoint;
+    fragment.targetCount = 1;
+    fragment.targets = &colorTarget;
+
+    wgpu::RenderPipelineDescriptor pipelineDesc{};
+    pipelineDesc.label = label;
+    pipelineDesc.layout = _pipelineLayout;
+    pipelineDesc.vertex.module = _shader;
+    pipelineDesc.vertex.entryPoint = "vs_main";
+    pipelineDesc.vertex.bufferCount = 0;
+    pipelineDesc.vertex.buffers = nullptr;
+    pipelineDesc.fragment = &fragment;
+    pipelineDesc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
+    pipelineDesc.primitive.cullMode = wgpu::CullMode::None;
+    pipelineDesc.multisample.count = 1;
+    pipelineDesc.multisample.mask = 0xFF'FF'FF'FF;
+    pipelineDesc.depthStencil = nullptr;
+
+    return _renderer.GetPipelineCache().RequestRenderPipeline(pipelineDesc);
+}
+
+void UpscalePass::RenderUpscale(const wgpu::RenderPassEncoder& pass, const wgpu::TextureView& input, const glm::uvec2& inputSize, const glm::uvec2& outputSize)
+{
+    Render(pass, _upscale, input, { glm::vec2{ inputSize }, glm::vec2{ outputSize }, _sharpness });
+}
+
+void UpscalePass::RenderSharpen(const wgpu::RenderPassEncoder& pass, const wgpu::TextureView& input, const glm::uvec2& size)
+{
+    Render(pass, _sharpen, input, { glm::vec2{ size }, glm::vec2{ size }, _sharpness });
+}
+
+void UpscalePass::Render(const wgpu::RenderPassEncoder& pass, Stage& stage, const wgpu::TextureView& input, const Params& params)
+{
+    if (input.Get() != stage.input.Get())
+    {
+        std::array<wgpu::BindGroupEntry, 2> bgEntries{};
+        bgEntries[0].binding = 0;
+        bgEntries[0].textureView = input;
+        bgEntries[1].binding = 1;
+        bgEntries[1].buffer = _renderer.GetUniformRing().Buffer();
+        bgEntries[1].size = sizeof(Params);
+
+        wgpu::BindGroupDescriptor bgDesc{};
+        bgDesc.label = "Upscale bind group";
+        bgDesc.layout = _bindGroupLayout;
+        bgDesc.entryCount = bgEntries.size();
+        bgDesc.entries = bgEntries.data();
+
+        stage.bindGroup = _renderer.Device().CreateBindGroup(&bgDesc);
+        stage.input = input;
+    }
+
+    // The target is still cleared while the pipeline compiles.
+    wgpu::RenderPipeline pipeline = _renderer.GetPipelineCache().GetRenderPipeline(stage.pipelineKey);
+    uint32_t dynamicOffset{};
+    if (!pipeline || !_renderer.GetUniformRing().Allocate(params, dynamicOffset))
+        return;
+
+    pass.SetPipeline(pipeline);
+    pass.SetBindGroup(0, stage.bindGroup, 1, &dynamicOffset);
+    pass.Draw(3, 1, 0, 0);
+}
@@ -15,6 +15,20 @@
 #include <backends/imgui_impl_glfw.h>
 
 #include "graphics/skybox_pass.hpp"
+#include "residency_manager.hpp"
+#include "gpu_object_cache.hpp"
+#include "pipeline_cache.hpp"
+#include "shader_library.hpp"
+#include "uniform_ring.hpp"
+#include "frame_scheduler.hpp"
+#include "render_graph.hpp"
+#include "dynamic_resolution.hpp"
+#include "graphics/upscale_pass.hpp"
+#include "graphics/taa_pass.hpp"
+#include "graphics/hdr_pass.hpp"
+#include "graphics/bloom_pass.hpp"
+#include "graphics/auto_exposure_pass.hpp"
+#include "enum_util.hpp"
 
 using namespace std::literals::chrono_literals;
 
@@ -47,10 +61,27 @@ void RequestDeviceResources(Renderer::DeviceResources& deviceResources)
 
         deviceResources->adapter = wgpu::Adapter(adapter);
 
+        // Block compressed formats are opt-in, the texture loader picks whichever ones we got.
+        std::vector<wgpu::FeatureName> requiredFeatures{};
+        for (wgpu::FeatureName feature : { wgpu::FeatureName::TextureCompressionBC, wgpu::FeatureName::TextureCompressionETC2, wgpu::FeatureName::TextureCompressionASTC })
+        {
+            if (deviceResources->adapter.HasFeature(feature))
+                requiredFeatures.emplace_back(feature);
+        }
+
         wgpu::DeviceDescriptor deviceDesc{};
         deviceDesc.label = "Device";
-        deviceDesc.requiredFeatureCount = 0;
-        deviceDesc.requiredLimits = nullptr;
+        deviceDesc.requiredFeatureCount = requiredFeatures.size();
+        deviceDesc.requiredFeatures = requiredFeatures.data();
+
+        // The mip generator writes as many mips per dispatch as there are storage texture slots,
+        // and the material system binds as many texture pools as there are sampled texture slots.
+        wgpu::SupportedLimits adapterLimits{};
+        deviceResources->adapter.GetLimits(&adapterLimits);
+        wgpu::RequiredLimits requiredLimits{};
+        requiredLimits.limits.maxStorageTexturesPerShaderStage = adapterLimits.limits.maxStorageTexturesPerShaderStage;
+        requiredLimits.limits.maxSampledTexturesPerShaderStage = adapterLimits.limits.maxSampledTexturesPerShaderStage;
+        deviceDesc.requiredLimits = &requiredLimits;
         deviceDesc.nextInChain = nullptr;
         deviceDesc.defaultQueue.nextInChain = nullptr;  
         deviceDesc.defaultQueue.label = "Default queue";
@@ -198,10 +229,10 @@ EM_BOOL em_render(double time, void* userData)
 
     ImGui::Begin("Light");   
     {
-        float exposure = g_renderer->GetSkyboxPass().GetExposure();
-        if (ImGui::DragFloat("Exposure", &exposure, 0.01f, 0.0f, 10.0f))
+        float skyIntensity = g_renderer->GetSkyboxPass().GetIntensity();
+        if (ImGui::DragFloat("Sky intensity", &skyIntensity, 0.01f, 0.0f, 10.0f))
         {
-            g_renderer->GetSkyboxPass().SetExposure(exposure);
+            g_renderer->GetSkyboxPass().SetIntensity(skyIntensity);
         }
 
         auto view = g_registry.view<Renderer::PointLight, Transform>();
@@ -221,6 +252,132 @@ EM_BOOL em_render(double time, void* userData)
     }
     ImGui::End();
 
+    ImGui::Begin("Resolution");
+    {
+        DynamicResolution& dynamicResolution = g_renderer->GetDynamicResolution();
+
+        bool enabled = dynamicResolution.Enabled();
+        if (ImGui::Checkbox("Dynamic resolution", &enabled))
+        {
+            dynamicResolution.SetEnabled(enabled);
+        }
+
+        float budget = dynamicResolution.Budget();
+        if (ImGui::DragFloat("GPU budget (ms)", &budget, 0.1f, 1.0f, 100.0f))
+        {
+            dynamicResolution.SetBudget(budget);
+        }
+
+        float sharpness = g_renderer->GetUpscalePass().GetSharpness();
+        if (ImGui::SliderFloat("Sharpness", &sharpness, 0.0f, 1.0f))
+        {
+            g_renderer->GetUpscalePass().SetSharpness(sharpness);
+        }
+
+        ImGui::Text("Scale: %.0f%%, GPU: %.2f ms", dynamicResolution.Scale() * 100.0f, dynamicResolution.SmoothedGpuMs());
+    }
+    ImGui::End();
+
+    ImGui::Begin("Post process");
+    {
+        HDRPass& hdrPass = g_renderer->GetHDRPass();
+        AutoExposurePass& autoExposurePass = g_renderer->GetAutoExposurePass();
+
+        bool autoExposure = autoExposurePass.Enabled();
+        if (ImGui::Checkbox("Auto exposure", &autoExposure))
+        {
+            autoExposurePass.SetEnabled(autoExposure);
+        }
+
+        float adaptationSpeed = autoExposurePass.GetAdaptationSpeed();
+        if (ImGui::SliderFloat("Adaptation speed", &adaptationSpeed, 0.1f, 10.0f))
+        {
+            autoExposurePass.SetAdaptationSpeed(adaptationSpeed);
+        }
+
+        // Compensates on top of the auto exposure while it's enabled.
+        float exposure = hdrPass.GetExposure();
+        if (ImGui::DragFloat("Exposure (EV)", &exposure, 0.05f, -10.0f, 10.0f))
+        {
+            hdrPass.SetExposure(exposure);
+        }
+
+        // Every change rebakes the LUT once.
+        HDRPass::Grading grading = hdrPass.GetGrading();
+        bool gradingChanged = ImGui::ColorEdit3("Gain", &grading.gain.x);
+        gradingChanged |= ImGui::SliderFloat("Contrast", &grading.contrast, 0.5f, 2.0f);
+        gradingChanged |= ImGui::SliderFloat("Saturation", &grading.saturation, 0.0f, 2.0f);
+        if (gradingChanged)
+        {
+            hdrPass.SetGrading(grading);
+        }
+
+        BloomPass& bloomPass = g_renderer->GetBloomPass();
+        bool bloom = bloomPass.Enabled();
+        if (ImGui::Checkbox("Bloom", &bloom))
+        {
+            bloomPass.SetEnabled(bloom);
+        }
+
+        float bloomIntensity = hdrPass.GetBloomIntensity();
+        if (ImGui::SliderFloat("Bloom intensity", &bloomIntensity, 0.0f, 0.5f))
+        {
+            hdrPass.SetBloomIntensity(bloomIntensity);
+        }
+        ImGui::Text("Bloom mips: %u", bloomPass.MipCount());
+    }
+    ImGui::End();
+
+    ImGui::Begin("Anti-aliasing");
+    {
+        const char* modes[] = { "Off", "FXAA", "SMAA", "MSAA 4x", "TAA" };
+        int mode = static_cast<int>(g_renderer->GetAntiAliasing());
+        if (ImGui::Combo("Mode", &mode, modes, IM_ARRAYSIZE(modes)))
+        {
+            g_renderer->SetAntiAliasing(static_cast<AntiAliasing>(mode));
+        }
+
+        float blend = g_renderer->GetTAAPass().GetBlend();
+        if (ImGui::SliderFloat("TAA blend", &blend, 0.02f, 0.5f))
+        {
+            g_renderer->GetTAAPass().SetBlend(blend);
+        }
+    }
+    ImGui::End();
+
+    ImGui::Begin("Memory");
+    {
+        ResidencyManager& residencyManager = g_renderer->GetResidencyManager();
+
+        int budget = static_cast<int>(residencyManager.Budget() / (1024 * 1024));
+        if (ImGui::DragInt("Budget (MiB)", &budget, 1.0f, 16, 4096))
+        {
+            residencyManager.SetBudget(static_cast<uint64_t>(budget) * 1024 * 1024);
+        }
+
+        ImGui::Text("Total: %.1f MiB", residencyManager.TotalBytes() / (1024.0f * 1024.0f));
+        for (uint32_t i = 0; i < static_cast<uint32_t>(ResidencyCategory::Count); ++i)
+        {
+            const ResidencyCategory category = static_cast<ResidencyCategory>(i);
+            ImGui::Text("%s: %.1f MiB", std::string(conv_enum_str(category)).c_str(), residencyManager.CategoryBytes(category) / (1024.0f * 1024.0f));
+        }
+        ImGui::Text("Evictions: %llu", static_cast<unsigned long long>(residencyManager.EvictionCount()));
+
+        const GpuObjectCache& objectCache = g_renderer->GetObjectCache();
+        for (uint32_t i = 0; i < static_cast<uint32_t>(GpuObjectType::Count); ++i)
+        {
+            const GpuObjectType type = static_cast<GpuObjectType>(i);
+            const GpuObjectCache::Stats& stats = objectCache.GetStats(type);
+            ImGui::Text("%s cache: %llu hits, %llu misses", std::string(conv_enum_str(type)).c_str(), static_cast<unsigned long long>(stats.hits), static_cast<unsigned long long>(stats.misses));
+        }
+        ImGui::Text("Pipelines compiling: %u", g_renderer->GetPipelineCache().PendingCount());
+        ImGui::Text("Uniform ring: %.1f of %.1f KiB in flight", g_renderer->GetUniformRing().UsedBytes() / 1024.0f, g_renderer->GetUniformRing().Size() / 1024.0f);
+        ImGui::Text("Frames in flight: %u of %u", g_renderer->GetFrameScheduler().FramesInFlight(), MAX_FRAMES_IN_FLIGHT);
+        ImGui::Text("Render graph: %u passes, %u culled, %u virtual textures on %u textures", g_renderer->GetRenderGraph().PassCount(), g_renderer->GetRenderGraph().CulledPassCount(), g_renderer->GetRenderGraph().VirtualTextureCount(), g_renderer->GetRenderGraph().TransientTextureCount());
+        ImGui::Text("Shader modules: %u, %llu cache hits", g_renderer->GetShaderLibrary().ModuleCount(), static_cast<unsigned long long>(g_renderer->GetShaderLibrary().CacheHits()));
+    }
+    ImGui::End();
+
     ImGui::Begin("transforms");
     {
         auto view = g_registry.view<Transform>(); 
@@ -0,0 +1,461 @@
+#include "material_system.hpp"
+#include <array>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "renderer.hpp"
+#include "gpu_object_cache.hpp"
+#include "residency_manager.hpp"
+#include "shader_library.hpp"
+#include "texture_loader.hpp"
+#include "upload_manager.hpp"
+#include "frame_scheduler.hpp"
+
+constexpr uint32_t INITIAL_POOL_LAYERS{ 4 };
+constexpr uint32_t FEEDBACK_BINDING{ 2 };
+constexpr uint32_t FIRST_POOL_BINDING{ 3 };
+
+// Declares the pool bindings and a function that samples a pool by index, since WGSL can't index bindings.
+std::string BuildTexturePoolShader(uint32_t poolCount)
+{
+    std::string source{ "// Generated from the device's texture limit, don't edit.\n\n" };
+    for (uint32_t i = 0; i < poolCount; ++i)
+    {
+        source += "@group(2) @binding(" + std::to_string(FIRST_POOL_BINDING + i) + ") var u_texturePool" + std::to_string(i) + ": texture_2d_array<f32>;\n";
+    }
+
+    source += "\nfn SampleTexturePool(pool: u32, s: sampler, uv: vec2<f32>, layer: i32, ddx: vec2<f32>, ddy: vec2<f32>, fallback: vec4<f32>) -> vec4<f32>\n{\n";
+    source += "    var value = fallback;\n    switch (pool)\n    {\n";
+    for (uint32_t i = 0; i < poolCount; ++i)
+    {
+        const std::string index{ std::to_string(i) };
+        source += "        case " + index + "u: { value = textureSampleGrad(u_texturePool" + index + ", s, uv, layer, ddx, ddy); }\n";
+    }
+    source += "        default: {}\n    }\n    return value;\n}\n";
+
+    return source;
+}
+
+MaterialSystem::MaterialSystem(const Renderer& renderer) : _renderer(renderer)
+{
+    wgpu::SupportedLimits limits{};
+    _renderer.Device().GetLimits(&limits);
+    _maxLayers = std::min(limits.limits.maxTextureArrayLayers, 0xFFFFu);
+    // The fragment shader samples the irradiance map too.
+    _maxPools = std::min(limits.limits.maxSampledTexturesPerShaderStage - 1, MAX_TEXTURE_POOLS);
+
+    ShaderStruct materialStruct{ "Material", sizeof(Material) };
+    materialStruct.Field<glm::vec3>("albedoFactor", offsetof(Material, albedoFactor))
+                  .Field<float>("metallicFactor", offsetof(Material, metallicFactor))
+                  .Field<glm::vec3>("emissiveFactor", offsetof(Material, emissiveFactor))
+                  .Field<float>("roughnessFactor", offsetof(Material, roughnessFactor))
+                  .Field<float>("aoFactor", offsetof(Material, aoFactor))
+                  .Field<float>("normalFactor", offsetof(Material, normalFactor))
+                  .Field<uint32_t>("albedoTexture", offsetof(Material, albedoTexture))
+                  .Field<uint32_t>("normalTexture", offsetof(Material, normalTexture))
+                  .Field<uint32_t>("ormTexture", offsetof(Material, ormTexture))
+                  .Field<uint32_t>("emissiveTexture", offsetof(Material, emissiveTexture))
+                  .Field<float>("alphaFactor", offsetof(Material, alphaFactor))
+                  .Field<float>("alphaCutoff", offsetof(Material, alphaCutoff));
+
+    _renderer.GetShaderLibrary().AddGeneratedStructs("generated/material.wgsl", { materialStruct });
+    _renderer.GetShaderLibrary().AddGeneratedFile("generated/texture-pools.wgsl", BuildTexturePoolShader(_maxPools));
+
+    // Pools are handed out by pointer while they're being filled.
+    _pools.reserve(_maxPools);
+
+    wgpu::BufferDescriptor materialBufferDesc{};
+    materialBufferDesc.label = "Material buffer";
+    materialBufferDesc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
+    materialBufferDesc.size = sizeof(Material) * MAX_MATERIALS;
+    _materialBuffer = _renderer.Device().CreateBuffer(&materialBufferDesc);
+    _renderer.GetResidencyManager().Track(_materialBuffer, ResidencyCategory::Buffers);
+
+    wgpu::BufferDescriptor feedbackBufferDesc{};
+    feedbackBufferDesc.label = "Material feedback buffer";
+    feedbackBufferDesc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc | wgpu::BufferUsage::CopyDst;
+    feedbackBufferDesc.size = sizeof(uint32_t) * MAX_MATERIALS;
+    _feedbackBuffer = _renderer.Device().CreateBuffer(&feedbackBufferDesc);
+    _renderer.GetResidencyManager().Track(_feedbackBuffer, ResidencyCategory::Buffers);
+
+    wgpu::SamplerDescriptor samplerDesc{};
+    samplerDesc.label = "Material sampler";
+    samplerDesc.addressModeU = wgpu::AddressMode::ClampToEdge;
+    samplerDesc.addressModeV = wgpu::AddressMode::ClampToEdge;
+    samplerDesc.addressModeW = wgpu::AddressMode::ClampToEdge;
+    samplerDesc.minFilter = wgpu::FilterMode::Linear;
+    samplerDesc.magFilter = wgpu::FilterMode::Linear;
+    samplerDesc.mipmapFilter = wgpu::MipmapFilterMode::Linear;
+    samplerDesc.lodMinClamp = 0.0f;
+    samplerDesc.lodMaxClamp = 32.0f;
+    samplerDesc.compare = wgpu::CompareFunction::Undefined;
+    samplerDesc.maxAnisotropy = 1;
+    _sampler = _renderer.GetObjectCache().GetSampler(samplerDesc);
+
+    // Bound to every pool slot that isn't in use yet, the shader never samples it.
+    wgpu::TextureDescriptor emptyPoolDesc{};
+    emptyPoolDesc.label = "Empty texture pool";
+    emptyPoolDesc.dimension = wgpu::TextureDimension::e2D;
+    emptyPoolDesc.size = { 1, 1, 1 };
+    emptyPoolDesc.format = wgpu::TextureFormat::RGBA8Unorm;
+    emptyPoolDesc.mipLevelCount = 1;
+    emptyPoolDesc.sampleCount = 1;
+    emptyPoolDesc.usage = wgpu::TextureUsage::TextureBinding;
+    _emptyPoolTexture = _renderer.Device().CreateTexture(&emptyPoolDesc);
+
+    wgpu::TextureViewDescriptor emptyPoolViewDesc{};
+    emptyPoolViewDesc.dimension = wgpu::TextureViewDimension::e2DArray;
+    _emptyPoolView = _emptyPoolTexture.CreateView(&emptyPoolViewDesc);
+
+    std::vector<wgpu::BindGroupLayoutEntry> bgLayoutEntries(FIRST_POOL_BINDING + _maxPools);
+    bgLayoutEntries[0].binding = 0;
+    bgLayoutEntries[0].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutEntries[0].buffer.type = wgpu::BufferBindingType::ReadOnlyStorage;
+    bgLayoutEntries[0].buffer.minBindingSize = sizeof(Material);
+
+    bgLayoutEntries[1].binding = 1;
+    bgLayoutEntries[1].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutEntries[1].sampler.type = wgpu::SamplerBindingType::Filtering;
+
+    for (uint32_t i = 0; i < _maxPools; ++i)
+    {
+        wgpu::BindGroupLayoutEntry& entry = bgLayoutEntries[FIRST_POOL_BINDING + i];
+        entry.binding = FIRST_POOL_BINDING + i;
+        entry.visibility = wgpu::ShaderStage::Fragment;
+        entry.texture.sampleType = wgpu::TextureSampleType::Float;
+        entry.texture.viewDimension = wgpu::TextureViewDimension::e2DArray;
+        entry.texture.multisampled = false;
+    }
+
+    bgLayoutEntries[FEEDBACK_BINDING].binding = FEEDBACK_BINDING;
+    bgLayoutEntries[FEEDBACK_BINDING].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutEntries[FEEDBACK_BINDING].buffer.type = wgpu::BufferBindingType::Storage;
+    bgLayoutEntries[FEEDBACK_BINDING].buffer.minBindingSize = sizeof(uint32_t);
+
+    wgpu::BindGroupLayoutDescriptor bgLayoutDesc{};
+    bgLayoutDesc.label = "Material bind group layout";
+    bgLayoutDesc.entryCount = bgLayoutEntries.size();
+    bgLayoutDesc.entries = bgLayoutEntries.data();
+    _bindGroupLayout = _renderer.GetObjectCache().GetBindGroupLayout(bgLayoutDesc);
+}
+
+uint32_t MaterialSystem::AddTexture(const wgpu::Texture& texture, wgpu::TextureFormat viewFormat, uint32_t baseMip)
+{
+    if (!texture)
+        return INVALID_TEXTURE;
+
+    baseMip = std::min(baseMip, texture.GetMipLevelCount() - 1);
+    const uint32_t width = std::max(texture.GetWidth() >> baseMip, 1u);
+    const uint32_t height = std::max(texture.GetHeight() >> baseMip, 1u);
+
+    TexturePool* pool = FindOrCreatePool(width, height, texture.GetMipLevelCount() - baseMip, texture.GetFormat(), viewFormat);
+    if (!pool)
+        return INVALID_TEXTURE;
+
+    uint32_t layer{};
+    if (!AllocateLayer(*pool, layer))
+        return INVALID_TEXTURE;
+
+    CopyLayers(texture, baseMip, 0, pool->texture, layer, 1);
+
+    const uint32_t poolIndex = static_cast<uint32_t>(pool - _pools.data());
+    return (poolIndex << 16) | layer;
+}
+
+uint32_t MaterialSystem::ShrinkTexture(uint32_t handle)
+{
+    if (handle == INVALID_TEXTURE || (handle >> 16) >= _pools.size())
+        return INVALID_TEXTURE;
+
+    // Pools are reserved up front, so the source stays put while the destination is created.
+    const TexturePool& source = _pools[handle >> 16];
+    if (source.mipLevelCount == 1)
+        return INVALID_TEXTURE;
+
+    TexturePool* pool = FindOrCreatePool(std::max(source.width >> 1, 1u), std::max(source.height >> 1, 1u), source.mipLevelCount - 1, source.format, source.viewFormat);
+    if (!pool)
+        return INVALID_TEXTURE;
+
+    uint32_t layer{};
+    if (!AllocateLayer(*pool, layer))
+        return INVALID_TEXTURE;
+
+    CopyLayers(source.texture, 1, handle & 0xFFFF, pool->texture, layer, 1);
+
+    const uint32_t poolIndex = static_cast<uint32_t>(pool - _pools.data());
+    return (poolIndex << 16) | layer;
+}
+
+void MaterialSystem::RemoveTexture(uint32_t handle)
+{
+    if (handle == INVALID_TEXTURE || (handle >> 16) >= _pools.size())
+        return;
+
+    TexturePool& pool = _pools[handle >> 16];
+    pool.freeLayers.push_back(handle & 0xFFFF);
+
+    const uint32_t liveLayers = pool.layerCount - static_cast<uint32_t>(pool.freeLayers.size());
+    if (liveLayers == 0)
+        ReleasePool(handle >> 16);
+    else if (pool.layerCapacity > INITIAL_POOL_LAYERS && liveLayers <= pool.layerCapacity / 4)
+        CompactPool(handle >> 16);
+}
+
+uint32_t MaterialSystem::AddMaterial(const Material& material)
+{
+    if (_materials.size() == MAX_MATERIALS)
+    {
+        std::cout << "Exceeded the maximum of " << MAX_MATERIALS << " materials" << std::endl;
+        return INVALID_MATERIAL;
+    }
+
+    _materials.push_back(material);
+    const uint32_t index = static_cast<uint32_t>(_materials.size() - 1);
+    _renderer.GetUploadManager().UploadBuffer(_materialBuffer, index * sizeof(Material), &material, sizeof(Material));
+
+    return index;
+}
+
+void MaterialSystem::UpdateMaterial(uint32_t index, const Material& material)
+{
+    _materials[index] = material;
+    _renderer.GetUploadManager().UploadBuffer(_materialBuffer, index * sizeof(Material), &material, sizeof(Material));
+}
+
+const wgpu::BindGroup& MaterialSystem::BindGroup() const
+{
+    if (!_bindGroupDirty)
+        return _bindGroup;
+
+    std::vector<wgpu::BindGroupEntry> bgEntries(FIRST_POOL_BINDING + _maxPools);
+    bgEntries[0].binding = 0;
+    bgEntries[0].buffer = _materialBuffer;
+
+    bgEntries[1].binding = 1;
+    bgEntries[1].sampler = _sampler;
+
+    for (uint32_t i = 0; i < _maxPools; ++i)
+    {
+        bgEntries[FIRST_POOL_BINDING + i].binding = FIRST_POOL_BINDING + i;
+        bgEntries[FIRST_POOL_BINDING + i].textureView = i < _pools.size() && _pools[i].texture ? _pools[i].view : _emptyPoolView;
+    }
+
+    bgEntries[FEEDBACK_BINDING].binding = FEEDBACK_BINDING;
+    bgEntries[FEEDBACK_BINDING].buffer = _feedbackBuffer;
+
+    wgpu::BindGroupDescriptor bgDesc{};
+    bgDesc.label = "Material bind group";
+    bgDesc.layout = _bindGroupLayout;
+    bgDesc.entryCount = bgEntries.size();
+    bgDesc.entries = bgEntries.data();
+    _bindGroup = _renderer.Device().CreateBindGroup(&bgDesc);
+    _bindGroupDirty = false;
+
+    return _bindGroup;
+}
+
+MaterialSystem::TexturePool* MaterialSystem::FindOrCreatePool(uint32_t width, uint32_t height, uint32_t mipLevelCount, wgpu::TextureFormat format, wgpu::TextureFormat viewFormat)
+{
+    TexturePool* released{ nullptr };
+    for (auto& pool : _pools)
+    {
+        if (!pool.texture)
+        {
+            released = released ? released : &pool;
+            continue;
+        }
+
+        if (pool.width == width && pool.height == height && pool.mipLevelCount == mipLevelCount && pool.format == format && pool.viewFormat == viewFormat)
+            return &pool;
+    }
+
+    if (!released && _pools.size() == _maxPools)
+    {
+        std::cout << "Out of texture pools, all " << _maxPools << " are in use. Can't add a " << width << "x" << height << " texture" << std::endl;
+        return nullptr;
+    }
+
+    TexturePool pool{};
+    pool.width = width;
+    pool.height = height;
+    pool.mipLevelCount = mipLevelCount;
+    pool.format = format;
+    pool.viewFormat = viewFormat;
+    pool.layerCount = 0;
+    CreatePoolTexture(pool, INITIAL_POOL_LAYERS);
+
+    if (released)
+    {
+        *released = pool;
+        return released;
+    }
+
+    _pools.push_back(pool);
+    return &_pools.back();
+}
+
+bool MaterialSystem::AllocateLayer(TexturePool& pool, uint32_t& layer)
+{
+    if (!pool.freeLayers.empty())
+    {
+        layer = pool.freeLayers.back();
+        pool.freeLayers.pop_back();
+        return true;
+    }
+
+    if (pool.layerCount == pool.layerCapacity && !GrowPool(pool))
+        return false;
+
+    layer = pool.layerCount++;
+    return true;
+}
+
+bool MaterialSystem::GrowPool(TexturePool& pool)
+{
+    if (pool.layerCapacity == _maxLayers)
+    {
+        std::cout << "Texture pool is full at " << _maxLayers << " layers" << std::endl;
+        return false;
+    }
+
+    // Array textures can't be resized, so the layers move into a new texture of twice the size.
+    wgpu::Texture previous = pool.texture;
+    CreatePoolTexture(pool, std::min(pool.layerCapacity * 2, _maxLayers));
+    CopyLayers(previous, 0, 0, pool.texture, 0, pool.layerCount);
+
+    return true;
+}
+
+void MaterialSystem::CompactPool(uint32_t poolIndex)
+{
+    TexturePool& pool = _pools[poolIndex];
+
+    std::vector<bool> isFree(pool.layerCount, false);
+    for (uint32_t layer : pool.freeLayers)
+    {
+        isFree[layer] = true;
+    }
+
+    // Live layers move to the front of a texture half the size, which gives the memory of the freed layers back.
+    wgpu::Texture previous = pool.texture;
+    CreatePoolTexture(pool, std::max(pool.layerCapacity / 2, INITIAL_POOL_LAYERS));
+
+    std::vector<uint32_t> remap(pool.layerCount, 0);
+    uint32_t layerCount{ 0 };
+    for (uint32_t layer = 0; layer < pool.layerCount; ++layer)
+    {
+        if (isFree[layer])
+            continue;
+
+        CopyLayers(previous, 0, layer, pool.texture, layerCount, 1);
+        remap[layer] = layerCount++;
+    }
+
+    pool.layerCount = layerCount;
+    pool.freeLayers.clear();
+
+    for (uint32_t i = 0; i < _materials.size(); ++i)
+    {
+        Material material = _materials[i];
+        bool moved{ false };
+
+        for (MaterialTexture slot : { MaterialTexture::Albedo, MaterialTexture::Normal, MaterialTexture::ORM, MaterialTexture::Emissive })
+        {
+            uint32_t& handle = material.TextureHandle(slot);
+            if (handle != INVALID_TEXTURE && (handle >> 16) == poolIndex)
+            {
+                handle = (poolIndex << 16) | remap[handle & 0xFFFF];
+                moved = true;
+            }
+        }
+
+        if (moved)
+            UpdateMaterial(i, material);
+    }
+}
+
+void MaterialSystem::ReleasePool(uint32_t poolIndex)
+{
+    RetirePoolTexture(_pools[poolIndex].texture);
+    _pools[poolIndex] = TexturePool{};
+    _bindGroupDirty = true;
+}
+
+void MaterialSystem::RetirePoolTexture(const wgpu::Texture& texture)
+{
+    if (!texture)
+        return;
+
+    // Frames in flight may still sample it and queued copies may still read it, so it counts towards the budget until they're done.
+    _renderer.GetFrameScheduler().Defer([&residencyManager = _renderer.GetResidencyManager(), texture]()
+                                        {
+                                            residencyManager.Untrack(texture);
+                                            texture.Destroy();
+                                        });
+}
+
+void MaterialSystem::CreatePoolTexture(TexturePool& pool, uint32_t layerCapacity)
+{
+    wgpu::TextureDescriptor poolDesc{};
+    poolDesc.label = "Material texture pool";
+    poolDesc.dimension = wgpu::TextureDimension::e2D;
+    poolDesc.size = { pool.width, pool.height, layerCapacity };
+    poolDesc.format = pool.format;
+    poolDesc.mipLevelCount = pool.mipLevelCount;
+    poolDesc.sampleCount = 1;
+    poolDesc.usage = wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::CopySrc | wgpu::TextureUsage::TextureBinding;
+    poolDesc.viewFormatCount = pool.viewFormat != pool.format ? 1 : 0;
+    poolDesc.viewFormats = pool.viewFormat != pool.format ? &pool.viewFormat : nullptr;
+
+    // The previous texture is replaced, copies out of it are recorded after this.
+    RetirePoolTexture(pool.texture);
+    pool.texture = _renderer.Device().CreateTexture(&poolDesc);
+    _renderer.GetResidencyManager().Track(pool.texture, ResidencyCategory::TexturePools);
+    pool.layerCapacity = layerCapacity;
+
+    wgpu::TextureViewDescriptor poolViewDesc{};
+    poolViewDesc.label = "Material texture pool view";
+    poolViewDesc.format = pool.viewFormat;
+    poolViewDesc.dimension = wgpu::TextureViewDimension::e2DArray;
+    poolViewDesc.baseMipLevel = 0;
+    poolViewDesc.mipLevelCount = pool.mipLevelCount;
+    poolViewDesc.baseArrayLayer = 0;
+    poolViewDesc.arrayLayerCount = layerCapacity;
+    poolViewDesc.aspect = wgpu::TextureAspect::All;
+    pool.view = pool.texture.CreateView(&poolViewDesc);
+
+    _bindGroupDirty = true;
+}
+
+void MaterialSystem::CopyLayers(const wgpu::Texture& source, uint32_t sourceMip, uint32_t sourceLayer, const wgpu::Texture& destination, uint32_t destinationLayer, uint32_t layerCount) const
+{
+    if (layerCount == 0)
+        return;
+
+    // Recorded behind the uploads that filled the source, in the same batch.
+    const wgpu::CommandEncoder& encoder = _renderer.GetUploadManager().Encoder();
+    const BlockInfo block = GetBlockInfo(source.GetFormat());
+
+    for (uint32_t mip = 0; mip + sourceMip < source.GetMipLevelCount(); ++mip)
+    {
+        const uint32_t width = std::max(source.GetWidth() >> (sourceMip + mip), 1u);
+        const uint32_t height = std::max(source.GetHeight() >> (sourceMip + mip), 1u);
+
+        wgpu::ImageCopyTexture sourceCopy{};
+        sourceCopy.texture = source;
+        sourceCopy.mipLevel = sourceMip + mip;
+        sourceCopy.origin = { 0, 0, sourceLayer };
+        sourceCopy.aspect = wgpu::TextureAspect::All;
+
+        wgpu::ImageCopyTexture destinationCopy{};
+        destinationCopy.texture = destination;
+        destinationCopy.mipLevel = mip;
+        destinationCopy.origin = { 0, 0, destinationLayer };
+        destinationCopy.aspect = wgpu::TextureAspect::All;
+
+        // Block compressed mips are copied with their physical size.
+        wgpu::Extent3D copySize{ (width + block.width - 1) / block.width * block.width, (height + block.height - 1) / block.height * block.height, layerCount };
+        encoder.CopyTextureToTexture(&sourceCopy, &destinationCopy, &copySize);
+    }
+}
@@ -1,5 +1,6 @@
 #include "mesh.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <optional>
 #include <tiny_gltf.h>
@@ -7,7 +8,11 @@
 #include "renderer.hpp"
 #include "graphics/pbr_pass.hpp"
 #include <utils.hpp>
-#include "texture_loader.hpp"   
+#include "texture_loader.hpp"
+#include "material_system.hpp"
+#include "texture_streamer.hpp"
+#include "residency_manager.hpp"
+#include "frame_scheduler.hpp"
 
 uint32_t CalculateStride(const tinygltf::Accessor& accessor)
 {
@@ -85,6 +90,83 @@ std::vector<float> ExtractAttribute(
     return data;
 }
 
+// Packs occlusion into R, roughness into G and metallic into B, at the resolution of the metallic roughness image if there is one.
+// Occlusion is sampled nearest when its size differs. Missing images leave their channels at one, the shader variant ignores them.
+std::vector<uint8_t> PackOcclusionRoughnessMetallic(const tinygltf::Image* metallicRoughness, const tinygltf::Image* occlusion)
+{
+    const tinygltf::Image& base = metallicRoughness ? *metallicRoughness : *occlusion;
+    const uint32_t width = base.width;
+    const uint32_t height = base.height;
+
+    std::vector<uint8_t> packed(width * height * 4, 255);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            uint8_t* texel = &packed[(y * width + x) * 4];
+
+            if (occlusion)
+            {
+                const uint32_t ox = x * occlusion->width / width;
+                const uint32_t oy = y * occlusion->height / height;
+                texel[0] = occlusion->image[(oy * occlusion->width + ox) * occlusion->component];
+            }
+
+            if (metallicRoughness)
+            {
+                const uint8_t* mr = &metallicRoughness->image[(y * width + x) * metallicRoughness->component];
+                texel[1] = mr[1];
+                texel[2] = mr[2];
+            }
+        }
+    }
+
+    return packed;
+}
+
+// Keeps only X and Y of a tangent space normal map, Z is reconstructed in the fragment shader.
+std::vector<uint8_t> PackNormalRG(const tinygltf::Image& normal)
+{
+    const size_t texelCount = static_cast<size_t>(normal.width) * normal.height;
+
+    std::vector<uint8_t> packed(texelCount * 2);
+    for (size_t i = 0; i < texelCount; ++i)
+    {
+        packed[i * 2 + 0] = normal.image[i * normal.component + 0];
+        packed[i * 2 + 1] = normal.image[i * normal.component + 1];
+    }
+
+    return packed;
+}
+
+bool DecodeSelectedImage(tinygltf::Image* image, const int imageIndex, std::string* err, std::string* warn, int reqWidth, int reqHeight, const unsigned char* bytes, int size, void* userData)
+{
+    const std::vector<int>& imageIndices = *static_cast<const std::vector<int>*>(userData);
+    if (std::find(imageIndices.begin(), imageIndices.end(), imageIndex) == imageIndices.end())
+        return true;
+
+    return tinygltf::LoadImageData(image, imageIndex, err, warn, reqWidth, reqHeight, bytes, size, nullptr);
+}
+
+// Parses the glTF again but only decodes the listed images, so streamed textures don't have to keep their source in memory.
+// Without any, it only reads the geometry.
+std::optional<tinygltf::Model> ReloadImages(const std::string& path, std::vector<int> imageIndices)
+{
+    tinygltf::TinyGLTF loader;
+    loader.SetImageLoader(DecodeSelectedImage, &imageIndices);
+
+    tinygltf::Model model;
+    std::string err;
+    std::string warn;
+    if (!loader.LoadASCIIFromFile(&model, &err, &warn, path))
+    {
+        std::cout << "Failed reloading images from: " << path << std::endl;
+        return std::nullopt;
+    }
+
+    return model;
+}
+
 glm::mat3x3 ComputeTBN(const PBRPass::Vertex corners[3], const glm::vec3& expectedNormal)
 {
     glm::vec3 ePos1 = corners[1].position - corners[0].position;
@@ -111,25 +193,9 @@ glm::mat3x3 ComputeTBN(const PBRPass::Vertex corners[3], const glm::vec3& expect
     return glm::mat3x3(tangent, bitangent, normal);
 }
 
-std::optional<Mesh> Mesh::CreateMesh(const std::string& path, Renderer& renderer)
+// Builds the vertex and index buffers of the primitive, when the mesh is created and when an evicted mesh is drawn again.
+bool CreateMeshBuffers(const tinygltf::Model& model, const tinygltf::Primitive& primitive, Renderer& renderer, Mesh::Buffers& buffers)
 {
-    tinygltf::TinyGLTF loader;
-    tinygltf::Model model;
-    std::string err;
-    std::string warn;
-
-
-    bool success = loader.LoadASCIIFromFile(&model, &err, &warn, path);
-    if(!warn.empty())
-        std::cout << warn << std::endl;
-    if (!err.empty())
-        std::cout << err << std::endl;
-    if(!success)
-    {
-        std::cout << "Failed parsing GLtf" << std::endl; 
-        return std::nullopt; 
-    }
-
     std::vector<glm::vec3> positions;
     std::vector<glm::vec3> normals;
     std::vector<glm::vec2> uvs;
@@ -137,83 +203,55 @@ std::optional<Mesh> Mesh::CreateMesh(const std::string& path, Renderer& renderer
     std::vector<uint32_t> indices32{};
     std::vector<uint16_t> indices16{};
 
-    int32_t albedoIndex;
-    int32_t normalIndex;
-    int32_t metallicIndex;
-    int32_t roughnessIndex;
-    int32_t aoIndex;
-    int32_t emissiveIndex;
-    Material material{};
+    // Get positions.
+    { 
+        auto values = ExtractAttribute(model, primitive, "POSITION", nullptr, nullptr);
+        positions.assign(reinterpret_cast<glm::vec3*>(values.data()), reinterpret_cast<glm::vec3*>(values.data()) + values.size() / 3);
+    }
 
-    for(size_t i = 0; i < model.meshes.size(); ++i)
+    // Get normals.
     {
-        tinygltf::Primitive primitive = model.meshes[i].primitives[0];
+        auto values = ExtractAttribute(model, primitive, "NORMAL", nullptr, nullptr);
+        normals.assign(reinterpret_cast<glm::vec3*>(values.data()), reinterpret_cast<glm::vec3*>(values.data()) + values.size() / 3);
+    }
 
-        tinygltf::Material gltfMaterial = model.materials[primitive.material];
-        albedoIndex = gltfMaterial.pbrMetallicRoughness.baseColorTexture.index;
-        normalIndex = gltfMaterial.normalTexture.index;
-        metallicIndex = gltfMaterial.pbrMetallicRoughness.metallicRoughnessTexture.index;
-        roughnessIndex = gltfMaterial.pbrMetallicRoughness.metallicRoughnessTexture.index;
-        aoIndex = gltfMaterial.occlusionTexture.index;
-        emissiveIndex = gltfMaterial.emissiveTexture.index;
-        material = {
-            glm::vec3{ gltfMaterial.pbrMetallicRoughness.baseColorFactor[0], gltfMaterial.pbrMetallicRoughness.baseColorFactor[1], gltfMaterial.pbrMetallicRoughness.baseColorFactor[2] },
-            static_cast<float>(gltfMaterial.pbrMetallicRoughness.metallicFactor),
-            static_cast<float>(gltfMaterial.pbrMetallicRoughness.roughnessFactor),
-            1.0f,
-            static_cast<float>(gltfMaterial.emissiveFactor[0])
-        };
+    // Get indices.
+    {
+        tinygltf::Accessor indicesAccessor = model.accessors[primitive.indices];
+        tinygltf::BufferView indicesBufferView = model.bufferViews[indicesAccessor.bufferView];
+        tinygltf::Buffer indicesBuffer = model.buffers[indicesBufferView.buffer];
 
-        // Get positions.
-        { 
-            auto values = ExtractAttribute(model, primitive, "POSITION", nullptr, nullptr);
-            positions.assign(reinterpret_cast<glm::vec3*>(values.data()), reinterpret_cast<glm::vec3*>(values.data()) + values.size() / 3);
-        }
+        auto firstIndexByte = indicesBuffer.data.begin() + indicesBufferView.byteOffset + indicesAccessor.byteOffset;
+        auto lastIndexByte = indicesBuffer.data.begin() + indicesBufferView.byteOffset + indicesBufferView.byteLength;
 
-        // Get normals.
+        if(indicesAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)
         {
-            auto values = ExtractAttribute(model, primitive, "NORMAL", nullptr, nullptr);
-            normals.assign(reinterpret_cast<glm::vec3*>(values.data()), reinterpret_cast<glm::vec3*>(values.data()) + values.size() / 3);
+            indices32 = { firstIndexByte, lastIndexByte };
         }
-
-        // Get indices.
+        else if(indicesAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT)
         {
-            tinygltf::Accessor indicesAccessor = model.accessors[primitive.indices];
-            tinygltf::BufferView indicesBufferView = model.bufferViews[indicesAccessor.bufferView];
-            tinygltf::Buffer indicesBuffer = model.buffers[indicesBufferView.buffer];
-
-            auto firstIndexByte = indicesBuffer.data.begin() + indicesBufferView.byteOffset + indicesAccessor.byteOffset;
-            auto lastIndexByte = indicesBuffer.data.begin() + indicesBufferView.byteOffset + indicesBufferView.byteLength;
-
-            if(indicesAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)
-            {
-                indices32 = { firstIndexByte, lastIndexByte };
-            }
-            else if(indicesAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT)
-            {
-                indices16 = std::vector<uint16_t>(std::distance(firstIndexByte, lastIndexByte) / sizeof(uint16_t));
-                memcpy(indices16.data(), &*firstIndexByte, std::distance(firstIndexByte, lastIndexByte));
+            indices16 = std::vector<uint16_t>(std::distance(firstIndexByte, lastIndexByte) / sizeof(uint16_t));
+            memcpy(indices16.data(), &*firstIndexByte, std::distance(firstIndexByte, lastIndexByte));
 
-            }
-            else
-            {
-                std::cout << "Failed parsing index type" << std::endl;  
-                return std::nullopt;
-            }
         }
-
-        // Get uv.
+        else
         {
-            glm::vec3 min, max;
-            auto values = ExtractAttribute(model, primitive, "TEXCOORD_0", &min, &max);
-            uvs.assign(reinterpret_cast<glm::vec2*>(values.data()), reinterpret_cast<glm::vec2*>(values.data()) + values.size() / 2);
+            std::cout << "Failed parsing index type" << std::endl;  
+            return false;
+        }
+    }
 
-            for(auto& uv : uvs)
-            {
-                uv.x = (uv.x - min.x) / (max.x - min.x);
-                uv.y = (uv.y - min.y) / (max.y - min.y);
+    // Get uv.
+    {
+        glm::vec3 min, max;
+        auto values = ExtractAttribute(model, primitive, "TEXCOORD_0", &min, &max);
+        uvs.assign(reinterpret_cast<glm::vec2*>(values.data()), reinterpret_cast<glm::vec2*>(values.data()) + values.size() / 2);
+
+        for(auto& uv : uvs)
+        {
+            uv.x = (uv.x - min.x) / (max.x - min.x);
+            uv.y = (uv.y - min.y) / (max.y - min.y);
 
-            }
         }
     }
 
@@ -249,93 +287,192 @@ std::optional<Mesh> Mesh::CreateMesh(const std::string& path, Renderer& renderer
     else
         indexData = indices32.data();
 
+    buffers.vertBuf = renderer.CreateBuffer(vertices.data(), sizeof(PBRPass::Vertex) * vertices.size(), wgpu::BufferUsage::Vertex, "Vertex buffer", ResidencyCategory::Meshes);
+    buffers.indexBuf = renderer.CreateBuffer(indexData, indexBufferSize, wgpu::BufferUsage::Index, "Index buffer", ResidencyCategory::Meshes);
+    buffers.indexFormat = indices32.empty() ? wgpu::IndexFormat::Uint16 : wgpu::IndexFormat::Uint32;
+    buffers.indexCount = indexCount;
+
+    return true;
+}
+
+// Frames in flight may still draw the mesh, so the buffers count until they are destroyed after the frame.
+void ReleaseMeshBuffers(Renderer& renderer, Mesh::Buffers& buffers)
+{
+    renderer.GetFrameScheduler().Defer([&residencyManager = renderer.GetResidencyManager(), vertBuf = buffers.vertBuf, indexBuf = buffers.indexBuf]()
+                                       {
+                                           residencyManager.Untrack(vertBuf);
+                                           residencyManager.Untrack(indexBuf);
+                                           vertBuf.Destroy();
+                                           indexBuf.Destroy();
+                                       });
+    buffers.vertBuf = nullptr;
+    buffers.indexBuf = nullptr;
+}
+
+std::optional<Mesh> Mesh::CreateMesh(const std::string& path, Renderer& renderer)
+{
+    tinygltf::TinyGLTF loader;
+    tinygltf::Model model;
+    std::string err;
+    std::string warn;
+
+
+    bool success = loader.LoadASCIIFromFile(&model, &err, &warn, path);
+    if(!warn.empty())
+        std::cout << warn << std::endl;
+    if (!err.empty())
+        std::cout << err << std::endl;
+    if(!success)
+    {
+        std::cout << "Failed parsing GLtf" << std::endl; 
+        return std::nullopt; 
+    }
+
+    if (model.meshes.empty())
+    {
+        std::cout << "No meshes in: " << path << std::endl;
+        return std::nullopt;
+    }
+
+    int32_t albedoIndex;
+    int32_t normalIndex;
+    int32_t metallicRoughnessIndex;
+    int32_t aoIndex;
+    int32_t emissiveIndex;
+    Material material{};
+    uint32_t alphaFeature{ 0 };
+
+    for(size_t i = 0; i < model.meshes.size(); ++i)
+    {
+        tinygltf::Primitive primitive = model.meshes[i].primitives[0];
+
+        tinygltf::Material gltfMaterial = model.materials[primitive.material];
+        albedoIndex = gltfMaterial.pbrMetallicRoughness.baseColorTexture.index;
+        normalIndex = gltfMaterial.normalTexture.index;
+        metallicRoughnessIndex = gltfMaterial.pbrMetallicRoughness.metallicRoughnessTexture.index;
+        aoIndex = gltfMaterial.occlusionTexture.index;
+        emissiveIndex = gltfMaterial.emissiveTexture.index;
+        material = {};
+        material.albedoFactor = glm::vec3{ gltfMaterial.pbrMetallicRoughness.baseColorFactor[0], gltfMaterial.pbrMetallicRoughness.baseColorFactor[1], gltfMaterial.pbrMetallicRoughness.baseColorFactor[2] };
+        material.metallicFactor = static_cast<float>(gltfMaterial.pbrMetallicRoughness.metallicFactor);
+        material.roughnessFactor = static_cast<float>(gltfMaterial.pbrMetallicRoughness.roughnessFactor);
+        material.emissiveFactor = glm::vec3{ gltfMaterial.emissiveFactor[0], gltfMaterial.emissiveFactor[1], gltfMaterial.emissiveFactor[2] };
+        material.aoFactor = static_cast<float>(gltfMaterial.occlusionTexture.strength);
+        material.normalFactor = static_cast<float>(gltfMaterial.normalTexture.scale);
+        material.alphaFactor = static_cast<float>(gltfMaterial.pbrMetallicRoughness.baseColorFactor[3]);
+        material.alphaCutoff = static_cast<float>(gltfMaterial.alphaCutoff);
+
+        alphaFeature = 0;
+        if (gltfMaterial.alphaMode == "MASK")
+            alphaFeature = MATERIAL_FEATURE_ALPHA_MASK;
+        else if (gltfMaterial.alphaMode == "BLEND")
+            alphaFeature = MATERIAL_FEATURE_ALPHA_BLEND;
+    }
+
+    // The last glTF mesh is the one that's drawn.
+    const uint32_t gltfMesh = static_cast<uint32_t>(model.meshes.size() - 1);
+    Mesh::Buffers buffers{};
+    if (!CreateMeshBuffers(model, model.meshes[gltfMesh].primitives[0], renderer, buffers))
+        return std::nullopt;
+
+    // Textures start out at a low resolution, the streamer fills in the material's handles and refines them on demand.
+    // Any of them may be missing, in which case the material's factors are used instead.
+    const uint32_t materialIndex = renderer.GetMaterialSystem().AddMaterial(material);
+    if (materialIndex == INVALID_MATERIAL)
+    {
+        ReleaseMeshBuffers(renderer, buffers);
+        return std::nullopt;
+    }
+
     Mesh mesh{}; 
-    mesh.vertBuf = renderer.CreateBuffer(vertices.data(), sizeof(PBRPass::Vertex) * vertices.size(), wgpu::BufferUsage::Vertex, "Vertex buffer");
-    mesh.indexBuf = renderer.CreateBuffer(indexData, indexBufferSize, wgpu::BufferUsage::Index, "Index buffer");
-    mesh.indexFormat = indices32.empty() ? wgpu::IndexFormat::Uint16 : wgpu::IndexFormat::Uint32;
-    mesh.indexCount = indexCount;
-
-    mesh.materialBuf = renderer.CreateBuffer(&material, sizeof(Material), wgpu::BufferUsage::Uniform, "Material buffer");
-
-    const auto& albedoImage = model.images[model.textures[albedoIndex].source];
-    const uint32_t mipLevelCount = bitWidth(std::max(albedoImage.width, albedoImage.height));
-    mesh.albedoTexture = renderer.GetTextureLoader().LoadTexture(albedoImage.image, albedoImage.width, albedoImage.height, wgpu::TextureFormat::BGRA8Unorm, mipLevelCount, albedoImage.name.c_str());
-
-    const auto& normalImage = model.images[model.textures[normalIndex].source];
-    mesh.normalTexture = renderer.GetTextureLoader().LoadTexture(normalImage.image, normalImage.width, normalImage.height, wgpu::TextureFormat::BGRA8Unorm, mipLevelCount, normalImage.name.c_str());
-
-    const auto& metallicImage = model.images[model.textures[metallicIndex].source];
-    mesh.metallicTexture = renderer.GetTextureLoader().LoadTexture(metallicImage.image, metallicImage.width, metallicImage.height, wgpu::TextureFormat::BGRA8Unorm, mipLevelCount, metallicImage.name.c_str());
-
-    const auto& roughnessImage = model.images[model.textures[roughnessIndex].source];
-    mesh.roughnessTexture = renderer.GetTextureLoader().LoadTexture(roughnessImage.image, roughnessImage.width, roughnessImage.height, wgpu::TextureFormat::BGRA8Unorm, mipLevelCount, roughnessImage.name.c_str());
-
-    const auto& aoImage = model.images[model.textures[aoIndex].source];
-    mesh.aoTexture = renderer.GetTextureLoader().LoadTexture(aoImage.image, aoImage.width, aoImage.height, wgpu::TextureFormat::BGRA8Unorm, mipLevelCount, aoImage.name.c_str());
-
-    const auto& emissiveImage = model.images[model.textures[emissiveIndex].source];
-    mesh.emissiveTexture = renderer.GetTextureLoader().LoadTexture(emissiveImage.image, emissiveImage.width, emissiveImage.height, wgpu::TextureFormat::BGRA8Unorm, mipLevelCount, emissiveImage.name.c_str());
-
-
-    wgpu::TextureViewDescriptor texViewDesc{};
-    texViewDesc.dimension = wgpu::TextureViewDimension::e2D;
-    texViewDesc.format = wgpu::TextureFormat::RGBA8Unorm;
-    texViewDesc.baseArrayLayer = 0;
-    texViewDesc.arrayLayerCount = 1;
-    texViewDesc.mipLevelCount = mipLevelCount;
-    texViewDesc.baseMipLevel = 0; 
-    texViewDesc.aspect = wgpu::TextureAspect::All;
-    mesh.albedoTextureView = mesh.albedoTexture.CreateView(&texViewDesc);
-    mesh.emissiveTextureView = mesh.emissiveTexture.CreateView(&texViewDesc);
-    mesh.normalTextureView = mesh.normalTexture.CreateView(&texViewDesc);
-    mesh.metallicTextureView = mesh.metallicTexture.CreateView(&texViewDesc);
-    mesh.roughnessTextureView = mesh.roughnessTexture.CreateView(&texViewDesc);
-    mesh.aoTextureView = mesh.aoTexture.CreateView(&texViewDesc);
-
-    wgpu::SamplerDescriptor samplerDesc{};
-    samplerDesc.addressModeU = wgpu::AddressMode::ClampToEdge;
-    samplerDesc.addressModeV = wgpu::AddressMode::ClampToEdge;
-    samplerDesc.addressModeW = wgpu::AddressMode::ClampToEdge;
-    samplerDesc.minFilter = wgpu::FilterMode::Linear;
-    samplerDesc.magFilter = wgpu::FilterMode::Linear;
-    samplerDesc.mipmapFilter = wgpu::MipmapFilterMode::Linear;
-    samplerDesc.lodMinClamp = 0.0f;
-    samplerDesc.lodMaxClamp = static_cast<float>(mipLevelCount);
-    samplerDesc.compare = wgpu::CompareFunction::Undefined;
-    samplerDesc.maxAnisotropy = 1;
-    mesh.sampler = renderer.Device().CreateSampler(&samplerDesc);
-
-    std::array<wgpu::BindGroupEntry, 8> bgEntries{};
-    bgEntries[0].binding = 0;
-    bgEntries[0].buffer = mesh.materialBuf;
-    
-    bgEntries[1].binding = 1;
-    bgEntries[1].sampler = mesh.sampler;
-
-    bgEntries[2].binding = 2;
-    bgEntries[2].textureView = mesh.albedoTextureView;
-
-    bgEntries[3].binding = 3;
-    bgEntries[3].textureView = mesh.normalTextureView;
-
-    bgEntries[4].binding = 4;
-    bgEntries[4].textureView = mesh.metallicTextureView;
-
-    bgEntries[5].binding = 5;
-    bgEntries[5].textureView = mesh.roughnessTextureView;
-
-    bgEntries[6].binding = 6;
-    bgEntries[6].textureView = mesh.aoTextureView;
-
-    bgEntries[7].binding = 7;
-    bgEntries[7].textureView = mesh.emissiveTextureView;
-
-
-    wgpu::BindGroupDescriptor bgDesc{};
-    bgDesc.layout = renderer.PBRRenderPass().PBRBindGroupLayout();
-    bgDesc.entryCount = bgEntries.size();
-    bgDesc.entries = bgEntries.data();
-    mesh.bindGroup = renderer.Device().CreateBindGroup(&bgDesc);
+    mesh.materialIndex = materialIndex;
+    mesh.buffers = std::make_shared<Mesh::Buffers>(buffers);
+    mesh.path = path;
+    mesh.gltfMesh = gltfMesh;
+
+    // Meshes that haven't been drawn for a while are the last resort when memory runs over budget. They're loaded again once they're drawn.
+    mesh.evictionId = renderer.GetResidencyManager().AddEvictable(EvictionPriority::Meshes, [&renderer, buffers = mesh.buffers]()
+                                                                  {
+                                                                      ReleaseMeshBuffers(renderer, *buffers);
+                                                                      return EvictionResult::Evicted;
+                                                                  });
+
+    mesh.materialFeatures = alphaFeature;
+    TextureStreamer& textureStreamer = renderer.GetTextureStreamer();
+
+    auto findImage = [&model](int32_t textureIndex) -> const tinygltf::Image*
+    {
+        if (textureIndex < 0 || model.textures[textureIndex].source < 0)
+            return nullptr;
+        return &model.images[model.textures[textureIndex].source];
+    };
+    auto imageIndex = [&model](const tinygltf::Image* image)
+    {
+        return image ? static_cast<int>(image - model.images.data()) : -1;
+    };
+
+    // Finer mips are built from the images read again from the file, the decoded model isn't kept.
+    auto reloadImage = [path](int index) -> TextureStreamer::SourceLoader
+    {
+        return [path, index]()
+        {
+            std::optional<tinygltf::Model> reloaded = ReloadImages(path, { index });
+            return reloaded ? reloaded->images[index].image : std::vector<uint8_t>{};
+        };
+    };
+
+    // Color data is decoded by the sampler, so filtering happens in linear space.
+    if (const tinygltf::Image* albedoImage = findImage(albedoIndex))
+    {
+        textureStreamer.AddTexture(mesh.materialIndex, MaterialTexture::Albedo, albedoImage->image, albedoImage->width, albedoImage->height, wgpu::TextureFormat::RGBA8UnormSrgb, albedoImage->name,
+                                   reloadImage(imageIndex(albedoImage)));
+    }
+
+    if (const tinygltf::Image* normalImage = findImage(normalIndex))
+    {
+        textureStreamer.AddTexture(mesh.materialIndex, MaterialTexture::Normal, PackNormalRG(*normalImage), normalImage->width, normalImage->height, wgpu::TextureFormat::RG8Unorm, normalImage->name,
+                                   [path, index = imageIndex(normalImage)]()
+                                   {
+                                       std::optional<tinygltf::Model> reloaded = ReloadImages(path, { index });
+                                       return reloaded ? PackNormalRG(reloaded->images[index]) : std::vector<uint8_t>{};
+                                   });
+        mesh.materialFeatures |= MATERIAL_FEATURE_NORMAL_MAP;
+    }
+
+    // glTF stores roughness and metallic in one image already, occlusion is optional and often shares it.
+    const tinygltf::Image* metallicRoughnessImage = findImage(metallicRoughnessIndex);
+    const tinygltf::Image* occlusionImage = findImage(aoIndex);
+    if (metallicRoughnessImage || occlusionImage)
+    {
+        const tinygltf::Image& ormBase = metallicRoughnessImage ? *metallicRoughnessImage : *occlusionImage;
+        textureStreamer.AddTexture(mesh.materialIndex, MaterialTexture::ORM, PackOcclusionRoughnessMetallic(metallicRoughnessImage, occlusionImage), ormBase.width, ormBase.height, wgpu::TextureFormat::RGBA8Unorm, ormBase.name,
+                                   [path, metallicRoughnessIndex = imageIndex(metallicRoughnessImage), occlusionIndex = imageIndex(occlusionImage)]()
+                                   {
+                                       std::optional<tinygltf::Model> reloaded = ReloadImages(path, { metallicRoughnessIndex, occlusionIndex });
+                                       if (!reloaded)
+                                           return std::vector<uint8_t>{};
+                                       return PackOcclusionRoughnessMetallic(metallicRoughnessIndex >= 0 ? &reloaded->images[metallicRoughnessIndex] : nullptr,
+                                                                             occlusionIndex >= 0 ? &reloaded->images[occlusionIndex] : nullptr);
+                                   });
+        mesh.materialFeatures |= (metallicRoughnessImage ? MATERIAL_FEATURE_METALLIC_ROUGHNESS_MAP : 0) | (occlusionImage ? MATERIAL_FEATURE_OCCLUSION_MAP : 0);
+    }
+
+    if (const tinygltf::Image* emissiveImage = findImage(emissiveIndex))
+    {
+        textureStreamer.AddTexture(mesh.materialIndex, MaterialTexture::Emissive, emissiveImage->image, emissiveImage->width, emissiveImage->height, wgpu::TextureFormat::RGBA8UnormSrgb, emissiveImage->name,
+                                   reloadImage(imageIndex(emissiveImage)));
+        mesh.materialFeatures |= MATERIAL_FEATURE_EMISSIVE_MAP;
+    }
 
     return std::optional<Mesh>(mesh);
 }
+
+bool Mesh::Reload(Renderer& renderer) const
+{
+    std::optional<tinygltf::Model> model = ReloadImages(path, {});
+    if (!model || gltfMesh >= model->meshes.size() || !CreateMeshBuffers(*model, model->meshes[gltfMesh].primitives[0], renderer, *buffers))
+        return false;
+
+    renderer.GetResidencyManager().MarkResident(evictionId);
+    return true;
+}
@@ -0,0 +1,352 @@
+#include "pipeline_cache.hpp"
+#include <cstring>
+#include <iostream>
+#include <emscripten.h>
+#include "renderer.hpp"
+#include "enum_util.hpp"
+
+constexpr const char* MANIFEST_STORAGE_KEY{ "pipeline-warm-up" };
+
+// FNV-1a over the descriptor contents. Objects are hashed by handle.
+class DescriptorHasher
+{
+public:
+    void Add(uint64_t value)
+    {
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            _hash ^= (value >> (i * 8)) & 0xFF;
+            _hash *= 1099511628211ull;
+        }
+    }
+
+    void Add(float value)
+    {
+        uint32_t bits{};
+        memcpy(&bits, &value, sizeof(bits));
+        Add(static_cast<uint64_t>(bits));
+    }
+
+    void Add(const char* string)
+    {
+        for (; string && *string; ++string)
+        {
+            _hash ^= static_cast<uint8_t>(*string);
+            _hash *= 1099511628211ull;
+        }
+        Add(static_cast<uint64_t>(0));
+    }
+
+    template <typename T>
+    void AddHandle(const T& object)
+    {
+        Add(reinterpret_cast<uint64_t>(object.Get()));
+    }
+
+    void AddConstants(size_t constantCount, const wgpu::ConstantEntry* constants)
+    {
+        Add(static_cast<uint64_t>(constantCount));
+        for (size_t i = 0; i < constantCount; ++i)
+        {
+            Add(constants[i].key);
+            uint64_t bits{};
+            memcpy(&bits, &constants[i].value, sizeof(bits));
+            Add(bits);
+        }
+    }
+
+    void AddStencilFace(const wgpu::StencilFaceState& face)
+    {
+        Add(static_cast<uint64_t>(face.compare));
+        Add(static_cast<uint64_t>(face.failOp));
+        Add(static_cast<uint64_t>(face.depthFailOp));
+        Add(static_cast<uint64_t>(face.passOp));
+    }
+
+    uint64_t Hash() const { return _hash; }
+
+private:
+    uint64_t _hash{ 14695981039346656037ull };
+};
+
+uint64_t HashDescriptor(const wgpu::RenderPipelineDescriptor& descriptor)
+{
+    DescriptorHasher hasher{};
+    hasher.AddHandle(descriptor.layout);
+
+    const wgpu::VertexState& vertex = descriptor.vertex;
+    hasher.AddHandle(vertex.module);
+    hasher.Add(vertex.entryPoint);
+    hasher.AddConstants(vertex.constantCount, vertex.constants);
+    hasher.Add(static_cast<uint64_t>(vertex.bufferCount));
+    for (size_t i = 0; i < vertex.bufferCount; ++i)
+    {
+        const wgpu::VertexBufferLayout& buffer = vertex.buffers[i];
+        hasher.Add(buffer.arrayStride);
+        hasher.Add(static_cast<uint64_t>(buffer.stepMode));
+        hasher.Add(static_cast<uint64_t>(buffer.attributeCount));
+        for (size_t j = 0; j < buffer.attributeCount; ++j)
+        {
+            hasher.Add(static_cast<uint64_t>(buffer.attributes[j].format));
+            hasher.Add(buffer.attributes[j].offset);
+            hasher.Add(static_cast<uint64_t>(buffer.attributes[j].shaderLocation));
+        }
+    }
+
+    hasher.Add(static_cast<uint64_t>(descriptor.primitive.topology));
+    hasher.Add(static_cast<uint64_t>(descriptor.primitive.stripIndexFormat));
+    hasher.Add(static_cast<uint64_t>(descriptor.primitive.frontFace));
+    hasher.Add(static_cast<uint64_t>(descriptor.primitive.cullMode));
+
+    hasher.Add(static_cast<uint64_t>(descriptor.depthStencil != nullptr));
+    if (const wgpu::DepthStencilState* depthStencil = descriptor.depthStencil)
+    {
+        hasher.Add(static_cast<uint64_t>(depthStencil->format));
+        hasher.Add(static_cast<uint64_t>(depthStencil->depthWriteEnabled));
+        hasher.Add(static_cast<uint64_t>(depthStencil->depthCompare));
+        hasher.AddStencilFace(depthStencil->stencilFront);
+        hasher.AddStencilFace(depthStencil->stencilBack);
+        hasher.Add(static_cast<uint64_t>(depthStencil->stencilReadMask));
+        hasher.Add(static_cast<uint64_t>(depthStencil->stencilWriteMask));
+        hasher.Add(static_cast<uint64_t>(static_cast<uint32_t>(depthStencil->depthBias)));
+        hasher.Add(depthStencil->depthBiasSlopeScale);
+        hasher.Add(depthStencil->depthBiasClamp);
+    }
+
+    hasher.Add(static_cast<uint64_t>(descriptor.multisample.count));
+    hasher.Add(static_cast<uint64_t>(descriptor.multisample.mask));
+    hasher.Add(static_cast<uint64_t>(descriptor.multisample.alphaToCoverageEnabled));
+
+    hasher.Add(static_cast<uint64_t>(descriptor.fragment != nullptr));
+    if (const wgpu::FragmentState* fragment = descriptor.fragment)
+    {
+        hasher.AddHandle(fragment->module);
+        hasher.Add(fragment->entryPoint);
+        hasher.AddConstants(fragment->constantCount, fragment->constants);
+        hasher.Add(static_cast<uint64_t>(fragment->targetCount));
+        for (size_t i = 0; i < fragment->targetCount; ++i)
+        {
+            const wgpu::ColorTargetState& target = fragment->targets[i];
+            hasher.Add(static_cast<uint64_t>(target.format));
+            hasher.Add(static_cast<uint64_t>(target.writeMask));
+            hasher.Add(static_cast<uint64_t>(target.blend != nullptr));
+            if (target.blend)
+            {
+                for (const wgpu::BlendComponent& component : { target.blend->color, target.blend->alpha })
+                {
+                    hasher.Add(static_cast<uint64_t>(component.operation));
+                    hasher.Add(static_cast<uint64_t>(component.srcFactor));
+                    hasher.Add(static_cast<uint64_t>(component.dstFactor));
+                }
+            }
+        }
+    }
+
+    return hasher.Hash();
+}
+
+uint64_t HashDescriptor(const wgpu::ComputePipelineDescriptor& descriptor)
+{
+    DescriptorHasher hasher{};
+    hasher.AddHandle(descriptor.layout);
+    hasher.AddHandle(descriptor.compute.module);
+    hasher.Add(descriptor.compute.entryPoint);
+    hasher.AddConstants(descriptor.compute.constantCount, descriptor.compute.constants);
+
+    return hasher.Hash();
+}
+
+PipelineCache::PipelineCache(const Renderer& renderer) : _renderer(renderer)
+{
+    // Entries are separated by semicolons, and the family is separated from the variant by a colon.
+    const std::string manifest{ emscripten_run_script_string((std::string("localStorage.getItem('") + MANIFEST_STORAGE_KEY + "') || ''").c_str()) };
+
+    size_t begin{ 0 };
+    while (begin < manifest.size())
+    {
+        size_t end = manifest.find(';', begin);
+        if (end == std::string::npos)
+            end = manifest.size();
+
+        if (end > begin)
+            _manifest.insert(manifest.substr(begin, end - begin));
+
+        begin = end + 1;
+    }
+}
+
+uint64_t PipelineCache::RequestRenderPipeline(const wgpu::RenderPipelineDescriptor& descriptor)
+{
+    const uint64_t key = HashDescriptor(descriptor);
+    if (_renderPipelines.count(key))
+        return key;
+
+    Entry<wgpu::RenderPipeline>& entry = _renderPipelines[key];
+    entry.layout = descriptor.layout;
+    entry.modules.push_back(descriptor.vertex.module);
+    if (descriptor.fragment)
+        entry.modules.push_back(descriptor.fragment->module);
+
+    ++_pendingCount;
+    _renderer.Device().CreateRenderPipelineAsync(&descriptor, [](WGPUCreatePipelineAsyncStatus status, WGPURenderPipeline pipeline, const char* message, void* userdata)
+                                                 {
+                                                     PendingPipeline* pending = reinterpret_cast<PendingPipeline*>(userdata);
+                                                     pending->cache->OnRenderPipelineCreated(pending, status, pipeline, message);
+                                                 }, new PendingPipeline{ this, key });
+
+    return key;
+}
+
+uint64_t PipelineCache::RequestComputePipeline(const wgpu::ComputePipelineDescriptor& descriptor)
+{
+    const uint64_t key = HashDescriptor(descriptor);
+    if (_computePipelines.count(key))
+        return key;
+
+    Entry<wgpu::ComputePipeline>& entry = _computePipelines[key];
+    entry.layout = descriptor.layout;
+    entry.modules.push_back(descriptor.compute.module);
+
+    ++_pendingCount;
+    _renderer.Device().CreateComputePipelineAsync(&descriptor, [](WGPUCreatePipelineAsyncStatus status, WGPUComputePipeline pipeline, const char* message, void* userdata)
+                                                  {
+                                                      PendingPipeline* pending = reinterpret_cast<PendingPipeline*>(userdata);
+                                                      pending->cache->OnComputePipelineCreated(pending, status, pipeline, message);
+                                                  }, new PendingPipeline{ this, key });
+
+    return key;
+}
+
+wgpu::RenderPipeline PipelineCache::GetRenderPipeline(uint64_t key, const wgpu::RenderPipeline& fallback) const
+{
+    auto it = _renderPipelines.find(key);
+    if (it == _renderPipelines.end() || !it->second.pipeline)
+        return fallback;
+
+    return it->second.pipeline;
+}
+
+wgpu::ComputePipeline PipelineCache::GetComputePipeline(uint64_t key, const wgpu::ComputePipeline& fallback) const
+{
+    auto it = _computePipelines.find(key);
+    if (it == _computePipelines.end() || !it->second.pipeline)
+        return fallback;
+
+    return it->second.pipeline;
+}
+
+wgpu::RenderPipeline PipelineCache::CreateRenderPipelineBlocking(const wgpu::RenderPipelineDescriptor& descriptor)
+{
+    const uint64_t key = HashDescriptor(descriptor);
+    Entry<wgpu::RenderPipeline>& entry = _renderPipelines[key];
+    if (entry.pipeline)
+        return entry.pipeline;
+
+    // A pending compile finishes into the pipeline created here, and is dropped when it comes back.
+    entry.pipeline = _renderer.Device().CreateRenderPipeline(&descriptor);
+    entry.layout = descriptor.layout;
+    entry.modules = { descriptor.vertex.module };
+    if (descriptor.fragment)
+        entry.modules.push_back(descriptor.fragment->module);
+
+    return entry.pipeline;
+}
+
+wgpu::ComputePipeline PipelineCache::CreateComputePipelineBlocking(const wgpu::ComputePipelineDescriptor& descriptor)
+{
+    const uint64_t key = HashDescriptor(descriptor);
+    Entry<wgpu::ComputePipeline>& entry = _computePipelines[key];
+    if (entry.pipeline)
+        return entry.pipeline;
+
+    entry.pipeline = _renderer.Device().CreateComputePipeline(&descriptor);
+    entry.layout = descriptor.layout;
+    entry.modules = { descriptor.compute.module };
+
+    return entry.pipeline;
+}
+
+void PipelineCache::RegisterWarmUp(const std::string& family, WarmUpCallback warmUp)
+{
+    _warmUps[family] = std::move(warmUp);
+}
+
+void PipelineCache::RecordVariant(const std::string& family, const std::string& variant)
+{
+    if (_manifest.insert(family + ":" + variant).second)
+        SaveManifest();
+}
+
+void PipelineCache::WarmUp()
+{
+    for (const std::string& entry : _manifest)
+    {
+        const size_t separator = entry.find(':');
+        if (separator == std::string::npos)
+            continue;
+
+        auto it = _warmUps.find(entry.substr(0, separator));
+        if (it != _warmUps.end())
+            it->second(entry.substr(separator + 1));
+    }
+}
+
+void PipelineCache::OnRenderPipelineCreated(PendingPipeline* pending, WGPUCreatePipelineAsyncStatus status, WGPURenderPipeline pipeline, const char* message)
+{
+    --_pendingCount;
+
+    Entry<wgpu::RenderPipeline>& entry = _renderPipelines[pending->key];
+
+    if (status != WGPUCreatePipelineAsyncStatus_Success)
+    {
+        std::cout << "Failed compiling render pipeline - status: " << conv_enum_str<wgpu::CreatePipelineAsyncStatus>(status) << "\n";
+        if (message) std::cout << message;
+        std::cout << std::endl;
+    }
+    else if (!entry.pipeline)
+    {
+        entry.pipeline = wgpu::RenderPipeline::Acquire(pipeline);
+    }
+    else
+    {
+        wgpuRenderPipelineRelease(pipeline);
+    }
+
+    delete pending;
+}
+
+void PipelineCache::OnComputePipelineCreated(PendingPipeline* pending, WGPUCreatePipelineAsyncStatus status, WGPUComputePipeline pipeline, const char* message)
+{
+    --_pendingCount;
+
+    Entry<wgpu::ComputePipeline>& entry = _computePipelines[pending->key];
+
+    if (status != WGPUCreatePipelineAsyncStatus_Success)
+    {
+        std::cout << "Failed compiling compute pipeline - status: " << conv_enum_str<wgpu::CreatePipelineAsyncStatus>(status) << "\n";
+        if (message) std::cout << message;
+        std::cout << std::endl;
+    }
+    else if (!entry.pipeline)
+    {
+        entry.pipeline = wgpu::ComputePipeline::Acquire(pipeline);
+    }
+    else
+    {
+        wgpuComputePipelineRelease(pipeline);
+    }
+
+    delete pending;
+}
+
+void PipelineCache::SaveManifest() const
+{
+    std::string manifest{};
+    for (const std::string& entry : _manifest)
+    {
+        manifest += entry + ";";
+    }
+
+    // Family and variant names are plain identifiers, so they can be passed along without escaping.
+    emscripten_run_script((std::string("localStorage.setItem('") + MANIFEST_STORAGE_KEY + "', '" + manifest + "')").c_str());
+}
@@ -0,0 +1,409 @@
+#include "render_graph.hpp"
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include "renderer.hpp"
+#include "frame_scheduler.hpp"
+
+// Transient textures that no pass has needed for this many frames are destroyed.
+constexpr uint64_t UNUSED_TEXTURE_FRAMES{ 30 };
+
+RenderGraphResource RenderGraph::Builder::CreateTexture(const RenderGraphTextureDesc& desc)
+{
+    _graph._resources.push_back({ desc, {}, false, 0, 0, ~0u, 0 });
+    return static_cast<RenderGraphResource>(_graph._resources.size() - 1);
+}
+
+void RenderGraph::Builder::WriteColor(RenderGraphResource target, const wgpu::Color& clearValue, RenderGraphResource resolveTarget)
+{
+    assert(target < _graph._resources.size() && "Writing an unknown render graph resource");
+
+    Pass& pass = _graph._passes[_pass];
+    pass.colors.push_back({ target, resolveTarget, clearValue, 0.0f });
+    pass.writes.push_back(target);
+    if (resolveTarget != INVALID_RENDER_GRAPH_RESOURCE)
+        pass.writes.push_back(resolveTarget);
+}
+
+void RenderGraph::Builder::WriteDepth(RenderGraphResource target, float clearValue)
+{
+    assert(target < _graph._resources.size() && "Writing an unknown render graph resource");
+
+    Pass& pass = _graph._passes[_pass];
+    pass.depth = { target, INVALID_RENDER_GRAPH_RESOURCE, {}, clearValue };
+    pass.writes.push_back(target);
+}
+
+void RenderGraph::Builder::WriteStorage(RenderGraphResource target)
+{
+    assert(target < _graph._resources.size() && "Writing an unknown render graph resource");
+
+    _graph._passes[_pass].writes.push_back(target);
+}
+
+void RenderGraph::Builder::Read(RenderGraphResource resource)
+{
+    assert(resource < _graph._resources.size() && "Reading an unknown render graph resource");
+
+    _graph._passes[_pass].reads.push_back(resource);
+}
+
+void RenderGraph::Builder::SideEffect()
+{
+    _graph._passes[_pass].sideEffect = true;
+}
+
+wgpu::RenderPassEncoder RenderGraph::Context::BeginRenderPass(const char* label) const
+{
+    wgpu::RenderPassDescriptor renderPass{};
+    renderPass.label = label;
+    renderPass.colorAttachmentCount = _pass.colorAttachments.size();
+    renderPass.colorAttachments = _pass.colorAttachments.data();
+    renderPass.depthStencilAttachment = _pass.depth.target != INVALID_RENDER_GRAPH_RESOURCE ? &_pass.depthAttachment : nullptr;
+
+    return _encoder.BeginRenderPass(&renderPass);
+}
+
+const wgpu::TextureView& RenderGraph::Context::View(RenderGraphResource resource) const
+{
+    return _graph._resources[resource].view;
+}
+
+glm::uvec2 RenderGraph::Context::Size(RenderGraphResource resource) const
+{
+    return { _graph._resources[resource].width, _graph._resources[resource].height };
+}
+
+RenderGraph::RenderGraph(const Renderer& renderer) : _renderer(renderer)
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+    for (const Texture& texture : _textures)
+    {
+        _renderer.GetResidencyManager().Untrack(texture.texture);
+    }
+}
+
+RenderGraphResource RenderGraph::ImportTexture(const char* label, const wgpu::TextureView& view)
+{
+    RenderGraphTextureDesc desc{};
+    desc.label = label;
+    _resources.push_back({ desc, view, true, 0, 0, ~0u, 0 });
+    return static_cast<RenderGraphResource>(_resources.size() - 1);
+}
+
+void RenderGraph::AddPass(const char* name, const SetupCallback& setup, ExecuteCallback execute)
+{
+    _passes.push_back({});
+    _passes.back().name = name;
+    _passes.back().execute = std::move(execute);
+
+    Builder builder{ *this, static_cast<uint32_t>(_passes.size() - 1) };
+    setup(builder);
+}
+
+void RenderGraph::Execute(const wgpu::CommandEncoder& encoder, uint32_t width, uint32_t height)
+{
+    ++_frame;
+    _width = width;
+    _height = height;
+
+    std::vector<std::vector<uint32_t>> writers(_resources.size());
+    for (uint32_t i = 0; i < _passes.size(); ++i)
+    {
+        for (RenderGraphResource resource : _passes[i].writes)
+        {
+            writers[resource].push_back(i);
+        }
+    }
+
+    const std::vector<uint32_t> sorted = SortPasses(writers);
+    std::vector<uint32_t> position(_passes.size());
+    for (uint32_t i = 0; i < sorted.size(); ++i)
+    {
+        position[sorted[i]] = i;
+    }
+
+    // Passes are kept when they write an output, and then everything they depend on is kept too.
+    std::vector<bool> needed(_passes.size(), false);
+    for (uint32_t i = 0; i < _passes.size(); ++i)
+    {
+        needed[i] = _passes[i].sideEffect;
+        for (RenderGraphResource resource : _passes[i].writes)
+        {
+            needed[i] = needed[i] || _resources[resource].imported;
+        }
+    }
+
+    // Dependencies are always earlier in the order, so one walk back reaches all of them.
+    for (auto it = sorted.rbegin(); it != sorted.rend(); ++it)
+    {
+        if (!needed[*it])
+            continue;
+
+        const Pass& pass = _passes[*it];
+        for (RenderGraphResource resource : pass.reads)
+        {
+            for (uint32_t writer : writers[resource])
+            {
+                needed[writer] = true;
+            }
+        }
+
+        // Attachments that are loaded need the writes before them.
+        for (RenderGraphResource resource : pass.writes)
+        {
+            for (uint32_t writer : writers[resource])
+            {
+                needed[writer] = needed[writer] || position[writer] < position[*it];
+            }
+        }
+    }
+
+    std::vector<uint32_t> order{};
+    for (uint32_t pass : sorted)
+    {
+        if (needed[pass])
+            order.push_back(pass);
+    }
+
+    for (uint32_t i = 0; i < order.size(); ++i)
+    {
+        const Pass& pass = _passes[order[i]];
+        auto use = [this, i](RenderGraphResource resource)
+        {
+            _resources[resource].firstUse = std::min(_resources[resource].firstUse, i);
+            _resources[resource].lastUse = std::max(_resources[resource].lastUse, i);
+        };
+
+        std::for_each(pass.reads.begin(), pass.reads.end(), use);
+        std::for_each(pass.writes.begin(), pass.writes.end(), use);
+    }
+
+    AllocateTextures(width, height);
+    ResolveAttachments(order);
+
+    for (uint32_t pass : order)
+    {
+        _passes[pass].execute(Context{ *this, encoder, _passes[pass] });
+    }
+
+    ReleaseUnusedTextures();
+
+    _passCount = static_cast<uint32_t>(order.size());
+    _culledPassCount = static_cast<uint32_t>(_passes.size() - order.size());
+    _virtualTextureCount = static_cast<uint32_t>(std::count_if(_resources.begin(), _resources.end(), [](const Resource& resource)
+                                                               {
+                                                                   return !resource.imported && resource.firstUse != ~0u;
+                                                               }));
+
+    _passes.clear();
+    _resources.clear();
+}
+
+std::vector<uint32_t> RenderGraph::SortPasses(const std::vector<std::vector<uint32_t>>& writers) const
+{
+    std::vector<std::vector<uint32_t>> dependents(_passes.size());
+    std::vector<uint32_t> dependencyCount(_passes.size(), 0);
+    auto addDependency = [&dependents, &dependencyCount](uint32_t before, uint32_t after)
+    {
+        dependents[before].push_back(after);
+        ++dependencyCount[after];
+    };
+
+    // Writers of a resource run in the order they were added, and readers after all of them.
+    for (const std::vector<uint32_t>& resourceWriters : writers)
+    {
+        for (uint32_t i = 1; i < resourceWriters.size(); ++i)
+        {
+            addDependency(resourceWriters[i - 1], resourceWriters[i]);
+        }
+    }
+
+    for (uint32_t i = 0; i < _passes.size(); ++i)
+    {
+        for (RenderGraphResource resource : _passes[i].reads)
+        {
+            for (uint32_t writer : writers[resource])
+            {
+                if (writer != i)
+                    addDependency(writer, i);
+            }
+        }
+    }
+
+    // Among passes that are ready, the one added first goes first, which keeps the order stable between frames.
+    std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> ready{};
+    for (uint32_t i = 0; i < _passes.size(); ++i)
+    {
+        if (dependencyCount[i] == 0)
+            ready.push(i);
+    }
+
+    std::vector<uint32_t> sorted{};
+    while (!ready.empty())
+    {
+        const uint32_t pass = ready.top();
+        ready.pop();
+        sorted.push_back(pass);
+
+        for (uint32_t dependent : dependents[pass])
+        {
+            if (--dependencyCount[dependent] == 0)
+                ready.push(dependent);
+        }
+    }
+
+    if (sorted.size() != _passes.size())
+    {
+        std::cout << "Render graph has a cycle, passes run in the order they were added" << std::endl;
+
+        sorted.resize(_passes.size());
+        for (uint32_t i = 0; i < _passes.size(); ++i)
+        {
+            sorted[i] = i;
+        }
+    }
+
+    return sorted;
+}
+
+void RenderGraph::AllocateTextures(uint32_t width, uint32_t height)
+{
+    std::vector<RenderGraphResource> transient{};
+    for (uint32_t i = 0; i < _resources.size(); ++i)
+    {
+        if (!_resources[i].imported && _resources[i].firstUse != ~0u)
+            transient.push_back(i);
+    }
+
+    std::sort(transient.begin(), transient.end(), [this](RenderGraphResource lhs, RenderGraphResource rhs)
+              {
+                  return _resources[lhs].firstUse < _resources[rhs].firstUse;
+              });
+
+    for (RenderGraphResource index : transient)
+    {
+        Resource& resource = _resources[index];
+        const uint32_t textureWidth = std::max(1u, static_cast<uint32_t>(width * resource.desc.scale));
+        const uint32_t textureHeight = std::max(1u, static_cast<uint32_t>(height * resource.desc.scale));
+        const wgpu::TextureUsage usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding | resource.desc.usage;
+
+        // A texture can be taken over once the last pass using it this frame has run.
+        auto texture = std::find_if(_textures.begin(), _textures.end(), [&](const Texture& texture)
+                                    {
+                                        return texture.format == resource.desc.format && texture.sampleCount == resource.desc.sampleCount &&
+                                               texture.width == textureWidth && texture.height == textureHeight && texture.usage == usage &&
+                                               (texture.lastUsedFrame != _frame || texture.busyUntil < resource.firstUse);
+                                    });
+
+        if (texture == _textures.end())
+        {
+            wgpu::TextureDescriptor textureDesc{};
+            textureDesc.label = resource.desc.label;
+            textureDesc.dimension = wgpu::TextureDimension::e2D;
+            textureDesc.size = { textureWidth, textureHeight, 1 };
+            textureDesc.format = resource.desc.format;
+            textureDesc.mipLevelCount = 1;
+            textureDesc.sampleCount = resource.desc.sampleCount;
+            textureDesc.usage = usage;
+
+            Texture created{};
+            created.texture = _renderer.Device().CreateTexture(&textureDesc);
+            created.view = created.texture.CreateView();
+            created.format = resource.desc.format;
+            created.sampleCount = resource.desc.sampleCount;
+            created.width = textureWidth;
+            created.height = textureHeight;
+            created.usage = usage;
+            created.extentWidth = width;
+            created.extentHeight = height;
+            _renderer.GetResidencyManager().Track(created.texture, ResidencyCategory::RenderTargets);
+
+            _textures.push_back(created);
+            texture = _textures.end() - 1;
+        }
+
+        resource.width = textureWidth;
+        resource.height = textureHeight;
+        texture->busyUntil = resource.lastUse;
+        texture->lastUsedFrame = _frame;
+        resource.view = texture->view;
+    }
+}
+
+void RenderGraph::ResolveAttachments(const std::vector<uint32_t>& order)
+{
+    // Whether each resource has been written yet this frame. Imported textures start out undefined as well.
+    std::vector<bool> written(_resources.size(), false);
+
+    for (uint32_t i = 0; i < order.size(); ++i)
+    {
+        Pass& pass = _passes[order[i]];
+        auto storeOp = [this, i](RenderGraphResource resource)
+        {
+            const bool usedLater = _resources[resource].imported || _resources[resource].lastUse > i;
+            return usedLater ? wgpu::StoreOp::Store : wgpu::StoreOp::Discard;
+        };
+
+        pass.colorAttachments.clear();
+        for (const Attachment& color : pass.colors)
+        {
+            wgpu::RenderPassColorAttachment attachment{};
+            attachment.view = _resources[color.target].view;
+            attachment.resolveTarget = color.resolveTarget != INVALID_RENDER_GRAPH_RESOURCE ? _resources[color.resolveTarget].view : nullptr;
+            attachment.loadOp = written[color.target] ? wgpu::LoadOp::Load : wgpu::LoadOp::Clear;
+            attachment.storeOp = storeOp(color.target);
+            attachment.clearValue = color.clearValue;
+            pass.colorAttachments.push_back(attachment);
+
+            written[color.target] = true;
+            if (color.resolveTarget != INVALID_RENDER_GRAPH_RESOURCE)
+                written[color.resolveTarget] = true;
+        }
+
+        if (pass.depth.target != INVALID_RENDER_GRAPH_RESOURCE)
+        {
+            pass.depthAttachment = {};
+            pass.depthAttachment.view = _resources[pass.depth.target].view;
+            pass.depthAttachment.depthLoadOp = written[pass.depth.target] ? wgpu::LoadOp::Load : wgpu::LoadOp::Clear;
+            pass.depthAttachment.depthStoreOp = storeOp(pass.depth.target);
+            pass.depthAttachment.depthClearValue = pass.depth.depthClearValue;
+            pass.depthAttachment.depthReadOnly = false;
+            pass.depthAttachment.stencilLoadOp = wgpu::LoadOp::Undefined;
+            pass.depthAttachment.stencilStoreOp = wgpu::StoreOp::Undefined;
+            pass.depthAttachment.stencilReadOnly = true;
+
+            written[pass.depth.target] = true;
+        }
+
+        // Storage writes count too, attachments after them load what they wrote.
+        for (RenderGraphResource resource : pass.writes)
+        {
+            written[resource] = true;
+        }
+    }
+}
+
+void RenderGraph::ReleaseUnusedTextures()
+{
+    for (auto it = _textures.begin(); it != _textures.end();)
+    {
+        // Textures sized for an old extent won't be needed again, unless the canvas is sized back.
+        const bool staleSize = it->lastUsedFrame != _frame && (it->extentWidth != _width || it->extentHeight != _height);
+        if (!staleSize && _frame - it->lastUsedFrame < UNUSED_TEXTURE_FRAMES)
+        {
+            ++it;
+            continue;
+        }
+
+        // Frames in flight may still render to it.
+        _renderer.GetResidencyManager().Untrack(it->texture);
+        _renderer.GetFrameScheduler().DeferDestroy(it->texture);
+        it = _textures.erase(it);
+    }
+}
@@ -13,8 +13,23 @@
 #include <graphics/hdr_pass.hpp>
 #include <graphics/imgui_pass.hpp>
 #include <graphics/skybox_pass.hpp>
+#include <graphics/upscale_pass.hpp>
+#include <graphics/taa_pass.hpp>
+#include <graphics/post_aa_pass.hpp>
+#include <graphics/bloom_pass.hpp>
+#include <graphics/auto_exposure_pass.hpp>
 #include <graphics/hdri_conversion_pass.hpp>
 #include "texture_loader.hpp"
+#include "upload_manager.hpp"
+#include "gpu_object_cache.hpp"
+#include "pipeline_cache.hpp"
+#include "shader_library.hpp"
+#include "uniform_ring.hpp"
+#include "frame_scheduler.hpp"
+#include "render_graph.hpp"
+#include "dynamic_resolution.hpp"
+#include "material_system.hpp"
+#include "texture_streamer.hpp"
 #include <graphics/irradiance_pass.hpp>
 
 Renderer::Renderer(DeviceResources deviceResources, GLFWwindow* window, int32_t width, int32_t height) :
@@ -24,7 +39,9 @@ Renderer::Renderer(DeviceResources deviceResources, GLFWwindow* window, int32_t
     _queue(deviceResources.queue),
     _window(window),
     _width(width),
-    _height(height)
+    _height(height),
+    _pendingWidth(width),
+    _pendingHeight(height)
 { 
     _device.SetUncapturedErrorCallback([](WGPUErrorType error, const char* message, void* userdata)  
                                        {
@@ -34,6 +51,40 @@ Renderer::Renderer(DeviceResources deviceResources, GLFWwindow* window, int32_t
                                        }, nullptr);
 
     _queue = _device.GetQueue();
+
+    _frameScheduler = std::make_unique<FrameScheduler>(_queue);
+    _residencyManager = std::make_unique<ResidencyManager>();
+    _objectCache = std::make_unique<GpuObjectCache>(_device);
+    _pipelineCache = std::make_unique<PipelineCache>(*this);
+    _shaderLibrary = std::make_unique<ShaderLibrary>(_device);
+    _renderGraph = std::make_unique<RenderGraph>(*this);
+    _dynamicResolution = std::make_unique<DynamicResolution>();
+
+    ShaderStruct pointLightStruct{ "PointLight", sizeof(PointLight) };
+    pointLightStruct.Field<glm::vec4>("color", offsetof(PointLight, color))
+                    .Field<glm::vec3>("position", offsetof(PointLight, position))
+                    .Field<float>("radius", offsetof(PointLight, radius));
+
+    ShaderStruct viewStruct{ "View", sizeof(View) };
+    viewStruct.Field<glm::mat4>("proj", offsetof(View, proj))
+              .Field<glm::mat4>("view", offsetof(View, view))
+              .Field<glm::mat4>("vp", offsetof(View, vp))
+              .Field<glm::mat4>("invVp", offsetof(View, invVp))
+              .Field<glm::mat4>("unjitteredVp", offsetof(View, unjitteredVp))
+              .Field<glm::mat4>("previousVp", offsetof(View, previousVp))
+              .Field<glm::vec3>("cameraPosition", offsetof(View, cameraPosition));
+
+    ShaderStruct lightingStruct{ "Lighting", sizeof(Lighting) };
+    lightingStruct.Field<glm::vec3>("lightDirection", offsetof(Lighting, lightDirection))
+                  .Field<float>("normalMapStrength", offsetof(Lighting, normalMapStrength))
+                  .Field<glm::vec3>("lightColor", offsetof(Lighting, lightColor))
+                  .Field("pointLights", pointLightStruct, offsetof(Lighting, pointLights), MAX_POINT_LIGHTS);
+
+    _shaderLibrary->AddGeneratedStructs("generated/common.wgsl", { pointLightStruct, viewStruct, lightingStruct });
+
+    _uploadManager = std::make_unique<UploadManager>(*this);
+    _uniformRing = std::make_unique<UniformRing>(*this);
+    _materialSystem = std::make_unique<MaterialSystem>(*this);
      
     _queue.OnSubmittedWorkDone([](WGPUQueueWorkDoneStatus status, void* userdata)
                                {
@@ -44,15 +95,17 @@ Renderer::Renderer(DeviceResources deviceResources, GLFWwindow* window, int32_t
     _cameraTransform.rotation = glm::quat{ glm::vec3{ glm::radians(30.0f), 0.0f, 0.0f } };
     glm::mat4 camMat{ BuildSRT(_cameraTransform) };
      
-    _commonData.view = glm::inverse(camMat);
+    // Both blocks start out dirty and are uploaded whole with the first frame.
+    _view = UniformBlock<View>{ CreateBuffer(nullptr, sizeof(View), wgpu::BufferUsage::Uniform, "View uniform") };
+    _lighting = UniformBlock<Lighting>{ CreateBuffer(nullptr, sizeof(Lighting), wgpu::BufferUsage::Uniform, "Lighting uniform") };
 
-    _commonData.pointLights[0] = { { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.5f, 0.0f, 0.5f   }, 1.0f };
-    _commonData.pointLights[1] = { { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.5f, 0.25f, -0.5f }, 1.0f };
-    _commonData.pointLights[2] = { { 1.0f, 1.0f, 1.0f, 1.0f }, { -0.5f, 0.5f, -0.5f }, 1.0f }; 
-    _commonData.pointLights[3] = { { 1.0f, 1.0f, 1.0f, 1.0f }, { -0.5f, 1.0f, 0.5f  }, 1.0f };
-    _commonData.normalMapStrength = 0.8f;
+    _view.Set(_view.Data().view, glm::inverse(camMat));
 
-    _commonBuf = CreateBuffer(&_commonData, sizeof(_commonData), wgpu::BufferUsage::Uniform, "Common uniform");
+    _lighting.Set(_lighting.Data().pointLights[0], { { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.5f, 0.0f, 0.5f   }, 1.0f });
+    _lighting.Set(_lighting.Data().pointLights[1], { { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.5f, 0.25f, -0.5f }, 1.0f });
+    _lighting.Set(_lighting.Data().pointLights[2], { { 1.0f, 1.0f, 1.0f, 1.0f }, { -0.5f, 0.5f, -0.5f }, 1.0f });
+    _lighting.Set(_lighting.Data().pointLights[3], { { 1.0f, 1.0f, 1.0f, 1.0f }, { -0.5f, 1.0f, 0.5f  }, 1.0f });
+    _lighting.Set(_lighting.Data().normalMapStrength, 0.8f);
 
     wgpu::TextureDescriptor irradianceTextureDesc{};
     irradianceTextureDesc.label = "Irradiance texture";
@@ -66,6 +119,7 @@ Renderer::Renderer(DeviceResources deviceResources, GLFWwindow* window, int32_t
     irradianceTextureDesc.usage = wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::StorageBinding | wgpu::TextureUsage::RenderAttachment;
 
     _irradianceTexture = _device.CreateTexture(&irradianceTextureDesc);
+    _residencyManager->Track(_irradianceTexture, ResidencyCategory::Textures);
 
     wgpu::TextureViewDescriptor irradianceViewDesc{};
     irradianceViewDesc.label = "Irradiance texture view";
@@ -80,16 +134,28 @@ Renderer::Renderer(DeviceResources deviceResources, GLFWwindow* window, int32_t
     _irradianceView = _irradianceTexture.CreateView(&irradianceViewDesc);
 
     CreatePipelineAndBuffers();
-    Resize(_width, _height);
+    CreateSurface();
+    ApplySize();
      
     _pbrPass = std::make_unique<PBRPass>(*this);
+    // The post process shader reads the exposure struct the auto exposure generates.
+    _autoExposurePass = std::make_unique<AutoExposurePass>(*this);
     _hdrPass = std::make_unique<HDRPass>(*this);
     _imGuiPass = std::make_unique<ImGuiPass>(*this);
     _skyboxPass = std::make_unique<SkyboxPass>(*this);
+    _upscalePass = std::make_unique<UpscalePass>(*this);
+    _taaPass = std::make_unique<TAAPass>(*this);
+    _postAAPass = std::make_unique<PostAAPass>(*this);
+    _bloomPass = std::make_unique<BloomPass>(*this);
     HDRIConversionPass hdriConversionPass{ *this };
     IrradiancePass irradiancePass{ *this, _skyboxPass->SkyboxView() };
 
     _textureLoader = std::make_unique<TextureLoader>(*this); 
+    _textureStreamer = std::make_unique<TextureStreamer>(*this);
+    _pipelineCache->WarmUp();
+
+    // The HDRI has to be uploaded before it's converted.
+    _uploadManager->Flush();
 
     {
         wgpu::CommandEncoderDescriptor ceDesc;
@@ -105,6 +171,7 @@ Renderer::Renderer(DeviceResources deviceResources, GLFWwindow* window, int32_t
         
         wgpu::CommandBuffer commands = encoder.Finish(nullptr);
 
+        _uniformRing->Flush();
         _queue.Submit(1, &commands);
     }
     {
@@ -130,56 +197,292 @@ Renderer::Renderer(DeviceResources deviceResources, GLFWwindow* window, int32_t
 
         wgpu::CommandBuffer commands = encoder.Finish(nullptr); 
 
+        _uniformRing->Flush();
         _queue.Submit(1, &commands);
     }
+
+    // The setup work counts as frame 0.
+    _uniformRing->EndFrame();
+    _frameScheduler->EndFrame();
 }
 
 Renderer::~Renderer() = default;
 
-void Renderer::Render() const
+void Renderer::Render()
 {
     glfwPollEvents();
 
+    // The CPU skips a frame rather than waiting once it's MAX_FRAMES_IN_FLIGHT ahead.
+    if (!_frameScheduler->BeginFrame())
+        return;
+
+    // A drag-resize sends many events per frame, only the last one is applied. A collapsed canvas keeps the old size.
+    if ((_pendingWidth != _width || _pendingHeight != _height) && _pendingWidth > 0 && _pendingHeight > 0)
+    {
+        _width = _pendingWidth;
+        _height = _pendingHeight;
+        ApplySize();
+    }
+
+    // The scene renders at a fraction of the canvas size while the GPU is over its frame budget.
+    _dynamicResolution->Update(_frameScheduler->LastFrameGpuMs());
+    const float renderScale = _dynamicResolution->Scale();
+    const bool taa = _antiAliasing == AntiAliasing::TAA;
+
+    // TAA moves the projection by a sub-pixel offset of the scene targets every frame. Same rounding as the graph's scaled textures.
+    const glm::uvec2 renderSize{ std::max(1u, static_cast<uint32_t>(_width * renderScale)), std::max(1u, static_cast<uint32_t>(_height * renderScale)) };
+    const glm::vec2 jitter = taa ? _taaPass->BeginFrame({ _width, _height }) : glm::vec2{ 0.0f };
+    // Pixels go down, NDC goes up.
+    const glm::vec2 ndcJitter = jitter * glm::vec2{ 2.0f, -2.0f } / glm::vec2{ renderSize };
 
     glm::mat4 camMat{ BuildSRT(_cameraTransform) };
 
-    _commonData.view = glm::inverse(camMat);
-    _commonData.vp = _commonData.proj * _commonData.view;
-    _commonData.time = glfwGetTime();
-    _commonData.cameraPosition = _cameraTransform.translation;
-    _queue.WriteBuffer(_commonBuf, 0, &_commonData, sizeof(_commonData));
+    _view.Set(_view.Data().previousVp, _view.Data().unjitteredVp);
+    _view.Set(_view.Data().view, glm::inverse(camMat));
+    _view.Set(_view.Data().proj, _camera.Projection(ndcJitter));
+    _view.Set(_view.Data().vp, _view.Data().proj * _view.Data().view);
+    _view.Set(_view.Data().invVp, glm::inverse(_view.Data().vp));
+    _view.Set(_view.Data().unjitteredVp, _camera.Projection() * _view.Data().view);
+    _view.Set(_view.Data().cameraPosition, _cameraTransform.translation);
+    _view.Flush(_queue);
+    _lighting.Flush(_queue);
+
+    // Resources loaded since the last frame have to land before anything samples them.
+    _textureStreamer->Update();
+    _uploadManager->Flush();
 
     wgpu::CommandEncoderDescriptor ceDesc; 
     ceDesc.label = "Command encoder";
 
     wgpu::CommandEncoder encoder = _device.CreateCommandEncoder(&ceDesc);
-    wgpu::TextureView backBufView = _swapChain.GetCurrentTextureView();
 
-    _skyboxPass->Render(encoder, _msaaView);
-    _pbrPass->Render(encoder, _msaaView, std::make_shared<wgpu::TextureView>(_hdrView)); // TODO: Seperate resolve into own pass.
-    _hdrPass->Render(encoder, backBufView);
-    _imGuiPass->Render(encoder, backBufView);
+    // The scene targets only exist for the frame, the graph decides what they're backed by.
+    RenderGraph& graph = *_renderGraph;
+    const RenderGraphResource backBuffer = graph.ImportTexture("Back buffer", _swapChain.GetCurrentTextureView());
+    RenderGraphResource sceneHdr{};
+    RenderGraphResource sceneMotion{};
+    RenderGraphResource upscaled{};
+    RenderGraphResource sharpened{};
+
+    // Opaque geometry, sky and blended geometry share one pass, so multisampled targets never leave the tile memory
+    // and only their resolve is stored. With TAA the scene writes its motion vectors next to the color.
+    // The sample count of the targets comes from the same setting as the scene pipelines'.
+    graph.AddPass("Scene", [&](RenderGraph::Builder& builder)
+                  {
+                      const uint32_t sampleCount = SceneSampleCount();
+                      const RenderGraphResource sceneDepth = builder.CreateTexture({ "Scene depth", DEPTH_STENCIL_FORMAT, sampleCount, renderScale });
+                      sceneHdr = builder.CreateTexture({ "HDR", wgpu::TextureFormat::RGBA16Float, 1, renderScale });
+                      if (sampleCount > 1)
+                      {
+                          const RenderGraphResource sceneColor = builder.CreateTexture({ "Scene color MSAA", wgpu::TextureFormat::RGBA16Float, sampleCount, renderScale });
+                          builder.WriteColor(sceneColor, { 0.3, 0.3, 0.3, 1.0 }, sceneHdr);
+                      }
+                      else
+                      {
+                          builder.WriteColor(sceneHdr, { 0.3, 0.3, 0.3, 1.0 });
+                      }
+                      if (taa)
+                      {
+                          sceneMotion = builder.CreateTexture({ "Motion vectors", MOTION_VECTOR_FORMAT, 1, renderScale });
+                          builder.WriteColor(sceneMotion, { 0.0, 0.0, 0.0, 0.0 });
+                      }
+                      // Reversed Z, the far plane is at 0.
+                      builder.WriteDepth(sceneDepth, 0.0f);
+                  }, [this](const RenderGraph::Context& context)
+                  {
+                      wgpu::RenderPassEncoder pass = context.BeginRenderPass("Scene render pass");
+                      _pbrPass->RenderOpaque(pass);
+                      _skyboxPass->Render(pass);
+                      _pbrPass->RenderBlended(pass);
+                      pass.End();
+                  });
+
+    RenderGraphResource taaOutput{ INVALID_RENDER_GRAPH_RESOURCE };
+    if (taa)
+    {
+        // The histories outlive the frame. The output becomes the next frame's history, and is already at the canvas size.
+        const RenderGraphResource taaHistory = graph.ImportTexture("TAA history", _taaPass->HistoryView());
+        taaOutput = graph.ImportTexture("TAA output", _taaPass->OutputView());
+
+        graph.AddPass("TAA", [&](RenderGraph::Builder& builder)
+                      {
+                          builder.Read(sceneHdr);
+                          builder.Read(sceneMotion);
+                          builder.Read(taaHistory);
+                          builder.WriteColor(taaOutput);
+                      }, [this, &sceneHdr, &sceneMotion, jitter](const RenderGraph::Context& context)
+                      {
+                          wgpu::RenderPassEncoder pass = context.BeginRenderPass("TAA render pass");
+                          _taaPass->Render(pass, context.View(sceneHdr), context.View(sceneMotion), context.Size(sceneHdr), jitter);
+                          pass.End();
+                      });
+    }
+    else if (renderScale < 1.0f)
+    {
+        graph.AddPass("Upscale", [&](RenderGraph::Builder& builder)
+                      {
+                          upscaled = builder.CreateTexture({ "Upscaled HDR", wgpu::TextureFormat::RGBA16Float });
+                          builder.Read(sceneHdr);
+                          builder.WriteColor(upscaled);
+                      }, [this, &sceneHdr, &upscaled](const RenderGraph::Context& context)
+                      {
+                          wgpu::RenderPassEncoder pass = context.BeginRenderPass("Upscale render pass");
+                          _upscalePass->RenderUpscale(pass, context.View(sceneHdr), context.Size(sceneHdr), context.Size(upscaled));
+                          pass.End();
+                      });
+
+        graph.AddPass("Sharpen", [&](RenderGraph::Builder& builder)
+                      {
+                          sharpened = builder.CreateTexture({ "Sharpened HDR", wgpu::TextureFormat::RGBA16Float });
+                          builder.Read(upscaled);
+                          builder.WriteColor(sharpened);
+                      }, [this, &upscaled](const RenderGraph::Context& context)
+                      {
+                          wgpu::RenderPassEncoder pass = context.BeginRenderPass("Sharpen render pass");
+                          _upscalePass->RenderSharpen(pass, context.View(upscaled), context.Size(upscaled));
+                          pass.End();
+                      });
+    }
+
+    // FXAA and SMAA work on the tonemapped image, which goes to the back buffer through them.
+    const bool postAA = _antiAliasing == AntiAliasing::FXAA || _antiAliasing == AntiAliasing::SMAA;
+    const RenderGraphResource hdr = taa ? taaOutput : renderScale < 1.0f ? sharpened : sceneHdr;
+
+    if (_autoExposurePass->Enabled())
+    {
+        // Only writes the exposure buffer, which the graph doesn't track. Declared first, so it runs before the post process.
+        graph.AddPass("Auto exposure", [&](RenderGraph::Builder& builder)
+                      {
+                          builder.Read(hdr);
+                          builder.SideEffect();
+                      }, [this, hdr](const RenderGraph::Context& context)
+                      {
+                          // The HDR color is at the canvas size by now, and imported textures like the TAA output don't have a size in the graph.
+                          _autoExposurePass->Render(context.Encoder(), context.View(hdr), { _width, _height });
+                      });
+    }
+
+    RenderGraphResource bloom{ INVALID_RENDER_GRAPH_RESOURCE };
+    if (_bloomPass->Enabled())
+    {
+        // The chain is kept across frames, only its top level is read by the post process.
+        _bloomPass->BeginFrame({ _width, _height });
+        bloom = graph.ImportTexture("Bloom", _bloomPass->OutputView());
+
+        graph.AddPass("Bloom", [&](RenderGraph::Builder& builder)
+                      {
+                          builder.Read(hdr);
+                          builder.WriteStorage(bloom);
+                      }, [this, hdr](const RenderGraph::Context& context)
+                      {
+                          _bloomPass->Render(context.Encoder(), context.View(hdr));
+                      });
+    }
+
+    RenderGraphResource ldr{};
+    RenderGraphResource edges{};
+    RenderGraphResource blendWeights{};
+    graph.AddPass("Post process", [&](RenderGraph::Builder& builder)
+                  {
+                      ldr = postAA ? builder.CreateTexture({ "LDR", _swapChainFormat }) : backBuffer;
+                      builder.Read(hdr);
+                      if (bloom != INVALID_RENDER_GRAPH_RESOURCE)
+                          builder.Read(bloom);
+                      builder.WriteColor(ldr);
+                  }, [this, hdr, bloom](const RenderGraph::Context& context)
+                  {
+                      wgpu::RenderPassEncoder pass = context.BeginRenderPass("HDR render pass");
+                      _hdrPass->Render(pass, context.View(hdr), _autoExposurePass->ExposureBuffer(), bloom != INVALID_RENDER_GRAPH_RESOURCE ? context.View(bloom) : nullptr);
+                      pass.End();
+                  });
+
+    if (_antiAliasing == AntiAliasing::FXAA)
+    {
+        graph.AddPass("FXAA", [&](RenderGraph::Builder& builder)
+                      {
+                          builder.Read(ldr);
+                          builder.WriteColor(backBuffer);
+                      }, [this, &ldr](const RenderGraph::Context& context)
+                      {
+                          wgpu::RenderPassEncoder pass = context.BeginRenderPass("FXAA render pass");
+                          _postAAPass->RenderFXAA(pass, context.View(ldr), context.Size(ldr));
+                          pass.End();
+                      });
+    }
+    else if (_antiAliasing == AntiAliasing::SMAA)
+    {
+        graph.AddPass("SMAA edges", [&](RenderGraph::Builder& builder)
+                      {
+                          edges = builder.CreateTexture({ "SMAA edges", PostAAPass::EDGES_FORMAT });
+                          builder.Read(ldr);
+                          builder.WriteColor(edges, { 0.0, 0.0, 0.0, 0.0 });
+                      }, [this, &ldr](const RenderGraph::Context& context)
+                      {
+                          wgpu::RenderPassEncoder pass = context.BeginRenderPass("SMAA edge render pass");
+                          _postAAPass->RenderEdges(pass, context.View(ldr), context.Size(ldr));
+                          pass.End();
+                      });
+
+        graph.AddPass("SMAA blend weights", [&](RenderGraph::Builder& builder)
+                      {
+                          blendWeights = builder.CreateTexture({ "SMAA blend weights", PostAAPass::BLEND_WEIGHTS_FORMAT });
+                          builder.Read(edges);
+                          builder.WriteColor(blendWeights, { 0.0, 0.0, 0.0, 0.0 });
+                      }, [this, &edges](const RenderGraph::Context& context)
+                      {
+                          wgpu::RenderPassEncoder pass = context.BeginRenderPass("SMAA blend weight render pass");
+                          _postAAPass->RenderBlendWeights(pass, context.View(edges), context.Size(edges));
+                          pass.End();
+                      });
+
+        graph.AddPass("SMAA blend", [&](RenderGraph::Builder& builder)
+                      {
+                          builder.Read(ldr);
+                          builder.Read(blendWeights);
+                          builder.WriteColor(backBuffer);
+                      }, [this, &ldr, &blendWeights](const RenderGraph::Context& context)
+                      {
+                          wgpu::RenderPassEncoder pass = context.BeginRenderPass("SMAA blend render pass");
+                          _postAAPass->RenderBlend(pass, context.View(ldr), context.View(blendWeights), context.Size(ldr));
+                          pass.End();
+                      });
+    }
+
+    graph.AddPass("ImGui", [&](RenderGraph::Builder& builder)
+                  {
+                      builder.WriteColor(backBuffer);
+                  }, [this](const RenderGraph::Context& context)
+                  {
+                      wgpu::RenderPassEncoder pass = context.BeginRenderPass("ImGui render pass");
+                      _imGuiPass->Render(pass);
+                      pass.End();
+                  });
+
+    // A changed grading rebakes the LUT before the graph's passes sample it.
+    _hdrPass->Prepare(encoder);
+    graph.Execute(encoder, _width, _height);
+
+    _textureStreamer->RecordFeedbackReadback(encoder);
 
     wgpu::CommandBuffer commands = encoder.Finish(nullptr);
 
+    // Every pass has made its transient allocations by now, they go up in one write.
+    _uniformRing->Flush();
     _queue.Submit(1, &commands);
+    _uniformRing->EndFrame();
+    _frameScheduler->EndFrame();
+
+    _textureStreamer->RequestFeedback();
+
+    // Evictions are recorded as uploads and land with the next frame.
+    _residencyManager->EndFrame();
+    _objectCache->EndFrame();
 }
 
 void Renderer::Resize(int32_t width, int32_t height)
 {
-    _width = width;
-    _height = height;
-    SetupRenderTarget();
-
-    if(_hdrPass)
-        _hdrPass->UpdateHDRView(_hdrView);
-
-    _camera.ratio = _width / static_cast<float>(_height);
-
-    _commonData.proj = glm::perspective(_camera.fov, _camera.ratio, _camera.zNear, _camera.zFar);
-    _commonData.vp = _commonData.proj * _commonData.view;
-
-    _queue.WriteBuffer(_commonBuf, 0, &_commonData, sizeof(_commonData));
+    _pendingWidth = width;
+    _pendingHeight = height;
 }
 
 void Renderer::DrawMesh(const Mesh& mesh, const Transform& transform)
@@ -195,12 +498,11 @@ void Renderer::SetLight(uint32_t index, const glm::vec4& color, const glm::vec3&
         return;
     }
 
-    _commonData.pointLights[index].color = color;
-    _commonData.pointLights[index].position = position;
-
+    _lighting.Set(_lighting.Data().pointLights[index].color, color);
+    _lighting.Set(_lighting.Data().pointLights[index].position, position);
 }
 
-void Renderer::SetupRenderTarget()
+void Renderer::CreateSurface()
 {
     wgpu::SurfaceDescriptorFromCanvasHTMLSelector canvasDesc{};
     canvasDesc.sType = wgpu::SType::SurfaceDescriptorFromCanvasHTMLSelector;
@@ -209,98 +511,71 @@ void Renderer::SetupRenderTarget()
     wgpu::SurfaceDescriptor surfDesc{};
     surfDesc.nextInChain = reinterpret_cast<wgpu::ChainedStruct*>(&canvasDesc);
 
-    wgpu::Surface surface = _instance.CreateSurface(&surfDesc);
+    _surface = _instance.CreateSurface(&surfDesc);
+    _swapChainFormat = _surface.GetPreferredFormat(_adapter);
+}
+
+void Renderer::SetAntiAliasing(AntiAliasing antiAliasing)
+{
+    // The history is from before TAA was last turned off.
+    if (antiAliasing == AntiAliasing::TAA && _antiAliasing != AntiAliasing::TAA)
+        _taaPass->ResetHistory();
+
+    _antiAliasing = antiAliasing;
+}
 
+void Renderer::ApplySize()
+{
+    // The surface stays, only the swap chain is sized to the canvas. The render targets follow through the render graph's pool.
     wgpu::SwapChainDescriptor swapDesc{};
     swapDesc.label = "Swapchain";
     swapDesc.usage = wgpu::TextureUsage::RenderAttachment;
-    swapDesc.format = _swapChainFormat = surface.GetPreferredFormat(_adapter);
+    swapDesc.format = _swapChainFormat;
     swapDesc.width = _width;
     swapDesc.height = _height;
     swapDesc.presentMode = wgpu::PresentMode::Fifo;
 
-    _swapChain = _device.CreateSwapChain(surface, &swapDesc);
-
-    wgpu::TextureDescriptor msaaDesc{};
-    msaaDesc.label = "MSAA RT";
-    msaaDesc.size.width = _width;
-    msaaDesc.size.height = _height;
-    msaaDesc.sampleCount = 4;
-    msaaDesc.format = wgpu::TextureFormat::RGBA16Float;
-    msaaDesc.usage = wgpu::TextureUsage::RenderAttachment;
-    _msaaTarget = _device.CreateTexture(&msaaDesc);
-    
-    _msaaView = _msaaTarget.CreateView();
-
-    wgpu::TextureDescriptor hdrDesc{ msaaDesc };
-    hdrDesc.label = "HDR RT";
-    hdrDesc.sampleCount = 1;
-    hdrDesc.usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding;
-    _hdrTarget = _device.CreateTexture(&hdrDesc);
-    _hdrView = _hdrTarget.CreateView();  
-
-    wgpu::TextureDescriptor depthTextureDesc{};
-    depthTextureDesc.label = "Depth texture";
-    depthTextureDesc.dimension = wgpu::TextureDimension::e2D;
-    depthTextureDesc.format = DEPTH_STENCIL_FORMAT;
-    depthTextureDesc.mipLevelCount = 1;
-    depthTextureDesc.sampleCount = 4;
-    depthTextureDesc.size = { static_cast<uint32_t>(_width), static_cast<uint32_t>(_height), 1 };
-    depthTextureDesc.usage = wgpu::TextureUsage::RenderAttachment; 
-    depthTextureDesc.viewFormatCount = 1;
-    depthTextureDesc.viewFormats = &DEPTH_STENCIL_FORMAT;
-
-    _depthTexture = _device.CreateTexture(&depthTextureDesc);
-
-    wgpu::TextureViewDescriptor depthTextureViewDesc{};
-    depthTextureViewDesc.label = "Depth texture view";
-    depthTextureViewDesc.aspect = wgpu::TextureAspect::DepthOnly;
-    depthTextureViewDesc.baseArrayLayer = 0;
-    depthTextureViewDesc.arrayLayerCount = 1;
-    depthTextureViewDesc.mipLevelCount = 1;
-    depthTextureViewDesc.dimension = wgpu::TextureViewDimension::e2D;
-    depthTextureViewDesc.format = DEPTH_STENCIL_FORMAT;
-
-    _depthTextureView = _depthTexture.CreateView(&depthTextureViewDesc);
-
-    _depthStencilAttachment.view = _depthTextureView;
-    _depthStencilAttachment.depthClearValue = 1.0f;
-    _depthStencilAttachment.depthLoadOp = wgpu::LoadOp::Clear;
-    _depthStencilAttachment.depthStoreOp = wgpu::StoreOp::Store;
-    _depthStencilAttachment.depthReadOnly = false;
-    _depthStencilAttachment.stencilClearValue = 0.f;
-    _depthStencilAttachment.stencilLoadOp = wgpu::LoadOp::Undefined;
-    _depthStencilAttachment.stencilStoreOp = wgpu::StoreOp::Undefined;
-    _depthStencilAttachment.stencilReadOnly = true;
+    _swapChain = _device.CreateSwapChain(_surface, &swapDesc);
+
+    // The projection follows in the next frame, which may jitter it.
+    _camera.ratio = _width / static_cast<float>(_height);
 }
 
 void Renderer::CreatePipelineAndBuffers()
 {
-    std::array<wgpu::BindGroupLayoutEntry, 2> bgLayoutEntry{};
+    std::array<wgpu::BindGroupLayoutEntry, 3> bgLayoutEntry{};
     bgLayoutEntry[0].binding = 0;
     bgLayoutEntry[0].visibility = wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment;
     bgLayoutEntry[0].buffer.type = wgpu::BufferBindingType::Uniform;
-    bgLayoutEntry[0].buffer.minBindingSize = sizeof(_commonData);
+    bgLayoutEntry[0].buffer.minBindingSize = sizeof(View);
     bgLayoutEntry[1].binding = 1;
     bgLayoutEntry[1].visibility = wgpu::ShaderStage::Fragment;
     bgLayoutEntry[1].texture.sampleType = wgpu::TextureSampleType::Float;
     bgLayoutEntry[1].texture.viewDimension = wgpu::TextureViewDimension::Cube;
+    bgLayoutEntry[2].binding = 2;
+    bgLayoutEntry[2].visibility = wgpu::ShaderStage::Fragment;
+    bgLayoutEntry[2].buffer.type = wgpu::BufferBindingType::Uniform;
+    bgLayoutEntry[2].buffer.minBindingSize = sizeof(Lighting);
 
     wgpu::BindGroupLayoutDescriptor bgLayoutDesc{};
     bgLayoutDesc.label = "Common binding group layout";
     bgLayoutDesc.entryCount = bgLayoutEntry.size();
     bgLayoutDesc.entries = bgLayoutEntry.data();
-    _commonBGLayout = _device.CreateBindGroupLayout(&bgLayoutDesc);
+    _commonBGLayout = _objectCache->GetBindGroupLayout(bgLayoutDesc);
 
-    std::array<wgpu::BindGroupEntry, 2> bgEntry{};
+    std::array<wgpu::BindGroupEntry, 3> bgEntry{};
     assert(bgLayoutEntry.size() == bgEntry.size() && "Bindgroup entry descriptions don't match their sizes");
 
     bgEntry[0].binding = 0;
-    bgEntry[0].buffer = _commonBuf;
-    bgEntry[0].size = sizeof(_commonData);
+    bgEntry[0].buffer = _view.Buffer();
+    bgEntry[0].size = sizeof(View);
 
     bgEntry[1].binding = 1;
     bgEntry[1].textureView = _irradianceView;
+
+    bgEntry[2].binding = 2;
+    bgEntry[2].buffer = _lighting.Buffer();
+    bgEntry[2].size = sizeof(Lighting);
      
     wgpu::BindGroupDescriptor bgDesc{};
     bgDesc.label = "Common bind group";
@@ -310,35 +585,34 @@ void Renderer::CreatePipelineAndBuffers()
     _commonBindGroup = _device.CreateBindGroup(&bgDesc); 
 }
 
-wgpu::Buffer Renderer::CreateBuffer(const void* data, unsigned long size, wgpu::BufferUsage usage, const char* label) const
+wgpu::Buffer Renderer::CreateBuffer(const void* data, unsigned long size, wgpu::BufferUsage usage, const char* label, ResidencyCategory category) const
 {
     wgpu::BufferDescriptor desc{};
     desc.label = label;
     desc.usage = usage | wgpu::BufferUsage::CopyDst; 
     desc.size = (size + 3) & ~3; // Ensure multiple of 4.
+    desc.mappedAtCreation = data != nullptr;
     wgpu::Buffer buffer = _device.CreateBuffer(&desc);
-    _queue.WriteBuffer(buffer, 0, data, desc.size);
+    _residencyManager->Track(buffer, category);
+
+    // Initial data is written straight into the new buffer, without a staging copy.
+    if (data)
+    {
+        memcpy(buffer.GetMappedRange(0, desc.size), data, size);
+        buffer.Unmap();
+    }
 
     return buffer;
 }
 
 wgpu::ShaderModule Renderer::CreateShader(const std::string& path, const char* label) const
 {
-    std::ifstream file{};
-    file.open(path);
-    file.seekg(0, std::ios::end);
-    size_t size = file.tellg();
-    std::string source(size, ' ');
-    file.seekg(0);
-    file.read(source.data(), size);
-
-    wgpu::ShaderModuleWGSLDescriptor wgsl{};
-    wgsl.sType = wgpu::SType::ShaderModuleWGSLDescriptor;
-    wgsl.code = source.c_str();
-    wgpu::ShaderModuleDescriptor desc{};
-    desc.nextInChain = reinterpret_cast<wgpu::ChainedStruct*>(&wgsl);
-    desc.label = label;
-    return _device.CreateShaderModule(&desc);
+    return _shaderLibrary->GetModule(path, {}, label);
+}
+
+wgpu::ShaderModule Renderer::CreateShaderFromSource(const std::string& source, const char* label) const
+{
+    return _shaderLibrary->GetModuleFromSource(source, {}, label);
 }
 
 glm::mat4 Renderer::BuildSRT(const Transform& transform) const
@@ -0,0 +1,185 @@
+#include "residency_manager.hpp"
+#include <algorithm>
+#include <iostream>
+#include "texture_loader.hpp"
+
+// Evictables used within this many frames are left alone, which also covers the latency of the streaming feedback.
+constexpr uint64_t EVICTION_GRACE_FRAMES{ 8 };
+
+BlockInfo ResidencyBlockInfo(wgpu::TextureFormat format)
+{
+    switch (format)
+    {
+    case wgpu::TextureFormat::Depth16Unorm:         return { 1, 1, 2 };
+    case wgpu::TextureFormat::Depth24Plus:
+    case wgpu::TextureFormat::Depth24PlusStencil8:
+    case wgpu::TextureFormat::Depth32Float:         return { 1, 1, 4 };
+    case wgpu::TextureFormat::Depth32FloatStencil8: return { 1, 1, 8 };
+    default:                                        return GetBlockInfo(format);
+    }
+}
+
+uint64_t TextureBytes(const wgpu::Texture& texture)
+{
+    const BlockInfo block = ResidencyBlockInfo(texture.GetFormat());
+
+    uint64_t bytes{ 0 };
+    for (uint32_t mip = 0; mip < texture.GetMipLevelCount(); ++mip)
+    {
+        const uint64_t width = std::max(texture.GetWidth() >> mip, 1u);
+        const uint64_t height = std::max(texture.GetHeight() >> mip, 1u);
+        bytes += (width + block.width - 1) / block.width * ((height + block.height - 1) / block.height) * block.bytes;
+    }
+
+    return bytes * texture.GetDepthOrArrayLayers() * texture.GetSampleCount();
+}
+
+ResidencyManager::ResidencyManager(uint64_t budget) : _budget(budget)
+{
+}
+
+void ResidencyManager::Track(const wgpu::Buffer& buffer, ResidencyCategory category)
+{
+    if (buffer)
+        Track(buffer.Get(), category, buffer.GetSize());
+}
+
+void ResidencyManager::Track(const wgpu::Texture& texture, ResidencyCategory category)
+{
+    if (texture)
+        Track(texture.Get(), category, TextureBytes(texture));
+}
+
+void ResidencyManager::Untrack(const wgpu::Buffer& buffer)
+{
+    if (buffer)
+        Untrack(buffer.Get());
+}
+
+void ResidencyManager::Untrack(const wgpu::Texture& texture)
+{
+    if (texture)
+        Untrack(texture.Get());
+}
+
+void ResidencyManager::Track(const void* handle, ResidencyCategory category, uint64_t bytes)
+{
+    // Tracking an object twice moves it to the new category.
+    Untrack(handle);
+
+    _allocations[handle] = { category, bytes };
+    _categoryBytes[static_cast<size_t>(category)] += bytes;
+    _totalBytes += bytes;
+}
+
+void ResidencyManager::Untrack(const void* handle)
+{
+    auto it = _allocations.find(handle);
+    if (it == _allocations.end())
+        return;
+
+    _categoryBytes[static_cast<size_t>(it->second.category)] -= it->second.bytes;
+    _totalBytes -= it->second.bytes;
+    _allocations.erase(it);
+}
+
+ResidencyManager::EvictionId ResidencyManager::AddEvictable(EvictionPriority priority, EvictCallback evict)
+{
+    Evictable evictable{ priority, std::move(evict), _frame, EvictableState::Resident };
+
+    if (!_freeEvictables.empty())
+    {
+        const EvictionId id = _freeEvictables.back();
+        _freeEvictables.pop_back();
+        _evictables[id] = std::move(evictable);
+        return id;
+    }
+
+    _evictables.push_back(std::move(evictable));
+    return static_cast<EvictionId>(_evictables.size() - 1);
+}
+
+void ResidencyManager::RemoveEvictable(EvictionId id)
+{
+    if (id >= _evictables.size() || _evictables[id].state == EvictableState::Removed)
+        return;
+
+    _evictables[id].state = EvictableState::Removed;
+    _evictables[id].evict = nullptr;
+    _freeEvictables.push_back(id);
+}
+
+void ResidencyManager::Touch(EvictionId id)
+{
+    if (id < _evictables.size())
+        _evictables[id].lastUsedFrame = _frame;
+}
+
+bool ResidencyManager::IsEvicted(EvictionId id) const
+{
+    return id < _evictables.size() && _evictables[id].state == EvictableState::Evicted;
+}
+
+void ResidencyManager::MarkResident(EvictionId id)
+{
+    if (!IsEvicted(id))
+        return;
+
+    _evictables[id].state = EvictableState::Resident;
+    _evictables[id].lastUsedFrame = _frame;
+}
+
+void ResidencyManager::EndFrame()
+{
+    ++_frame;
+
+    if (!OverBudget())
+    {
+        _reportedOverBudget = false;
+        return;
+    }
+
+    std::vector<EvictionId> candidates;
+    for (EvictionId id = 0; id < _evictables.size(); ++id)
+    {
+        const Evictable& evictable = _evictables[id];
+        if (evictable.state == EvictableState::Resident && evictable.lastUsedFrame + EVICTION_GRACE_FRAMES <= _frame)
+            candidates.push_back(id);
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [this](EvictionId a, EvictionId b)
+              {
+                  const Evictable& lhs = _evictables[a];
+                  const Evictable& rhs = _evictables[b];
+                  if (lhs.priority != rhs.priority)
+                      return lhs.priority < rhs.priority;
+                  return lhs.lastUsedFrame < rhs.lastUsedFrame;
+              });
+
+    // Every candidate frees at most one step per frame, so streamed textures lose one mip at a time.
+    for (EvictionId id : candidates)
+    {
+        if (!OverBudget())
+            break;
+
+        // Callbacks may add or remove evictables, so the entry is looked up again every time.
+        if (_evictables[id].state != EvictableState::Resident)
+            continue;
+
+        EvictCallback evict = _evictables[id].evict;
+        const EvictionResult result = evict();
+        if (result == EvictionResult::Pinned)
+            continue;
+
+        ++_evictionCount;
+        if (result == EvictionResult::Evicted)
+            _evictables[id].state = EvictableState::Evicted;
+    }
+
+    // Reported once until the budget is met again, the renderer keeps going with what it has.
+    if (OverBudget() && !_reportedOverBudget)
+    {
+        _reportedOverBudget = true;
+        std::cout << "GPU memory is over budget with nothing left to evict: " << _totalBytes << " of " << _budget << " bytes" << std::endl;
+    }
+}
@@ -0,0 +1,275 @@
+#include "shader_library.hpp"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "utils.hpp"
+
+constexpr const char* SHADER_DIRECTORY{ "assets/shaders/" };
+
+size_t RoundUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+ShaderStruct::ShaderStruct(const std::string& name, size_t size) : _name(name), _size(size)
+{
+}
+
+ShaderStruct& ShaderStruct::Field(const std::string& name, const ShaderStruct& type, size_t offset, uint32_t count)
+{
+    return AddField(name, type._name, type._align, type.WgslSize(), offset, count);
+}
+
+ShaderStruct& ShaderStruct::AddField(const std::string& name, const std::string& type, uint32_t align, uint32_t size, size_t offset, uint32_t count)
+{
+    // Array elements are padded to their alignment.
+    const size_t wgslOffset = RoundUp(_end, align);
+    const size_t stride = count > 1 ? RoundUp(size, align) : size;
+
+    _members.push_back({ name, type, count, offset, wgslOffset });
+    _end = wgslOffset + stride * count;
+    _align = std::max(_align, align);
+
+    return *this;
+}
+
+uint32_t ShaderStruct::WgslSize() const
+{
+    return static_cast<uint32_t>(RoundUp(_end, _align));
+}
+
+std::string ShaderStruct::Declaration() const
+{
+    std::string declaration{ "struct " + _name + "\n{\n" };
+
+    for (const Member& member : _members)
+    {
+        if (member.offset != member.wgslOffset)
+            std::cout << "Shader struct " << _name << "." << member.name << " is at offset " << member.offset << " in C++, but at " << member.wgslOffset << " in WGSL" << std::endl;
+
+        if (member.count > 1)
+            declaration += "    " + member.name + ": array<" + member.type + ", " + std::to_string(member.count) + ">,\n";
+        else
+            declaration += "    " + member.name + ": " + member.type + ",\n";
+    }
+
+    if (_size != WgslSize())
+        std::cout << "Shader struct " << _name << " is " << _size << " bytes in C++, but " << WgslSize() << " in WGSL" << std::endl;
+
+    return declaration + "}\n";
+}
+
+ShaderLibrary::ShaderLibrary(const wgpu::Device& device) : _device(device)
+{
+}
+
+void ShaderLibrary::AddGeneratedFile(const std::string& name, const std::string& source)
+{
+    _generatedFiles[name] = source;
+}
+
+void ShaderLibrary::AddGeneratedStructs(const std::string& name, const std::vector<ShaderStruct>& structs)
+{
+    std::string source{ "// Generated from the C++ layouts, don't edit.\n" };
+    for (const ShaderStruct& shaderStruct : structs)
+    {
+        source += "\n" + shaderStruct.Declaration();
+    }
+
+    AddGeneratedFile(name, source);
+}
+
+wgpu::ShaderModule ShaderLibrary::GetModule(const std::string& path, const Defines& defines, const char* label)
+{
+    const size_t separator = path.find_last_of('/');
+    const std::string directory = separator == std::string::npos ? "" : path.substr(0, separator + 1);
+
+    return CreateModule(Preprocess(LoadFile(path), directory, defines), label);
+}
+
+wgpu::ShaderModule ShaderLibrary::GetModuleFromSource(const std::string& source, const Defines& defines, const char* label)
+{
+    return CreateModule(Preprocess(source, SHADER_DIRECTORY, defines), label);
+}
+
+wgpu::ShaderModule ShaderLibrary::CreateModule(const std::string& code, const char* label)
+{
+    // FNV-1a over the final source, which is also what the browser keys its own shader cache by across restarts.
+    uint64_t hash{ 14695981039346656037ull };
+    for (char c : code)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ull;
+    }
+
+    auto it = _modules.find(hash);
+    if (it != _modules.end() && it->second.first == code)
+    {
+        ++_cacheHits;
+        return it->second.second;
+    }
+
+    wgpu::ShaderModuleWGSLDescriptor wgsl{};
+    wgsl.sType = wgpu::SType::ShaderModuleWGSLDescriptor;
+    wgsl.code = code.c_str();
+    wgpu::ShaderModuleDescriptor desc{};
+    desc.nextInChain = reinterpret_cast<wgpu::ChainedStruct*>(&wgsl);
+    desc.label = label;
+    wgpu::ShaderModule module = _device.CreateShaderModule(&desc);
+
+    // A collision keeps the first module cached, and the second is just compiled every time.
+    if (it == _modules.end())
+        _modules.emplace(hash, std::make_pair(code, module));
+
+    return module;
+}
+
+std::string ShaderLibrary::Preprocess(const std::string& source, const std::string& directory, const Defines& defines) const
+{
+    PreprocessState state{};
+    for (const auto& [name, value] : defines)
+    {
+        state.defines[name] = value;
+    }
+
+    std::string output{};
+    PreprocessFile(source, directory, state, output);
+    return output;
+}
+
+void ShaderLibrary::PreprocessFile(const std::string& source, const std::string& directory, PreprocessState& state, std::string& output) const
+{
+    // One entry per open #ifdef, telling whether its current branch is emitted.
+    std::vector<bool> active{};
+    auto emitting = [&active]()
+    {
+        return active.empty() || active.back();
+    };
+
+    std::istringstream lines{ source };
+    std::string line{};
+    while (std::getline(lines, line))
+    {
+        const size_t first = line.find_first_not_of(" \t");
+        if (first != std::string::npos && line[first] == '#')
+        {
+            std::istringstream directiveLine{ line.substr(first + 1) };
+            std::string directive{};
+            std::string name{};
+            directiveLine >> directive >> name;
+
+            if (directive == "ifdef" || directive == "ifndef")
+            {
+                const bool defined = state.defines.count(name) > 0;
+                active.push_back(emitting() && defined == (directive == "ifdef"));
+            }
+            else if (directive == "else")
+            {
+                if (active.empty())
+                {
+                    std::cout << "Shader preprocessor: #else without #ifdef" << std::endl;
+                    continue;
+                }
+
+                const bool parentEmitting = active.size() < 2 || active[active.size() - 2];
+                active.back() = parentEmitting && !active.back();
+            }
+            else if (directive == "endif")
+            {
+                if (active.empty())
+                    std::cout << "Shader preprocessor: #endif without #ifdef" << std::endl;
+                else
+                    active.pop_back();
+            }
+            else if (!emitting())
+            {
+                continue;
+            }
+            else if (directive == "define")
+            {
+                std::string value{};
+                std::getline(directiveLine, value);
+                const size_t valueStart = value.find_first_not_of(" \t");
+                state.defines[name] = valueStart == std::string::npos ? "" : value.substr(valueStart);
+            }
+            else if (directive == "include")
+            {
+                // The name keeps its quotes after extraction.
+                const std::string file = name.size() > 2 ? name.substr(1, name.size() - 2) : name;
+                const bool generated = _generatedFiles.count(file) > 0;
+                const std::string path = generated ? file : directory + file;
+
+                bool alreadyIncluded = false;
+                for (const std::string& included : state.included)
+                {
+                    alreadyIncluded |= included == path;
+                }
+                if (alreadyIncluded)
+                    continue;
+
+                state.included.push_back(path);
+
+                const size_t separator = path.find_last_of('/');
+                const std::string includeDirectory = generated || separator == std::string::npos ? directory : path.substr(0, separator + 1);
+                PreprocessFile(generated ? _generatedFiles.at(file) : LoadFile(path), includeDirectory, state, output);
+            }
+            else
+            {
+                std::cout << "Shader preprocessor: unknown directive #" << directive << std::endl;
+            }
+
+            continue;
+        }
+
+        if (!emitting())
+            continue;
+
+        if (state.defines.empty())
+        {
+            output += line + "\n";
+            continue;
+        }
+
+        // Replaces whole identifiers only, so defines can't match parts of longer names.
+        size_t i{ 0 };
+        while (i < line.size())
+        {
+            if (std::isalpha(static_cast<unsigned char>(line[i])) || line[i] == '_')
+            {
+                size_t end = i;
+                while (end < line.size() && (std::isalnum(static_cast<unsigned char>(line[end])) || line[end] == '_'))
+                    ++end;
+
+                const std::string identifier = line.substr(i, end - i);
+                auto define = state.defines.find(identifier);
+                output += define != state.defines.end() ? define->second : identifier;
+                i = end;
+            }
+            else
+            {
+                output += line[i++];
+            }
+        }
+        output += "\n";
+    }
+
+    if (!active.empty())
+        std::cout << "Shader preprocessor: missing #endif" << std::endl;
+}
+
+std::string ShaderLibrary::LoadFile(const std::string& path) const
+{
+    auto it = _files.find(path);
+    if (it != _files.end())
+        return it->second;
+
+    if (!std::ifstream{ path })
+    {
+        std::cout << "Failed reading shader: " << path << std::endl;
+        return "";
+    }
+
+    return _files.emplace(path, readTextFile(path)).first->second;
+}
@@ -1,154 +1,781 @@
 #include "texture_loader.hpp"
 #include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
 #include "renderer.hpp"
+#include "gpu_object_cache.hpp"
+#include "pipeline_cache.hpp"
+#include "residency_manager.hpp"
+#include "upload_manager.hpp"
+#include "utils.hpp"
+
+#if __has_include(<basisu_transcoder.h>)
+#include <basisu_transcoder.h>
+#define BASISU_TRANSCODER_AVAILABLE
+#endif
+
+constexpr uint8_t KTX2_IDENTIFIER[12]{ 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// Source texels reduced per workgroup, and the most mips a single dispatch can write.
+constexpr uint32_t SPD_BLOCK_SIZE{ 64 };
+constexpr uint32_t MAX_MIPS_PER_DISPATCH{ 6 };
+constexpr uint32_t MIP_DESTINATION_BINDING{ 1 };
+
+constexpr uint32_t KTX2_SUPERCOMPRESSION_NONE{ 0 };
+constexpr uint32_t KTX2_SUPERCOMPRESSION_BASISLZ{ 1 };
+constexpr uint32_t KTX2_DF_MODEL_UASTC{ 166 };
+
+// Identifier, header and index up to (but excluding) the supercompression global data offsets.
+struct KTX2Header
+{
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+};
+
+constexpr size_t KTX2_LEVEL_INDEX_OFFSET{ 80 };
+
+struct KTX2LevelIndex
+{
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
 
-TextureLoader::TextureLoader(const Renderer& renderer) : _renderer(renderer)
+// Maps the VkFormat values we ship in KTX2 containers to their WebGPU equivalent.
+wgpu::TextureFormat VkFormatToTextureFormat(uint32_t vkFormat)
 {
-    std::array<wgpu::BindGroupLayoutEntry, 2> bgLayoutEntries{};
-    bgLayoutEntries[0].binding = 0;
-    bgLayoutEntries[0].visibility = wgpu::ShaderStage::Compute;
-    bgLayoutEntries[0].texture.sampleType = wgpu::TextureSampleType::Float;
-    bgLayoutEntries[0].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+    switch (vkFormat)
+    {
+    case 9:   return wgpu::TextureFormat::R8Unorm;
+    case 16:  return wgpu::TextureFormat::RG8Unorm;
+    case 37:  return wgpu::TextureFormat::RGBA8Unorm;
+    case 43:  return wgpu::TextureFormat::RGBA8UnormSrgb;
+    case 44:  return wgpu::TextureFormat::BGRA8Unorm;
+    case 50:  return wgpu::TextureFormat::BGRA8UnormSrgb;
+    case 97:  return wgpu::TextureFormat::RGBA16Float;
+    case 109: return wgpu::TextureFormat::RGBA32Float;
+    case 133: return wgpu::TextureFormat::BC1RGBAUnorm;
+    case 134: return wgpu::TextureFormat::BC1RGBAUnormSrgb;
+    case 137: return wgpu::TextureFormat::BC3RGBAUnorm;
+    case 138: return wgpu::TextureFormat::BC3RGBAUnormSrgb;
+    case 139: return wgpu::TextureFormat::BC4RUnorm;
+    case 141: return wgpu::TextureFormat::BC5RGUnorm;
+    case 145: return wgpu::TextureFormat::BC7RGBAUnorm;
+    case 146: return wgpu::TextureFormat::BC7RGBAUnormSrgb;
+    case 151: return wgpu::TextureFormat::ETC2RGBA8Unorm;
+    case 152: return wgpu::TextureFormat::ETC2RGBA8UnormSrgb;
+    case 155: return wgpu::TextureFormat::EACRG11Unorm;
+    case 157: return wgpu::TextureFormat::ASTC4x4Unorm;
+    case 158: return wgpu::TextureFormat::ASTC4x4UnormSrgb;
+    default:  return wgpu::TextureFormat::Undefined;
+    }
+}
 
-    bgLayoutEntries[1].binding = 1;
-    bgLayoutEntries[1].visibility = wgpu::ShaderStage::Compute;
-    bgLayoutEntries[1].storageTexture.access = wgpu::StorageTextureAccess::WriteOnly;
-    bgLayoutEntries[1].storageTexture.format = wgpu::TextureFormat::RGBA8Unorm; // TODO: Check if using a different format will work. Original uses srgb.
-    bgLayoutEntries[1].storageTexture.viewDimension = wgpu::TextureViewDimension::e2D;
+BlockInfo GetBlockInfo(wgpu::TextureFormat format)
+{
+    switch (format)
+    {
+    case wgpu::TextureFormat::R8Unorm:          return { 1, 1, 1 };
+    case wgpu::TextureFormat::RG8Unorm:         return { 1, 1, 2 };
+    case wgpu::TextureFormat::RGBA8Unorm:
+    case wgpu::TextureFormat::RGBA8UnormSrgb:
+    case wgpu::TextureFormat::BGRA8Unorm:
+    case wgpu::TextureFormat::BGRA8UnormSrgb:   return { 1, 1, 4 };
+    case wgpu::TextureFormat::RGBA16Float:      return { 1, 1, 8 };
+    case wgpu::TextureFormat::RGBA32Float:      return { 1, 1, 16 };
+    case wgpu::TextureFormat::BC1RGBAUnorm:
+    case wgpu::TextureFormat::BC1RGBAUnormSrgb:
+    case wgpu::TextureFormat::BC4RUnorm:        return { 4, 4, 8 };
+    default:                                    return { 4, 4, 16 };
+    }
+}
 
-    wgpu::BindGroupLayoutDescriptor bgLayoutDesc{};
-    bgLayoutDesc.label = "Texture binding group layout";
-    bgLayoutDesc.entryCount = bgLayoutEntries.size();
-    bgLayoutDesc.entries = bgLayoutEntries.data();
+wgpu::FeatureName RequiredFeature(wgpu::TextureFormat format)
+{
+    switch (format)
+    {
+    case wgpu::TextureFormat::BC1RGBAUnorm:
+    case wgpu::TextureFormat::BC1RGBAUnormSrgb:
+    case wgpu::TextureFormat::BC3RGBAUnorm:
+    case wgpu::TextureFormat::BC3RGBAUnormSrgb:
+    case wgpu::TextureFormat::BC4RUnorm:
+    case wgpu::TextureFormat::BC5RGUnorm:
+    case wgpu::TextureFormat::BC7RGBAUnorm:
+    case wgpu::TextureFormat::BC7RGBAUnormSrgb:
+        return wgpu::FeatureName::TextureCompressionBC;
+    case wgpu::TextureFormat::ETC2RGBA8Unorm:
+    case wgpu::TextureFormat::ETC2RGBA8UnormSrgb:
+    case wgpu::TextureFormat::EACRG11Unorm:
+        return wgpu::FeatureName::TextureCompressionETC2;
+    case wgpu::TextureFormat::ASTC4x4Unorm:
+    case wgpu::TextureFormat::ASTC4x4UnormSrgb:
+        return wgpu::FeatureName::TextureCompressionASTC;
+    default:
+        return wgpu::FeatureName::Undefined;
+    }
+}
 
-    _bgLayout = _renderer.Device().CreateBindGroupLayout(&bgLayoutDesc);
+bool IsSrgb(wgpu::TextureFormat format)
+{
+    return format == wgpu::TextureFormat::RGBA8UnormSrgb || format == wgpu::TextureFormat::BGRA8UnormSrgb;
+}
 
-    wgpu::PipelineLayoutDescriptor bgPipelineLayoutDesc{};
-    bgPipelineLayoutDesc.bindGroupLayoutCount = 1;
-    bgPipelineLayoutDesc.bindGroupLayouts = &_bgLayout;
+// Storage textures can't be sRGB, so sRGB RGBA8 data lives in an RGBA8Unorm texture with an sRGB view format.
+wgpu::TextureFormat StorageCompatibleFormat(wgpu::TextureFormat format)
+{
+    return format == wgpu::TextureFormat::RGBA8UnormSrgb ? wgpu::TextureFormat::RGBA8Unorm : format;
+}
 
-    wgpu::PipelineLayout bgPipelineLayout = _renderer.Device().CreatePipelineLayout(&bgPipelineLayoutDesc);
+// The WGSL storage format the compute downsampler writes, or nullptr for formats that take the render pass fallback.
+const char* MipStorageFormat(wgpu::TextureFormat format)
+{
+    switch (format)
+    {
+    case wgpu::TextureFormat::RGBA8Unorm:
+    case wgpu::TextureFormat::RGBA8UnormSrgb:   return "rgba8unorm";
+    case wgpu::TextureFormat::RGBA16Float:      return "rgba16float";
+    default:                                    return nullptr;
+    }
+}
 
+// Color renderable formats that aren't storage capable in core WebGPU.
+bool SupportsMipBlit(wgpu::TextureFormat format)
+{
+    switch (format)
+    {
+    case wgpu::TextureFormat::R8Unorm:
+    case wgpu::TextureFormat::RG8Unorm:
+    case wgpu::TextureFormat::BGRA8Unorm:
+    case wgpu::TextureFormat::BGRA8UnormSrgb:
+        return true;
+    default:
+        return false;
+    }
+}
 
+bool SupportsMipGeneration(wgpu::TextureFormat format)
+{
+    return MipStorageFormat(format) != nullptr || SupportsMipBlit(format);
+}
 
-    wgpu::ComputePipelineDescriptor computePipelineDesc{};
-    computePipelineDesc.label = "Mip map generation";
-    computePipelineDesc.compute.entryPoint = "main";
-    computePipelineDesc.compute.module = _renderer.CreateShader("assets/shaders/mip-comp.wgsl", "Mip map generation");
-    computePipelineDesc.layout = bgPipelineLayout;
-    _computePipeline = _renderer.Device().CreateComputePipeline(&computePipelineDesc);
+// Builds the part of the downsampler that depends on the format and on how many mips one dispatch writes.
+std::string BuildMipShaderPrelude(wgpu::TextureFormat format, uint32_t mipCount)
+{
+    std::string prelude{ "const MIP_COUNT: u32 = " + std::to_string(mipCount) + "u;\n" };
+    prelude += "const SRGB: bool = " + std::string(IsSrgb(format) ? "true" : "false") + ";\n\n";
+
+    for (uint32_t mip = 1; mip <= mipCount; ++mip)
+    {
+        prelude += "@group(0) @binding(" + std::to_string(MIP_DESTINATION_BINDING + mip - 1) + ") var destinationMip" + std::to_string(mip) + ": texture_storage_2d_array<" + MipStorageFormat(format) + ", write>;\n";
+    }
+
+    prelude += "\nfn storeMip(mip: u32, coord: vec2<u32>, slice: u32, value: vec4<f32>)\n{\n    switch mip\n    {\n";
+    for (uint32_t mip = 1; mip <= mipCount; ++mip)
+    {
+        const std::string name{ "destinationMip" + std::to_string(mip) };
+        prelude += "        case " + std::to_string(mip) + "u: { if (all(coord < textureDimensions(" + name + "))) { textureStore(" + name + ", coord, slice, encodeOutput(value)); } }\n";
+    }
+    prelude += "        default: {}\n    }\n}\n\n";
+
+    return prelude;
+}
+
+TextureLoader::TextureLoader(const Renderer& renderer) : _renderer(renderer)
+{
+    wgpu::SupportedLimits limits{};
+    _renderer.Device().GetLimits(&limits);
+    _maxMipsPerDispatch = std::min(limits.limits.maxStorageTexturesPerShaderStage, MAX_MIPS_PER_DISPATCH);
+
+    _mipShaderSource = readTextFile("assets/shaders/mip-comp.wgsl");
+    _blitShader = _renderer.CreateShader("assets/shaders/mip-blit.wgsl", "Mip map blit shader");
+
+    // Variants are named by the numeric format, followed by the mip count for the compute path.
+    // The manifest comes from storage and may be malformed or from another build, so anything that doesn't parse or apply is skipped.
+    _renderer.GetPipelineCache().RegisterWarmUp("mip", [this](const std::string& variant)
+                                                {
+                                                    const size_t separator = variant.find('x');
+                                                    uint32_t format{};
+                                                    uint32_t mipCount{};
+                                                    if (separator == std::string::npos ||
+                                                        !parseUint32(std::string_view{ variant }.substr(0, separator), format) ||
+                                                        !parseUint32(std::string_view{ variant }.substr(separator + 1), mipCount))
+                                                        return;
+
+                                                    if (MipStorageFormat(static_cast<wgpu::TextureFormat>(format)) && mipCount > 0 && mipCount <= _maxMipsPerDispatch)
+                                                        GetMipPipeline(static_cast<wgpu::TextureFormat>(format), mipCount, true);
+                                                });
+    _renderer.GetPipelineCache().RegisterWarmUp("blit", [this](const std::string& variant)
+                                                {
+                                                    uint32_t format{};
+                                                    if (parseUint32(variant, format) && SupportsMipBlit(static_cast<wgpu::TextureFormat>(format)))
+                                                        GetBlitPipeline(static_cast<wgpu::TextureFormat>(format), true);
+                                                });
 }
 
 wgpu::Texture TextureLoader::LoadTexture(const std::string & path, const char* label) const
 {
-    assert(false && "Not implemented");
-    return wgpu::Texture();
+    std::ifstream file{ path, std::ios::binary };
+    if (!file)
+    {
+        std::cout << "Failed opening texture: " << path << std::endl;
+        return wgpu::Texture();
+    }
+
+    std::vector<uint8_t> fileData{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+
+    if (fileData.size() < sizeof(KTX2_IDENTIFIER) || memcmp(fileData.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0)
+    {
+        std::cout << "Unsupported texture container, only KTX2 is supported: " << path << std::endl;
+        return wgpu::Texture();
+    }
+
+    return LoadKTX2(fileData, label ? label : path.c_str());
 }
 
 wgpu::Texture TextureLoader::LoadTexture(const std::vector<uint8_t>& data, uint32_t width, uint32_t height, wgpu::TextureFormat format, uint32_t mipLevels, const char* label) const
 {
+    if (mipLevels > 1 && !SupportsMipGeneration(format))
+    {
+        std::cout << "Mip map generation is not supported for the format of: " << (label ? label : "texture") << std::endl;
+        return wgpu::Texture();
+    }
+
+    wgpu::TextureFormat viewFormat = format;
+
     wgpu::TextureDescriptor textureDesc{};
     textureDesc.label = label;
     textureDesc.dimension = wgpu::TextureDimension::e2D;
     textureDesc.size = { static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1 };
-    textureDesc.format = wgpu::TextureFormat::RGBA8Unorm;
+    textureDesc.format = StorageCompatibleFormat(format);
     textureDesc.mipLevelCount = mipLevels;
     textureDesc.sampleCount = 1;
-    textureDesc.usage = wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::CopySrc | wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::StorageBinding;
-    textureDesc.viewFormatCount = 0;
-    textureDesc.viewFormats = nullptr;
-
-    auto texture = _renderer.Device().CreateTexture(&textureDesc);
+    textureDesc.usage = wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::CopySrc | wgpu::TextureUsage::TextureBinding;
+    textureDesc.viewFormatCount = textureDesc.format != format ? 1 : 0;
+    textureDesc.viewFormats = textureDesc.format != format ? &viewFormat : nullptr;
 
-    wgpu::ImageCopyTexture destination{};
-    destination.texture = texture;
-    destination.origin = { 0, 0, 0 };
-    destination.aspect = wgpu::TextureAspect::All;
-    destination.mipLevel = 0;
+    if (mipLevels > 1)
+        textureDesc.usage |= MipStorageFormat(format) ? wgpu::TextureUsage::StorageBinding : wgpu::TextureUsage::RenderAttachment;
 
-    wgpu::TextureDataLayout source{};
-    source.offset = 0;
-    source.bytesPerRow = 4 * width;
-    source.rowsPerImage = height;
+    auto texture = _renderer.Device().CreateTexture(&textureDesc);
+    _renderer.GetResidencyManager().Track(texture, ResidencyCategory::Textures);
 
-    _renderer.Queue().WriteTexture(&destination, data.data(), data.size(), &source, &textureDesc.size);
+    WriteLevel(texture, format, 0, 0, 1, data.data(), data.size());
     if (mipLevels == 1)
         return texture;
 
-    std::vector<wgpu::TextureView> mipViews;
-    std::vector<wgpu::Extent3D> mipSizes;
+    // Recorded behind the upload of the first level, and submitted with the rest of the batch.
+    GenerateMips(_renderer.GetUploadManager().Encoder(), texture, format);
+
+    return texture;
+}
+
+void TextureLoader::GenerateMips(const wgpu::CommandEncoder& encoder, const wgpu::Texture& texture, wgpu::TextureFormat format) const
+{
+    if (format == wgpu::TextureFormat::Undefined)
+        format = texture.GetFormat();
+
+    if (!MipStorageFormat(format))
+    {
+        GenerateMipsBlit(encoder, texture, format);
+        return;
+    }
+
+    const uint32_t mipLevels = texture.GetMipLevelCount();
+    const uint32_t layerCount = texture.GetDepthOrArrayLayers();
 
-    mipSizes.resize(mipLevels);
-    mipSizes[0] = textureDesc.size;
+    wgpu::ComputePassDescriptor computePassDesc{};
+    computePassDesc.label = "Mip map generation compute pass";
+    computePassDesc.timestampWrites = 0;
+    wgpu::ComputePassEncoder computePass = encoder.BeginComputePass(&computePassDesc);
 
-    mipViews.reserve(mipSizes.size());
-    for (uint32_t i = 0; i < mipLevels; ++i)
+    uint32_t baseMip = 0;
+    while (baseMip + 1 < mipLevels)
+    {
+        const uint32_t width = std::max(texture.GetWidth() >> baseMip, 1u);
+        const uint32_t height = std::max(texture.GetHeight() >> baseMip, 1u);
+
+        // Only the first mip of a dispatch can filter an odd sized level, later ones are plain 2x2 averages.
+        // A dispatch ends before the mip whose source would be odd, the next one starts from there.
+        const uint32_t maxMipCount = std::min(mipLevels - 1 - baseMip, _maxMipsPerDispatch);
+        uint32_t mipCount{ 1 };
+        while (mipCount < maxMipCount)
+        {
+            const uint32_t sourceWidth = std::max(width >> mipCount, 1u);
+            const uint32_t sourceHeight = std::max(height >> mipCount, 1u);
+            if ((sourceWidth > 1 && sourceWidth % 2 != 0) || (sourceHeight > 1 && sourceHeight % 2 != 0))
+                break;
+
+            ++mipCount;
+        }
+
+        const MipPipeline& mipPipeline = GetMipPipeline(format, mipCount);
+
+        std::vector<wgpu::BindGroupEntry> bgEntries(MIP_DESTINATION_BINDING + mipCount);
+        for (uint32_t i = 0; i <= mipCount; ++i)
+        {
+            wgpu::TextureViewDescriptor viewDesc{};
+            viewDesc.label = "MIP level";
+            viewDesc.baseMipLevel = baseMip + i;
+            viewDesc.aspect = wgpu::TextureAspect::All;
+            viewDesc.dimension = wgpu::TextureViewDimension::e2DArray;
+            viewDesc.format = StorageCompatibleFormat(format);
+            viewDesc.baseArrayLayer = 0;
+            viewDesc.arrayLayerCount = layerCount;
+            viewDesc.mipLevelCount = 1;
+
+            const uint32_t binding = i == 0 ? 0 : MIP_DESTINATION_BINDING + i - 1;
+            bgEntries[binding].binding = binding;
+            bgEntries[binding].textureView = texture.CreateView(&viewDesc);
+        }
+
+        wgpu::BindGroupDescriptor bgDesc{};
+        bgDesc.entryCount = bgEntries.size();
+        bgDesc.entries = bgEntries.data();
+        bgDesc.layout = mipPipeline.bindGroupLayout;
+
+        // The views are new for every texture, so there's nothing to gain from caching the bind group.
+        wgpu::BindGroup bg = _renderer.Device().CreateBindGroup(&bgDesc);
+
+        computePass.SetPipeline(mipPipeline.pipeline);
+        computePass.SetBindGroup(0, bg, 0, nullptr);
+
+        const uint32_t workgroupCountX = (width + SPD_BLOCK_SIZE - 1) / SPD_BLOCK_SIZE;
+        const uint32_t workgroupCountY = (height + SPD_BLOCK_SIZE - 1) / SPD_BLOCK_SIZE;
+        computePass.DispatchWorkgroups(workgroupCountX, workgroupCountY, layerCount);
+
+        baseMip += mipCount;
+    }
+
+    computePass.End();
+}
+
+void TextureLoader::GenerateMipsBlit(const wgpu::CommandEncoder& encoder, const wgpu::Texture& texture, wgpu::TextureFormat format) const
+{
+    const BlitPipeline& blitPipeline = GetBlitPipeline(format);
+
+    for (uint32_t layer = 0; layer < texture.GetDepthOrArrayLayers(); ++layer)
     {
         wgpu::TextureViewDescriptor viewDesc{};
-        std::string labelStr{ "MIP level #" + std::to_string(i) };
-        viewDesc.label = labelStr.c_str();
-        viewDesc.baseMipLevel = i;
+        viewDesc.label = "MIP level";
         viewDesc.aspect = wgpu::TextureAspect::All;
         viewDesc.dimension = wgpu::TextureViewDimension::e2D;
-        viewDesc.format = textureDesc.format;
-        viewDesc.baseArrayLayer = 0;
+        viewDesc.format = format;
+        viewDesc.baseArrayLayer = layer;
         viewDesc.arrayLayerCount = 1;
+        viewDesc.baseMipLevel = 0;
         viewDesc.mipLevelCount = 1;
 
-        mipViews.emplace_back(texture.CreateView(&viewDesc));
+        // Each mip is rendered into and then read from by the next one, so it only needs one view.
+        wgpu::TextureView sourceView = texture.CreateView(&viewDesc);
 
-        if (i > 0)
+        for (uint32_t mip = 1; mip < texture.GetMipLevelCount(); ++mip)
         {
-            wgpu::Extent3D previousSize = mipSizes[i - 1];
-            mipSizes[i] = { previousSize.width / 2, previousSize.height / 2, previousSize.depthOrArrayLayers / 2 };
+            viewDesc.baseMipLevel = mip;
+            wgpu::TextureView destinationView = texture.CreateView(&viewDesc);
+
+            wgpu::BindGroupEntry bgEntry{};
+            bgEntry.binding = 0;
+            bgEntry.textureView = sourceView;
+
+            wgpu::BindGroupDescriptor bgDesc{};
+            bgDesc.entryCount = 1;
+            bgDesc.entries = &bgEntry;
+            bgDesc.layout = blitPipeline.bindGroupLayout;
+
+            wgpu::BindGroup bg = _renderer.Device().CreateBindGroup(&bgDesc);
+
+            wgpu::RenderPassColorAttachment colorAttachment{};
+            colorAttachment.view = destinationView;
+            colorAttachment.loadOp = wgpu::LoadOp::Clear;
+            colorAttachment.storeOp = wgpu::StoreOp::Store;
+            colorAttachment.resolveTarget = nullptr;
+
+            wgpu::RenderPassDescriptor renderPassDesc{};
+            renderPassDesc.label = "Mip map blit render pass";
+            renderPassDesc.colorAttachmentCount = 1;
+            renderPassDesc.colorAttachments = &colorAttachment;
+            renderPassDesc.depthStencilAttachment = nullptr;
+
+            wgpu::RenderPassEncoder renderPass = encoder.BeginRenderPass(&renderPassDesc);
+            renderPass.SetPipeline(blitPipeline.pipeline);
+            renderPass.SetBindGroup(0, bg, 0, nullptr);
+            renderPass.Draw(3, 1, 0, 0);
+            renderPass.End();
+
+            sourceView = destinationView;
         }
     }
+}
 
+const TextureLoader::MipPipeline& TextureLoader::GetMipPipeline(wgpu::TextureFormat format, uint32_t mipCount, bool warmUp) const
+{
+    const uint64_t key = (static_cast<uint64_t>(format) << 32) | mipCount;
+    auto it = _mipPipelines.find(key);
+    if (it == _mipPipelines.end())
+    {
+        std::vector<wgpu::BindGroupLayoutEntry> bgLayoutEntries(MIP_DESTINATION_BINDING + mipCount);
+        bgLayoutEntries[0].binding = 0;
+        bgLayoutEntries[0].visibility = wgpu::ShaderStage::Compute;
+        bgLayoutEntries[0].texture.sampleType = wgpu::TextureSampleType::Float;
+        bgLayoutEntries[0].texture.viewDimension = wgpu::TextureViewDimension::e2DArray;
 
-    
+        for (uint32_t mip = 1; mip <= mipCount; ++mip)
+        {
+            wgpu::BindGroupLayoutEntry& entry = bgLayoutEntries[MIP_DESTINATION_BINDING + mip - 1];
+            entry.binding = MIP_DESTINATION_BINDING + mip - 1;
+            entry.visibility = wgpu::ShaderStage::Compute;
+            entry.storageTexture.access = wgpu::StorageTextureAccess::WriteOnly;
+            entry.storageTexture.format = StorageCompatibleFormat(format);
+            entry.storageTexture.viewDimension = wgpu::TextureViewDimension::e2DArray;
+        }
 
-    wgpu::CommandEncoderDescriptor ceDesc;
-    ceDesc.label = "Command encoder";
+        MipPipeline mipPipeline{};
 
-    wgpu::CommandEncoder encoder = _renderer.Device().CreateCommandEncoder(&ceDesc);
+        wgpu::BindGroupLayoutDescriptor bgLayoutDesc{};
+        bgLayoutDesc.label = "Mip map generation binding group layout";
+        bgLayoutDesc.entryCount = bgLayoutEntries.size();
+        bgLayoutDesc.entries = bgLayoutEntries.data();
 
-    wgpu::ComputePassDescriptor computePassDesc{};
-    computePassDesc.label = "Mip map generation compute pass";
-    computePassDesc.timestampWrites = 0;
-    wgpu::ComputePassEncoder computePass = encoder.BeginComputePass(&computePassDesc);
+        mipPipeline.bindGroupLayout = _renderer.GetObjectCache().GetBindGroupLayout(bgLayoutDesc);
+
+        wgpu::PipelineLayoutDescriptor pipelineLayoutDesc{};
+        pipelineLayoutDesc.bindGroupLayoutCount = 1;
+        pipelineLayoutDesc.bindGroupLayouts = &mipPipeline.bindGroupLayout;
+
+        std::string source{ BuildMipShaderPrelude(format, mipCount) + _mipShaderSource };
+
+        mipPipeline.descriptor.label = "Mip map generation";
+        mipPipeline.descriptor.compute.entryPoint = "main";
+        mipPipeline.descriptor.compute.module = _renderer.CreateShaderFromSource(source, "Mip map generation");
+        mipPipeline.descriptor.layout = _renderer.GetObjectCache().GetPipelineLayout(pipelineLayoutDesc);
 
-    computePass.SetPipeline(_computePipeline);
+        it = _mipPipelines.emplace(key, mipPipeline).first;
+    }
 
-    for (size_t level = 1; level < mipLevels; ++level)
+    MipPipeline& mipPipeline = it->second;
+    if (warmUp)
+    {
+        _renderer.GetPipelineCache().RequestComputePipeline(mipPipeline.descriptor);
+    }
+    else if (!mipPipeline.pipeline)
     {
-        std::array<wgpu::BindGroupEntry, 2> bgEntries{};
-        bgEntries[0].binding = 0;
-        bgEntries[0].textureView = mipViews[level - 1];
+        mipPipeline.pipeline = _renderer.GetPipelineCache().CreateComputePipelineBlocking(mipPipeline.descriptor);
+        _renderer.GetPipelineCache().RecordVariant("mip", std::to_string(static_cast<uint32_t>(format)) + "x" + std::to_string(mipCount));
+    }
 
-        bgEntries[1].binding = 1;
-        bgEntries[1].textureView = mipViews[level];
+    return mipPipeline;
+}
 
-        wgpu::BindGroupDescriptor bgDesc{};
-        bgDesc.entryCount = bgEntries.size();
-        bgDesc.entries = bgEntries.data();
-        bgDesc.layout = _bgLayout;
+const TextureLoader::BlitPipeline& TextureLoader::GetBlitPipeline(wgpu::TextureFormat format, bool warmUp) const
+{
+    auto it = _blitPipelines.find(format);
+    if (it == _blitPipelines.end())
+    {
+        // The descriptor points into the entry, which doesn't move once it's in the map.
+        BlitPipeline& blitPipeline = _blitPipelines[format];
+
+        wgpu::BindGroupLayoutEntry bgLayoutEntry{};
+        bgLayoutEntry.binding = 0;
+        bgLayoutEntry.visibility = wgpu::ShaderStage::Fragment;
+        bgLayoutEntry.texture.sampleType = wgpu::TextureSampleType::Float;
+        bgLayoutEntry.texture.viewDimension = wgpu::TextureViewDimension::e2D;
+
+        wgpu::BindGroupLayoutDescriptor bgLayoutDesc{};
+        bgLayoutDesc.label = "Mip map blit binding group layout";
+        bgLayoutDesc.entryCount = 1;
+        bgLayoutDesc.entries = &bgLayoutEntry;
+
+        blitPipeline.bindGroupLayout = _renderer.GetObjectCache().GetBindGroupLayout(bgLayoutDesc);
+
+        wgpu::PipelineLayoutDescriptor pipelineLayoutDesc{};
+        pipelineLayoutDesc.bindGroupLayoutCount = 1;
+        pipelineLayoutDesc.bindGroupLayouts = &blitPipeline.bindGroupLayout;
+
+        blitPipeline.colorTarget.format = format;
+        blitPipeline.colorTarget.blend = nullptr;
+
+        wgpu::FragmentState& fragment = blitPipeline.fragment;
+        fragment.module = _blitShader;
+        fragment.entryPoint = "fs_main";
+        fragment.targetCount = 1;
+        fragment.targets = &blitPipeline.colorTarget;
+        fragment.constantCount = 0;
+        fragment.constants = nullptr;
+
+        wgpu::RenderPipelineDescriptor& renderPipelineDesc = blitPipeline.descriptor;
+        renderPipelineDesc.label = "Mip map blit";
+        renderPipelineDesc.layout = _renderer.GetObjectCache().GetPipelineLayout(pipelineLayoutDesc);
+        renderPipelineDesc.fragment = &fragment;
+        renderPipelineDesc.vertex.bufferCount = 0;
+        renderPipelineDesc.vertex.buffers = nullptr;
+        renderPipelineDesc.vertex.entryPoint = "vs_main";
+        renderPipelineDesc.vertex.module = _blitShader;
+
+        renderPipelineDesc.multisample.count = 1;
+        renderPipelineDesc.multisample.mask = 0xFF'FF'FF'FF;
+
+        renderPipelineDesc.primitive.frontFace = wgpu::FrontFace::CCW;
+        renderPipelineDesc.primitive.cullMode = wgpu::CullMode::None;
+        renderPipelineDesc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
+        renderPipelineDesc.primitive.stripIndexFormat = wgpu::IndexFormat::Undefined;
+
+        renderPipelineDesc.depthStencil = nullptr;
+
+        it = _blitPipelines.find(format);
+    }
 
-        wgpu::BindGroup bg = _renderer.Device().CreateBindGroup(&bgDesc);
+    BlitPipeline& blitPipeline = it->second;
+    if (warmUp)
+    {
+        _renderer.GetPipelineCache().RequestRenderPipeline(blitPipeline.descriptor);
+    }
+    else if (!blitPipeline.pipeline)
+    {
+        blitPipeline.pipeline = _renderer.GetPipelineCache().CreateRenderPipelineBlocking(blitPipeline.descriptor);
+        _renderer.GetPipelineCache().RecordVariant("blit", std::to_string(static_cast<uint32_t>(format)));
+    }
 
-        computePass.SetBindGroup(0, bg, 0, nullptr);
+    return blitPipeline;
+}
+
+wgpu::Texture TextureLoader::LoadKTX2(const std::vector<uint8_t>& fileData, const char* label) const
+{
+    if (fileData.size() < KTX2_LEVEL_INDEX_OFFSET)
+    {
+        std::cout << "Truncated KTX2 header: " << label << std::endl;
+        return wgpu::Texture();
+    }
 
-        uint32_t invocationCountX = mipSizes[level].width;
-        uint32_t invocationCountY = mipSizes[level].height;
-        const uint32_t workgroupSizePerDim = 8;
-        uint32_t workgroupCountX = (invocationCountX + workgroupSizePerDim - 1) / workgroupSizePerDim;
-        uint32_t workgroupCountY = (invocationCountY + workgroupSizePerDim - 1) / workgroupSizePerDim;
+    KTX2Header header{};
+    memcpy(&header, fileData.data() + sizeof(KTX2_IDENTIFIER), sizeof(KTX2Header));
 
-        computePass.DispatchWorkgroups(workgroupCountX, workgroupCountY, 1);
+    if (header.pixelDepth > 1 || header.pixelWidth == 0 || header.pixelHeight == 0)
+    {
+        std::cout << "Only 2D, array and cube KTX2 textures are supported: " << label << std::endl;
+        return wgpu::Texture();
     }
-    computePass.End();
 
-    wgpu::CommandBuffer commands = encoder.Finish(nullptr);
-    _renderer.Queue().Submit(1, &commands);
+    if (header.faceCount != 1 && header.faceCount != 6)
+    {
+        std::cout << "Invalid KTX2 face count " << header.faceCount << ": " << label << std::endl;
+        return wgpu::Texture();
+    }
+
+    // A level count of 0 still stores the base level, which the loader generates the rest of the chain from.
+    const uint32_t maxLevelCount = bitWidth(std::max(header.pixelWidth, header.pixelHeight)) + 1;
+    if (header.levelCount > maxLevelCount)
+    {
+        std::cout << "Invalid KTX2 level count " << header.levelCount << ": " << label << std::endl;
+        return wgpu::Texture();
+    }
+
+    const uint32_t levelCount = std::max(header.levelCount, 1u);
+    const uint32_t layerCount = std::max(header.layerCount, 1u) * header.faceCount;
+
+    if (fileData.size() < KTX2_LEVEL_INDEX_OFFSET + levelCount * sizeof(KTX2LevelIndex))
+    {
+        std::cout << "Truncated KTX2 level index: " << label << std::endl;
+        return wgpu::Texture();
+    }
+
+    std::vector<KTX2LevelIndex> levels(levelCount);
+    memcpy(levels.data(), fileData.data() + KTX2_LEVEL_INDEX_OFFSET, levelCount * sizeof(KTX2LevelIndex));
+
+    // Written so corrupt offsets can't wrap around.
+    for (const auto& level : levels)
+    {
+        if (level.byteOffset > fileData.size() || level.byteLength > fileData.size() - level.byteOffset)
+        {
+            std::cout << "KTX2 level data out of bounds: " << label << std::endl;
+            return wgpu::Texture();
+        }
+    }
+
+    // The color model lives in the first basic descriptor block, after the total size and the block header.
+    const size_t dfdColorModelOffset = size_t{ header.dfdByteOffset } + 12;
+    const bool isUASTC = header.vkFormat == 0 && dfdColorModelOffset < fileData.size() && fileData[dfdColorModelOffset] == KTX2_DF_MODEL_UASTC;
+
+    if (header.supercompressionScheme == KTX2_SUPERCOMPRESSION_BASISLZ || isUASTC)
+        return TranscodeBasis(fileData, label);
+
+    if (header.supercompressionScheme != KTX2_SUPERCOMPRESSION_NONE)
+    {
+        std::cout << "Unsupported KTX2 supercompression scheme " << header.supercompressionScheme << ": " << label << std::endl;
+        return wgpu::Texture();
+    }
+
+    wgpu::TextureFormat format = VkFormatToTextureFormat(header.vkFormat);
+    if (format == wgpu::TextureFormat::Undefined)
+    {
+        std::cout << "Unsupported KTX2 vkFormat " << header.vkFormat << ": " << label << std::endl;
+        return wgpu::Texture();
+    }
+
+    wgpu::FeatureName requiredFeature = RequiredFeature(format);
+    if (requiredFeature != wgpu::FeatureName::Undefined && !_renderer.Device().HasFeature(requiredFeature))
+    {
+        std::cout << "Device does not support the block format of: " << label << std::endl;
+        return wgpu::Texture();
+    }
+
+    // A level count of 0 asks the loader to generate the chain itself.
+    if (header.levelCount == 0 && SupportsMipGeneration(format) && layerCount == 1)
+    {
+        const uint8_t* levelData = fileData.data() + levels[0].byteOffset;
+        std::vector<uint8_t> data{ levelData, levelData + levels[0].byteLength };
+        const uint32_t mipLevelCount = bitWidth(std::max(header.pixelWidth, header.pixelHeight));
+        return LoadTexture(data, header.pixelWidth, header.pixelHeight, format, mipLevelCount, label);
+    }
+
+    wgpu::TextureDescriptor textureDesc{};
+    textureDesc.label = label;
+    textureDesc.dimension = wgpu::TextureDimension::e2D;
+    textureDesc.size = { header.pixelWidth, header.pixelHeight, layerCount };
+    textureDesc.format = format;
+    textureDesc.mipLevelCount = levelCount;
+    textureDesc.sampleCount = 1;
+    textureDesc.usage = wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::CopySrc | wgpu::TextureUsage::TextureBinding;
+    textureDesc.viewFormatCount = 0;
+    textureDesc.viewFormats = nullptr;
+
+    wgpu::Texture texture = _renderer.Device().CreateTexture(&textureDesc);
+    _renderer.GetResidencyManager().Track(texture, ResidencyCategory::Textures);
+
+    // Levels hold every layer and face back to back, so each one is a single write.
+    for (uint32_t level = 0; level < levelCount; ++level)
+    {
+        WriteLevel(texture, format, level, 0, layerCount, fileData.data() + levels[level].byteOffset, levels[level].byteLength);
+    }
 
     return texture;
 }
+
+wgpu::Texture TextureLoader::TranscodeBasis(const std::vector<uint8_t>& fileData, const char* label) const
+{
+#ifdef BASISU_TRANSCODER_AVAILABLE
+    static bool transcoderInitialized = false;
+    if (!transcoderInitialized)
+    {
+        basist::basisu_transcoder_init();
+        transcoderInitialized = true;
+    }
+
+    basist::ktx2_transcoder transcoder{};
+    if (!transcoder.init(fileData.data(), static_cast<uint32_t>(fileData.size())) || !transcoder.start_transcoding())
+    {
+        std::cout << "Failed starting Basis transcoding: " << label << std::endl;
+        return wgpu::Texture();
+    }
+
+    const bool srgb = transcoder.get_dfd_transfer_func() == basist::KTX2_KHR_DF_TRANSFER_SRGB;
+
+    // Pick the best block format the device can sample, falling back to plain RGBA8.
+    basist::transcoder_texture_format transcodeFormat = basist::transcoder_texture_format::cTFRGBA32;
+    wgpu::TextureFormat format = srgb ? wgpu::TextureFormat::RGBA8UnormSrgb : wgpu::TextureFormat::RGBA8Unorm;
+    if (_renderer.Device().HasFeature(wgpu::FeatureName::TextureCompressionBC))
+    {
+        transcodeFormat = basist::transcoder_texture_format::cTFBC7_RGBA;
+        format = srgb ? wgpu::TextureFormat::BC7RGBAUnormSrgb : wgpu::TextureFormat::BC7RGBAUnorm;
+    }
+    else if (_renderer.Device().HasFeature(wgpu::FeatureName::TextureCompressionASTC))
+    {
+        transcodeFormat = basist::transcoder_texture_format::cTFASTC_4x4_RGBA;
+        format = srgb ? wgpu::TextureFormat::ASTC4x4UnormSrgb : wgpu::TextureFormat::ASTC4x4Unorm;
+    }
+    else if (_renderer.Device().HasFeature(wgpu::FeatureName::TextureCompressionETC2))
+    {
+        transcodeFormat = basist::transcoder_texture_format::cTFETC2_RGBA;
+        format = srgb ? wgpu::TextureFormat::ETC2RGBA8UnormSrgb : wgpu::TextureFormat::ETC2RGBA8Unorm;
+    }
+
+    const uint32_t levelCount = transcoder.get_levels();
+    const uint32_t faceCount = transcoder.get_faces();
+    const uint32_t layerCount = std::max(transcoder.get_layers(), 1u);
+
+    wgpu::TextureDescriptor textureDesc{};
+    textureDesc.label = label;
+    textureDesc.dimension = wgpu::TextureDimension::e2D;
+    textureDesc.size = { transcoder.get_width(), transcoder.get_height(), layerCount * faceCount };
+    textureDesc.format = format;
+    textureDesc.mipLevelCount = levelCount;
+    textureDesc.sampleCount = 1;
+    textureDesc.usage = wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::CopySrc | wgpu::TextureUsage::TextureBinding;
+    textureDesc.viewFormatCount = 0;
+    textureDesc.viewFormats = nullptr;
+
+    wgpu::Texture texture = _renderer.Device().CreateTexture(&textureDesc);
+    _renderer.GetResidencyManager().Track(texture, ResidencyCategory::Textures);
+
+    const uint32_t bytesPerBlock = basist::basis_get_bytes_per_block_or_pixel(transcodeFormat);
+    const bool uncompressed = basist::basis_transcoder_format_is_uncompressed(transcodeFormat);
+
+    std::vector<uint8_t> transcoded{};
+    for (uint32_t level = 0; level < levelCount; ++level)
+    {
+        for (uint32_t layer = 0; layer < layerCount; ++layer)
+        {
+            for (uint32_t face = 0; face < faceCount; ++face)
+            {
+                basist::ktx2_image_level_info levelInfo{};
+                transcoder.get_image_level_info(levelInfo, level, layer, face);
+
+                const uint32_t outputSize = uncompressed ? levelInfo.m_orig_width * levelInfo.m_orig_height : levelInfo.m_total_blocks;
+                transcoded.resize(outputSize * bytesPerBlock);
+
+                if (!transcoder.transcode_image_level(level, layer, face, transcoded.data(), outputSize, transcodeFormat))
+                {
+                    std::cout << "Failed transcoding level " << level << ": " << label << std::endl;
+                    return wgpu::Texture();
+                }
+
+                WriteLevel(texture, format, level, layer * faceCount + face, 1, transcoded.data(), transcoded.size());
+            }
+        }
+    }
+
+    return texture;
+#else
+    std::cout << "Basis Universal transcoder is not available, cannot load: " << label << std::endl;
+    return wgpu::Texture();
+#endif
+}
+
+void TextureLoader::WriteLevel(const wgpu::Texture& texture, wgpu::TextureFormat format, uint32_t level, uint32_t baseLayer, uint32_t layerCount, const uint8_t* data, size_t size) const
+{
+    const BlockInfo block = GetBlockInfo(format);
+    const uint32_t width = std::max(texture.GetWidth() >> level, 1u);
+    const uint32_t height = std::max(texture.GetHeight() >> level, 1u);
+    const uint32_t blocksX = (width + block.width - 1) / block.width;
+    const uint32_t blocksY = (height + block.height - 1) / block.height;
+
+    wgpu::ImageCopyTexture destination{};
+    destination.texture = texture;
+    destination.origin = { 0, 0, baseLayer };
+    destination.aspect = wgpu::TextureAspect::All;
+    destination.mipLevel = level;
+
+    const uint32_t bytesPerRow = blocksX * block.bytes;
+    if (size < static_cast<size_t>(bytesPerRow) * blocksY * layerCount)
+    {
+        std::cout << "Not enough data for texture level " << level << std::endl;
+        return;
+    }
+
+    // Block compressed levels are copied with their physical size, rounded up to whole blocks.
+    wgpu::Extent3D levelSize{ blocksX * block.width, blocksY * block.height, layerCount };
+
+    _renderer.GetUploadManager().UploadTexture(destination, data, bytesPerRow, blocksY, levelSize);
+}
@@ -0,0 +1,250 @@
+#include "texture_streamer.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include "renderer.hpp"
+#include "frame_scheduler.hpp"
+#include "texture_loader.hpp"
+#include "utils.hpp"
+
+// Largest resolution a texture starts out with, and how many textures are streamed in per frame.
+constexpr uint32_t INITIAL_RESOLUTION_LOG2{ 7 };
+constexpr uint32_t MAX_STREAM_INS_PER_FRAME{ 2 };
+
+// A chain of bitWidth(size) levels starts at 2^mipLevelCount texels on its longer side, so a resolution of 2^r is mip mipLevelCount - r.
+// Resolutions above the streamed range aren't worth a pool, and the largest mip is as far as it goes.
+constexpr uint32_t BaseMipForResolution(uint32_t mipLevelCount, uint32_t resolutionLog2)
+{
+    resolutionLog2 = std::min(resolutionLog2, MAX_STREAMED_RESOLUTION_LOG2);
+    return mipLevelCount > resolutionLog2 ? mipLevelCount - resolutionLog2 : 0;
+}
+
+constexpr uint32_t ResidentResolution(uint32_t size, uint32_t baseMip)
+{
+    return std::max(size >> baseMip, 1u);
+}
+
+static_assert(bitWidth(2048) == 11);
+static_assert(ResidentResolution(2048, BaseMipForResolution(bitWidth(2048), INITIAL_RESOLUTION_LOG2)) == 128);
+static_assert(ResidentResolution(2048, BaseMipForResolution(bitWidth(2048), 11)) == 2048);
+static_assert(ResidentResolution(2048, BaseMipForResolution(bitWidth(2048), MIN_STREAMED_RESOLUTION_LOG2)) == 16);
+static_assert(ResidentResolution(8192, BaseMipForResolution(bitWidth(8192), 13)) == 4096);
+static_assert(ResidentResolution(64, BaseMipForResolution(bitWidth(64), INITIAL_RESOLUTION_LOG2)) == 64);
+
+// Halves the image with a box filter, sRGB color is averaged in linear space. Odd sizes repeat their last row or column.
+std::vector<uint8_t> Downsample(const std::vector<uint8_t>& data, uint32_t& width, uint32_t& height, wgpu::TextureFormat format)
+{
+    static const std::array<float, 256> srgbToLinear = []()
+    {
+        std::array<float, 256> table{};
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            const float value = i / 255.0f;
+            table[i] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+        }
+        return table;
+    }();
+
+    const bool srgb = format == wgpu::TextureFormat::RGBA8UnormSrgb;
+    const uint32_t channels = static_cast<uint32_t>(data.size() / (static_cast<size_t>(width) * height));
+    const uint32_t halfWidth = std::max(width >> 1, 1u);
+    const uint32_t halfHeight = std::max(height >> 1, 1u);
+
+    std::vector<uint8_t> half(static_cast<size_t>(halfWidth) * halfHeight * channels);
+    for (uint32_t y = 0; y < halfHeight; ++y)
+    {
+        const uint32_t rows[2]{ std::min(y * 2, height - 1), std::min(y * 2 + 1, height - 1) };
+        for (uint32_t x = 0; x < halfWidth; ++x)
+        {
+            const uint32_t columns[2]{ std::min(x * 2, width - 1), std::min(x * 2 + 1, width - 1) };
+            for (uint32_t c = 0; c < channels; ++c)
+            {
+                const bool decode = srgb && c < 3;
+                float sum{ 0.0f };
+                for (uint32_t row : rows)
+                {
+                    for (uint32_t column : columns)
+                    {
+                        const uint8_t value = data[(static_cast<size_t>(row) * width + column) * channels + c];
+                        sum += decode ? srgbToLinear[value] : value / 255.0f;
+                    }
+                }
+
+                float value = sum * 0.25f;
+                if (decode)
+                    value = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+                half[(static_cast<size_t>(y) * halfWidth + x) * channels + c] = static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+            }
+        }
+    }
+
+    width = halfWidth;
+    height = halfHeight;
+    return half;
+}
+
+TextureStreamer::TextureStreamer(const Renderer& renderer) : _renderer(renderer)
+{
+    wgpu::BufferDescriptor readbackBufferDesc{};
+    readbackBufferDesc.label = "Material feedback readback buffer";
+    readbackBufferDesc.usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst;
+    readbackBufferDesc.size = sizeof(uint32_t) * MAX_MATERIALS;
+    _readbackBuffer = _renderer.Device().CreateBuffer(&readbackBufferDesc);
+    _renderer.GetResidencyManager().Track(_readbackBuffer, ResidencyCategory::Buffers);
+
+    _feedback.resize(MAX_MATERIALS);
+}
+
+void TextureStreamer::AddTexture(uint32_t materialIndex, MaterialTexture slot, const std::vector<uint8_t>& data, uint32_t width, uint32_t height, wgpu::TextureFormat format,
+                                 const std::string& label, SourceLoader loadSource)
+{
+    StreamedTexture texture{};
+    texture.materialIndex = materialIndex;
+    texture.slot = slot;
+    texture.loadSource = std::move(loadSource);
+    texture.width = width;
+    texture.height = height;
+    texture.format = format;
+    texture.label = label;
+    texture.mipLevelCount = std::max(bitWidth(std::max(width, height)), 1u);
+    texture.residentBaseMip = texture.mipLevelCount;
+
+    StreamIn(texture, data, BaseMipForResolution(texture.mipLevelCount, INITIAL_RESOLUTION_LOG2));
+
+    // Looked up by index, the vector moves its textures around as it grows.
+    const size_t index = _textures.size();
+    texture.evictionId = _renderer.GetResidencyManager().AddEvictable(EvictionPriority::StreamedMips, [this, index]()
+                                                                      {
+                                                                          return StreamOut(_textures[index]);
+                                                                      });
+
+    _textures.push_back(std::move(texture));
+}
+
+void TextureStreamer::Update()
+{
+    if (_readbackState != ReadbackState::Ready)
+        return;
+
+    ResidencyManager& residencyManager = _renderer.GetResidencyManager();
+
+    uint32_t streamIns{ 0 };
+    for (auto& texture : _textures)
+    {
+        // Feedback holds the log2 of the resolution the material wants, which maps to a base mip of the full chain.
+        const uint32_t wantedBaseMip = BaseMipForResolution(texture.mipLevelCount, _feedback[texture.materialIndex]);
+
+        // Textures that are sampled at their resident resolution are the last ones to be evicted.
+        if (wantedBaseMip <= texture.residentBaseMip)
+            residencyManager.Touch(texture.evictionId);
+
+        if (wantedBaseMip < texture.residentBaseMip && streamIns < MAX_STREAM_INS_PER_FRAME && !residencyManager.OverBudget())
+        {
+            const std::vector<uint8_t> data = texture.loadSource();
+            if (!data.empty())
+                StreamIn(texture, data, wantedBaseMip);
+            ++streamIns;
+        }
+    }
+
+    // Textures that didn't make it this frame are picked up again by the next readback.
+    _readbackState = ReadbackState::Idle;
+}
+
+void TextureStreamer::RecordFeedbackReadback(const wgpu::CommandEncoder& encoder)
+{
+    if (_readbackState != ReadbackState::Idle)
+        return;
+
+    const wgpu::Buffer& feedbackBuffer = _renderer.GetMaterialSystem().FeedbackBuffer();
+    encoder.CopyBufferToBuffer(feedbackBuffer, 0, _readbackBuffer, 0, _readbackBuffer.GetSize());
+    encoder.ClearBuffer(feedbackBuffer, 0, feedbackBuffer.GetSize());
+
+    _readbackState = ReadbackState::Recorded;
+}
+
+void TextureStreamer::RequestFeedback()
+{
+    if (_readbackState != ReadbackState::Recorded)
+        return;
+
+    _readbackState = ReadbackState::Mapping;
+    _readbackBuffer.MapAsync(wgpu::MapMode::Read, 0, _readbackBuffer.GetSize(), [](WGPUBufferMapAsyncStatus status, void* userdata)
+                             {
+                                 TextureStreamer* streamer = reinterpret_cast<TextureStreamer*>(userdata);
+                                 if (status != WGPUBufferMapAsyncStatus_Success)
+                                 {
+                                     streamer->_readbackState = ReadbackState::Idle;
+                                     return;
+                                 }
+
+                                 memcpy(streamer->_feedback.data(), streamer->_readbackBuffer.GetConstMappedRange(0, streamer->_readbackBuffer.GetSize()), streamer->_readbackBuffer.GetSize());
+                                 streamer->_readbackBuffer.Unmap();
+                                 streamer->_readbackState = ReadbackState::Ready;
+                             }, this);
+}
+
+void TextureStreamer::StreamIn(StreamedTexture& texture, const std::vector<uint8_t>& data, uint32_t baseMip)
+{
+    if (data.size() % (static_cast<size_t>(texture.width) * texture.height) != 0)
+    {
+        std::cout << "Source data doesn't match the size of texture: " << texture.label << std::endl;
+        return;
+    }
+
+    // Only the wanted mips are uploaded and generated, the finer ones are reduced away on the CPU first.
+    uint32_t width = texture.width;
+    uint32_t height = texture.height;
+    std::vector<uint8_t> reduced;
+    for (uint32_t mip = 0; mip < baseMip; ++mip)
+    {
+        reduced = Downsample(mip == 0 ? data : reduced, width, height, texture.format);
+    }
+
+    wgpu::Texture source = _renderer.GetTextureLoader().LoadTexture(baseMip == 0 ? data : reduced, width, height, texture.format, texture.mipLevelCount - baseMip, texture.label.c_str());
+    if (!source)
+        return;
+
+    const uint32_t handle = _renderer.GetMaterialSystem().AddTexture(source, texture.format);
+    // The copy into the pool still reads the source, so it counts until the frame is done with it.
+    _renderer.GetFrameScheduler().Defer([&residencyManager = _renderer.GetResidencyManager(), source]()
+                                        {
+                                            residencyManager.Untrack(source);
+                                            source.Destroy();
+                                        });
+    if (handle == INVALID_TEXTURE)
+        return;
+
+    ReplaceHandle(texture, handle);
+    texture.residentBaseMip = baseMip;
+}
+
+EvictionResult TextureStreamer::StreamOut(StreamedTexture& texture)
+{
+    if (texture.mipLevelCount - texture.residentBaseMip <= MIN_STREAMED_RESOLUTION_LOG2)
+        return EvictionResult::Pinned;
+
+    // The smaller mips are already resident, so they're copied over instead of being loaded again.
+    Material material = _renderer.GetMaterialSystem().GetMaterial(texture.materialIndex);
+    const uint32_t handle = _renderer.GetMaterialSystem().ShrinkTexture(material.TextureHandle(texture.slot));
+    if (handle == INVALID_TEXTURE)
+        return EvictionResult::Pinned;
+
+    ReplaceHandle(texture, handle);
+    ++texture.residentBaseMip;
+
+    return EvictionResult::Shrunk;
+}
+
+void TextureStreamer::ReplaceHandle(const StreamedTexture& texture, uint32_t handle)
+{
+    // The material lets go of the old layer before it's removed, removing it may compact its pool.
+    MaterialSystem& materialSystem = _renderer.GetMaterialSystem();
+    Material material = materialSystem.GetMaterial(texture.materialIndex);
+    const uint32_t previous = material.TextureHandle(texture.slot);
+    material.TextureHandle(texture.slot) = handle;
+    materialSystem.UpdateMaterial(texture.materialIndex, material);
+    materialSystem.RemoveTexture(previous);
+}
@@ -0,0 +1,77 @@
+#include "uniform_ring.hpp"
+#include <cstring>
+#include <iostream>
+#include "renderer.hpp"
+#include "frame_scheduler.hpp"
+#include "utils.hpp"
+
+UniformRing::UniformRing(const Renderer& renderer, uint64_t size) :
+    _renderer(renderer),
+    _size(size),
+    _data(size)
+{
+    wgpu::SupportedLimits limits{};
+    _renderer.Device().GetLimits(&limits);
+    _alignment = limits.limits.minUniformBufferOffsetAlignment;
+
+    _buffer = _renderer.CreateBuffer(nullptr, _size, wgpu::BufferUsage::Uniform | wgpu::BufferUsage::Storage, "Transient uniform ring");
+}
+
+bool UniformRing::Allocate(const void* data, uint64_t size, uint32_t& offset)
+{
+    const uint64_t alignedSize = ceilToNextMultiple(static_cast<uint32_t>(size), _alignment);
+
+    // Allocations don't wrap around, the end of the ring is skipped instead.
+    uint64_t skipped{ 0 };
+    if (_head + alignedSize > _size)
+        skipped = _size - _head;
+
+    if (_usedBytes + skipped + alignedSize > _size)
+    {
+        if (!_reportedFull)
+            std::cout << "Transient uniform ring is full, skipping work until frames in flight finish" << std::endl;
+
+        _reportedFull = true;
+        return false;
+    }
+
+    if (skipped > 0)
+    {
+        // The upload range has to be contiguous.
+        Flush();
+        _head = 0;
+        _flushedHead = 0;
+    }
+
+    memcpy(_data.data() + _head, data, size);
+    offset = static_cast<uint32_t>(_head);
+
+    _head += alignedSize;
+    _usedBytes += skipped + alignedSize;
+    _frameBytes += skipped + alignedSize;
+
+    return true;
+}
+
+void UniformRing::Flush()
+{
+    if (_head == _flushedHead)
+        return;
+
+    _renderer.Queue().WriteBuffer(_buffer, _flushedHead, _data.data() + _flushedHead, _head - _flushedHead);
+    _flushedHead = _head;
+}
+
+void UniformRing::EndFrame()
+{
+    if (_frameBytes == 0)
+        return;
+
+    _renderer.GetFrameScheduler().Defer([this, bytes = _frameBytes]()
+                                        {
+                                            _usedBytes -= bytes;
+                                            _reportedFull = false;
+                                        });
+
+    _frameBytes = 0;
+}
@@ -0,0 +1,186 @@
+#include "upload_manager.hpp"
+#include <cstring>
+#include <iostream>
+#include "renderer.hpp"
+#include "residency_manager.hpp"
+#include "enum_util.hpp"
+
+constexpr uint64_t BUFFER_COPY_ALIGNMENT{ 4 };
+constexpr uint64_t TEXTURE_COPY_ALIGNMENT{ 256 };
+
+uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+UploadManager::UploadManager(const Renderer& renderer, uint64_t stagingBufferSize) :
+    _renderer(renderer),
+    _stagingBufferSize(stagingBufferSize)
+{
+}
+
+void UploadManager::UploadBuffer(const wgpu::Buffer& destination, uint64_t offset, const void* data, uint64_t size)
+{
+    const uint64_t alignedSize = alignUp(size, BUFFER_COPY_ALIGNMENT);
+    Allocation allocation = Allocate(alignedSize, BUFFER_COPY_ALIGNMENT);
+
+    memcpy(allocation.mapping, data, size);
+    memset(allocation.mapping + size, 0, alignedSize - size);
+
+    Encoder().CopyBufferToBuffer(allocation.buffer, allocation.offset, destination, offset, alignedSize);
+}
+
+void UploadManager::UploadTexture(const wgpu::ImageCopyTexture& destination, const void* data, uint32_t bytesPerRow, uint32_t rowsPerImage, const wgpu::Extent3D& size)
+{
+    const uint32_t alignedBytesPerRow = static_cast<uint32_t>(alignUp(bytesPerRow, TEXTURE_COPY_ALIGNMENT));
+    const uint64_t rowCount = static_cast<uint64_t>(rowsPerImage) * size.depthOrArrayLayers;
+    Allocation allocation = Allocate(alignedBytesPerRow * rowCount, TEXTURE_COPY_ALIGNMENT);
+
+    const uint8_t* source = static_cast<const uint8_t*>(data);
+    if (alignedBytesPerRow == bytesPerRow)
+    {
+        memcpy(allocation.mapping, source, bytesPerRow * rowCount);
+    }
+    else
+    {
+        for (uint64_t row = 0; row < rowCount; ++row)
+        {
+            memcpy(allocation.mapping + row * alignedBytesPerRow, source + row * bytesPerRow, bytesPerRow);
+        }
+    }
+
+    wgpu::ImageCopyBuffer stagingCopy{};
+    stagingCopy.buffer = allocation.buffer;
+    stagingCopy.layout.offset = allocation.offset;
+    stagingCopy.layout.bytesPerRow = alignedBytesPerRow;
+    stagingCopy.layout.rowsPerImage = rowsPerImage;
+
+    Encoder().CopyBufferToTexture(&stagingCopy, &destination, &size);
+}
+
+const wgpu::CommandEncoder& UploadManager::Encoder()
+{
+    if (!_encoder)
+    {
+        wgpu::CommandEncoderDescriptor ceDesc{};
+        ceDesc.label = "Upload command encoder";
+        _encoder = _renderer.Device().CreateCommandEncoder(&ceDesc);
+    }
+
+    return _encoder;
+}
+
+void UploadManager::Flush()
+{
+    if (!_encoder)
+        return;
+
+    Batch* batch = new Batch{ this, std::move(_recording) };
+    _recording.clear();
+
+    for (auto& stagingBuffer : batch->stagingBuffers)
+    {
+        stagingBuffer.buffer.Unmap();
+        stagingBuffer.mapping = nullptr;
+    }
+
+    wgpu::CommandBuffer commands = _encoder.Finish(nullptr);
+    _renderer.Queue().Submit(1, &commands);
+    _encoder = nullptr;
+    ++_submittedBatches;
+
+    _renderer.Queue().OnSubmittedWorkDone([](WGPUQueueWorkDoneStatus status, void* userdata)
+                                          {
+                                              Batch* batch = reinterpret_cast<Batch*>(userdata);
+                                              if (status != WGPUQueueWorkDoneStatus_Success)
+                                                  std::cout << "Upload batch finished with status: " << conv_enum_str<wgpu::QueueWorkDoneStatus>(status) << std::endl;
+
+                                              batch->manager->OnBatchCompleted(batch);
+                                          }, batch);
+}
+
+UploadManager::Allocation UploadManager::Allocate(uint64_t size, uint64_t alignment)
+{
+    if (!_recording.empty())
+    {
+        StagingBuffer& current = _recording.back();
+        const uint64_t offset = alignUp(current.offset, alignment);
+        if (offset + size <= current.size)
+        {
+            current.offset = offset + size;
+            return { current.buffer, current.mapping + offset, offset };
+        }
+    }
+
+    StagingBuffer stagingBuffer = AcquireStagingBuffer(size);
+    stagingBuffer.offset = size;
+    _recording.push_back(stagingBuffer);
+
+    return { stagingBuffer.buffer, stagingBuffer.mapping, 0 };
+}
+
+UploadManager::StagingBuffer UploadManager::AcquireStagingBuffer(uint64_t size)
+{
+    if (size <= _stagingBufferSize && !_available.empty())
+    {
+        StagingBuffer stagingBuffer = _available.back();
+        _available.pop_back();
+        return stagingBuffer;
+    }
+
+    // Uploads larger than the ring size get a dedicated buffer, which is dropped again once the copy is done.
+    wgpu::BufferDescriptor stagingDesc{};
+    stagingDesc.label = "Upload staging buffer";
+    stagingDesc.usage = wgpu::BufferUsage::MapWrite | wgpu::BufferUsage::CopySrc;
+    stagingDesc.size = std::max(alignUp(size, BUFFER_COPY_ALIGNMENT), _stagingBufferSize);
+    stagingDesc.mappedAtCreation = true;
+
+    StagingBuffer stagingBuffer{};
+    stagingBuffer.buffer = _renderer.Device().CreateBuffer(&stagingDesc);
+    _renderer.GetResidencyManager().Track(stagingBuffer.buffer, ResidencyCategory::Staging);
+    stagingBuffer.mapping = static_cast<uint8_t*>(stagingBuffer.buffer.GetMappedRange(0, stagingDesc.size));
+    stagingBuffer.size = stagingDesc.size;
+    stagingBuffer.offset = 0;
+
+    return stagingBuffer;
+}
+
+void UploadManager::OnBatchCompleted(Batch* batch)
+{
+    ++_completedBatches;
+
+    for (auto& stagingBuffer : batch->stagingBuffers)
+    {
+        if (stagingBuffer.size > _stagingBufferSize)
+        {
+            _renderer.GetResidencyManager().Untrack(stagingBuffer.buffer);
+            continue;
+        }
+
+        PendingMap* pendingMap = new PendingMap{ this, stagingBuffer };
+        stagingBuffer.buffer.MapAsync(wgpu::MapMode::Write, 0, stagingBuffer.size, [](WGPUBufferMapAsyncStatus status, void* userdata)
+                                      {
+                                          PendingMap* pendingMap = reinterpret_cast<PendingMap*>(userdata);
+                                          pendingMap->manager->OnStagingBufferMapped(pendingMap, status == WGPUBufferMapAsyncStatus_Success);
+                                      }, pendingMap);
+    }
+
+    delete batch;
+}
+
+void UploadManager::OnStagingBufferMapped(PendingMap* pendingMap, bool success)
+{
+    if (success)
+    {
+        StagingBuffer stagingBuffer = pendingMap->stagingBuffer;
+        stagingBuffer.mapping = static_cast<uint8_t*>(stagingBuffer.buffer.GetMappedRange(0, stagingBuffer.size));
+        stagingBuffer.offset = 0;
+        _available.push_back(stagingBuffer);
+    }
+    else
+    {
+        _renderer.GetResidencyManager().Untrack(pendingMap->stagingBuffer.buffer);
+    }
+
+    delete pendingMap;
+}